@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Keeps the compiler from optimizing away a result that is never used
+template <class T>
+inline void doNotOptimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T *sink;
+    sink = &value;
+#endif
+}
+
+// Minimal microbenchmark harness. Every benchmark is a function that runs one operation, called in a loop.
+// The harness picks the number of iterations so a sample takes at least the minimum time, takes several
+// samples and reports the median time per operation. Results can be written as JSON and compared between builds.
+//
+// Options: [--filter substring] [--json file] [--min-time seconds] [--samples n] [--baseline file] [--tolerance fraction]
+class BenchmarkHarness
+{
+private:
+    typedef struct Benchmark
+    {
+        std::string name;
+        std::function<void()> setup;     // Runs before each sample, outside the timing
+        std::function<void()> operation;
+        double itemsPerOperation;
+    } Benchmark;
+
+    typedef struct Result
+    {
+        std::string name;
+        unsigned long iterations;
+        double medianNs;
+        double minNs;
+        double stddevNs;
+        double itemsPerSecond;
+    } Result;
+
+    std::vector<Benchmark> mBenchmarks;
+    std::vector<Result> mResults;
+    std::string mFilter;
+    std::string mJsonPath;
+    std::string mBaselinePath;
+    double mMinTime = 0.1;
+    double mTolerance = 0.1;
+    int mSamples = 5;
+
+    static double timeLoop(const Benchmark &benchmark, unsigned long iterations)
+    {
+        if (benchmark.setup)
+            benchmark.setup();
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < iterations; i++)
+            benchmark.operation();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    Result run(const Benchmark &benchmark)
+    {
+        // Grow the iteration count until one sample takes long enough to time reliably
+        unsigned long iterations = 1;
+        while (true)
+        {
+            double time = timeLoop(benchmark, iterations);
+            if (time >= mMinTime || iterations >= (1ul << 30))
+                break;
+            double scale = time > 0 ? mMinTime / time * 1.2 : 10;
+            iterations = (unsigned long) (iterations * std::min(10.0, std::max(1.5, scale))) + 1;
+        }
+
+        std::vector<double> samples;
+        for (int s = 0; s < mSamples; s++)
+            samples.push_back(timeLoop(benchmark, iterations) / iterations * 1e9);
+        std::sort(samples.begin(), samples.end());
+
+        double mean = 0, variance = 0;
+        for (double sample : samples)
+            mean += sample / samples.size();
+        for (double sample : samples)
+            variance += (sample - mean) * (sample - mean) / samples.size();
+
+        Result result;
+        result.name = benchmark.name;
+        result.iterations = iterations;
+        result.medianNs = samples[samples.size() / 2];
+        result.minNs = samples.front();
+        result.stddevNs = sqrt(variance);
+        result.itemsPerSecond = benchmark.itemsPerOperation / (result.medianNs * 1e-9);
+        return result;
+    }
+
+    bool writeJson(std::string path)
+    {
+        std::ofstream fileStream(path.c_str());
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not write " << path << std::endl;
+            return false;
+        }
+
+        char date[32];
+        time_t now = time(nullptr);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+#ifdef NDEBUG
+        const char *buildType = "release";
+#else
+        const char *buildType = "debug";
+#endif
+
+        // One benchmark per line, so the file diffs well and is easy to read back
+        fileStream << "{\n\"context\": {\"date\": \"" << date << "\", \"threads\": " << std::thread::hardware_concurrency()
+                   << ", \"build\": \"" << buildType << "\"},\n\"benchmarks\": [\n";
+        for (size_t i = 0; i < mResults.size(); i++)
+        {
+            const Result &result = mResults[i];
+            fileStream << "{\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations
+                       << ", \"median_ns\": " << result.medianNs << ", \"min_ns\": " << result.minNs
+                       << ", \"stddev_ns\": " << result.stddevNs << ", \"items_per_second\": " << result.itemsPerSecond << "}"
+                       << (i + 1 < mResults.size() ? ",\n" : "\n");
+        }
+        fileStream << "]\n}\n";
+        return true;
+    }
+
+    // Reads name -> median_ns from a file written by writeJson()
+    static bool readJson(std::string path, std::map<std::string, double> &outMedians)
+    {
+        std::ifstream fileStream(path.c_str());
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not load baseline " << path << std::endl;
+            return false;
+        }
+
+        std::string line;
+        while (getline(fileStream, line))
+        {
+            size_t name = line.find("\"name\": \"");
+            size_t median = line.find("\"median_ns\": ");
+            if (name == std::string::npos || median == std::string::npos)
+                continue;
+
+            name += strlen("\"name\": \"");
+            outMedians[line.substr(name, line.find('"', name) - name)] = atof(line.c_str() + median + strlen("\"median_ns\": "));
+        }
+        return true;
+    }
+
+    // Returns false if any benchmark got slower than the baseline by more than the tolerance, or has no valid median in
+    // the baseline. Benchmarks added since the baseline was written need a new one.
+    bool compareBaseline()
+    {
+        std::map<std::string, double> baseline;
+        if (!readJson(mBaselinePath, baseline))
+            return false;
+        if (baseline.empty())
+        {
+            std::cerr << "Error: The baseline " << mBaselinePath << " has no benchmarks" << std::endl;
+            return false;
+        }
+
+        bool passed = true;
+        for (const Result &result : mResults)
+        {
+            if (baseline.find(result.name) == baseline.end() || baseline[result.name] <= 0)
+            {
+                printf("%-44s %12s -> %12.1f ns MISSING\n", result.name.c_str(), "", result.medianNs);
+                std::cerr << "Error: The baseline has no valid median of " << result.name << std::endl;
+                passed = false;
+                continue;
+            }
+
+            double change = result.medianNs / baseline[result.name] - 1.0;
+            bool regressed = change > mTolerance;
+            printf("%-44s %12.1f -> %12.1f ns (%+.1f%%)%s\n", result.name.c_str(), baseline[result.name], result.medianNs, change * 100, regressed ? " REGRESSED" : "");
+            passed = passed && !regressed;
+        }
+        return passed;
+    }
+
+public:
+    BenchmarkHarness(int argc, char **argv)
+    {
+        for (int i = 1; i < argc; i += 2)
+        {
+            std::string arg = argv[i];
+            if (i + 1 == argc)
+                std::cerr << "Missing value for " << arg << std::endl;
+            else if (arg == "--filter") mFilter = argv[i + 1];
+            else if (arg == "--json") mJsonPath = argv[i + 1];
+            else if (arg == "--min-time") mMinTime = atof(argv[i + 1]);
+            else if (arg == "--samples") mSamples = std::max(1, atoi(argv[i + 1]));
+            else if (arg == "--baseline") mBaselinePath = argv[i + 1];
+            else if (arg == "--tolerance") mTolerance = atof(argv[i + 1]);
+        }
+    }
+
+    // items is the number of elements one operation processes (e.g. nodes or rays), used for the throughput
+    void add(std::string name, std::function<void()> operation, double items = 1, std::function<void()> setup = nullptr)
+    {
+        mBenchmarks.push_back({name, setup, operation, items});
+    }
+
+    // Runs the benchmarks matching the filter. Returns the exit code of the program.
+    int run()
+    {
+        printf("%-44s %12s %12s %10s %14s\n", "Benchmark", "Median ns", "Min ns", "Stddev", "Items/s");
+        for (const Benchmark &benchmark : mBenchmarks)
+        {
+            if (benchmark.name.find(mFilter) == std::string::npos)
+                continue;
+
+            Result result = run(benchmark);
+            mResults.push_back(result);
+            printf("%-44s %12.1f %12.1f %9.1f%% %14.4g\n", result.name.c_str(), result.medianNs, result.minNs, result.stddevNs / result.medianNs * 100, result.itemsPerSecond);
+        }
+
+        if (!mJsonPath.empty() && !writeJson(mJsonPath))
+            return 1;
+
+        if (!mBaselinePath.empty() && !compareBaseline())
+            return 1;
+
+        return 0;
+    }
+};
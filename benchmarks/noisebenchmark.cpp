@@ -0,0 +1,75 @@
+// Compares the old single threaded siv::PerlinNoise loop with NoiseGenerator, in megapixels per second.
+//
+// Usage: NoiseBenchmark [size] [octaves]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <PerlinNoise.hpp>
+#include <noise.hpp>
+
+// Runs the function a few times and returns the best time in seconds
+template <class F>
+double bestOf(int runs, F function)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int size = argc > 1 ? atoi(argv[1]) : 2048;
+    unsigned int octaves = argc > 2 ? atoi(argv[2]) : 4;
+    const float frequency = 50;
+    const int runs = 5;
+    double megapixels = size * size / 1e6;
+
+    std::vector<unsigned char> imageData(size * size);
+
+    // The loop previously used by the Texture noise constructor
+    double scalar = bestOf(runs, [&]() {
+        const siv::PerlinNoise perlin{34877u};
+        const double invFreq = 1.0f / frequency;
+        for (unsigned int i = 0; i < size; i++)
+        {
+            for (unsigned int j = 0; j < size; j++)
+            {
+                imageData[i * size + j] = (unsigned char) (255 * perlin.octave2D_01(i * invFreq, j * invFreq, octaves));
+            }
+        }
+    });
+
+    NoiseSettings settings = {size, size, 1, octaves, frequency, 0.5f, 34877u, false};
+
+    NoiseGenerator single(1);
+    double lanes = bestOf(runs, [&]() { single.generate(settings, imageData.data()); });
+
+    NoiseGenerator threaded;
+    double parallel = bestOf(runs, [&]() { threaded.generate(settings, imageData.data()); });
+
+    settings.tileable = true;
+    double tileable = bestOf(runs, [&]() { threaded.generate(settings, imageData.data()); });
+
+    NoiseSettings volume = {size / 8, size / 8, 64, octaves, frequency / 8, 0.5f, 34877u, true};
+    double megavoxels = volume.width * volume.height * volume.depth / 1e6;
+    std::vector<unsigned char> volumeData(volume.width * volume.height * volume.depth);
+    double volume3D = bestOf(runs, [&]() { threaded.generate(volume, volumeData.data()); });
+
+    printf("Noise %ux%u, %u octaves, %u threads\n", size, size, octaves, std::thread::hardware_concurrency());
+    printf("%-28s %10.2f MP/s\n", "siv::PerlinNoise loop", megapixels / scalar);
+    printf("%-28s %10.2f MP/s (%.2fx)\n", "NoiseGenerator 1 thread", megapixels / lanes, scalar / lanes);
+    printf("%-28s %10.2f MP/s (%.2fx)\n", "NoiseGenerator all threads", megapixels / parallel, scalar / parallel);
+    printf("%-28s %10.2f MP/s (%.2fx)\n", "NoiseGenerator tileable", megapixels / tileable, scalar / tileable);
+    printf("%-28s %10.2f MV/s\n", "NoiseGenerator 3D", megavoxels / volume3D);
+
+    return 0;
+}
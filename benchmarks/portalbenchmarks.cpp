@@ -0,0 +1,229 @@
+// Microbenchmarks of the engine hot paths. Runs without a window or OpenGL context.
+//
+// Usage: PortalBenchmarks [--filter substring] [--json file] [--min-time seconds] [--samples n]
+//                         [--baseline file] [--tolerance fraction] [--model file.obj]
+//
+// Compare two builds with: PortalBenchmarks --json before.json, then PortalBenchmarks --baseline before.json
+
+#include <memory>
+#include <random>
+#include <harness.hpp>
+#include <node.hpp>
+#include <mesh.hpp>
+#include <camera.hpp>
+#include <portal.hpp>
+#include <jobs.hpp>
+#include <pool.hpp>
+
+// A tree of nodes with the given number of children per node and depth, owned by nodes
+Node *buildTree(std::vector<std::unique_ptr<Node>> &nodes, int branching, int depth)
+{
+    nodes.emplace_back(new Node());
+    Node *node = nodes.back().get();
+    node->setPosition(glm::vec3(1, 0.5f, 0.25f));
+    node->rotate(glm::vec3(0, 1, 0), 0.1f);
+
+    if (depth > 0)
+    {
+        for (int i = 0; i < branching; i++)
+            node->addChild(*buildTree(nodes, branching, depth - 1));
+    }
+    return node;
+}
+
+// Updates the render transforms to the simulated ones, as if the renderer interpolated with alpha = 1
+void syncRenderTransforms(std::vector<Node *> nodes)
+{
+    for (Node *node : nodes)
+        node->setRenderTransform(node->getTransformMatrix());
+}
+
+int main(int argc, char **argv)
+{
+    std::string modelPath = "../res/models/turret.obj";
+    // The other arguments, and a missing value, are handled by the harness
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (std::string(argv[i]) == "--model" && i + 1 < argc)
+            modelPath = argv[i + 1];
+    }
+
+    BenchmarkHarness harness(argc, argv);
+    JobSystem jobs;
+
+    // Node::updateTransforms over synthetic trees of different shapes
+    typedef struct TreeShape
+    {
+        const char *name;
+        int branching;
+        int depth;
+    } TreeShape;
+
+    std::vector<std::vector<std::unique_ptr<Node>>> trees;
+    Node *wideRoot = nullptr;
+    double wideCount = 0;
+    for (TreeShape shape : {TreeShape{"wide", 16384, 1}, TreeShape{"deep", 1, 4096}, TreeShape{"balanced", 4, 7}})
+    {
+        trees.emplace_back();
+        std::vector<std::unique_ptr<Node>> &nodes = trees.back();
+        Node *root = buildTree(nodes, shape.branching, shape.depth);
+        double count = nodes.size();
+        if (shape.branching > 1 && shape.depth == 1)
+        {
+            wideRoot = root;
+            wideCount = count;
+        }
+
+        harness.add(std::string("updateTransforms/") + shape.name, [root] { root->updateTransforms(); }, count);
+        // The deep chain has no wide nodes to split, and would only measure the recursion
+        if (shape.branching > 1)
+            harness.add(std::string("updateTransformsJobs/") + shape.name, [root, &jobs] { root->updateTransforms(jobs); }, count);
+    }
+
+    // Scaling of the job system over thread counts, from 1 up to every hardware thread. The items per second of a
+    // count divided by those of threads1 is its speedup. compute is bound by arithmetic and shows the overhead of the
+    // scheduler, updateTransforms/wide shows the scaling of the real transform update.
+    std::vector<unsigned int> threadCounts;
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(hardwareThreads);
+
+    const size_t computeCount = 1 << 18;
+    std::vector<float> computeValues(computeCount);
+    std::vector<std::unique_ptr<JobSystem>> scalingJobs;
+    for (unsigned int threads : threadCounts)
+    {
+        scalingJobs.emplace_back(new JobSystem(threads));
+        JobSystem *system = scalingJobs.back().get();
+        std::string suffix = "/threads" + std::to_string(threads);
+
+        harness.add("parallelFor/compute" + suffix, [&, system] {
+            system->parallelFor("compute", computeCount, 1024, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                {
+                    float x = i * 0.001f;
+                    for (int k = 0; k < 16; k++)
+                        x = std::sin(x) * 1.5f + 0.25f;
+                    computeValues[i] = x;
+                }
+            });
+            doNotOptimize(computeValues[0]);
+        }, computeCount);
+        harness.add("updateTransformsJobs/wide" + suffix, [wideRoot, system] { wideRoot->updateTransforms(*system); }, wideCount);
+    }
+
+    // Cube::isColliding with rays from random points around a rotated cube towards its center area
+    Cube cube(glm::vec3(20, 20, 60), false);
+    cube.setPosition(glm::vec3(50, -20, 0));
+    cube.rotate(glm::vec3(0, 1, 0), M_PI / 4);
+    cube.updateTransforms();
+
+    const int rays = 256;
+    std::vector<glm::vec3> origins, directions;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> uniform(-1, 1);
+    for (int i = 0; i < rays; i++)
+    {
+        glm::vec3 origin = glm::normalize(glm::vec3(uniform(random), uniform(random), uniform(random))) * 80.0f + cube.getPosition();
+        glm::vec3 target = cube.getPosition() + glm::vec3(uniform(random), uniform(random), uniform(random)) * 15.0f;
+        origins.push_back(origin);
+        directions.push_back((target - origin) * 2.0f);
+    }
+
+    harness.add("Cube::isColliding", [&] {
+        glm::vec3 normal, intersection;
+        int hits = 0;
+        for (int i = 0; i < rays; i++)
+            hits += cube.isColliding(origins[i], directions[i], normal, intersection);
+        doNotOptimize(hits);
+    }, rays);
+
+    // Portal::passthrough for a camera crossing the portal, and for one walking past it
+    Node root;
+    Camera camera(glm::vec3(0), M_PI / 2, 0.01f, 200.0f);
+    Portal portals[2] = {Portal(glm::vec2(5, 10), glm::vec3(1)), Portal(glm::vec2(5, 10), glm::vec3(1))};
+    root.addChild(camera);
+    root.addChild(portals[0]);
+    root.addChild(portals[1]);
+    portals[0].setPosition(glm::vec3(-8, -24, -9.8f));
+    portals[1].setPosition(glm::vec3(8, -24, -9.8f));
+    portals[1].rotate(glm::vec3(0, 1, 0), M_PI / 2);
+
+    harness.add("Portal::passthrough/hit", [&] {
+        camera.setPosition(glm::vec3(-8, -24, -9.3f));
+        camera.updateTransforms();
+        doNotOptimize(portals[0].passthrough(camera, glm::vec3(0, 0, -1), portals[1]));
+    }, 1, [&] { root.updateTransforms(); });
+
+    harness.add("Portal::passthrough/miss", [&] {
+        camera.setPosition(glm::vec3(0, -24, -9.3f));
+        camera.updateTransforms();
+        doNotOptimize(portals[0].passthrough(camera, glm::vec3(0, 0, -1), portals[1]));
+    }, 1, [&] { root.updateTransforms(); });
+
+    // The view and oblique projection chain of 10 recursion levels, as planned every frame
+    harness.add("Portal::viewChain/depth10", [&] {
+        glm::mat4 proj = camera.getPerspectiveMatrix();
+        glm::mat4 view[2] = {camera.getViewMatrix(), camera.getViewMatrix()};
+        glm::mat4 levelProj[2];
+        for (int depth = 1; depth <= 10; depth++)
+        {
+            view[0] = portals[0].getViewMatrix(view[0], &portals[1]);
+            view[1] = portals[1].getViewMatrix(view[1], &portals[0]);
+            levelProj[0] = portals[1].getObliqueProjection(proj, view[0]);
+            levelProj[1] = portals[0].getObliqueProjection(proj, view[1]);
+        }
+        doNotOptimize(levelProj[0]);
+        doNotOptimize(levelProj[1]);
+    }, 20, [&] {
+        camera.setPosition(glm::vec3(0, -24, 10));
+        root.updateTransforms();
+        syncRenderTransforms({&root, &camera, &portals[0], &portals[1]});
+    });
+
+    // Spawning and despawning a batch of nodes, through a pool and through the allocator
+    const int spawns = 1024;
+    Pool<Node> nodePool;
+    std::vector<Handle<Node>> handles(spawns);
+    std::vector<Node *> pointers(spawns);
+    harness.add("Pool::spawnDespawn", [&] {
+        for (int i = 0; i < spawns; i++)
+            handles[i] = nodePool.create();
+        for (int i = 0; i < spawns; i++)
+            nodePool.destroy(handles[i]);
+    }, spawns);
+    // The same from every job thread at once, as the level loaders do, which measures the contention on the pool lock
+    harness.add("Pool::spawnDespawnJobs", [&] {
+        jobs.parallelFor("spawnDespawn", spawns, 64, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                handles[i] = nodePool.create();
+            for (size_t i = begin; i < end; i++)
+                nodePool.destroy(handles[i]);
+        });
+    }, spawns);
+    harness.add("new::spawnDespawn", [&] {
+        for (int i = 0; i < spawns; i++)
+            pointers[i] = new Node();
+        for (int i = 0; i < spawns; i++)
+            delete pointers[i];
+        doNotOptimize(pointers[0]);
+    }, spawns);
+
+    // Parsing the turret model
+    std::ifstream model(modelPath.c_str());
+    if (model)
+    {
+        harness.add("ObjMesh::parse/turret", [&] {
+            ObjData data;
+            ObjMesh::parse(modelPath, 0.1f, data);
+            doNotOptimize(data.vertices.size());
+        });
+    }
+    else
+    {
+        std::cerr << "Error: Could not load " << modelPath << ", skipping the ObjMesh benchmark" << std::endl;
+    }
+
+    return harness.run();
+}
@@ -0,0 +1,13 @@
+#version 450 core
+
+// Upsamples a portal depth rendered at a lower resolution into the target of the depth before it.
+// The stencil test limits it to the pixels of the views at that depth.
+layout(binding = 6) uniform sampler2D u_source;
+uniform vec2 u_uv_scale;    // From pixels of the destination to texture coordinates of the source
+
+out vec4 color;
+
+void main()
+{
+    color = vec4(texture(u_source, gl_FragCoord.xy * u_uv_scale).rgb, 1.0);
+}
@@ -1,12 +1,17 @@
 #version 450 core
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
 
 in vec3 fragWorldPos;
 in vec3 fragNormal;
 in vec2 fragTextureCoordinate;
 
-#define N_LIGHTS 5
-uniform vec3 u_light_positions[N_LIGHTS];
-uniform vec3 u_light_colors[N_LIGHTS];
+#define MAX_LIGHTS 32
+uniform vec3 u_light_positions[MAX_LIGHTS];
+uniform vec3 u_light_colors[MAX_LIGHTS];
+uniform int u_light_count = 0;
+uniform int u_light_mask = -1;   // Lights that can reach the mesh, binned on the CPU
 uniform vec3 u_camera_position;
 uniform int u_is_portal = 0;
 uniform vec3 u_portal_color;
@@ -15,6 +20,51 @@ uniform float u_time;
 layout(binding = 0) uniform sampler2D texDiffuse;
 layout(binding = 1) uniform sampler2D noise;
 
+// Materials store their albedo as a layer in a texture array.
+// u_material is uniform for the draw, so it can index the sampler array directly.
+#define MAX_TEXTURE_ARRAYS 4
+struct Material
+{
+    uint array;
+    uint layer;
+    uvec2 handle;
+};
+layout(std430, binding = 0) readonly buffer Materials
+{
+    Material materials[];
+};
+uniform int u_material = -1;
+layout(binding = 2) uniform sampler2DArray texArrays[MAX_TEXTURE_ARRAYS];
+
+// Distance from each light to the closest caster, one cube map per light, compared with hardware filtering
+layout(binding = 7) uniform samplerCubeArrayShadow shadowMaps;
+uniform int u_shadows = 0;
+uniform float u_shadow_range;
+
+// 1 where the light reaches the fragment, 0 in its shadow. The bias grows with the distance, as the texels get larger.
+float shadow(int light, vec3 L_m)
+{
+    if(u_shadows == 0)
+        return 1.0;
+
+    float dist = length(L_m);
+    float bias = 0.05 + 0.005 * dist;
+    return texture(shadowMaps, vec4(-L_m, light), (dist - bias) / u_shadow_range);
+}
+
+vec4 albedo(vec2 uv)
+{
+    if(u_material < 0)
+        return texture(texDiffuse, uv);
+
+    Material material = materials[u_material];
+#ifdef BINDLESS
+    return texture(sampler2DArray(material.handle), vec3(uv, material.layer));
+#else
+    return texture(texArrays[material.array], vec3(uv, material.layer));
+#endif
+}
+
 out vec4 color;
 
 const float alpha = 32.0;
@@ -30,8 +80,11 @@ void main()
         vec3 diffuse = vec3(0);
         vec3 specular = vec3(0);
         vec3 V = u_camera_position - fragWorldPos;
-        for(int i = 0; i < N_LIGHTS; i++)
+        for(int i = 0; i < u_light_count; i++)
         {
+            if((u_light_mask & (1 << i)) == 0)
+                continue;
+
             vec3 lightPos = u_light_positions[i];
             vec3 color = u_light_colors[i];
             
@@ -40,13 +93,13 @@ void main()
 
             float dist = length(L_m);
 
-            float attenuation = 1 / (0.01 + 0.05*dist + 0.01*pow(dist, 2));
+            float attenuation = shadow(i, L_m) / (0.01 + 0.05*dist + 0.01*pow(dist, 2));
             
             diffuse += attenuation * color * clamp(dot(normalize(L_m), fragNormal), 0, 1);
             specular += attenuation * color * pow(clamp(dot(normalize(R_m), normalize(V)), 0, 1), alpha) ;
         }
 
-        color = (vec4(vec3(ambient), 1) + vec4(diffuse * diff_factor, 1))  * texture(texDiffuse, fragTextureCoordinate) + vec4(specular * spec_factor, 0); 
+        color = (vec4(vec3(ambient), 1) + vec4(diffuse * diff_factor, 1))  * albedo(fragTextureCoordinate) + vec4(specular * spec_factor, 0); 
     }
     else
     {
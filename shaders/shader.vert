@@ -1,8 +1,9 @@
 #version 450 core
 
-in vec3 position;
-in vec3 normal;
-in vec2 textureCoordinate;
+// Fixed locations, so the vertex arrays also work with shadow.vert
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 textureCoordinate;
 
 uniform mat4 view;
 uniform mat4 proj;
@@ -0,0 +1,12 @@
+#version 450 core
+
+in vec3 fragWorldPos;
+
+uniform vec3 u_light_position;
+uniform float u_shadow_range;
+
+// The shadow maps store the distance to the light, so any direction of the cube map is compared the same way
+void main()
+{
+    gl_FragDepth = min(length(fragWorldPos - u_light_position) / u_shadow_range, 1.0);
+}
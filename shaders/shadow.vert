@@ -0,0 +1,15 @@
+#version 450 core
+
+layout(location = 0) in vec3 position;
+
+uniform mat4 model;
+uniform mat4 viewProjection;    // Of one face of the cube map
+
+out vec3 fragWorldPos;
+
+void main()
+{
+    vec4 worldPos = model * vec4(position, 1.0);
+    fragWorldPos = worldPos.xyz;
+    gl_Position = viewProjection * worldPos;
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+// Debug allocation tracker. Replaces the global operator new and delete, and counts the allocations of every frame made
+// by the threads which take part in the frame loop (the main thread, the simulation thread and the job workers). A
+// sample of the call stacks of the allocations is kept, so the report shows where they came from. In assertion mode,
+// every frame after the warmup which allocates is an error.
+//
+// Compile time: the tracker is only compiled in when PORTAL_ALLOCATION_TRACKER is defined (CMake option
+//               ENABLE_ALLOCATION_TRACKER). Otherwise it is a no-op and operator new is not replaced.
+//               The operators are defined in the one file which defines ALLOCATION_TRACKER_IMPLEMENTATION before
+//               including this header (main.cpp). Only supported on POSIX systems, call stacks need glibc.
+//               Allocations made by the GL driver on a tracked thread are counted as well.
+//
+// Usage:
+//     AllocationTracker::trackThread();          // On every thread of the frame loop
+//     AllocationTracker::get().setAssert(60);    // Frames after the first 60 must not allocate
+//     AllocationTracker::get().endFrame();
+
+#include <cstdint>
+
+#define ALLOCATION_SITES 64
+#define ALLOCATION_STACK_DEPTH 6
+#define ALLOCATION_MAX_ERRORS 10
+
+#ifdef PORTAL_ALLOCATION_TRACKER
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+class AllocationTracker
+{
+private:
+    // The call stack of a sampled allocation, and how often it was seen
+    typedef struct Site
+    {
+        void *stack[ALLOCATION_STACK_DEPTH];
+        int depth;
+        uint64_t count;
+        uint64_t bytes;
+    } Site;
+
+    std::atomic<uint64_t> mFrameCount{0};
+    std::atomic<uint64_t> mFrameBytes{0};
+    std::atomic<uint64_t> mTotalCount{0};
+    std::atomic<uint64_t> mTotalBytes{0};
+    std::atomic<uint64_t> mSampleCounter{0};
+    unsigned int mSampleRate = 1;
+
+    // Fixed table, so recording a site never allocates. Guarded by a spin lock, as it is only written when sampling.
+    Site mSites[ALLOCATION_SITES] = {};
+    int mSiteCount = 0;
+    uint64_t mDroppedSamples = 0;
+    std::atomic_flag mSitesLock = ATOMIC_FLAG_INIT;
+
+    std::atomic<bool> mSampling{true};     // Sites are sampled, i.e. not asserting or after the warmup
+    unsigned long mFrame = 0;
+    uint64_t mLastCount = 0;
+    uint64_t mLastBytes = 0;
+    uint64_t mPeakCount = 0;        // Of a frame after the warmup
+    uint64_t mSteadyCount = 0;      // Allocations in all frames after the warmup
+    unsigned long mSteadyFrames = 0;
+    unsigned long mAllocatingFrames = 0;
+    long mWarmupFrames = -1;        // -1 when not asserting
+    bool mFailed = false;
+
+    inline static thread_local bool tTracked = false;
+    inline static thread_local bool tInside = false;    // Set while the tracker itself runs, e.g. in backtrace()
+
+    AllocationTracker() {}
+
+    bool isSteady()
+    {
+        return (long) mFrame >= std::max(mWarmupFrames, 0l);
+    }
+
+    __attribute__((noinline)) void sample(size_t size)
+    {
+#if defined(__GLIBC__)
+        // The first frames are sample(), record() and the allocation function called by operator new
+        void *stack[ALLOCATION_STACK_DEPTH + 3];
+        int depth = backtrace(stack, ALLOCATION_STACK_DEPTH + 3) - 3;
+        if (depth <= 0)
+            return;
+
+        while (mSitesLock.test_and_set(std::memory_order_acquire))
+        {
+        }
+        Site *site = nullptr;
+        for (int i = 0; i < mSiteCount && !site; i++)
+        {
+            if (mSites[i].depth == depth && std::equal(stack + 3, stack + 3 + depth, mSites[i].stack))
+                site = &mSites[i];
+        }
+        if (!site && mSiteCount < ALLOCATION_SITES)
+        {
+            site = &mSites[mSiteCount++];
+            std::copy(stack + 3, stack + 3 + depth, site->stack);
+            site->depth = depth;
+        }
+        if (site)
+        {
+            site->count++;
+            site->bytes += size;
+        }
+        else
+        {
+            mDroppedSamples++;
+        }
+        mSitesLock.clear(std::memory_order_release);
+#else
+        (void) size;
+#endif
+    }
+
+    void printSites(uint64_t minCount)
+    {
+        while (mSitesLock.test_and_set(std::memory_order_acquire))
+        {
+        }
+        for (int i = 0; i < mSiteCount; i++)
+        {
+            Site &site = mSites[i];
+            if (site.count < minCount)
+                continue;
+            fprintf(stderr, "  %lu sampled allocations, %lu bytes:\n", (unsigned long) site.count, (unsigned long) site.bytes);
+            fflush(stderr);
+#if defined(__GLIBC__)
+            // Writes the symbols directly, without allocating
+            backtrace_symbols_fd(site.stack, site.depth, STDERR_FILENO);
+#endif
+        }
+        if (mDroppedSamples)
+            fprintf(stderr, "  %lu samples dropped, the site table is full\n", (unsigned long) mDroppedSamples);
+        mSitesLock.clear(std::memory_order_release);
+    }
+
+    void clearSites()
+    {
+        while (mSitesLock.test_and_set(std::memory_order_acquire))
+        {
+        }
+        mSiteCount = 0;
+        mDroppedSamples = 0;
+        mSitesLock.clear(std::memory_order_release);
+    }
+
+public:
+    static AllocationTracker &get()
+    {
+        // Never destroyed, operator delete can still be called after main returns
+        static AllocationTracker *tracker = new (malloc(sizeof(AllocationTracker))) AllocationTracker();
+        return *tracker;
+    }
+
+    // Counts the allocations of the calling thread from now on
+    static void trackThread()
+    {
+        tTracked = true;
+    }
+
+    // Frames after the first warmupFrames which allocate are errors. Sites are only sampled after the warmup.
+    void setAssert(long warmupFrames)
+    {
+        mWarmupFrames = warmupFrames;
+        mSampling = isSteady();
+        clearSites();
+    }
+
+    // Samples the call stack of every rate-th allocation
+    void setSampleRate(unsigned int rate)
+    {
+        mSampleRate = std::max(rate, 1u);
+    }
+
+    __attribute__((noinline)) void record(size_t size)
+    {
+        if (!tTracked || tInside)
+            return;
+
+        tInside = true;
+        mFrameCount.fetch_add(1, std::memory_order_relaxed);
+        mFrameBytes.fetch_add(size, std::memory_order_relaxed);
+        if (mSampling.load(std::memory_order_relaxed) && mSampleCounter.fetch_add(1, std::memory_order_relaxed) % mSampleRate == 0)
+            sample(size);
+        tInside = false;
+    }
+
+    // Must be called at the end of every frame, on the main thread. Returns false if the frame allocated in assertion mode.
+    bool endFrame()
+    {
+        tInside = true;
+        mLastCount = mFrameCount.exchange(0, std::memory_order_relaxed);
+        mLastBytes = mFrameBytes.exchange(0, std::memory_order_relaxed);
+        mTotalCount.fetch_add(mLastCount, std::memory_order_relaxed);
+        mTotalBytes.fetch_add(mLastBytes, std::memory_order_relaxed);
+
+        bool passed = true;
+        if (isSteady())
+        {
+            mSteadyFrames++;
+            mSteadyCount += mLastCount;
+            mPeakCount = std::max(mPeakCount, mLastCount);
+            if (mLastCount > 0)
+                mAllocatingFrames++;
+
+            if (mWarmupFrames >= 0 && mLastCount > 0)
+            {
+                passed = false;
+                mFailed = true;
+                if (mAllocatingFrames <= ALLOCATION_MAX_ERRORS)
+                {
+                    fprintf(stderr, "Error: Frame %lu made %lu allocations (%lu bytes) after the warmup\n",
+                            mFrame, (unsigned long) mLastCount, (unsigned long) mLastBytes);
+                    printSites(1);
+                    clearSites();
+                }
+            }
+        }
+        mFrame++;
+        mSampling = isSteady();
+        tInside = false;
+        return passed;
+    }
+
+    uint64_t getLastCount()
+    {
+        return mLastCount;
+    }
+
+    uint64_t getLastBytes()
+    {
+        return mLastBytes;
+    }
+
+    // False if any frame after the warmup allocated in assertion mode
+    bool hasPassed()
+    {
+        return !mFailed;
+    }
+
+    void report()
+    {
+        tInside = true;
+        printf("Allocations: %lu (%.2f MB) in %lu frames, last frame %lu (%lu bytes)\n",
+               (unsigned long) mTotalCount.load(), mTotalBytes.load() / (1024.0 * 1024.0), mFrame,
+               (unsigned long) mLastCount, (unsigned long) mLastBytes);
+        if (mSteadyFrames > 0)
+            printf("Allocations after frame %ld: %.2f per frame, at most %lu, %lu of %lu frames allocated\n",
+                   std::max(mWarmupFrames, 0l), (double) mSteadyCount / mSteadyFrames, (unsigned long) mPeakCount,
+                   mAllocatingFrames, mSteadyFrames);
+        fflush(stdout);
+        if (mSiteCount > 0)
+        {
+            fprintf(stderr, "Sampled allocation sites (1 in %u):\n", mSampleRate);
+            printSites(1);
+        }
+        tInside = false;
+    }
+};
+
+#ifdef ALLOCATION_TRACKER_IMPLEMENTATION
+
+__attribute__((noinline)) static void *trackedAllocate(size_t size)
+{
+    void *pointer = malloc(size ? size : 1);
+    if (!pointer)
+        throw std::bad_alloc();
+    AllocationTracker::get().record(size);
+    return pointer;
+}
+
+__attribute__((noinline)) static void *trackedAllocateAligned(size_t size, std::align_val_t alignment)
+{
+    size_t align = std::max((size_t) alignment, sizeof(void *));
+    void *pointer = nullptr;
+    if (posix_memalign(&pointer, align, size ? size : 1) != 0)
+        throw std::bad_alloc();
+    AllocationTracker::get().record(size);
+    return pointer;
+}
+
+__attribute__((noinline)) static void *trackedAllocateNothrow(size_t size) noexcept
+{
+    void *pointer = malloc(size ? size : 1);
+    if (pointer)
+        AllocationTracker::get().record(size);
+    return pointer;
+}
+
+// Frees are not counted, a frame which frees without allocating only releases memory of earlier frames
+static void trackedFree(void *pointer)
+{
+    free(pointer);
+}
+
+void *operator new(size_t size) { return trackedAllocate(size); }
+void *operator new[](size_t size) { return trackedAllocate(size); }
+void *operator new(size_t size, std::align_val_t alignment) { return trackedAllocateAligned(size, alignment); }
+void *operator new[](size_t size, std::align_val_t alignment) { return trackedAllocateAligned(size, alignment); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return trackedAllocateNothrow(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return trackedAllocateNothrow(size); }
+
+void operator delete(void *pointer) noexcept { trackedFree(pointer); }
+void operator delete[](void *pointer) noexcept { trackedFree(pointer); }
+void operator delete(void *pointer, size_t) noexcept { trackedFree(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { trackedFree(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { trackedFree(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { trackedFree(pointer); }
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept { trackedFree(pointer); }
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept { trackedFree(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { trackedFree(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { trackedFree(pointer); }
+
+#endif
+
+#else
+
+// The tracker is compiled out, everything is a no-op
+class AllocationTracker
+{
+public:
+    static AllocationTracker &get()
+    {
+        static AllocationTracker tracker;
+        return tracker;
+    }
+
+    static void trackThread() {}
+    void setAssert(long) {}
+    void setSampleRate(unsigned int) {}
+    bool endFrame() { return true; }
+    uint64_t getLastCount() { return 0; }
+    uint64_t getLastBytes() { return 0; }
+    bool hasPassed() { return true; }
+    void report() {}
+};
+
+#endif
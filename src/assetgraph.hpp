@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <jobs.hpp>
+#include <profiler.hpp>
+
+#define ASSET_TIMELINE_WIDTH 40   // Columns of the bars in the printed timeline
+
+// One asset of the startup. load runs on a worker thread and must not use GL (file I/O, parsing, decoding),
+// upload runs on the thread owning the GL context once load is done. Either can be empty.
+typedef struct AssetTask
+{
+    std::string name;
+    std::function<void()> load;
+    std::function<void()> upload;
+    std::vector<int> dependents;    // Tasks waiting for this one
+    int waiting;                    // Dependencies not uploaded yet
+
+    // Timeline, in ms since run() started
+    double ready;                   // All dependencies uploaded
+    double loadStart;
+    double loadEnd;
+    double uploadStart;
+    double uploadEnd;
+    std::thread::id loadThread;
+} AssetTask;
+
+// Loads the assets of the startup as a dependency graph. A task starts loading on the job system as soon as all of its
+// dependencies are uploaded, and finished loads are uploaded on the calling thread in the order they arrive, so the
+// startup takes as long as the slowest chain of assets instead of the sum of all of them.
+class AssetGraph
+{
+private:
+    std::vector<AssetTask> mTasks;
+    std::deque<int> mLoaded;        // Waiting for their upload
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::chrono::steady_clock::time_point mStart;
+    std::thread::id mContextThread;
+    double mTotal = 0;
+
+    double now()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count();
+    }
+
+    void loaded(int task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mLoaded.push_back(task);
+        }
+        mCondition.notify_one();
+    }
+
+    void start(JobSystem &jobs, JobCounter &counter, int task)
+    {
+        AssetTask &asset = mTasks[task];
+        asset.ready = asset.loadStart = asset.loadEnd = now();
+        if (!asset.load)
+        {
+            loaded(task);
+            return;
+        }
+
+        // The tasks are not added to while running, so the reference stays valid. The profiler keeps the zone
+        // names past the lifetime of the graph, so they are not the asset names.
+        jobs.run("loadAsset", [this, &asset, task] {
+            asset.loadThread = std::this_thread::get_id();
+            asset.loadStart = now();
+            asset.load();
+            asset.loadEnd = now();
+            loaded(task);
+        }, counter);
+    }
+
+public:
+    // Returns the index of the task, to be used in the dependencies of later tasks
+    int add(std::string name, std::function<void()> load, std::function<void()> upload, std::vector<int> dependencies = {})
+    {
+        int task = mTasks.size();
+        mTasks.push_back({name, load, upload, {}, 0, 0, 0, 0, 0, 0, std::thread::id()});
+        for (int dependency : dependencies)
+        {
+            // Only earlier tasks, so there are no cycles
+            if (dependency < 0 || dependency >= task)
+            {
+                std::cerr << "Error: " << name << " depends on an unknown asset" << std::endl;
+                continue;
+            }
+            mTasks[dependency].dependents.push_back(task);
+            mTasks[task].waiting++;
+        }
+        return task;
+    }
+
+    // Runs every task, and returns once all are uploaded. Has to be called from the thread owning the GL context,
+    // which runs loads itself while nothing is ready to upload.
+    void run(JobSystem &jobs)
+    {
+        PROFILE_ZONE("AssetGraph::run");
+        mStart = std::chrono::steady_clock::now();
+        mContextThread = std::this_thread::get_id();
+
+        JobCounter counter;
+        for (size_t i = 0; i < mTasks.size(); i++)
+        {
+            if (mTasks[i].waiting == 0)
+                start(jobs, counter, i);
+        }
+
+        size_t uploaded = 0;
+        while (uploaded < mTasks.size())
+        {
+            int task = -1;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (!mLoaded.empty())
+                {
+                    task = mLoaded.front();
+                    mLoaded.pop_front();
+                }
+            }
+
+            if (task < 0)
+            {
+                if (!jobs.runOne())
+                {
+                    std::unique_lock<std::mutex> lock(mMutex);
+                    mCondition.wait_for(lock, std::chrono::milliseconds(1), [this] { return !mLoaded.empty(); });
+                }
+                continue;
+            }
+
+            AssetTask &asset = mTasks[task];
+            asset.uploadStart = now();
+            if (asset.upload)
+            {
+                PROFILE_ZONE("uploadAsset");
+                asset.upload();
+            }
+            asset.uploadEnd = now();
+            uploaded++;
+
+            for (int dependent : asset.dependents)
+            {
+                if (--mTasks[dependent].waiting == 0)
+                    start(jobs, counter, dependent);
+            }
+        }
+
+        // The jobs have all pushed their results, but may still hold the counter
+        jobs.wait(counter);
+        mTotal = now();
+    }
+
+    // Prints when each asset was loaded and uploaded, and on which thread. In the bars, '.' is waiting for
+    // dependencies or a free thread, '=' is loading and '#' is uploading.
+    void printTimeline()
+    {
+        std::vector<std::thread::id> threads;
+        double serial = 0;
+
+        printf("Startup assets (ms):\n");
+        printf("  %-28s %9s %19s %19s  %-9s\n", "asset", "ready", "load", "upload", "thread");
+        for (const AssetTask &asset : mTasks)
+        {
+            std::string thread = "-";
+            if (asset.load && asset.loadThread == mContextThread)
+            {
+                thread = "main";
+            }
+            else if (asset.load)
+            {
+                auto found = std::find(threads.begin(), threads.end(), asset.loadThread);
+                if (found == threads.end())
+                    found = threads.insert(threads.end(), asset.loadThread);
+                thread = "worker " + std::to_string(found - threads.begin() + 1);
+            }
+
+            char bar[ASSET_TIMELINE_WIDTH + 1];
+            for (int c = 0; c < ASSET_TIMELINE_WIDTH; c++)
+            {
+                double t = (c + 0.5) * mTotal / ASSET_TIMELINE_WIDTH;
+                bar[c] = t >= asset.uploadStart && t < asset.uploadEnd ? '#'
+                       : t >= asset.loadStart && t < asset.loadEnd     ? '='
+                       : t >= asset.ready && t < asset.uploadEnd       ? '.'
+                                                                       : ' ';
+            }
+            bar[ASSET_TIMELINE_WIDTH] = '\0';
+
+            printf("  %-28s %9.2f %8.2f - %8.2f %8.2f - %8.2f  %-9s |%s|\n", asset.name.c_str(), asset.ready,
+                   asset.loadStart, asset.loadEnd, asset.uploadStart, asset.uploadEnd, thread.c_str(), bar);
+            serial += (asset.loadEnd - asset.loadStart) + (asset.uploadEnd - asset.uploadStart);
+        }
+        printf("Startup assets took %.2f ms, %.2f ms one after another\n", mTotal, serial);
+    }
+};
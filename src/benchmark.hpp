@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Deterministic camera and portal placement script for the headless benchmark.
+//
+// frames <n>                                   Number of frames to render
+// warmup <n>                                   Frames rendered before timing starts
+// camera <frame> <x> <y> <z> <yaw> <pitch>     Camera key frame, linearly interpolated between key frames
+// portal <frame> <index>                       Place portal <index> where the camera looks at <frame>
+//
+// Lines starting with # are comments.
+class BenchmarkScript
+{
+private:
+    typedef struct CameraKey
+    {
+        int frame;
+        float position[3];
+        float yaw;
+        float pitch;
+    } CameraKey;
+
+    typedef struct PortalEvent
+    {
+        int frame;
+        int portal;
+    } PortalEvent;
+
+    std::vector<CameraKey> mCameraKeys;
+    std::vector<PortalEvent> mPortalEvents;
+    int mFrames = 0;
+    int mWarmup = 0;
+
+public:
+    bool load(std::string path)
+    {
+        std::ifstream fileStream(path.c_str());
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not load " << path << std::endl;
+            return false;
+        }
+
+        std::string line;
+        int lineNumber = 0;
+        while (getline(fileStream, line))
+        {
+            lineNumber++;
+            std::istringstream iss(line);
+            std::string type;
+            if (!(iss >> type) || type[0] == '#')
+                continue;
+
+            if (type == "frames")
+            {
+                iss >> mFrames;
+            }
+            else if (type == "warmup")
+            {
+                iss >> mWarmup;
+            }
+            else if (type == "camera")
+            {
+                CameraKey key;
+                iss >> key.frame >> key.position[0] >> key.position[1] >> key.position[2] >> key.yaw >> key.pitch;
+                mCameraKeys.push_back(key);
+            }
+            else if (type == "portal")
+            {
+                PortalEvent event;
+                iss >> event.frame >> event.portal;
+                mPortalEvents.push_back(event);
+            }
+            else
+            {
+                std::cerr << "Error: " << path << ":" << lineNumber << " unknown command " << type << std::endl;
+                return false;
+            }
+
+            if (iss.fail())
+            {
+                std::cerr << "Error: " << path << ":" << lineNumber << " could not parse " << line << std::endl;
+                return false;
+            }
+        }
+
+        std::sort(mCameraKeys.begin(), mCameraKeys.end(), [](const CameraKey &a, const CameraKey &b) { return a.frame < b.frame; });
+
+        if (mCameraKeys.empty())
+        {
+            std::cerr << "Error: " << path << " has no camera key frames" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    int getFrames()
+    {
+        return mFrames;
+    }
+
+    int getWarmup()
+    {
+        return mWarmup;
+    }
+
+    // Interpolates the camera key frames. Frames outside the keys are clamped to the first/last key.
+    void getCamera(int frame, float outPosition[3], float &outYaw, float &outPitch)
+    {
+        size_t next = 0;
+        while (next < mCameraKeys.size() && mCameraKeys[next].frame <= frame)
+            next++;
+
+        const CameraKey &a = mCameraKeys[next == 0 ? 0 : next - 1];
+        const CameraKey &b = mCameraKeys[std::min(next, mCameraKeys.size() - 1)];
+        float t = b.frame == a.frame ? 0.0f : (float) (frame - a.frame) / (b.frame - a.frame);
+
+        for (int i = 0; i < 3; i++)
+            outPosition[i] = a.position[i] + t * (b.position[i] - a.position[i]);
+        outYaw = a.yaw + t * (b.yaw - a.yaw);
+        outPitch = a.pitch + t * (b.pitch - a.pitch);
+    }
+
+    // Fills outPortals with the portals to place at the given frame
+    void getPortalEvents(int frame, std::vector<int> &outPortals)
+    {
+        outPortals.clear();
+        for (const PortalEvent &event : mPortalEvents)
+        {
+            if (event.frame == frame)
+                outPortals.push_back(event.portal);
+        }
+    }
+};
+
+// Collects per frame timings and writes them as CSV and summary statistics
+class BenchmarkStats
+{
+private:
+    typedef struct FrameTiming
+    {
+        double frame;
+        double update;
+        double render;
+    } FrameTiming;
+
+    std::vector<FrameTiming> mFrames;
+
+    static double percentile(std::vector<double> &sorted, double p)
+    {
+        return sorted[(size_t) (p * (sorted.size() - 1))];
+    }
+
+public:
+    // Keeps record() from allocating for the first frames
+    void reserve(size_t frames)
+    {
+        mFrames.reserve(frames);
+    }
+
+    // Times in milliseconds
+    void record(double frame, double update, double render)
+    {
+        mFrames.push_back({frame, update, render});
+    }
+
+    bool writeCsv(std::string path)
+    {
+        std::ofstream fileStream(path.c_str());
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not write " << path << std::endl;
+            return false;
+        }
+
+        fileStream << "frame,frame_ms,update_ms,render_ms\n";
+        for (size_t i = 0; i < mFrames.size(); i++)
+        {
+            fileStream << i << "," << mFrames[i].frame << "," << mFrames[i].update << "," << mFrames[i].render << "\n";
+        }
+        return true;
+    }
+
+    // Summary statistics of the frame times, as key = value
+    std::map<std::string, double> summary()
+    {
+        std::map<std::string, double> result;
+        if (mFrames.empty())
+            return result;
+
+        std::vector<double> sorted;
+        double sum = 0;
+        for (const FrameTiming &timing : mFrames)
+        {
+            sorted.push_back(timing.frame);
+            sum += timing.frame;
+        }
+        std::sort(sorted.begin(), sorted.end());
+
+        result["frames"] = sorted.size();
+        result["avg_ms"] = sum / sorted.size();
+        result["min_ms"] = sorted.front();
+        result["p50_ms"] = percentile(sorted, 0.50);
+        result["p95_ms"] = percentile(sorted, 0.95);
+        result["p99_ms"] = percentile(sorted, 0.99);
+        result["max_ms"] = sorted.back();
+        result["fps"] = 1000.0 / result["avg_ms"];
+        return result;
+    }
+
+    void printSummary()
+    {
+        for (auto &entry : summary())
+            printf("%-8s %10.3f\n", entry.first.c_str(), entry.second);
+    }
+
+    bool writeSummary(std::string path)
+    {
+        std::ofstream fileStream(path.c_str());
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not write " << path << std::endl;
+            return false;
+        }
+
+        for (auto &entry : summary())
+            fileStream << entry.first << " = " << entry.second << "\n";
+        return true;
+    }
+
+    // Compares the average and p95 frame time against a previously written summary.
+    // Returns false if either got slower by more than the tolerance (e.g. 0.1 = 10%), or is missing from the baseline.
+    bool compareBaseline(std::string path, double tolerance)
+    {
+        std::ifstream fileStream(path.c_str());
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not load baseline " << path << std::endl;
+            return false;
+        }
+
+        std::map<std::string, double> baseline;
+        std::string key, equals;
+        double value;
+        while (fileStream >> key >> equals >> value)
+            baseline[key] = value;
+
+        std::map<std::string, double> current = summary();
+        bool passed = true;
+        for (std::string metric : {"avg_ms", "p95_ms"})
+        {
+            if (baseline.find(metric) == baseline.end() || baseline[metric] <= 0)
+            {
+                std::cerr << "Error: The baseline " << path << " has no valid " << metric << std::endl;
+                passed = false;
+                continue;
+            }
+
+            double change = current[metric] / baseline[metric] - 1.0;
+            printf("%-8s baseline %8.3f current %8.3f (%+.1f%%)\n", metric.c_str(), baseline[metric], current[metric], change * 100);
+            if (change > tolerance)
+            {
+                std::cerr << "Error: " << metric << " regressed by more than " << tolerance * 100 << "%" << std::endl;
+                passed = false;
+            }
+        }
+        return passed;
+    }
+};
@@ -25,6 +25,7 @@ private:
     float mFar;
     float mYaw;
     float mPitch;
+    glm::fquat mRenderOrientation = glm::fquat(1, 0, 0, 0);
 
 public:
     Camera(Window &window, glm::vec3 position, float fov, float near, float far)
@@ -38,12 +39,24 @@ public:
         mPitch = 0;
     }
 
+    // A camera without a window, e.g. for tools and benchmarks. Its aspect ratio is 1.
+    Camera(glm::vec3 position, float fov, float near, float far)
+    {
+        setPosition(position);
+        mfov = fov;
+        mNear = near;
+        mFar = far;
+        mWindow = nullptr;
+        mYaw = 0;
+        mPitch = 0;
+    }
+
     glm::mat4 getPerspectiveMatrix()
     {
         // Handle the possibility of having 0 and inf aspect ratio
         float aspect = 1;
-        float w = mWindow->getWidth();
-        float h = mWindow->getHeight();
+        float w = mWindow ? mWindow->getWidth() : 0;
+        float h = mWindow ? mWindow->getHeight() : 0;
         if(w != 0 && h != 0)
         {
             aspect = w / h;
@@ -51,13 +64,21 @@ public:
         return glm::perspective(mfov, aspect, mNear, mFar);
     }
 
+    // The position is interpolated between ticks, while the orientation is the latest one,
+    // so looking around with the mouse does not wait for the next tick
     glm::mat4 getViewMatrix()
     {
-        glm::mat4 rot = glm::mat4_cast(glm::conjugate(getOrientation()));
-        glm::mat4 pos = glm::translate(glm::mat4(1.0f), -getPosition());
+        glm::mat4 rot = glm::mat4_cast(glm::conjugate(mRenderOrientation));
+        glm::mat4 pos = glm::translate(glm::mat4(1.0f), -getRenderPosition());
         return rot * pos;
     }
 
+    // Set by the renderer from the latest simulation snapshot
+    void setRenderOrientation(glm::fquat orientation)
+    {
+        mRenderOrientation = orientation;
+    }
+
     // Translates the camera based on the viewing direction 
     // translation = [right, up, forward] in view space
     void translateCamera(glm::vec3 translation)
@@ -97,6 +118,14 @@ public:
         rotate(glm::vec3(1,0,0), mPitch);
     }
 
+    // Sets the absolute viewing direction of the camera
+    void setDirection(float yaw, float pitch)
+    {
+        mYaw = yaw;
+        mPitch = 0;
+        direct(0, pitch);
+    }
+
     // Get the forward direction which the camera is facing in world space
     glm::vec3 get3DLookingVector()
     {
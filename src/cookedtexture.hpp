@@ -0,0 +1,555 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN64
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Cooked textures (.ctex) are written offline by the TextureCooker tool.
+// The file holds every mip level precomputed, either as raw RGBA8 or as
+// BC1/BC7 blocks, so the runtime only has to map the file and upload each level.
+//
+// Layout: [CookedTextureHeader][CookedTextureLevel * levels][level data ...]
+
+#define COOKED_TEXTURE_MAGIC 0x58455443 // "CTEX"
+#define COOKED_TEXTURE_VERSION 1
+#define COOKED_TEXTURE_MAX_LEVELS 16
+
+typedef enum cooked_format_e
+{
+    COOKED_RGBA8 = 0,
+    COOKED_BC1 = 1,
+    COOKED_BC7 = 2
+} cooked_format_e;
+
+typedef struct CookedTextureHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+} CookedTextureHeader;
+
+typedef struct CookedTextureLevel
+{
+    uint32_t offset; // Offset of the level data from the start of the file
+    uint32_t size;
+    uint32_t width;
+    uint32_t height;
+} CookedTextureLevel;
+
+static inline const char *cookedFormatName(uint32_t format)
+{
+    switch (format)
+    {
+    case COOKED_RGBA8: return "rgba8";
+    case COOKED_BC1: return "bc1";
+    case COOKED_BC7: return "bc7";
+    }
+    return "unknown";
+}
+
+// Finds the cooked version of a texture: ../res/textures/wall.png -> ../res/cooked/wall.ctex
+static inline std::string cookedTexturePath(std::string path)
+{
+    size_t slash = path.find_last_of("/\\");
+    std::string dir = slash == std::string::npos ? "" : path.substr(0, slash);
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    size_t dot = name.rfind(".");
+    if (dot != std::string::npos)
+        name = name.substr(0, dot);
+
+    size_t dirSlash = dir.find_last_of("/\\");
+    std::string parent = dirSlash == std::string::npos ? "." : dir.substr(0, dirSlash);
+
+    return parent + "/cooked/" + name + ".ctex";
+}
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+private:
+    const unsigned char *mData = nullptr;
+    size_t mSize = 0;
+#ifdef _WIN64
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = NULL;
+#endif
+
+public:
+    bool open(std::string path)
+    {
+#ifdef _WIN64
+        mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (mFile == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        GetFileSizeEx(mFile, &size);
+        mSize = (size_t) size.QuadPart;
+
+        mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mMapping == NULL)
+        {
+            close();
+            return false;
+        }
+        mData = (const unsigned char *) MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        mSize = (size_t) st.st_size;
+
+        void *data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        mData = data == MAP_FAILED ? nullptr : (const unsigned char *) data;
+#endif
+        if (!mData)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN64
+        if (mData) UnmapViewOfFile(mData);
+        if (mMapping != NULL) CloseHandle(mMapping);
+        if (mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+        mMapping = NULL;
+        mFile = INVALID_HANDLE_VALUE;
+#else
+        if (mData) munmap((void *) mData, mSize);
+#endif
+        mData = nullptr;
+        mSize = 0;
+    }
+
+    const unsigned char *data()
+    {
+        return mData;
+    }
+
+    size_t size()
+    {
+        return mSize;
+    }
+};
+
+// A cooked texture file mapped into memory. The level pointers point directly into the mapping.
+class CookedTexture
+{
+private:
+    MappedFile mFile;
+    const CookedTextureHeader *mHeader = nullptr;
+    const CookedTextureLevel *mLevels = nullptr;
+
+public:
+    bool open(std::string path)
+    {
+        if (!mFile.open(path))
+            return false;
+
+        if (mFile.size() < sizeof(CookedTextureHeader))
+        {
+            std::cerr << "Error: " << path << " is not a cooked texture" << std::endl;
+            close();
+            return false;
+        }
+
+        mHeader = (const CookedTextureHeader *) mFile.data();
+        if (
+            mHeader->magic != COOKED_TEXTURE_MAGIC ||
+            mHeader->version != COOKED_TEXTURE_VERSION ||
+            mHeader->levels == 0 ||
+            mHeader->levels > COOKED_TEXTURE_MAX_LEVELS ||
+            mFile.size() < sizeof(CookedTextureHeader) + mHeader->levels * sizeof(CookedTextureLevel))
+        {
+            std::cerr << "Error: " << path << " has an unsupported cooked texture header" << std::endl;
+            close();
+            return false;
+        }
+
+        mLevels = (const CookedTextureLevel *) (mFile.data() + sizeof(CookedTextureHeader));
+        for (uint32_t i = 0; i < mHeader->levels; i++)
+        {
+            if ((size_t) mLevels[i].offset + mLevels[i].size > mFile.size())
+            {
+                std::cerr << "Error: " << path << " is truncated" << std::endl;
+                close();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        mFile.close();
+        mHeader = nullptr;
+        mLevels = nullptr;
+    }
+
+    const CookedTextureHeader &header()
+    {
+        return *mHeader;
+    }
+
+    const CookedTextureLevel &level(unsigned int index)
+    {
+        return mLevels[index];
+    }
+
+    const unsigned char *levelData(unsigned int index)
+    {
+        return mFile.data() + mLevels[index].offset;
+    }
+};
+
+// Everything below is used by the cooker. It runs on the CPU only and does not touch OpenGL.
+
+typedef struct MipLevel
+{
+    unsigned int width;
+    unsigned int height;
+    std::vector<unsigned char> data;
+} MipLevel;
+
+// Builds the full mip chain of an RGBA8 image using a box filter.
+// Odd dimensions are handled by clamping the 2x2 footprint at the edge.
+static inline std::vector<MipLevel> generateMipChain(const unsigned char *rgba, unsigned int width, unsigned int height)
+{
+    std::vector<MipLevel> levels;
+    levels.push_back({width, height, std::vector<unsigned char>(rgba, rgba + width * height * 4)});
+
+    while (width > 1 || height > 1)
+    {
+        const MipLevel &src = levels.back();
+        unsigned int w = std::max(1u, width / 2);
+        unsigned int h = std::max(1u, height / 2);
+        MipLevel dst = {w, h, std::vector<unsigned char>(w * h * 4)};
+
+        for (unsigned int y = 0; y < h; y++)
+        {
+            unsigned int y0 = std::min(y * 2, height - 1);
+            unsigned int y1 = std::min(y * 2 + 1, height - 1);
+            for (unsigned int x = 0; x < w; x++)
+            {
+                unsigned int x0 = std::min(x * 2, width - 1);
+                unsigned int x1 = std::min(x * 2 + 1, width - 1);
+                for (unsigned int c = 0; c < 4; c++)
+                {
+                    unsigned int sum =
+                        src.data[(y0 * width + x0) * 4 + c] +
+                        src.data[(y0 * width + x1) * 4 + c] +
+                        src.data[(y1 * width + x0) * 4 + c] +
+                        src.data[(y1 * width + x1) * 4 + c];
+                    dst.data[(y * w + x) * 4 + c] = (unsigned char) ((sum + 2) / 4);
+                }
+            }
+        }
+
+        levels.push_back(dst);
+        width = w;
+        height = h;
+    }
+
+    return levels;
+}
+
+// Copies a 4x4 block out of an image, replicating the edge pixels for blocks that go past the border
+static inline void fetchBlock(const MipLevel &level, unsigned int bx, unsigned int by, unsigned char out[16][4])
+{
+    for (unsigned int y = 0; y < 4; y++)
+        for (unsigned int x = 0; x < 4; x++)
+        {
+            unsigned int sx = std::min(bx * 4 + x, level.width - 1);
+            unsigned int sy = std::min(by * 4 + y, level.height - 1);
+            memcpy(out[y * 4 + x], &level.data[(sy * level.width + sx) * 4], 4);
+        }
+}
+
+// Finds the two end points of the principal axis of the block, using a few power iterations
+static inline void principalEndpoints(unsigned char block[16][4], int channels, float outMin[4], float outMax[4])
+{
+    float mean[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < channels; c++)
+            mean[c] += block[i][c] / 16.0f;
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; i++)
+        for (int a = 0; a < channels; a++)
+            for (int b = 0; b < channels; b++)
+                cov[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+    float axis[4] = {1, 1, 1, 1};
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {0, 0, 0, 0};
+        float len = 0;
+        for (int a = 0; a < channels; a++)
+        {
+            for (int b = 0; b < channels; b++)
+                next[a] += cov[a][b] * axis[b];
+            len += next[a] * next[a];
+        }
+        if (len < 1e-8f)
+            break;
+        len = sqrtf(len);
+        for (int a = 0; a < channels; a++)
+            axis[a] = next[a] / len;
+    }
+
+    float tMin = 0, tMax = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0;
+        for (int c = 0; c < channels; c++)
+            t += (block[i][c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+
+    for (int c = 0; c < 4; c++)
+    {
+        outMin[c] = c < channels ? std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tMin)) : 255.0f;
+        outMax[c] = c < channels ? std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tMax)) : 255.0f;
+    }
+}
+
+static inline int colorError(const unsigned char *a, const int *b, int channels)
+{
+    int error = 0;
+    for (int c = 0; c < channels; c++)
+        error += (a[c] - b[c]) * (a[c] - b[c]);
+    return error;
+}
+
+// BC1 (DXT1) encoding of a single block, opaque four color mode
+static inline void encodeBC1Block(unsigned char block[16][4], unsigned char out[8])
+{
+    float lo[4], hi[4];
+    principalEndpoints(block, 3, lo, hi);
+
+    auto to565 = [](const float *c) -> uint16_t {
+        return (uint16_t) (((int) (c[0] * 31 / 255.0f + 0.5f) << 11) | ((int) (c[1] * 63 / 255.0f + 0.5f) << 5) | (int) (c[2] * 31 / 255.0f + 0.5f));
+    };
+
+    uint16_t c0 = to565(hi);
+    uint16_t c1 = to565(lo);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    int palette[4][3];
+    const uint16_t ends[2] = {c0, c1};
+    for (int i = 0; i < 2; i++)
+    {
+        palette[i][0] = ((ends[i] >> 11) & 31) * 255 / 31;
+        palette[i][1] = ((ends[i] >> 5) & 63) * 255 / 63;
+        palette[i][2] = (ends[i] & 31) * 255 / 31;
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = colorError(block[i], palette[0], 3);
+            for (int p = 1; p < 4; p++)
+            {
+                int error = colorError(block[i], palette[p], 3);
+                if (error < bestError)
+                {
+                    best = p;
+                    bestError = error;
+                }
+            }
+            indices |= (uint32_t) best << (i * 2);
+        }
+    }
+
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    memcpy(out + 4, &indices, 4);
+}
+
+// BC7 encoding of a single block using mode 6 only (one subset, RGBA 7777 end points with p-bits, 4 bit indices).
+// This is a good fit for the smooth textures in this project and keeps the encoder small.
+static inline void encodeBC7Block(unsigned char block[16][4], unsigned char out[16])
+{
+    static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    float ends[2][4];
+    principalEndpoints(block, 4, ends[0], ends[1]);
+
+    // Quantize both end points to 7 bits + a shared p-bit, picking the p-bit with the lowest error
+    int q[2][4], p[2], e[2][4];
+    for (int i = 0; i < 2; i++)
+    {
+        int bestError = -1;
+        for (int pbit = 0; pbit <= 1; pbit++)
+        {
+            int candidate[4], error = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                candidate[c] = std::min(127, std::max(0, (int) ((ends[i][c] - pbit) / 2.0f + 0.5f)));
+                float diff = ((candidate[c] << 1) | pbit) - ends[i][c];
+                error += (int) (diff * diff);
+            }
+            if (bestError < 0 || error < bestError)
+            {
+                bestError = error;
+                p[i] = pbit;
+                memcpy(q[i], candidate, sizeof(candidate));
+            }
+        }
+        for (int c = 0; c < 4; c++)
+            e[i][c] = (q[i][c] << 1) | p[i];
+    }
+
+    int palette[16][4];
+    for (int w = 0; w < 16; w++)
+        for (int c = 0; c < 4; c++)
+            palette[w][c] = ((64 - weights[w]) * e[0][c] + weights[w] * e[1][c] + 32) >> 6;
+
+    int indices[16];
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0, bestError = colorError(block[i], palette[0], 4);
+        for (int w = 1; w < 16; w++)
+        {
+            int error = colorError(block[i], palette[w], 4);
+            if (error < bestError)
+            {
+                best = w;
+                bestError = error;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // The most significant bit of the first index is implicit, swap the end points if it would be set
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; c++)
+            std::swap(q[0][c], q[1][c]);
+        std::swap(p[0], p[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    int bit = 0;
+    auto write = [&](uint32_t value, int bits) {
+        for (int i = 0; i < bits; i++, bit++)
+            out[bit / 8] |= ((value >> i) & 1) << (bit % 8);
+    };
+
+    write(1 << 6, 7); // Mode 6
+    for (int c = 0; c < 4; c++)
+    {
+        write(q[0][c], 7);
+        write(q[1][c], 7);
+    }
+    write(p[0], 1);
+    write(p[1], 1);
+    write(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        write(indices[i], 4);
+}
+
+// Compresses a mip level into BC1 or BC7 blocks. Levels smaller than a block are padded.
+static inline std::vector<unsigned char> compressLevel(const MipLevel &level, cooked_format_e format)
+{
+    if (format == COOKED_RGBA8)
+        return level.data;
+
+    unsigned int blocksX = (level.width + 3) / 4;
+    unsigned int blocksY = (level.height + 3) / 4;
+    unsigned int blockSize = format == COOKED_BC1 ? 8 : 16;
+    std::vector<unsigned char> out(blocksX * blocksY * blockSize);
+
+    unsigned char block[16][4];
+    for (unsigned int by = 0; by < blocksY; by++)
+        for (unsigned int bx = 0; bx < blocksX; bx++)
+        {
+            fetchBlock(level, bx, by, block);
+            unsigned char *dst = &out[(by * blocksX + bx) * blockSize];
+            if (format == COOKED_BC1)
+                encodeBC1Block(block, dst);
+            else
+                encodeBC7Block(block, dst);
+        }
+
+    return out;
+}
+
+// Writes all levels of an RGBA8 image to a cooked texture file
+static inline bool writeCookedTexture(std::string path, const unsigned char *rgba, unsigned int width, unsigned int height, cooked_format_e format)
+{
+    std::vector<MipLevel> mips = generateMipChain(rgba, width, height);
+    if (mips.size() > COOKED_TEXTURE_MAX_LEVELS)
+        mips.resize(COOKED_TEXTURE_MAX_LEVELS);
+
+    CookedTextureHeader header = {COOKED_TEXTURE_MAGIC, COOKED_TEXTURE_VERSION, (uint32_t) format, width, height, (uint32_t) mips.size()};
+    std::vector<CookedTextureLevel> levels;
+    std::vector<std::vector<unsigned char>> data;
+
+    uint32_t offset = sizeof(CookedTextureHeader) + mips.size() * sizeof(CookedTextureLevel);
+    for (const MipLevel &mip : mips)
+    {
+        data.push_back(compressLevel(mip, format));
+        levels.push_back({offset, (uint32_t) data.back().size(), mip.width, mip.height});
+        offset += data.back().size();
+    }
+
+    std::ofstream fileStream(path.c_str(), std::ios::binary);
+    if (!fileStream)
+    {
+        std::cerr << "Error: Could not write " << path << std::endl;
+        return false;
+    }
+
+    fileStream.write((const char *) &header, sizeof(header));
+    fileStream.write((const char *) levels.data(), levels.size() * sizeof(CookedTextureLevel));
+    for (const std::vector<unsigned char> &level : data)
+        fileStream.write((const char *) level.data(), level.size());
+
+    return (bool) fileStream;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/common.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/gtc/matrix_access.hpp>
+
+// View frustum as six planes extracted from a view projection matrix (Gribb & Hartmann).
+// Works for the oblique portal projections as well, where the near plane is the plane of the portal.
+class Frustum
+{
+private:
+    glm::vec4 mPlanes[6];
+
+public:
+    Frustum(const glm::mat4 &viewProjection)
+    {
+        glm::vec4 row0 = glm::row(viewProjection, 0);
+        glm::vec4 row1 = glm::row(viewProjection, 1);
+        glm::vec4 row2 = glm::row(viewProjection, 2);
+        glm::vec4 row3 = glm::row(viewProjection, 3);
+
+        mPlanes[0] = row3 + row0;   // Left
+        mPlanes[1] = row3 - row0;   // Right
+        mPlanes[2] = row3 + row1;   // Bottom
+        mPlanes[3] = row3 - row1;   // Top
+        mPlanes[4] = row3 + row2;   // Near
+        mPlanes[5] = row3 - row2;   // Far
+    }
+
+    // Whether an axis aligned box, given by its center and half size, is at least partly inside
+    bool intersects(const glm::vec3 &center, const glm::vec3 &extents) const
+    {
+        for (const glm::vec4 &plane : mPlanes)
+        {
+            glm::vec3 normal = glm::vec3(plane);
+            float radius = glm::dot(extents, glm::abs(normal));
+            if (glm::dot(normal, center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+// Position of the eye of a rigid view matrix in world space, without inverting it
+inline glm::vec3 viewEye(const glm::mat4 &view)
+{
+    return -(glm::transpose(glm::mat3(view)) * glm::vec3(view[3]));
+}
+
+// Axis aligned world space bounds of a local box after a rigid transform
+inline void transformBounds(const glm::vec3 &localMin, const glm::vec3 &localMax, const glm::mat4 &transform, glm::vec3 &outCenter, glm::vec3 &outExtents)
+{
+    glm::vec3 center = (localMin + localMax) * 0.5f;
+    glm::vec3 extents = (localMax - localMin) * 0.5f;
+    glm::mat3 rotation = glm::mat3(transform);
+
+    outCenter = glm::vec3(transform * glm::vec4(center, 1));
+    outExtents = glm::vec3(0);
+    for (int i = 0; i < 3; i++)
+        outExtents += glm::abs(rotation[i]) * extents[i];
+}
+
+// A view through a chain of portals, planned before any draw. The first view is the camera, and every other view looks
+// through a portal seen in its parent view and out of the partner portal. Everything the draws of the view need is
+// computed when it is planned and compiled, so submitting it is only GL calls.
+typedef struct RenderView
+{
+    glm::mat4 view;
+    glm::mat4 proj;
+    glm::mat4 viewProjection;
+    glm::vec3 eye;              // Position in world space
+    glm::vec4 clipPlane;        // World space plane of the portal looked out of, nothing behind it is drawn. Zero for the camera.
+    int parent;                 // Index of the view looked through, -1 for the camera
+    int portal;                 // Index of the portal looked through in the parent view, -1 for the camera
+    int depth;                  // Portals looked through
+    uint8_t stencil;            // Marks the pixels of the view in the stencil buffer
+    glm::vec4 bounds;           // Screen rectangle the view can cover in normalized device coordinates: min x, min y, max x, max y
+    glm::ivec4 scissor;         // The bounds in pixels of the target of the view: x, y, width, height
+    glm::ivec4 parentScissor;   // The bounds in pixels of the target of the parent view
+    std::vector<int> children;  // Views through the portals of this view, nearest portal first
+    std::vector<int> frames;    // Portals in this view which are not looked through, drawn as their frame
+    std::vector<int> draws;     // Indices of the meshes in gamedata.meshes which are visible in the view
+} RenderView;
+
+// The pixels of a rectangle in normalized device coordinates, in a viewport of width x height: x, y, width, height.
+// Rounded outwards, so the rectangle is covered completely.
+inline glm::ivec4 scissorRect(const glm::vec4 &bounds, int width, int height)
+{
+    int x0 = glm::clamp((int) std::floor((bounds.x * 0.5f + 0.5f) * width), 0, width);
+    int y0 = glm::clamp((int) std::floor((bounds.y * 0.5f + 0.5f) * height), 0, height);
+    int x1 = glm::clamp((int) std::ceil((bounds.z * 0.5f + 0.5f) * width), x0, width);
+    int y1 = glm::clamp((int) std::ceil((bounds.w * 0.5f + 0.5f) * height), y0, height);
+    return glm::ivec4(x0, y0, x1 - x0, y1 - y0);
+}
@@ -8,31 +8,113 @@
 #include <texture.hpp>
 #include <portal.hpp>
 #include <light.hpp>
+#include <material.hpp>
+#include <snapshot.hpp>
+#include <simulation.hpp>
+#include <benchmark.hpp>
+#include <jobs.hpp>
+#include <culling.hpp>
+#include <level.hpp>
+#include <scenepools.hpp>
+#include <softwarerenderer.hpp>
+#include <resolution.hpp>
+#include <rendergraph.hpp>
+#include <shadows.hpp>
 
-#define N_LIGHTS 5
+#define MAX_LIGHTS 32    // Light slots in shader.frag, and bits of the light mask
+#define PORTAL_MAX_DEPTH 10
+#define PORTAL_MAX_VIEWS 64     // Views rendered per frame, including the camera. Each has its own 8 bit stencil value, so at most 256.
+
+// The simulation advances in fixed ticks, independent of the frame rate
+#define TICK_RATE 60.0
+#define TICK_DT (1.0 / TICK_RATE)
+#define MAX_FRAME_TIME 0.25     // Longer frames are clamped, so a stall does not trigger a burst of ticks
+
+#define MOVE_SPEED 12.0f        // Units per second
+#define TURRET_SPEED 0.6f       // Radians per second
 
 #define ALBEDO_TEXTURE_BINDING 0
 #define NOISE_TEXTURE_BINDING 1
 
+// A portal seen in a view, which can be looked through
+typedef struct ViewCandidate
+{
+    float area;         // Part of the screen it covers
+    int parent;
+    int portal;
+    glm::vec4 bounds;
+
+    bool operator<(const ViewCandidate &other) const
+    {
+        return area < other.area;
+    }
+} ViewCandidate;
+
+// A wall hit by the rays placing a portal
+typedef struct RayHit
+{
+    float dist;
+    glm::vec3 pos, normal, up;  // Positions, normal and up vector of the wall that is hit
+} RayHit;
+
 typedef struct gamedata_st 
 {
     Window *window;
 
+    ScenePools pools;   // Owns the objects of the scene
     Node *root;
-    ObjMesh *turret;
+    std::vector<ObjMesh*> turrets;
+    std::vector<glm::vec3> turretPositions;    // Positions the turrets bob around
     Mesh *player;
-    Portal *portals[2];
+    std::vector<Portal*> portals;   // Linked in pairs, 2i and 2i + 1. The player places the first pair.
 
     std::vector<Cube*> cubes;
 
-    Texture *wallTexture;
-    Texture *rubixTexture;
-    Texture *turretTexture;
-    Texture *noiseTexture;
+    MaterialLibrary *materials;
+    std::vector<LevelMaterial> materialSources;    // Texture of every material, to save the scene as a level
+    NoiseTexture *noiseTexture;
+    Resource *noiseResource;        // The GL texture of the noise texture
 
     Camera *camera;
 
-    Shader *shader;
+    ResourceCache *resources;   // Owns the GL meshes, programs, textures, targets and buffers
+    Resource *program;
+    Shader *shader;             // The program of the resource above
+    SoftwareRenderer *software; // Renders on the CPU instead of OpenGL when set (PortalSoftware)
+    DynamicResolution *resolution;  // Renders the deeper portal views at a lower resolution when set
+    ShadowMaps *shadows;        // Shadows of the lights, nullptr when disabled or with the software renderer
+    RenderGraph *graph;         // The passes of the frame, built again every frame by renderViews()
+    bool dumpGraph;             // Prints the render graph of the next frame
+    bool releaseGeometry;       // Frees the CPU copy of the vertex data once it is uploaded
+
+    std::vector<Light*> lights;
+
+    JobSystem *jobs;
+    unsigned int jobThreads;            // Threads of the job system, 0 for one per hardware thread
+    std::vector<Mesh*> meshes;          // Meshes of the world, culled for every view
+    std::vector<RenderView> views;      // Views through the portals, planned before any draw
+    size_t viewCount;                   // Views planned this frame. The others keep their allocations for later frames.
+    std::vector<ViewCandidate> candidates;  // Max heap of the portals to look through, while planning the views
+    std::vector<glm::ivec4> depthScissors;  // Per portal depth, covers the scissors of its views
+    std::vector<int> depthTargets;          // Per portal depth, the render graph target its views are drawn into
+
+    // Scratch space of the frame, kept so the frame loop does not allocate once they are large enough
+    std::vector<RayHit> hits;               // Per cube, when placing a portal (simulation)
+    std::vector<int> portalEvents;          // Portals the script places this frame (simulation)
+    std::vector<glm::vec3> portalPositions; // Streaming hints (main thread)
+
+    double simulationTime;      // Time of the last tick
+    double accumulator;         // Frame time not yet simulated
+    double prevFrameTime;
+    unsigned long frame;        // Number of simulated frames
+
+    // The simulation publishes the transforms the renderer needs into a snapshot, so the two can run on different threads
+    std::vector<Node*> nodes;
+    TripleBuffer<RenderSnapshot> *snapshots;
+    SimulationThread *simulation;   // nullptr when the simulation runs on the main thread
+
+    LevelFile *level;               // The streamed level, nullptr for built scenes
+    LevelStreamer *streamer;
 
-    Light *lights[N_LIGHTS];
+    BenchmarkScript *script;        // Drives the camera in the headless benchmark, nullptr otherwise
 } gamedata_st;
\ No newline at end of file
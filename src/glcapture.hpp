@@ -0,0 +1,1222 @@
+#pragma once
+
+// Capture of the GL command stream. GLCapture replaces the glad function pointers of every GL call the renderer makes
+// with wrappers which append the call, and a copy of any data it reads from memory, to a binary stream before calling
+// the driver. Everything from startup to the end of the captured frames is recorded, so the stream creates every
+// buffer, texture and program it uses. GLReplay executes a stream again in a GL context of its own, without any game
+// logic, remapping the object names and uniform locations the driver hands out.
+//
+// The stream is [header][commands], where each command is [uint8 opcode][arguments], data is [uint8 present][uint64 size][bytes]
+// and the end of each frame is a CAPTURE_FRAME command.
+//
+// Usage:
+//     GLCapture::get().start("frames.glcap", 100, width, height, framebuffer);  // After the context is created
+//     GLCapture::get().endFrame();     // After every frame, writes the file after the last
+//
+// Only the thread owning the GL context may make the captured calls.
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define GL_CAPTURE_MAGIC 0x50434c47 // "GLCP"
+#define GL_CAPTURE_VERSION 2
+
+// Every GL function that is captured, as the name after gl
+#define GL_CAPTURE_FUNCTIONS(X) \
+    X(Enable) X(Disable) X(BlendFunc) X(DepthFunc) X(ClearColor) X(Clear) X(Viewport) X(Scissor) \
+    X(StencilMask) X(StencilOp) X(StencilFunc) X(PixelStorei) X(DrawElements) X(DrawArrays) \
+    X(UseProgram) X(GetUniformLocation) X(Uniform1i) X(Uniform1f) X(Uniform2f) X(Uniform3fv) X(UniformMatrix4fv) \
+    X(CreateShader) X(ShaderSource) X(CompileShader) X(CreateProgram) X(AttachShader) X(LinkProgram) \
+    X(DeleteShader) X(DeleteProgram) \
+    X(GenBuffers) X(CreateBuffers) X(DeleteBuffers) X(BindBuffer) X(BindBufferBase) X(BufferData) X(NamedBufferStorage) \
+    X(GenVertexArrays) X(CreateVertexArrays) X(DeleteVertexArrays) X(BindVertexArray) \
+    X(VertexAttribPointer) X(EnableVertexAttribArray) \
+    X(GenTextures) X(CreateTextures) X(DeleteTextures) X(BindTexture) X(BindTextureUnit) \
+    X(TexParameteri) X(TextureParameteri) X(TexImage2D) X(TexImage3D) X(TexSubImage2D) X(TexSubImage3D) \
+    X(CompressedTexImage2D) X(TextureStorage2D) X(TextureStorage3D) X(TextureSubImage3D) \
+    X(CompressedTextureSubImage3D) X(GenerateMipmap) X(GenerateTextureMipmap) X(CopyImageSubData) \
+    X(GenFramebuffers) X(CreateFramebuffers) X(DeleteFramebuffers) X(BindFramebuffer) X(FramebufferRenderbuffer) \
+    X(NamedFramebufferTexture) X(NamedFramebufferTextureLayer) X(NamedFramebufferRenderbuffer) \
+    X(NamedFramebufferDrawBuffer) X(NamedFramebufferReadBuffer) \
+    X(GenRenderbuffers) X(CreateRenderbuffers) X(DeleteRenderbuffers) X(BindRenderbuffer) \
+    X(RenderbufferStorage) X(NamedRenderbufferStorage)
+
+#define GL_CAPTURE_OPCODE(name) CAPTURE_gl##name,
+typedef enum capture_op_e
+{
+    CAPTURE_FRAME,
+    GL_CAPTURE_FUNCTIONS(GL_CAPTURE_OPCODE)
+    CAPTURE_OP_COUNT
+} capture_op_e;
+#undef GL_CAPTURE_OPCODE
+
+typedef struct GLCaptureHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    uint32_t framebuffer;   // Of the window, which the replay substitutes with its own
+    uint32_t frames;
+} GLCaptureHeader;
+
+// Size of the pixels a texture upload reads, with the rows aligned to alignment
+inline size_t captureImageSize(GLenum format, GLenum type, GLsizei width, GLsizei height, GLsizei depth, int alignment)
+{
+    size_t components = format == GL_RED || format == GL_DEPTH_COMPONENT ? 1 : format == GL_RG ? 2 : format == GL_RGB || format == GL_BGR ? 3 : 4;
+    size_t bytes = type == GL_FLOAT || type == GL_UNSIGNED_INT || type == GL_INT ? 4 : type == GL_UNSIGNED_SHORT || type == GL_SHORT || type == GL_HALF_FLOAT ? 2 : 1;
+    size_t row = width * components * bytes;
+    size_t alignedRow = (row + alignment - 1) / alignment * alignment;
+    size_t rows = (size_t) height * depth;
+    return rows ? alignedRow * (rows - 1) + row : 0;    // The last row is not padded
+}
+
+class GLCapture
+{
+private:
+#define GL_CAPTURE_REAL(name) decltype(glad_gl##name) mReal##name = nullptr;
+    GL_CAPTURE_FUNCTIONS(GL_CAPTURE_REAL)
+#undef GL_CAPTURE_REAL
+
+    std::vector<uint8_t> mStream;
+    std::string mPath;
+    GLCaptureHeader mHeader = {};
+    unsigned int mFrames = 0;           // To capture
+    bool mRecording = false;
+    int mUnpackAlignment = 4;
+
+    void begin(capture_op_e op)
+    {
+        mStream.push_back((uint8_t) op);
+    }
+
+    template <typename T>
+    void put(T value)
+    {
+        const uint8_t *bytes = (const uint8_t *) &value;
+        mStream.insert(mStream.end(), bytes, bytes + sizeof(T));
+    }
+
+    void putData(const void *data, size_t size)
+    {
+        put<uint8_t>(data != nullptr);
+        if (!data)
+            return;
+        put<uint64_t>(size);
+        mStream.insert(mStream.end(), (const uint8_t *) data, (const uint8_t *) data + size);
+    }
+
+    void putNames(GLsizei count, const GLuint *names)
+    {
+        put<int32_t>(count);
+        for (GLsizei i = 0; i < count; i++)
+            put<uint32_t>(names[i]);
+    }
+
+    // Wrappers of the GL functions, which record the call and forward it to the driver
+
+    static void APIENTRY captureEnable(GLenum cap) { GLCapture &c = get(); c.begin(CAPTURE_glEnable); c.put(cap); c.mRealEnable(cap); }
+    static void APIENTRY captureDisable(GLenum cap) { GLCapture &c = get(); c.begin(CAPTURE_glDisable); c.put(cap); c.mRealDisable(cap); }
+    static void APIENTRY captureDepthFunc(GLenum func) { GLCapture &c = get(); c.begin(CAPTURE_glDepthFunc); c.put(func); c.mRealDepthFunc(func); }
+    static void APIENTRY captureClear(GLbitfield mask) { GLCapture &c = get(); c.begin(CAPTURE_glClear); c.put(mask); c.mRealClear(mask); }
+    static void APIENTRY captureStencilMask(GLuint mask) { GLCapture &c = get(); c.begin(CAPTURE_glStencilMask); c.put(mask); c.mRealStencilMask(mask); }
+    static void APIENTRY captureUseProgram(GLuint program) { GLCapture &c = get(); c.begin(CAPTURE_glUseProgram); c.put(program); c.mRealUseProgram(program); }
+    static void APIENTRY captureCompileShader(GLuint shader) { GLCapture &c = get(); c.begin(CAPTURE_glCompileShader); c.put(shader); c.mRealCompileShader(shader); }
+    static void APIENTRY captureLinkProgram(GLuint program) { GLCapture &c = get(); c.begin(CAPTURE_glLinkProgram); c.put(program); c.mRealLinkProgram(program); }
+    static void APIENTRY captureDeleteShader(GLuint shader) { GLCapture &c = get(); c.begin(CAPTURE_glDeleteShader); c.put(shader); c.mRealDeleteShader(shader); }
+    static void APIENTRY captureDeleteProgram(GLuint program) { GLCapture &c = get(); c.begin(CAPTURE_glDeleteProgram); c.put(program); c.mRealDeleteProgram(program); }
+    static void APIENTRY captureBindVertexArray(GLuint array) { GLCapture &c = get(); c.begin(CAPTURE_glBindVertexArray); c.put(array); c.mRealBindVertexArray(array); }
+    static void APIENTRY captureEnableVertexAttribArray(GLuint index) { GLCapture &c = get(); c.begin(CAPTURE_glEnableVertexAttribArray); c.put(index); c.mRealEnableVertexAttribArray(index); }
+    static void APIENTRY captureGenerateMipmap(GLenum target) { GLCapture &c = get(); c.begin(CAPTURE_glGenerateMipmap); c.put(target); c.mRealGenerateMipmap(target); }
+    static void APIENTRY captureGenerateTextureMipmap(GLuint texture) { GLCapture &c = get(); c.begin(CAPTURE_glGenerateTextureMipmap); c.put(texture); c.mRealGenerateTextureMipmap(texture); }
+
+    static void APIENTRY captureBlendFunc(GLenum sfactor, GLenum dfactor)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glBlendFunc); c.put(sfactor); c.put(dfactor);
+        c.mRealBlendFunc(sfactor, dfactor);
+    }
+
+    static void APIENTRY captureClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glClearColor); c.put(red); c.put(green); c.put(blue); c.put(alpha);
+        c.mRealClearColor(red, green, blue, alpha);
+    }
+
+    static void APIENTRY captureViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glViewport); c.put(x); c.put(y); c.put(width); c.put(height);
+        c.mRealViewport(x, y, width, height);
+    }
+
+    static void APIENTRY captureScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glScissor); c.put(x); c.put(y); c.put(width); c.put(height);
+        c.mRealScissor(x, y, width, height);
+    }
+
+    static void APIENTRY captureStencilOp(GLenum fail, GLenum zfail, GLenum zpass)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glStencilOp); c.put(fail); c.put(zfail); c.put(zpass);
+        c.mRealStencilOp(fail, zfail, zpass);
+    }
+
+    static void APIENTRY captureStencilFunc(GLenum func, GLint ref, GLuint mask)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glStencilFunc); c.put(func); c.put(ref); c.put(mask);
+        c.mRealStencilFunc(func, ref, mask);
+    }
+
+    static void APIENTRY capturePixelStorei(GLenum pname, GLint param)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glPixelStorei); c.put(pname); c.put(param);
+        if (pname == GL_UNPACK_ALIGNMENT)
+            c.mUnpackAlignment = param;
+        c.mRealPixelStorei(pname, param);
+    }
+
+    static void APIENTRY captureDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glDrawElements); c.put(mode); c.put(count); c.put(type); c.put<uint64_t>((uintptr_t) indices);
+        c.mRealDrawElements(mode, count, type, indices);
+    }
+
+    static void APIENTRY captureDrawArrays(GLenum mode, GLint first, GLsizei count)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glDrawArrays); c.put(mode); c.put(first); c.put(count);
+        c.mRealDrawArrays(mode, first, count);
+    }
+
+    static GLint APIENTRY captureGetUniformLocation(GLuint program, const GLchar *name)
+    {
+        GLCapture &c = get();
+        GLint location = c.mRealGetUniformLocation(program, name);
+        c.begin(CAPTURE_glGetUniformLocation); c.put(program); c.putData(name, strlen(name) + 1); c.put(location);
+        return location;
+    }
+
+    static void APIENTRY captureUniform1i(GLint location, GLint v0)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glUniform1i); c.put(location); c.put(v0);
+        c.mRealUniform1i(location, v0);
+    }
+
+    static void APIENTRY captureUniform1f(GLint location, GLfloat v0)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glUniform1f); c.put(location); c.put(v0);
+        c.mRealUniform1f(location, v0);
+    }
+
+    static void APIENTRY captureUniform2f(GLint location, GLfloat v0, GLfloat v1)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glUniform2f); c.put(location); c.put(v0); c.put(v1);
+        c.mRealUniform2f(location, v0, v1);
+    }
+
+    static void APIENTRY captureUniform3fv(GLint location, GLsizei count, const GLfloat *value)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glUniform3fv); c.put(location); c.put(count); c.putData(value, count * 3 * sizeof(GLfloat));
+        c.mRealUniform3fv(location, count, value);
+    }
+
+    static void APIENTRY captureUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glUniformMatrix4fv); c.put(location); c.put(count); c.put(transpose); c.putData(value, count * 16 * sizeof(GLfloat));
+        c.mRealUniformMatrix4fv(location, count, transpose, value);
+    }
+
+    static GLuint APIENTRY captureCreateShader(GLenum type)
+    {
+        GLCapture &c = get();
+        GLuint shader = c.mRealCreateShader(type);
+        c.begin(CAPTURE_glCreateShader); c.put(type); c.put(shader);
+        return shader;
+    }
+
+    // The strings are joined into one source
+    static void APIENTRY captureShaderSource(GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length)
+    {
+        GLCapture &c = get();
+        std::string source;
+        for (GLsizei i = 0; i < count; i++)
+            source.append(string[i], length && length[i] >= 0 ? (size_t) length[i] : strlen(string[i]));
+        c.begin(CAPTURE_glShaderSource); c.put(shader); c.putData(source.c_str(), source.size() + 1);
+        c.mRealShaderSource(shader, count, string, length);
+    }
+
+    static GLuint APIENTRY captureCreateProgram()
+    {
+        GLCapture &c = get();
+        GLuint program = c.mRealCreateProgram();
+        c.begin(CAPTURE_glCreateProgram); c.put(program);
+        return program;
+    }
+
+    static void APIENTRY captureAttachShader(GLuint program, GLuint shader)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glAttachShader); c.put(program); c.put(shader);
+        c.mRealAttachShader(program, shader);
+    }
+
+    static void APIENTRY captureGenBuffers(GLsizei n, GLuint *buffers) { GLCapture &c = get(); c.mRealGenBuffers(n, buffers); c.begin(CAPTURE_glGenBuffers); c.putNames(n, buffers); }
+    static void APIENTRY captureCreateBuffers(GLsizei n, GLuint *buffers) { GLCapture &c = get(); c.mRealCreateBuffers(n, buffers); c.begin(CAPTURE_glCreateBuffers); c.putNames(n, buffers); }
+    static void APIENTRY captureDeleteBuffers(GLsizei n, const GLuint *buffers) { GLCapture &c = get(); c.begin(CAPTURE_glDeleteBuffers); c.putNames(n, buffers); c.mRealDeleteBuffers(n, buffers); }
+    static void APIENTRY captureGenVertexArrays(GLsizei n, GLuint *arrays) { GLCapture &c = get(); c.mRealGenVertexArrays(n, arrays); c.begin(CAPTURE_glGenVertexArrays); c.putNames(n, arrays); }
+    static void APIENTRY captureCreateVertexArrays(GLsizei n, GLuint *arrays) { GLCapture &c = get(); c.mRealCreateVertexArrays(n, arrays); c.begin(CAPTURE_glCreateVertexArrays); c.putNames(n, arrays); }
+    static void APIENTRY captureDeleteVertexArrays(GLsizei n, const GLuint *arrays) { GLCapture &c = get(); c.begin(CAPTURE_glDeleteVertexArrays); c.putNames(n, arrays); c.mRealDeleteVertexArrays(n, arrays); }
+    static void APIENTRY captureGenTextures(GLsizei n, GLuint *textures) { GLCapture &c = get(); c.mRealGenTextures(n, textures); c.begin(CAPTURE_glGenTextures); c.putNames(n, textures); }
+    static void APIENTRY captureDeleteTextures(GLsizei n, const GLuint *textures) { GLCapture &c = get(); c.begin(CAPTURE_glDeleteTextures); c.putNames(n, textures); c.mRealDeleteTextures(n, textures); }
+    static void APIENTRY captureGenFramebuffers(GLsizei n, GLuint *framebuffers) { GLCapture &c = get(); c.mRealGenFramebuffers(n, framebuffers); c.begin(CAPTURE_glGenFramebuffers); c.putNames(n, framebuffers); }
+    static void APIENTRY captureCreateFramebuffers(GLsizei n, GLuint *framebuffers) { GLCapture &c = get(); c.mRealCreateFramebuffers(n, framebuffers); c.begin(CAPTURE_glCreateFramebuffers); c.putNames(n, framebuffers); }
+    static void APIENTRY captureDeleteFramebuffers(GLsizei n, const GLuint *framebuffers) { GLCapture &c = get(); c.begin(CAPTURE_glDeleteFramebuffers); c.putNames(n, framebuffers); c.mRealDeleteFramebuffers(n, framebuffers); }
+    static void APIENTRY captureGenRenderbuffers(GLsizei n, GLuint *renderbuffers) { GLCapture &c = get(); c.mRealGenRenderbuffers(n, renderbuffers); c.begin(CAPTURE_glGenRenderbuffers); c.putNames(n, renderbuffers); }
+    static void APIENTRY captureCreateRenderbuffers(GLsizei n, GLuint *renderbuffers) { GLCapture &c = get(); c.mRealCreateRenderbuffers(n, renderbuffers); c.begin(CAPTURE_glCreateRenderbuffers); c.putNames(n, renderbuffers); }
+    static void APIENTRY captureDeleteRenderbuffers(GLsizei n, const GLuint *renderbuffers) { GLCapture &c = get(); c.begin(CAPTURE_glDeleteRenderbuffers); c.putNames(n, renderbuffers); c.mRealDeleteRenderbuffers(n, renderbuffers); }
+
+    static void APIENTRY captureCreateTextures(GLenum target, GLsizei n, GLuint *textures)
+    {
+        GLCapture &c = get();
+        c.mRealCreateTextures(target, n, textures);
+        c.begin(CAPTURE_glCreateTextures); c.put(target); c.putNames(n, textures);
+    }
+
+    static void APIENTRY captureBindBuffer(GLenum target, GLuint buffer)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glBindBuffer); c.put(target); c.put(buffer);
+        c.mRealBindBuffer(target, buffer);
+    }
+
+    static void APIENTRY captureBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glBindBufferBase); c.put(target); c.put(index); c.put(buffer);
+        c.mRealBindBufferBase(target, index, buffer);
+    }
+
+    static void APIENTRY captureBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glBufferData); c.put(target); c.put<int64_t>(size); c.putData(data, size); c.put(usage);
+        c.mRealBufferData(target, size, data, usage);
+    }
+
+    static void APIENTRY captureNamedBufferStorage(GLuint buffer, GLsizeiptr size, const void *data, GLbitfield flags)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glNamedBufferStorage); c.put(buffer); c.put<int64_t>(size); c.putData(data, size); c.put(flags);
+        c.mRealNamedBufferStorage(buffer, size, data, flags);
+    }
+
+    static void APIENTRY captureVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glVertexAttribPointer); c.put(index); c.put(size); c.put(type); c.put(normalized); c.put(stride); c.put<uint64_t>((uintptr_t) pointer);
+        c.mRealVertexAttribPointer(index, size, type, normalized, stride, pointer);
+    }
+
+    static void APIENTRY captureBindTexture(GLenum target, GLuint texture)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glBindTexture); c.put(target); c.put(texture);
+        c.mRealBindTexture(target, texture);
+    }
+
+    static void APIENTRY captureBindTextureUnit(GLuint unit, GLuint texture)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glBindTextureUnit); c.put(unit); c.put(texture);
+        c.mRealBindTextureUnit(unit, texture);
+    }
+
+    static void APIENTRY captureTexParameteri(GLenum target, GLenum pname, GLint param)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glTexParameteri); c.put(target); c.put(pname); c.put(param);
+        c.mRealTexParameteri(target, pname, param);
+    }
+
+    static void APIENTRY captureTextureParameteri(GLuint texture, GLenum pname, GLint param)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glTextureParameteri); c.put(texture); c.put(pname); c.put(param);
+        c.mRealTextureParameteri(texture, pname, param);
+    }
+
+    static void APIENTRY captureTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border,
+                                           GLenum format, GLenum type, const void *pixels)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glTexImage2D); c.put(target); c.put(level); c.put(internalformat); c.put(width); c.put(height); c.put(border);
+        c.put(format); c.put(type); c.putData(pixels, captureImageSize(format, type, width, height, 1, c.mUnpackAlignment));
+        c.mRealTexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+    }
+
+    static void APIENTRY captureTexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth,
+                                           GLint border, GLenum format, GLenum type, const void *pixels)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glTexImage3D); c.put(target); c.put(level); c.put(internalformat); c.put(width); c.put(height); c.put(depth); c.put(border);
+        c.put(format); c.put(type); c.putData(pixels, captureImageSize(format, type, width, height, depth, c.mUnpackAlignment));
+        c.mRealTexImage3D(target, level, internalformat, width, height, depth, border, format, type, pixels);
+    }
+
+    static void APIENTRY captureTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+                                              GLenum format, GLenum type, const void *pixels)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glTexSubImage2D); c.put(target); c.put(level); c.put(xoffset); c.put(yoffset); c.put(width); c.put(height);
+        c.put(format); c.put(type); c.putData(pixels, captureImageSize(format, type, width, height, 1, c.mUnpackAlignment));
+        c.mRealTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+    }
+
+    static void APIENTRY captureTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width,
+                                              GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glTexSubImage3D); c.put(target); c.put(level); c.put(xoffset); c.put(yoffset); c.put(zoffset);
+        c.put(width); c.put(height); c.put(depth);
+        c.put(format); c.put(type); c.putData(pixels, captureImageSize(format, type, width, height, depth, c.mUnpackAlignment));
+        c.mRealTexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+    }
+
+    static void APIENTRY captureCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height,
+                                                     GLint border, GLsizei imageSize, const void *data)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glCompressedTexImage2D); c.put(target); c.put(level); c.put(internalformat); c.put(width); c.put(height);
+        c.put(border); c.put(imageSize); c.putData(data, imageSize);
+        c.mRealCompressedTexImage2D(target, level, internalformat, width, height, border, imageSize, data);
+    }
+
+    static void APIENTRY captureTextureStorage2D(GLuint texture, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glTextureStorage2D); c.put(texture); c.put(levels); c.put(internalformat); c.put(width); c.put(height);
+        c.mRealTextureStorage2D(texture, levels, internalformat, width, height);
+    }
+
+    static void APIENTRY captureTextureStorage3D(GLuint texture, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glTextureStorage3D); c.put(texture); c.put(levels); c.put(internalformat); c.put(width); c.put(height); c.put(depth);
+        c.mRealTextureStorage3D(texture, levels, internalformat, width, height, depth);
+    }
+
+    static void APIENTRY captureTextureSubImage3D(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width,
+                                                  GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glTextureSubImage3D); c.put(texture); c.put(level); c.put(xoffset); c.put(yoffset); c.put(zoffset);
+        c.put(width); c.put(height); c.put(depth);
+        c.put(format); c.put(type); c.putData(pixels, captureImageSize(format, type, width, height, depth, c.mUnpackAlignment));
+        c.mRealTextureSubImage3D(texture, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+    }
+
+    static void APIENTRY captureCompressedTextureSubImage3D(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLint zoffset,
+                                                            GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLsizei imageSize, const void *data)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glCompressedTextureSubImage3D); c.put(texture); c.put(level); c.put(xoffset); c.put(yoffset); c.put(zoffset);
+        c.put(width); c.put(height); c.put(depth); c.put(format); c.put(imageSize); c.putData(data, imageSize);
+        c.mRealCompressedTextureSubImage3D(texture, level, xoffset, yoffset, zoffset, width, height, depth, format, imageSize, data);
+    }
+
+    static void APIENTRY captureCopyImageSubData(GLuint srcName, GLenum srcTarget, GLint srcLevel, GLint srcX, GLint srcY, GLint srcZ,
+                                                 GLuint dstName, GLenum dstTarget, GLint dstLevel, GLint dstX, GLint dstY, GLint dstZ,
+                                                 GLsizei srcWidth, GLsizei srcHeight, GLsizei srcDepth)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glCopyImageSubData);
+        c.put(srcName); c.put(srcTarget); c.put(srcLevel); c.put(srcX); c.put(srcY); c.put(srcZ);
+        c.put(dstName); c.put(dstTarget); c.put(dstLevel); c.put(dstX); c.put(dstY); c.put(dstZ);
+        c.put(srcWidth); c.put(srcHeight); c.put(srcDepth);
+        c.mRealCopyImageSubData(srcName, srcTarget, srcLevel, srcX, srcY, srcZ, dstName, dstTarget, dstLevel, dstX, dstY, dstZ, srcWidth, srcHeight, srcDepth);
+    }
+
+    static void APIENTRY captureBindFramebuffer(GLenum target, GLuint framebuffer)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glBindFramebuffer); c.put(target); c.put(framebuffer);
+        c.mRealBindFramebuffer(target, framebuffer);
+    }
+
+    static void APIENTRY captureFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glFramebufferRenderbuffer); c.put(target); c.put(attachment); c.put(renderbuffertarget); c.put(renderbuffer);
+        c.mRealFramebufferRenderbuffer(target, attachment, renderbuffertarget, renderbuffer);
+    }
+
+    static void APIENTRY captureNamedFramebufferTexture(GLuint framebuffer, GLenum attachment, GLuint texture, GLint level)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glNamedFramebufferTexture); c.put(framebuffer); c.put(attachment); c.put(texture); c.put(level);
+        c.mRealNamedFramebufferTexture(framebuffer, attachment, texture, level);
+    }
+
+    static void APIENTRY captureNamedFramebufferTextureLayer(GLuint framebuffer, GLenum attachment, GLuint texture, GLint level, GLint layer)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glNamedFramebufferTextureLayer); c.put(framebuffer); c.put(attachment); c.put(texture); c.put(level); c.put(layer);
+        c.mRealNamedFramebufferTextureLayer(framebuffer, attachment, texture, level, layer);
+    }
+
+    static void APIENTRY captureNamedFramebufferRenderbuffer(GLuint framebuffer, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glNamedFramebufferRenderbuffer); c.put(framebuffer); c.put(attachment); c.put(renderbuffertarget); c.put(renderbuffer);
+        c.mRealNamedFramebufferRenderbuffer(framebuffer, attachment, renderbuffertarget, renderbuffer);
+    }
+
+    static void APIENTRY captureNamedFramebufferDrawBuffer(GLuint framebuffer, GLenum buf)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glNamedFramebufferDrawBuffer); c.put(framebuffer); c.put(buf);
+        c.mRealNamedFramebufferDrawBuffer(framebuffer, buf);
+    }
+
+    static void APIENTRY captureNamedFramebufferReadBuffer(GLuint framebuffer, GLenum src)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glNamedFramebufferReadBuffer); c.put(framebuffer); c.put(src);
+        c.mRealNamedFramebufferReadBuffer(framebuffer, src);
+    }
+
+    static void APIENTRY captureBindRenderbuffer(GLenum target, GLuint renderbuffer)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glBindRenderbuffer); c.put(target); c.put(renderbuffer);
+        c.mRealBindRenderbuffer(target, renderbuffer);
+    }
+
+    static void APIENTRY captureRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glRenderbufferStorage); c.put(target); c.put(internalformat); c.put(width); c.put(height);
+        c.mRealRenderbufferStorage(target, internalformat, width, height);
+    }
+
+    static void APIENTRY captureNamedRenderbufferStorage(GLuint renderbuffer, GLenum internalformat, GLsizei width, GLsizei height)
+    {
+        GLCapture &c = get();
+        c.begin(CAPTURE_glNamedRenderbufferStorage); c.put(renderbuffer); c.put(internalformat); c.put(width); c.put(height);
+        c.mRealNamedRenderbufferStorage(renderbuffer, internalformat, width, height);
+    }
+
+    // Puts the wrappers in place of the glad function pointers, or the other way round
+    void hook(bool install)
+    {
+#define GL_CAPTURE_HOOK(name)                  \
+        if (install)                           \
+        {                                      \
+            mReal##name = glad_gl##name;       \
+            glad_gl##name = capture##name;     \
+        }                                      \
+        else                                   \
+            glad_gl##name = mReal##name;
+        GL_CAPTURE_FUNCTIONS(GL_CAPTURE_HOOK)
+#undef GL_CAPTURE_HOOK
+    }
+
+public:
+    static GLCapture &get()
+    {
+        static GLCapture capture;
+        return capture;
+    }
+
+    // Records every captured GL call from now on, until the end of the given number of frames.
+    // The GL functions have to be loaded, and the framebuffer of the window is substituted by the replay.
+    void start(std::string path, unsigned int frames, int width, int height, unsigned int framebuffer)
+    {
+        if (mRecording)
+            return;
+
+        mPath = path;
+        mFrames = frames;
+        mHeader = {GL_CAPTURE_MAGIC, GL_CAPTURE_VERSION, width, height, framebuffer, 0};
+        mStream.clear();
+        mRecording = true;
+        hook(true);
+        printf("Capturing the GL calls of %u frames to %s\n", frames, path.c_str());
+    }
+
+    bool isRecording()
+    {
+        return mRecording;
+    }
+
+    // Marks the end of a frame. Stops and writes the capture after the last frame.
+    void endFrame()
+    {
+        if (!mRecording)
+            return;
+
+        begin(CAPTURE_FRAME);
+        mHeader.frames++;
+        if (mHeader.frames >= mFrames)
+            stop();
+    }
+
+    // Restores the GL functions and writes the frames captured so far
+    bool stop()
+    {
+        if (!mRecording)
+            return true;
+
+        hook(false);
+        mRecording = false;
+
+        std::ofstream fileStream(mPath.c_str(), std::ios::binary);
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not write " << mPath << std::endl;
+            return false;
+        }
+        fileStream.write((const char *) &mHeader, sizeof(mHeader));
+        fileStream.write((const char *) mStream.data(), mStream.size());
+        printf("Captured %u frames, %.2f MB of GL calls\n", mHeader.frames, mStream.size() / (1024.0 * 1024.0));
+
+        std::vector<uint8_t>().swap(mStream);
+        return true;
+    }
+};
+
+// Executes a stream written by GLCapture, one frame at a time. The GL functions have to be loaded.
+class GLReplay
+{
+private:
+    typedef enum name_type_e
+    {
+        NAME_BUFFER,
+        NAME_VERTEX_ARRAY,
+        NAME_TEXTURE,
+        NAME_FRAMEBUFFER,
+        NAME_RENDERBUFFER,
+        NAME_SHADER,
+        NAME_PROGRAM,
+        NAME_TYPE_COUNT
+    } name_type_e;
+
+    std::vector<uint8_t> mStream;
+    GLCaptureHeader mHeader = {};
+    size_t mPosition = 0;
+    std::vector<size_t> mFrameStarts;   // Of the frames replayed so far
+    unsigned int mFrame = 0;            // Next to replay
+    unsigned int mFramebuffer = 0;      // Replaces the framebuffer of the captured window
+
+    std::unordered_map<GLuint, GLuint> mNames[NAME_TYPE_COUNT];    // Captured name to replayed name
+    std::unordered_map<uint64_t, GLint> mLocations;                 // Captured program and location to replayed location
+    GLuint mProgram = 0;                                            // Captured name of the active program
+
+    template <typename T>
+    T get()
+    {
+        T value;
+        memcpy(&value, mStream.data() + mPosition, sizeof(T));
+        mPosition += sizeof(T);
+        return value;
+    }
+
+    const void *getData()
+    {
+        if (!get<uint8_t>())
+            return nullptr;
+        uint64_t size = get<uint64_t>();
+        const void *data = mStream.data() + mPosition;
+        mPosition += size;
+        return data;
+    }
+
+    GLuint name(name_type_e type, GLuint captured)
+    {
+        if (type == NAME_FRAMEBUFFER && captured == mHeader.framebuffer)
+            return mFramebuffer;
+        auto found = mNames[type].find(captured);
+        return found == mNames[type].end() ? captured : found->second;
+    }
+
+    GLuint name(name_type_e type)
+    {
+        return name(type, get<GLuint>());
+    }
+
+    // Maps the captured names of a glGen or glCreate call to the names just created
+    void addNames(name_type_e type, GLsizei count, const GLuint *created, const std::vector<GLuint> &captured)
+    {
+        for (GLsizei i = 0; i < count; i++)
+            mNames[type][captured[i]] = created[i];
+    }
+
+    std::vector<GLuint> getNames()
+    {
+        std::vector<GLuint> names(get<int32_t>());
+        for (GLuint &name : names)
+            name = get<GLuint>();
+        return names;
+    }
+
+    // Deletes the replayed objects of the captured names with the given function
+    template <typename F>
+    void deleteNames(name_type_e type, F function)
+    {
+        std::vector<GLuint> names = getNames();
+        for (GLuint &captured : names)
+        {
+            GLuint replayed = name(type, captured);
+            mNames[type].erase(captured);
+            captured = replayed;
+        }
+        function(names.size(), names.data());
+    }
+
+    template <typename F>
+    void createNames(name_type_e type, F function)
+    {
+        std::vector<GLuint> captured = getNames();
+        std::vector<GLuint> created(captured.size());
+        function(created.size(), created.data());
+        addNames(type, created.size(), created.data(), captured);
+    }
+
+    GLint location()
+    {
+        GLint captured = get<GLint>();
+        auto found = mLocations.find((uint64_t) mProgram << 32 | (uint32_t) captured);
+        return found == mLocations.end() ? captured : found->second;
+    }
+
+    name_type_e imageType(GLenum target)
+    {
+        return target == GL_RENDERBUFFER ? NAME_RENDERBUFFER : NAME_TEXTURE;
+    }
+
+    // Executes the command at the current position. Returns false at the end of a frame.
+    bool execute()
+    {
+        capture_op_e op = (capture_op_e) get<uint8_t>();
+        switch (op)
+        {
+        case CAPTURE_FRAME:
+            return false;
+        case CAPTURE_glEnable: glEnable(get<GLenum>()); break;
+        case CAPTURE_glDisable: glDisable(get<GLenum>()); break;
+        case CAPTURE_glDepthFunc: glDepthFunc(get<GLenum>()); break;
+        case CAPTURE_glClear: glClear(get<GLbitfield>()); break;
+        case CAPTURE_glStencilMask: glStencilMask(get<GLuint>()); break;
+        case CAPTURE_glCompileShader: glCompileShader(name(NAME_SHADER)); break;
+        case CAPTURE_glLinkProgram: glLinkProgram(name(NAME_PROGRAM)); break;
+        case CAPTURE_glBindVertexArray: glBindVertexArray(name(NAME_VERTEX_ARRAY)); break;
+        case CAPTURE_glEnableVertexAttribArray: glEnableVertexAttribArray(get<GLuint>()); break;
+        case CAPTURE_glGenerateMipmap: glGenerateMipmap(get<GLenum>()); break;
+        case CAPTURE_glGenerateTextureMipmap: glGenerateTextureMipmap(name(NAME_TEXTURE)); break;
+        case CAPTURE_glUseProgram:
+            mProgram = get<GLuint>();
+            glUseProgram(name(NAME_PROGRAM, mProgram));
+            break;
+        case CAPTURE_glDeleteShader:
+        {
+            GLuint captured = get<GLuint>();
+            glDeleteShader(name(NAME_SHADER, captured));
+            mNames[NAME_SHADER].erase(captured);
+            break;
+        }
+        case CAPTURE_glDeleteProgram:
+        {
+            GLuint captured = get<GLuint>();
+            glDeleteProgram(name(NAME_PROGRAM, captured));
+            mNames[NAME_PROGRAM].erase(captured);
+            break;
+        }
+        case CAPTURE_glBlendFunc:
+        {
+            GLenum sfactor = get<GLenum>();
+            glBlendFunc(sfactor, get<GLenum>());
+            break;
+        }
+        case CAPTURE_glClearColor:
+        {
+            GLfloat red = get<GLfloat>(), green = get<GLfloat>(), blue = get<GLfloat>();
+            glClearColor(red, green, blue, get<GLfloat>());
+            break;
+        }
+        case CAPTURE_glViewport:
+        {
+            GLint x = get<GLint>(), y = get<GLint>();
+            GLsizei width = get<GLsizei>();
+            glViewport(x, y, width, get<GLsizei>());
+            break;
+        }
+        case CAPTURE_glScissor:
+        {
+            GLint x = get<GLint>(), y = get<GLint>();
+            GLsizei width = get<GLsizei>();
+            glScissor(x, y, width, get<GLsizei>());
+            break;
+        }
+        case CAPTURE_glStencilOp:
+        {
+            GLenum fail = get<GLenum>(), zfail = get<GLenum>();
+            glStencilOp(fail, zfail, get<GLenum>());
+            break;
+        }
+        case CAPTURE_glStencilFunc:
+        {
+            GLenum func = get<GLenum>();
+            GLint ref = get<GLint>();
+            glStencilFunc(func, ref, get<GLuint>());
+            break;
+        }
+        case CAPTURE_glPixelStorei:
+        {
+            GLenum pname = get<GLenum>();
+            glPixelStorei(pname, get<GLint>());
+            break;
+        }
+        case CAPTURE_glDrawElements:
+        {
+            GLenum mode = get<GLenum>();
+            GLsizei count = get<GLsizei>();
+            GLenum type = get<GLenum>();
+            glDrawElements(mode, count, type, (const void *) (uintptr_t) get<uint64_t>());
+            break;
+        }
+        case CAPTURE_glDrawArrays:
+        {
+            GLenum mode = get<GLenum>();
+            GLint first = get<GLint>();
+            glDrawArrays(mode, first, get<GLsizei>());
+            break;
+        }
+        case CAPTURE_glGetUniformLocation:
+        {
+            GLuint program = get<GLuint>();
+            const GLchar *uniform = (const GLchar *) getData();
+            GLint captured = get<GLint>();
+            mLocations[(uint64_t) program << 32 | (uint32_t) captured] = glGetUniformLocation(name(NAME_PROGRAM, program), uniform);
+            break;
+        }
+        case CAPTURE_glUniform1i:
+        {
+            GLint uniform = location();
+            glUniform1i(uniform, get<GLint>());
+            break;
+        }
+        case CAPTURE_glUniform1f:
+        {
+            GLint uniform = location();
+            glUniform1f(uniform, get<GLfloat>());
+            break;
+        }
+        case CAPTURE_glUniform2f:
+        {
+            GLint uniform = location();
+            GLfloat v0 = get<GLfloat>();
+            glUniform2f(uniform, v0, get<GLfloat>());
+            break;
+        }
+        case CAPTURE_glUniform3fv:
+        {
+            GLint uniform = location();
+            GLsizei count = get<GLsizei>();
+            glUniform3fv(uniform, count, (const GLfloat *) getData());
+            break;
+        }
+        case CAPTURE_glUniformMatrix4fv:
+        {
+            GLint uniform = location();
+            GLsizei count = get<GLsizei>();
+            GLboolean transpose = get<GLboolean>();
+            glUniformMatrix4fv(uniform, count, transpose, (const GLfloat *) getData());
+            break;
+        }
+        case CAPTURE_glCreateShader:
+        {
+            GLenum type = get<GLenum>();
+            mNames[NAME_SHADER][get<GLuint>()] = glCreateShader(type);
+            break;
+        }
+        case CAPTURE_glShaderSource:
+        {
+            GLuint shader = name(NAME_SHADER);
+            const GLchar *source = (const GLchar *) getData();
+            glShaderSource(shader, 1, &source, nullptr);
+            break;
+        }
+        case CAPTURE_glCreateProgram:
+            mNames[NAME_PROGRAM][get<GLuint>()] = glCreateProgram();
+            break;
+        case CAPTURE_glAttachShader:
+        {
+            GLuint program = name(NAME_PROGRAM);
+            glAttachShader(program, name(NAME_SHADER));
+            break;
+        }
+        case CAPTURE_glGenBuffers: createNames(NAME_BUFFER, glGenBuffers); break;
+        case CAPTURE_glCreateBuffers: createNames(NAME_BUFFER, glCreateBuffers); break;
+        case CAPTURE_glDeleteBuffers: deleteNames(NAME_BUFFER, glDeleteBuffers); break;
+        case CAPTURE_glGenVertexArrays: createNames(NAME_VERTEX_ARRAY, glGenVertexArrays); break;
+        case CAPTURE_glCreateVertexArrays: createNames(NAME_VERTEX_ARRAY, glCreateVertexArrays); break;
+        case CAPTURE_glDeleteVertexArrays: deleteNames(NAME_VERTEX_ARRAY, glDeleteVertexArrays); break;
+        case CAPTURE_glGenTextures: createNames(NAME_TEXTURE, glGenTextures); break;
+        case CAPTURE_glDeleteTextures: deleteNames(NAME_TEXTURE, glDeleteTextures); break;
+        case CAPTURE_glGenFramebuffers: createNames(NAME_FRAMEBUFFER, glGenFramebuffers); break;
+        case CAPTURE_glCreateFramebuffers: createNames(NAME_FRAMEBUFFER, glCreateFramebuffers); break;
+        case CAPTURE_glDeleteFramebuffers: deleteNames(NAME_FRAMEBUFFER, glDeleteFramebuffers); break;
+        case CAPTURE_glGenRenderbuffers: createNames(NAME_RENDERBUFFER, glGenRenderbuffers); break;
+        case CAPTURE_glCreateRenderbuffers: createNames(NAME_RENDERBUFFER, glCreateRenderbuffers); break;
+        case CAPTURE_glDeleteRenderbuffers: deleteNames(NAME_RENDERBUFFER, glDeleteRenderbuffers); break;
+        case CAPTURE_glCreateTextures:
+        {
+            GLenum target = get<GLenum>();
+            createNames(NAME_TEXTURE, [target](GLsizei n, GLuint *textures) { glCreateTextures(target, n, textures); });
+            break;
+        }
+        case CAPTURE_glBindBuffer:
+        {
+            GLenum target = get<GLenum>();
+            glBindBuffer(target, name(NAME_BUFFER));
+            break;
+        }
+        case CAPTURE_glBindBufferBase:
+        {
+            GLenum target = get<GLenum>();
+            GLuint index = get<GLuint>();
+            glBindBufferBase(target, index, name(NAME_BUFFER));
+            break;
+        }
+        case CAPTURE_glBufferData:
+        {
+            GLenum target = get<GLenum>();
+            GLsizeiptr size = get<int64_t>();
+            const void *data = getData();
+            glBufferData(target, size, data, get<GLenum>());
+            break;
+        }
+        case CAPTURE_glNamedBufferStorage:
+        {
+            GLuint buffer = name(NAME_BUFFER);
+            GLsizeiptr size = get<int64_t>();
+            const void *data = getData();
+            glNamedBufferStorage(buffer, size, data, get<GLbitfield>());
+            break;
+        }
+        case CAPTURE_glVertexAttribPointer:
+        {
+            GLuint index = get<GLuint>();
+            GLint size = get<GLint>();
+            GLenum type = get<GLenum>();
+            GLboolean normalized = get<GLboolean>();
+            GLsizei stride = get<GLsizei>();
+            glVertexAttribPointer(index, size, type, normalized, stride, (const void *) (uintptr_t) get<uint64_t>());
+            break;
+        }
+        case CAPTURE_glBindTexture:
+        {
+            GLenum target = get<GLenum>();
+            glBindTexture(target, name(NAME_TEXTURE));
+            break;
+        }
+        case CAPTURE_glBindTextureUnit:
+        {
+            GLuint unit = get<GLuint>();
+            glBindTextureUnit(unit, name(NAME_TEXTURE));
+            break;
+        }
+        case CAPTURE_glTexParameteri:
+        {
+            GLenum target = get<GLenum>(), pname = get<GLenum>();
+            glTexParameteri(target, pname, get<GLint>());
+            break;
+        }
+        case CAPTURE_glTextureParameteri:
+        {
+            GLuint texture = name(NAME_TEXTURE);
+            GLenum pname = get<GLenum>();
+            glTextureParameteri(texture, pname, get<GLint>());
+            break;
+        }
+        case CAPTURE_glTexImage2D:
+        {
+            GLenum target = get<GLenum>();
+            GLint level = get<GLint>(), internalformat = get<GLint>();
+            GLsizei width = get<GLsizei>(), height = get<GLsizei>();
+            GLint border = get<GLint>();
+            GLenum format = get<GLenum>(), type = get<GLenum>();
+            glTexImage2D(target, level, internalformat, width, height, border, format, type, getData());
+            break;
+        }
+        case CAPTURE_glTexImage3D:
+        {
+            GLenum target = get<GLenum>();
+            GLint level = get<GLint>(), internalformat = get<GLint>();
+            GLsizei width = get<GLsizei>(), height = get<GLsizei>(), depth = get<GLsizei>();
+            GLint border = get<GLint>();
+            GLenum format = get<GLenum>(), type = get<GLenum>();
+            glTexImage3D(target, level, internalformat, width, height, depth, border, format, type, getData());
+            break;
+        }
+        case CAPTURE_glTexSubImage2D:
+        {
+            GLenum target = get<GLenum>();
+            GLint level = get<GLint>(), xoffset = get<GLint>(), yoffset = get<GLint>();
+            GLsizei width = get<GLsizei>(), height = get<GLsizei>();
+            GLenum format = get<GLenum>(), type = get<GLenum>();
+            glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, getData());
+            break;
+        }
+        case CAPTURE_glTexSubImage3D:
+        {
+            GLenum target = get<GLenum>();
+            GLint level = get<GLint>(), xoffset = get<GLint>(), yoffset = get<GLint>(), zoffset = get<GLint>();
+            GLsizei width = get<GLsizei>(), height = get<GLsizei>(), depth = get<GLsizei>();
+            GLenum format = get<GLenum>(), type = get<GLenum>();
+            glTexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, getData());
+            break;
+        }
+        case CAPTURE_glCompressedTexImage2D:
+        {
+            GLenum target = get<GLenum>();
+            GLint level = get<GLint>();
+            GLenum internalformat = get<GLenum>();
+            GLsizei width = get<GLsizei>(), height = get<GLsizei>();
+            GLint border = get<GLint>();
+            GLsizei imageSize = get<GLsizei>();
+            glCompressedTexImage2D(target, level, internalformat, width, height, border, imageSize, getData());
+            break;
+        }
+        case CAPTURE_glTextureStorage2D:
+        {
+            GLuint texture = name(NAME_TEXTURE);
+            GLsizei levels = get<GLsizei>();
+            GLenum internalformat = get<GLenum>();
+            GLsizei width = get<GLsizei>();
+            glTextureStorage2D(texture, levels, internalformat, width, get<GLsizei>());
+            break;
+        }
+        case CAPTURE_glTextureStorage3D:
+        {
+            GLuint texture = name(NAME_TEXTURE);
+            GLsizei levels = get<GLsizei>();
+            GLenum internalformat = get<GLenum>();
+            GLsizei width = get<GLsizei>(), height = get<GLsizei>();
+            glTextureStorage3D(texture, levels, internalformat, width, height, get<GLsizei>());
+            break;
+        }
+        case CAPTURE_glTextureSubImage3D:
+        {
+            GLuint texture = name(NAME_TEXTURE);
+            GLint level = get<GLint>(), xoffset = get<GLint>(), yoffset = get<GLint>(), zoffset = get<GLint>();
+            GLsizei width = get<GLsizei>(), height = get<GLsizei>(), depth = get<GLsizei>();
+            GLenum format = get<GLenum>(), type = get<GLenum>();
+            glTextureSubImage3D(texture, level, xoffset, yoffset, zoffset, width, height, depth, format, type, getData());
+            break;
+        }
+        case CAPTURE_glCompressedTextureSubImage3D:
+        {
+            GLuint texture = name(NAME_TEXTURE);
+            GLint level = get<GLint>(), xoffset = get<GLint>(), yoffset = get<GLint>(), zoffset = get<GLint>();
+            GLsizei width = get<GLsizei>(), height = get<GLsizei>(), depth = get<GLsizei>();
+            GLenum format = get<GLenum>();
+            GLsizei imageSize = get<GLsizei>();
+            glCompressedTextureSubImage3D(texture, level, xoffset, yoffset, zoffset, width, height, depth, format, imageSize, getData());
+            break;
+        }
+        case CAPTURE_glCopyImageSubData:
+        {
+            GLuint srcName = get<GLuint>();
+            GLenum srcTarget = get<GLenum>();
+            GLint srcLevel = get<GLint>(), srcX = get<GLint>(), srcY = get<GLint>(), srcZ = get<GLint>();
+            GLuint dstName = get<GLuint>();
+            GLenum dstTarget = get<GLenum>();
+            GLint dstLevel = get<GLint>(), dstX = get<GLint>(), dstY = get<GLint>(), dstZ = get<GLint>();
+            GLsizei width = get<GLsizei>(), height = get<GLsizei>(), depth = get<GLsizei>();
+            glCopyImageSubData(name(imageType(srcTarget), srcName), srcTarget, srcLevel, srcX, srcY, srcZ,
+                               name(imageType(dstTarget), dstName), dstTarget, dstLevel, dstX, dstY, dstZ, width, height, depth);
+            break;
+        }
+        case CAPTURE_glBindFramebuffer:
+        {
+            GLenum target = get<GLenum>();
+            glBindFramebuffer(target, name(NAME_FRAMEBUFFER));
+            break;
+        }
+        case CAPTURE_glFramebufferRenderbuffer:
+        {
+            GLenum target = get<GLenum>(), attachment = get<GLenum>(), renderbuffertarget = get<GLenum>();
+            glFramebufferRenderbuffer(target, attachment, renderbuffertarget, name(NAME_RENDERBUFFER));
+            break;
+        }
+        case CAPTURE_glNamedFramebufferTexture:
+        {
+            GLuint framebuffer = name(NAME_FRAMEBUFFER);
+            GLenum attachment = get<GLenum>();
+            GLuint texture = name(NAME_TEXTURE);
+            glNamedFramebufferTexture(framebuffer, attachment, texture, get<GLint>());
+            break;
+        }
+        case CAPTURE_glNamedFramebufferTextureLayer:
+        {
+            GLuint framebuffer = name(NAME_FRAMEBUFFER);
+            GLenum attachment = get<GLenum>();
+            GLuint texture = name(NAME_TEXTURE);
+            GLint level = get<GLint>();
+            glNamedFramebufferTextureLayer(framebuffer, attachment, texture, level, get<GLint>());
+            break;
+        }
+        case CAPTURE_glNamedFramebufferRenderbuffer:
+        {
+            GLuint framebuffer = name(NAME_FRAMEBUFFER);
+            GLenum attachment = get<GLenum>(), renderbuffertarget = get<GLenum>();
+            glNamedFramebufferRenderbuffer(framebuffer, attachment, renderbuffertarget, name(NAME_RENDERBUFFER));
+            break;
+        }
+        case CAPTURE_glNamedFramebufferDrawBuffer:
+        {
+            GLuint framebuffer = name(NAME_FRAMEBUFFER);
+            glNamedFramebufferDrawBuffer(framebuffer, get<GLenum>());
+            break;
+        }
+        case CAPTURE_glNamedFramebufferReadBuffer:
+        {
+            GLuint framebuffer = name(NAME_FRAMEBUFFER);
+            glNamedFramebufferReadBuffer(framebuffer, get<GLenum>());
+            break;
+        }
+        case CAPTURE_glBindRenderbuffer:
+        {
+            GLenum target = get<GLenum>();
+            glBindRenderbuffer(target, name(NAME_RENDERBUFFER));
+            break;
+        }
+        case CAPTURE_glRenderbufferStorage:
+        {
+            GLenum target = get<GLenum>(), internalformat = get<GLenum>();
+            GLsizei width = get<GLsizei>();
+            glRenderbufferStorage(target, internalformat, width, get<GLsizei>());
+            break;
+        }
+        case CAPTURE_glNamedRenderbufferStorage:
+        {
+            GLuint renderbuffer = name(NAME_RENDERBUFFER);
+            GLenum internalformat = get<GLenum>();
+            GLsizei width = get<GLsizei>();
+            glNamedRenderbufferStorage(renderbuffer, internalformat, width, get<GLsizei>());
+            break;
+        }
+        default:
+            std::cerr << "Error: Unknown GL capture command " << (int) op << std::endl;
+            mPosition = mStream.size();
+            return false;
+        }
+        return true;
+    }
+
+public:
+    bool open(std::string path)
+    {
+        std::ifstream fileStream(path.c_str(), std::ios::binary);
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not load " << path << std::endl;
+            return false;
+        }
+
+        fileStream.read((char *) &mHeader, sizeof(mHeader));
+        if (!fileStream || mHeader.magic != GL_CAPTURE_MAGIC || mHeader.version != GL_CAPTURE_VERSION)
+        {
+            std::cerr << "Error: " << path << " is not a GL capture" << std::endl;
+            return false;
+        }
+        mStream.assign(std::istreambuf_iterator<char>(fileStream), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    int getWidth()
+    {
+        return mHeader.width;
+    }
+
+    int getHeight()
+    {
+        return mHeader.height;
+    }
+
+    unsigned int getFrames()
+    {
+        return mHeader.frames;
+    }
+
+    size_t getBytes()
+    {
+        return mStream.size();
+    }
+
+    // The framebuffer drawn to in place of the framebuffer of the captured window
+    void setFramebuffer(unsigned int framebuffer)
+    {
+        mFramebuffer = framebuffer;
+    }
+
+    // Executes the next frame. The first frame also executes the startup before it, which creates the resources.
+    // Returns false when there are no more frames.
+    bool replayFrame()
+    {
+        if (mFrame >= mHeader.frames)
+            return false;
+        if (mFrame == mFrameStarts.size())
+            mFrameStarts.push_back(mPosition);
+
+        while (mPosition < mStream.size() && execute())
+        {
+        }
+        mFrame++;
+        return true;
+    }
+
+    // Continues at a frame that was replayed before. The state it starts from is whatever the frame before it left.
+    void seek(unsigned int frame)
+    {
+        if (frame >= mFrameStarts.size())
+            return;
+        mFrame = frame;
+        mPosition = mFrameStarts[frame];
+    }
+
+    // Deletes every object the replay created which the stream did not delete
+    void destroy()
+    {
+        for (auto &entry : mNames[NAME_BUFFER]) glDeleteBuffers(1, &entry.second);
+        for (auto &entry : mNames[NAME_VERTEX_ARRAY]) glDeleteVertexArrays(1, &entry.second);
+        for (auto &entry : mNames[NAME_TEXTURE]) glDeleteTextures(1, &entry.second);
+        for (auto &entry : mNames[NAME_FRAMEBUFFER]) glDeleteFramebuffers(1, &entry.second);
+        for (auto &entry : mNames[NAME_RENDERBUFFER]) glDeleteRenderbuffers(1, &entry.second);
+        for (auto &entry : mNames[NAME_SHADER]) glDeleteShader(entry.second);
+        for (auto &entry : mNames[NAME_PROGRAM]) glDeleteProgram(entry.second);
+        for (auto &names : mNames)
+            names.clear();
+    }
+};
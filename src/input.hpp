@@ -0,0 +1,393 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define INPUT_MAX_KEYS 512
+#define INPUT_MAX_BUTTONS 16
+
+#define INPUT_RECORDING_MAGIC 0x504e4950 // "PINP"
+#define INPUT_RECORDING_VERSION 1
+
+typedef struct MousePosition
+{
+	double x;
+	double y;
+} MousePosition;
+
+typedef enum input_event_e
+{
+	INPUT_KEY = 0,
+	INPUT_MOUSE_BUTTON = 1,
+	INPUT_CURSOR = 2
+} input_event_e;
+
+typedef struct InputEvent
+{
+	uint8_t type;
+	int code;       // Key or mouse button
+	int action;     // GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+	double x;       // Cursor position
+	double y;
+} InputEvent;
+
+// The input of one frame. Plain data, so it can be copied to the simulation thread.
+typedef struct InputState
+{
+	bool keyDown[INPUT_MAX_KEYS];
+	bool keyPressed[INPUT_MAX_KEYS];
+	bool mouseDown[INPUT_MAX_BUTTONS];
+	bool mousePressed[INPUT_MAX_BUTTONS];
+	MousePosition mousePosition;
+	MousePosition mouseDelta;
+	double time;
+
+	bool isKeyDown(int key) const
+	{
+		if (key < 0 || key >= INPUT_MAX_KEYS) return false;
+		return keyDown[key];
+	}
+
+	bool isKeyPressed(int key) const
+	{
+		if (key < 0 || key >= INPUT_MAX_KEYS) return false;
+		return keyPressed[key];
+	}
+
+	bool isMouseButtonDown(int button) const
+	{
+		if (button < 0 || button >= INPUT_MAX_BUTTONS) return false;
+		return mouseDown[button];
+	}
+
+	bool isMouseButtonPressed(int button) const
+	{
+		if (button < 0 || button >= INPUT_MAX_BUTTONS) return false;
+		return mousePressed[button];
+	}
+} InputState;
+
+// Writes the input of every frame to a compact binary file.
+// Each frame is [varint time delta in us][varint event count][events], where key and button
+// events are [type][varint code][action] and cursor events are [type][double x][double y].
+class InputRecorder
+{
+private:
+	std::ofstream mFileStream;
+	int64_t mPrevTime = 0;
+
+	void writeVarint(uint64_t value)
+	{
+		do
+		{
+			uint8_t byte = value & 0x7f;
+			value >>= 7;
+			if (value) byte |= 0x80;
+			mFileStream.put(byte);
+		} while (value);
+	}
+
+public:
+	bool open(std::string path)
+	{
+		mFileStream.open(path.c_str(), std::ios::binary);
+		if (!mFileStream)
+		{
+			std::cerr << "Error: Could not write " << path << std::endl;
+			return false;
+		}
+
+		uint32_t header[2] = {INPUT_RECORDING_MAGIC, INPUT_RECORDING_VERSION};
+		mFileStream.write((const char *) header, sizeof(header));
+		return true;
+	}
+
+	void writeFrame(int64_t timeMicros, const std::vector<InputEvent> &events)
+	{
+		writeVarint(timeMicros - mPrevTime);
+		writeVarint(events.size());
+		mPrevTime = timeMicros;
+
+		for (const InputEvent &event : events)
+		{
+			mFileStream.put(event.type);
+			if (event.type == INPUT_CURSOR)
+			{
+				mFileStream.write((const char *) &event.x, sizeof(double));
+				mFileStream.write((const char *) &event.y, sizeof(double));
+			}
+			else
+			{
+				writeVarint(event.code);
+				mFileStream.put((char) event.action);
+			}
+		}
+	}
+
+	void close()
+	{
+		mFileStream.close();
+	}
+};
+
+// Reads a recording written by InputRecorder back, one frame at a time
+class InputReplayer
+{
+private:
+	std::ifstream mFileStream;
+	std::string mPath;
+	uint64_t mSize = 0;
+	int64_t mTime = 0;
+	unsigned long mFrames = 0;
+
+	bool readVarint(uint64_t &value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			int byte = mFileStream.get();
+			if (byte == EOF)
+				return false;
+			value |= (uint64_t) (byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+public:
+	bool open(std::string path)
+	{
+		mFileStream.open(path.c_str(), std::ios::binary | std::ios::ate);
+		if (!mFileStream)
+		{
+			std::cerr << "Error: Could not load " << path << std::endl;
+			return false;
+		}
+		mPath = path;
+		mSize = (uint64_t) mFileStream.tellg();
+		mFileStream.seekg(0);
+
+		uint32_t header[2];
+		mFileStream.read((char *) header, sizeof(header));
+		if (!mFileStream || header[0] != INPUT_RECORDING_MAGIC || header[1] != INPUT_RECORDING_VERSION)
+		{
+			std::cerr << "Error: " << path << " is not an input recording" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Reads the next frame. Returns false at the end of the recording.
+	bool readFrame(int64_t &outTimeMicros, std::vector<InputEvent> &outEvents)
+	{
+		uint64_t delta, count;
+		if (!readVarint(delta) || !readVarint(count))
+			return false;
+
+		// The smallest event is a key or button with a one byte code: [type][code][action]
+		uint64_t remaining = mSize - std::min(mSize, (uint64_t) mFileStream.tellg());
+		if (count > remaining / 3)
+		{
+			std::cerr << "Error: Frame " << mFrames << " of " << mPath << " has more events than the file holds" << std::endl;
+			return false;
+		}
+
+		mTime += delta;
+		outTimeMicros = mTime;
+		outEvents.clear();
+
+		for (uint64_t i = 0; i < count && mFileStream; i++)
+		{
+			InputEvent event = {};
+			event.type = mFileStream.get();
+			if (event.type == INPUT_CURSOR)
+			{
+				mFileStream.read((char *) &event.x, sizeof(double));
+				mFileStream.read((char *) &event.y, sizeof(double));
+			}
+			else
+			{
+				uint64_t code;
+				if (!readVarint(code))
+					break;
+				event.code = (int) code;
+				event.action = mFileStream.get();
+			}
+			outEvents.push_back(event);
+		}
+
+		if (!mFileStream || outEvents.size() != count)
+		{
+			std::cerr << "Error: " << mPath << " ends in the middle of frame " << mFrames << std::endl;
+			return false;
+		}
+
+		mFrames++;
+		return true;
+	}
+
+	unsigned long getFrames()
+	{
+		return mFrames;
+	}
+};
+
+// Input state built from a queue of events. The window pushes events as they arrive, and beginFrame()
+// applies all events since the previous frame. Events come either from the window or from a replayed recording.
+class Input
+{
+private:
+	InputState mState = {};
+
+	std::vector<InputEvent> mQueue;         // Events received since the last frame
+	std::vector<InputEvent> mFrameEvents;   // Events applied this frame
+	int64_t mTimeMicros = 0;
+
+	InputRecorder *mRecorder = nullptr;
+	InputReplayer *mReplayer = nullptr;
+
+	void clearPressed()
+	{
+		// Only the states pressed last frame have to be cleared
+		for (const InputEvent &event : mFrameEvents)
+		{
+			if (event.type == INPUT_KEY && event.code >= 0 && event.code < INPUT_MAX_KEYS)
+				mState.keyPressed[event.code] = false;
+			if (event.type == INPUT_MOUSE_BUTTON && event.code >= 0 && event.code < INPUT_MAX_BUTTONS)
+				mState.mousePressed[event.code] = false;
+		}
+	}
+
+	void applyEvents(const std::vector<InputEvent> &events)
+	{
+		MousePosition prevPosition = mState.mousePosition;
+		for (const InputEvent &event : events)
+		{
+			if (event.type == INPUT_CURSOR)
+			{
+				mState.mousePosition = {event.x, event.y};
+				continue;
+			}
+
+			if (event.action != 1 && event.action != 0) // Ignore repeats (GLFW_REPEAT)
+				continue;
+
+			bool down = event.action == 1;
+			if (event.type == INPUT_KEY && event.code >= 0 && event.code < INPUT_MAX_KEYS)
+			{
+				mState.keyPressed[event.code] |= down && !mState.keyDown[event.code];
+				mState.keyDown[event.code] = down;
+			}
+			else if (event.type == INPUT_MOUSE_BUTTON && event.code >= 0 && event.code < INPUT_MAX_BUTTONS)
+			{
+				mState.mousePressed[event.code] |= down && !mState.mouseDown[event.code];
+				mState.mouseDown[event.code] = down;
+			}
+		}
+		mState.mouseDelta = {mState.mousePosition.x - prevPosition.x, mState.mousePosition.y - prevPosition.y};
+	}
+
+public:
+	void push(const InputEvent &event)
+	{
+		mQueue.push_back(event);
+	}
+
+	void record(InputRecorder *recorder)
+	{
+		mRecorder = recorder;
+	}
+
+	void replay(InputReplayer *replayer)
+	{
+		mReplayer = replayer;
+	}
+
+	bool isReplaying()
+	{
+		return mReplayer != nullptr;
+	}
+
+	// Applies the events of a new frame. realTime is the current time in seconds, which is replaced by
+	// the recorded time during a replay. Returns false when a replay has run out of frames.
+	bool beginFrame(double realTime)
+	{
+		clearPressed();
+
+		if (mReplayer)
+		{
+			mQueue.clear();
+			if (!mReplayer->readFrame(mTimeMicros, mFrameEvents))
+			{
+				mFrameEvents.clear();
+				return false;
+			}
+		}
+		else
+		{
+			mTimeMicros = (int64_t) (realTime * 1e6);
+			mFrameEvents.swap(mQueue);
+			mQueue.clear();
+			if (mRecorder)
+				mRecorder->writeFrame(mTimeMicros, mFrameEvents);
+		}
+
+		applyEvents(mFrameEvents);
+		mState.time = getTime();
+		return true;
+	}
+
+	// Time of the current frame, quantized to microseconds so recorded and replayed runs see the same values
+	double getTime()
+	{
+		return mTimeMicros / 1e6;
+	}
+
+	const std::vector<InputEvent> &getEvents()
+	{
+		return mFrameEvents;
+	}
+
+	// State of the current frame
+	const InputState &getState()
+	{
+		return mState;
+	}
+
+	bool isKeyDown(int key)
+	{
+		return mState.isKeyDown(key);
+	}
+
+	bool isKeyPressed(int key)
+	{
+		return mState.isKeyPressed(key);
+	}
+
+	bool isMouseButtonDown(int button)
+	{
+		return mState.isMouseButtonDown(button);
+	}
+
+	bool isMouseButtonPressed(int button)
+	{
+		return mState.isMouseButtonPressed(button);
+	}
+
+	MousePosition getMousePosition()
+	{
+		return mState.mousePosition;
+	}
+
+	MousePosition getMouseDelta()
+	{
+		return mState.mouseDelta;
+	}
+};
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <profiler.hpp>
+#include <allocations.hpp>
+
+// Threads that are not workers (the main and simulation threads) get their own queue when they first submit jobs
+#define JOB_EXTERNAL_THREADS 4
+// Initial capacity of every queue, more than the batches of a parallelFor()
+#define JOB_QUEUE_CAPACITY 64
+
+// Counts the unfinished jobs of a batch. wait() returns once it reaches zero.
+typedef struct JobCounter
+{
+    std::atomic<int> count{0};
+} JobCounter;
+
+// Work stealing job scheduler. Every thread pushes and pops jobs at the back of its own deque, so nested
+// jobs stay on the thread that created them, and idle threads steal the oldest (largest) jobs from the front
+// of the other deques. A thread waiting for a counter runs jobs instead of blocking, so jobs can wait for jobs.
+// The deques are ring buffers which only grow, and parallelFor() queues its batches without wrapping them in
+// a std::function, so scheduling jobs does not allocate once the queues are large enough.
+class JobSystem
+{
+private:
+    typedef struct Job
+    {
+        const char *name;
+        std::function<void()> function;                 // Of jobs queued with run()
+        void (*range)(const void *, size_t, size_t);    // Of parallelFor() batches, called as range(context, begin, end)
+        const void *context;
+        size_t begin;
+        size_t end;
+        JobCounter *counter;
+    } Job;
+
+    typedef struct Queue
+    {
+        std::mutex mutex;
+        std::vector<Job> jobs = std::vector<Job>(JOB_QUEUE_CAPACITY);   // Ring buffer
+        size_t head = 0;                                                // The oldest job
+        size_t count = 0;
+    } Queue;
+
+    std::vector<std::unique_ptr<Queue>> mQueues;
+    std::vector<std::thread> mWorkers;
+    std::atomic<int> mExternalThreads{0};
+    std::atomic<int> mQueued{0};
+    std::atomic<bool> mStop{false};
+    std::mutex mSleepMutex;
+    std::condition_variable mSleepCondition;
+
+    // The queue of the calling thread. Workers own theirs from the start, other threads are assigned one on first use.
+    // The owner is the id of the job system rather than its address, which a later job system can reuse.
+    inline static std::atomic<uint64_t> sNextId{1};
+    inline static thread_local uint64_t tOwner = 0;
+    inline static thread_local int tQueue = 0;
+    const uint64_t mId = sNextId++;
+
+    int queueIndex()
+    {
+        if (tOwner != mId)
+        {
+            tOwner = mId;
+            tQueue = mWorkers.size() + mExternalThreads++ % JOB_EXTERNAL_THREADS;
+        }
+        return tQueue;
+    }
+
+    template <typename Function>
+    static void invokeRange(const void *context, size_t begin, size_t end)
+    {
+        (*(const Function *) context)(begin, end);
+    }
+
+    void push(int queue, Job &&job)
+    {
+        {
+            Queue &q = *mQueues[queue];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.count == q.jobs.size())
+            {
+                std::vector<Job> jobs(q.jobs.size() * 2);
+                for (size_t i = 0; i < q.count; i++)
+                    jobs[i] = std::move(q.jobs[(q.head + i) % q.jobs.size()]);
+                q.jobs.swap(jobs);
+                q.head = 0;
+            }
+            q.jobs[(q.head + q.count++) % q.jobs.size()] = std::move(job);
+        }
+        {
+            // Counted under the sleep mutex, so a worker cannot miss the wake up between checking and sleeping
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+            mQueued++;
+        }
+        mSleepCondition.notify_one();
+    }
+
+    // Pops the newest job of the own queue, or steals the oldest job of another queue
+    bool pop(int queue, Job &outJob)
+    {
+        if (mQueued.load() == 0)
+            return false;
+
+        for (size_t i = 0; i < mQueues.size(); i++)
+        {
+            size_t victim = (queue + i) % mQueues.size();
+            Queue &q = *mQueues[victim];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.count == 0)
+                continue;
+
+            if (i == 0)
+            {
+                outJob = std::move(q.jobs[(q.head + q.count - 1) % q.jobs.size()]);
+            }
+            else
+            {
+                outJob = std::move(q.jobs[q.head]);
+                q.head = (q.head + 1) % q.jobs.size();
+            }
+            q.count--;
+            mQueued--;
+            return true;
+        }
+        return false;
+    }
+
+    void execute(Job &job)
+    {
+        {
+            PROFILE_ZONE(job.name);
+            if (job.range)
+                job.range(job.context, job.begin, job.end);
+            else
+                job.function();
+        }
+        job.function = nullptr;
+        job.counter->count--;
+    }
+
+    void workerLoop(int queue)
+    {
+        // Jobs created inside jobs go to the worker's own deque
+        tOwner = mId;
+        tQueue = queue;
+        AllocationTracker::trackThread();
+
+        Job job;
+        while (!mStop)
+        {
+            if (pop(queue, job))
+            {
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mSleepMutex);
+            mSleepCondition.wait(lock, [this] { return mQueued.load() > 0 || mStop; });
+        }
+    }
+
+public:
+    // threads includes the calling thread, which runs jobs while it waits
+    JobSystem(unsigned int threads = std::thread::hardware_concurrency())
+    {
+        unsigned int workers = std::max(1u, threads) - 1;
+        for (unsigned int i = 0; i < workers + JOB_EXTERNAL_THREADS; i++)
+            mQueues.push_back(std::unique_ptr<Queue>(new Queue()));
+
+        for (unsigned int i = 0; i < workers; i++)
+            mWorkers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+            mStop = true;
+        }
+        mSleepCondition.notify_all();
+        for (std::thread &worker : mWorkers)
+            worker.join();
+    }
+
+    unsigned int getThreads()
+    {
+        return mWorkers.size() + 1;
+    }
+
+    // Queues a job. The name shows up as a zone in the profiler.
+    void run(const char *name, std::function<void()> function, JobCounter &counter)
+    {
+        counter.count++;
+        push(queueIndex(), {name, std::move(function), nullptr, nullptr, 0, 0, &counter});
+    }
+
+    // Runs one queued job on the calling thread. Returns false if there was none.
+    bool runOne()
+    {
+        Job job;
+        if (!pop(queueIndex(), job))
+            return false;
+        execute(job);
+        return true;
+    }
+
+    // Runs other jobs until every job of the counter is finished
+    void wait(JobCounter &counter)
+    {
+        int queue = queueIndex();
+        Job job;
+        while (counter.count.load() > 0)
+        {
+            if (pop(queue, job))
+                execute(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // Calls function(begin, end) over [0, count) in batches of at least grain elements, and returns when all are done.
+    // Small ranges run directly on the calling thread. The batches refer to function, which outlives them.
+    template <typename Function>
+    void parallelFor(const char *name, size_t count, size_t grain, const Function &function)
+    {
+        grain = std::max(grain, count / (getThreads() * 4) + 1);
+        if (count <= grain || getThreads() == 1)
+        {
+            PROFILE_ZONE(name);
+            function(0, count);
+            return;
+        }
+
+        JobCounter counter;
+        for (size_t begin = grain; begin < count; begin += grain)
+        {
+            size_t end = std::min(count, begin + grain);
+            counter.count++;
+            push(queueIndex(), {name, nullptr, &invokeRange<Function>, &function, begin, end, &counter});
+        }
+
+        // The first batch runs here, while the workers take the rest
+        {
+            PROFILE_ZONE(name);
+            function(0, std::min(count, grain));
+        }
+        wait(counter);
+    }
+};
@@ -0,0 +1,728 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <mesh.hpp>
+#include <light.hpp>
+#include <scenepools.hpp>
+#include <texture.hpp>
+#include <profiler.hpp>
+
+// Binary level file, little endian:
+//   LevelHeader
+//   materials   [uint32 filter][uint32 length][path]
+//   models      [float scale][uint32 length][path]
+//   LevelPortal[portals]        Linked in pairs, 2i and 2i + 1
+//   LevelChunkEntry[chunks]     The chunk directory
+//   LevelNode[]                 The nodes of every chunk, at the offset in its entry
+// Chunks are independent subtrees of the scene graph, and are loaded and unloaded as a whole.
+#define LEVEL_MAGIC 0x4c564c50 // "PLVL"
+#define LEVEL_VERSION 1
+
+#define LEVEL_CHUNK_SIZE 200.0f     // Top level nodes are grouped into chunks on a grid of this size
+#define LEVEL_STREAM_THREADS 2
+
+typedef enum level_node_e
+{
+    LEVEL_ROOM = 0,     // Cube seen from the inside
+    LEVEL_BOX = 1,      // Cube seen from the outside
+    LEVEL_MODEL = 2,
+    LEVEL_LIGHT = 3
+} level_node_e;
+
+typedef struct LevelHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t materials;
+    uint32_t models;
+    uint32_t portals;
+    uint32_t chunks;
+    float spawn[3];         // Start position of the camera
+} LevelHeader;
+
+typedef struct LevelNode
+{
+    uint32_t type;
+    int32_t parent;         // Index in the chunk, -1 for the top level nodes
+    int32_t material;       // Index in the material table of the level
+    int32_t model;          // Index in the model table, for LEVEL_MODEL
+    float position[3];      // Relative to the parent
+    float orientation[4];   // w, x, y, z
+    float size[3];          // Dimensions of cubes, color of lights
+} LevelNode;
+
+typedef struct LevelPortal
+{
+    float position[3];
+    float orientation[4];
+    float dimensions[2];
+    float color[3];
+} LevelPortal;
+
+typedef struct LevelChunkEntry
+{
+    float boundsMin[3];     // World space bounds of everything in the chunk
+    float boundsMax[3];
+    uint32_t nodes;
+    uint32_t memory;        // Bytes of geometry the chunk needs when loaded
+    uint64_t offset;
+} LevelChunkEntry;
+
+typedef struct LevelMaterial
+{
+    std::string path;
+    filter_e filter;
+} LevelMaterial;
+
+typedef struct LevelModel
+{
+    std::string path;
+    float scale;
+} LevelModel;
+
+inline bool readLevelString(std::istream &stream, std::string &outString)
+{
+    uint32_t length;
+    stream.read((char *) &length, sizeof(length));
+    if (!stream || length > 4096)
+        return false;
+    outString.resize(length);
+    stream.read(&outString[0], length);
+    return (bool) stream;
+}
+
+inline void writeLevelString(std::ostream &stream, const std::string &string)
+{
+    uint32_t length = string.size();
+    stream.write((const char *) &length, sizeof(length));
+    stream.write(string.data(), length);
+}
+
+// The parts of a level file that stay in memory: the tables, the portals and the chunk directory
+class LevelFile
+{
+private:
+    std::string mPath;
+
+public:
+    std::vector<LevelMaterial> materials;
+    std::vector<LevelModel> models;
+    std::vector<LevelPortal> portals;
+    std::vector<LevelChunkEntry> chunks;
+    glm::vec3 spawn;
+
+    bool open(std::string path)
+    {
+        mPath = path;
+        std::ifstream fileStream(path.c_str(), std::ios::binary | std::ios::ate);
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not load " << path << std::endl;
+            return false;
+        }
+        uint64_t size = (uint64_t) fileStream.tellg();
+        fileStream.seekg(0);
+
+        LevelHeader header;
+        fileStream.read((char *) &header, sizeof(header));
+        if (!fileStream || header.magic != LEVEL_MAGIC || header.version != LEVEL_VERSION)
+        {
+            std::cerr << "Error: " << path << " is not a level" << std::endl;
+            return false;
+        }
+
+        // The tables are resized to the counts of the header, which have to fit in the file even with empty strings
+        uint64_t minimumSize = sizeof(header) + ((uint64_t) header.materials + header.models) * 2 * sizeof(uint32_t)
+                             + (uint64_t) header.portals * sizeof(LevelPortal) + (uint64_t) header.chunks * sizeof(LevelChunkEntry);
+        if (minimumSize > size)
+        {
+            std::cerr << "Error: The header of " << path << " has more entries than the file holds" << std::endl;
+            return false;
+        }
+        spawn = glm::vec3(header.spawn[0], header.spawn[1], header.spawn[2]);
+
+        materials.resize(header.materials);
+        for (LevelMaterial &material : materials)
+        {
+            uint32_t filter;
+            fileStream.read((char *) &filter, sizeof(filter));
+            material.filter = (filter_e) filter;
+            if (!readLevelString(fileStream, material.path))
+                break;
+        }
+
+        models.resize(header.models);
+        for (LevelModel &model : models)
+        {
+            fileStream.read((char *) &model.scale, sizeof(model.scale));
+            if (!readLevelString(fileStream, model.path))
+                break;
+        }
+
+        portals.resize(header.portals);
+        fileStream.read((char *) portals.data(), portals.size() * sizeof(LevelPortal));
+        chunks.resize(header.chunks);
+        fileStream.read((char *) chunks.data(), chunks.size() * sizeof(LevelChunkEntry));
+
+        if (!fileStream)
+        {
+            std::cerr << "Error: " << path << " is truncated" << std::endl;
+            return false;
+        }
+        printf("Level %s: %d chunks, %d portals\n", path.c_str(), (int) chunks.size(), (int) portals.size());
+        return true;
+    }
+
+    // Reads the nodes of a chunk. Safe to call from several threads, each read opens the file.
+    bool readChunk(unsigned int index, std::vector<LevelNode> &outNodes)
+    {
+        std::ifstream fileStream(mPath.c_str(), std::ios::binary | std::ios::ate);
+        uint64_t size = fileStream ? (uint64_t) fileStream.tellg() : 0;
+        const LevelChunkEntry &entry = chunks[index];
+        if (entry.offset > size || entry.nodes > (size - entry.offset) / sizeof(LevelNode))
+        {
+            std::cerr << "Error: Chunk " << index << " of " << mPath << " has more nodes than the file holds" << std::endl;
+            return false;
+        }
+
+        fileStream.seekg(entry.offset);
+        outNodes.resize(entry.nodes);
+        fileStream.read((char *) outNodes.data(), outNodes.size() * sizeof(LevelNode));
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not read chunk " << index << " of " << mPath << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+// Collects a scene into chunks and writes it as a level file
+class LevelWriter
+{
+private:
+    typedef struct Chunk
+    {
+        int cellX, cellZ;
+        LevelChunkEntry entry;
+        std::vector<LevelNode> nodes;
+    } Chunk;
+
+    std::vector<Chunk> mChunks;
+
+public:
+    std::vector<LevelMaterial> materials;
+    std::vector<LevelModel> models;
+    std::vector<LevelPortal> portals;
+    glm::vec3 spawn = glm::vec3(0);
+
+    int addModel(std::string path, float scale)
+    {
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            if (models[i].path == path && models[i].scale == scale)
+                return i;
+        }
+        models.push_back({path, scale});
+        return models.size() - 1;
+    }
+
+    // Returns the chunk of the grid cell containing the position
+    int chunkAt(glm::vec3 position)
+    {
+        int x = (int) floor(position.x / LEVEL_CHUNK_SIZE);
+        int z = (int) floor(position.z / LEVEL_CHUNK_SIZE);
+        for (size_t i = 0; i < mChunks.size(); i++)
+        {
+            if (mChunks[i].cellX == x && mChunks[i].cellZ == z)
+                return i;
+        }
+
+        Chunk chunk = {x, z, {}, {}};
+        for (int i = 0; i < 3; i++)
+        {
+            chunk.entry.boundsMin[i] = INFINITY;
+            chunk.entry.boundsMax[i] = -INFINITY;
+        }
+        mChunks.push_back(chunk);
+        return mChunks.size() - 1;
+    }
+
+    // Adds a node to a chunk, and grows the chunk by its world space bounds and geometry. Returns its index in the chunk.
+    int addNode(int chunk, const LevelNode &node, glm::vec3 boundsMin, glm::vec3 boundsMax, uint32_t memory)
+    {
+        Chunk &target = mChunks[chunk];
+        for (int i = 0; i < 3; i++)
+        {
+            target.entry.boundsMin[i] = std::min(target.entry.boundsMin[i], boundsMin[i]);
+            target.entry.boundsMax[i] = std::max(target.entry.boundsMax[i], boundsMax[i]);
+        }
+        target.entry.memory += memory;
+        target.nodes.push_back(node);
+        return target.nodes.size() - 1;
+    }
+
+    bool write(std::string path)
+    {
+        std::ofstream fileStream(path.c_str(), std::ios::binary);
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not write " << path << std::endl;
+            return false;
+        }
+
+        LevelHeader header = {LEVEL_MAGIC, LEVEL_VERSION, (uint32_t) materials.size(), (uint32_t) models.size(), (uint32_t) portals.size(), (uint32_t) mChunks.size(), {spawn.x, spawn.y, spawn.z}};
+        fileStream.write((const char *) &header, sizeof(header));
+        for (const LevelMaterial &material : materials)
+        {
+            uint32_t filter = material.filter;
+            fileStream.write((const char *) &filter, sizeof(filter));
+            writeLevelString(fileStream, material.path);
+        }
+        for (const LevelModel &model : models)
+        {
+            fileStream.write((const char *) &model.scale, sizeof(model.scale));
+            writeLevelString(fileStream, model.path);
+        }
+        fileStream.write((const char *) portals.data(), portals.size() * sizeof(LevelPortal));
+
+        // The node data follows the directory
+        uint64_t offset = (uint64_t) fileStream.tellp() + mChunks.size() * sizeof(LevelChunkEntry);
+        for (Chunk &chunk : mChunks)
+        {
+            chunk.entry.nodes = chunk.nodes.size();
+            chunk.entry.offset = offset;
+            offset += chunk.nodes.size() * sizeof(LevelNode);
+            fileStream.write((const char *) &chunk.entry, sizeof(LevelChunkEntry));
+        }
+        for (const Chunk &chunk : mChunks)
+            fileStream.write((const char *) chunk.nodes.data(), chunk.nodes.size() * sizeof(LevelNode));
+
+        printf("Wrote level %s: %d chunks, %d portals\n", path.c_str(), (int) mChunks.size(), (int) portals.size());
+        return (bool) fileStream;
+    }
+};
+
+typedef enum chunk_state_e
+{
+    CHUNK_UNLOADED,
+    CHUNK_QUEUED,
+    CHUNK_LOADING,
+    CHUNK_READY,        // Loaded by a background thread, waiting to be attached to the scene
+    CHUNK_LOADED,
+    CHUNK_FAILED
+} chunk_state_e;
+
+// A chunk of the level and the scene objects created from it
+typedef struct LevelChunk
+{
+    chunk_state_e state;
+    bool wanted;
+    float priority;                     // Distance from the camera, shortened for chunks behind nearby portals
+    std::vector<LevelNode> records;
+    std::vector<Node *> nodes;          // One per record, nullptr for the nodes that were skipped
+    std::vector<Node *> roots;
+    std::vector<Handle<Cube>> cubes;
+    std::vector<Handle<ObjMesh>> models;
+    std::vector<glm::vec3> modelPositions;
+    std::vector<Handle<Light>> lights;
+} LevelChunk;
+
+// Loads the chunks of a level on background threads, keeping the closest chunks within a radius of the camera
+// resident within a memory budget. A portal close to the camera gives the chunk behind its partner the priority of
+// the portal itself, so that chunk is prefetched before the player can look or walk through.
+// plan() and apply() are called from the thread owning the GL context, while the simulation is not running.
+class LevelStreamer
+{
+private:
+    LevelFile *mFile;
+    ScenePools *mPools;
+    ResourceCache *mResources;
+    std::vector<int> mMaterials;    // Level material index to MaterialLibrary index
+    float mRadius;
+    size_t mBudget;
+    bool mReleaseGeometry = false;
+
+    std::vector<LevelChunk> mChunks;
+    std::vector<unsigned int> mQueue;   // Chunks to load, closest first
+    std::vector<unsigned int> mOrder;   // Chunks by priority, reused by every plan()
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStop = false;
+    unsigned long mHints = 0;
+
+    static float distanceToBounds(glm::vec3 position, const LevelChunkEntry &entry)
+    {
+        glm::vec3 boundsMin = glm::vec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+        glm::vec3 boundsMax = glm::vec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+        return glm::length(glm::max(glm::max(boundsMin - position, position - boundsMax), glm::vec3(0)));
+    }
+
+    // The chunk containing the position, or -1
+    int chunkAt(glm::vec3 position)
+    {
+        for (size_t i = 0; i < mChunks.size(); i++)
+        {
+            if (distanceToBounds(position, mFile->chunks[i]) == 0)
+                return i;
+        }
+        return -1;
+    }
+
+    // The nearest ancestor of a node that was created, or -1 to attach the node to the chunk root. Nodes below skipped
+    // ones (lights over the light slots, models with an invalid index) keep their place in the world: outPosition and
+    // outOrientation are the transform of the skipped ancestors, to apply on top of the node's own.
+    static int attachedParent(const LevelChunk &chunk, int index, glm::vec3 &outPosition, glm::fquat &outOrientation)
+    {
+        outPosition = glm::vec3(0);
+        outOrientation = glm::fquat(1, 0, 0, 0);
+        int parent = chunk.records[index].parent;
+        while (parent >= 0 && parent < index && !chunk.nodes[parent])
+        {
+            const LevelNode &skipped = chunk.records[parent];
+            glm::fquat orientation(skipped.orientation[0], skipped.orientation[1], skipped.orientation[2], skipped.orientation[3]);
+            outPosition = glm::vec3(skipped.position[0], skipped.position[1], skipped.position[2]) + orientation * outPosition;
+            outOrientation = orientation * outOrientation;
+            index = parent;
+            parent = skipped.parent;
+        }
+        return parent >= 0 && parent < index ? parent : -1;
+    }
+
+    // Reads the chunk and builds its meshes. Lights are created in apply(), as their ids are not thread safe.
+    bool load(unsigned int index)
+    {
+        PROFILE_ZONE("loadChunk");
+
+        LevelChunk &chunk = mChunks[index];
+        if (!mFile->readChunk(index, chunk.records))
+            return false;
+
+        chunk.nodes.assign(chunk.records.size(), nullptr);
+        for (size_t i = 0; i < chunk.records.size(); i++)
+        {
+            const LevelNode &record = chunk.records[i];
+            Mesh *mesh = nullptr;
+            if (record.type == LEVEL_ROOM || record.type == LEVEL_BOX)
+            {
+                chunk.cubes.push_back(mPools->cubes.create(glm::vec3(record.size[0], record.size[1], record.size[2]), record.type == LEVEL_ROOM));
+                mesh = mPools->cubes.get(chunk.cubes.back());
+            }
+            else if (record.type == LEVEL_MODEL && record.model >= 0 && record.model < (int) mFile->models.size())
+            {
+                chunk.models.push_back(mPools->models.create(mFile->models[record.model].path, mFile->models[record.model].scale));
+                chunk.modelPositions.push_back(glm::vec3(record.position[0], record.position[1], record.position[2]));
+                mesh = mPools->models.get(chunk.models.back());
+            }
+            if (!mesh)
+                continue;
+
+            mesh->setPosition(glm::vec3(record.position[0], record.position[1], record.position[2]));
+            mesh->setOrientation(glm::fquat(record.orientation[0], record.orientation[1], record.orientation[2], record.orientation[3]));
+            bool validMaterial = record.material >= 0 && record.material < (int) mMaterials.size();
+            mesh->material = validMaterial ? mMaterials[record.material] : -1;
+            chunk.nodes[i] = mesh;
+        }
+        return true;
+    }
+
+    void loaderLoop()
+    {
+        while (true)
+        {
+            unsigned int index;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mCondition.wait(lock, [this] { return mStop || !mQueue.empty(); });
+                if (mStop)
+                    return;
+                index = mQueue.front();
+                mQueue.erase(mQueue.begin());
+                mChunks[index].state = CHUNK_LOADING;
+            }
+
+            bool loaded = load(index);
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            mChunks[index].state = loaded ? CHUNK_READY : CHUNK_FAILED;
+        }
+    }
+
+    // Frees the objects of a chunk. Chunks that were attached to the scene also free their GPU data.
+    void release(LevelChunk &chunk, bool attached)
+    {
+        for (Handle<Cube> cube : chunk.cubes)
+        {
+            if (attached)
+                mPools->cubes.get(cube)->destroy(*mResources);
+            mPools->cubes.destroy(cube);
+        }
+        for (Handle<ObjMesh> model : chunk.models)
+        {
+            if (attached)
+                mPools->models.get(model)->destroy(*mResources);
+            mPools->models.destroy(model);
+        }
+        for (Handle<Light> light : chunk.lights)
+            mPools->lights.destroy(light);
+
+        chunk.records.clear();
+        chunk.nodes.clear();
+        chunk.roots.clear();
+        chunk.cubes.clear();
+        chunk.models.clear();
+        chunk.modelPositions.clear();
+        chunk.lights.clear();
+    }
+
+public:
+    // radius in world units, budget in bytes of chunk geometry
+    // The objects of the chunks are created in pools, and their GPU data comes from the resource cache
+    LevelStreamer(LevelFile *file, ScenePools *pools, ResourceCache *resources, std::vector<int> materials, float radius, size_t budget)
+    {
+        mFile = file;
+        mPools = pools;
+        mResources = resources;
+        mMaterials = materials;
+        mRadius = radius;
+        mBudget = budget;
+        mChunks.resize(file->chunks.size(), {CHUNK_UNLOADED, false, INFINITY, {}, {}, {}, {}, {}, {}, {}});
+
+        for (int i = 0; i < LEVEL_STREAM_THREADS; i++)
+            mThreads.emplace_back(&LevelStreamer::loaderLoop, this);
+    }
+
+    // Frees the CPU copy of the vertex data of the chunks once it is uploaded
+    void setReleaseGeometry(bool release)
+    {
+        mReleaseGeometry = release;
+    }
+
+    // Stops the loaders, and frees the chunks that never reached the scene. Attached chunks are owned by the scene.
+    ~LevelStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mCondition.notify_all();
+        for (std::thread &thread : mThreads)
+            thread.join();
+
+        for (LevelChunk &chunk : mChunks)
+        {
+            if (chunk.state == CHUNK_READY)
+                release(chunk, false);
+        }
+    }
+
+    // Decides which chunks should be resident for the camera and portal positions, and queues the missing ones
+    void plan(glm::vec3 camera, const std::vector<glm::vec3> &portals)
+    {
+        PROFILE_ZONE("planChunks");
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        for (size_t i = 0; i < mChunks.size(); i++)
+            mChunks[i].priority = distanceToBounds(camera, mFile->chunks[i]);
+
+        // Prefetch hints: the chunk behind a nearby portal is as close as the portal
+        for (size_t i = 0; i < portals.size(); i++)
+        {
+            float distance = glm::distance(camera, portals[i]);
+            int target = (i ^ 1) < portals.size() ? chunkAt(portals[i ^ 1]) : -1;
+            if (distance > mRadius || target < 0 || distance >= mChunks[target].priority)
+                continue;
+
+            if (mChunks[target].state == CHUNK_UNLOADED && mChunks[target].priority > mRadius)
+                mHints++;
+            mChunks[target].priority = distance;
+        }
+
+        // Keep the closest chunks in the radius, as long as they fit in the budget
+        std::vector<unsigned int> &order = mOrder;
+        order.resize(mChunks.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) { return mChunks[a].priority < mChunks[b].priority; });
+
+        size_t memory = 0;
+        for (LevelChunk &chunk : mChunks)
+            chunk.wanted = false;
+        for (unsigned int index : order)
+        {
+            LevelChunk &chunk = mChunks[index];
+            if (chunk.priority > mRadius)
+                break;
+            if (memory + mFile->chunks[index].memory > mBudget)
+                continue;
+            chunk.wanted = true;
+            memory += mFile->chunks[index].memory;
+        }
+
+        // Requeue the wanted chunks that are not loaded yet, closest first
+        mQueue.clear();
+        for (unsigned int index : order)
+        {
+            LevelChunk &chunk = mChunks[index];
+            if (chunk.state == CHUNK_QUEUED && !chunk.wanted)
+                chunk.state = CHUNK_UNLOADED;
+            if (chunk.wanted && (chunk.state == CHUNK_UNLOADED || chunk.state == CHUNK_QUEUED))
+            {
+                chunk.state = CHUNK_QUEUED;
+                mQueue.push_back(index);
+            }
+        }
+        lock.unlock();
+        mCondition.notify_all();
+    }
+
+    // Whether apply() has chunks to attach or evict
+    bool hasChanges()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (LevelChunk &chunk : mChunks)
+        {
+            if (chunk.state == CHUNK_READY || (chunk.state == CHUNK_LOADED && !chunk.wanted))
+                return true;
+        }
+        return false;
+    }
+
+    // Blocks until every queued chunk is loaded, e.g. for the chunks around the start position
+    void finish()
+    {
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                bool busy = !mQueue.empty();
+                for (LevelChunk &chunk : mChunks)
+                    busy = busy || chunk.state == CHUNK_LOADING;
+                if (!busy)
+                    return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // Uploads the loaded chunks and links them into chunks with top level nodes in outAttached. At most lightSlots
+    // lights are created. Chunks to unload are moved to outEvicted, and have to be removed from the scene before
+    // evict() frees them. Without a shader (the software renderer) nothing is uploaded.
+    void apply(Shader *shader, unsigned int lightSlots, std::vector<LevelChunk *> &outAttached, std::vector<LevelChunk *> &outEvicted)
+    {
+        PROFILE_ZONE("applyChunks");
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (LevelChunk &chunk : mChunks)
+        {
+            if (chunk.state == CHUNK_LOADED && !chunk.wanted)
+            {
+                outEvicted.push_back(&chunk);
+                continue;
+            }
+            if (chunk.state != CHUNK_READY)
+                continue;
+
+            // The camera moved away while the chunk was loading
+            if (!chunk.wanted)
+            {
+                release(chunk, false);
+                chunk.state = CHUNK_UNLOADED;
+                continue;
+            }
+
+            for (size_t i = 0; i < chunk.records.size(); i++)
+            {
+                const LevelNode &record = chunk.records[i];
+                if (record.type == LEVEL_LIGHT)
+                {
+                    if (chunk.lights.size() >= lightSlots)
+                    {
+                        std::cerr << "Error: Out of light slots, a light of the level is skipped" << std::endl;
+                        continue;
+                    }
+                    chunk.lights.push_back(mPools->lights.create(glm::vec3(record.position[0], record.position[1], record.position[2]), glm::vec3(record.size[0], record.size[1], record.size[2])));
+                    chunk.nodes[i] = mPools->lights.get(chunk.lights.back());
+                }
+                if (!chunk.nodes[i])
+                    continue;
+
+                glm::vec3 position;
+                glm::fquat orientation;
+                int parent = attachedParent(chunk, i, position, orientation);
+                if (parent != record.parent)
+                {
+                    Node *node = chunk.nodes[i];
+                    node->setPosition(position + orientation * node->getPosition());
+                    node->setOrientation(orientation * node->getOrientation());
+                }
+
+                if (parent < 0)
+                    chunk.roots.push_back(chunk.nodes[i]);
+                else
+                    chunk.nodes[parent]->addChild(*chunk.nodes[i]);
+            }
+            lightSlots -= chunk.lights.size();
+
+            std::vector<Mesh *> meshes;
+            for (Handle<Cube> cube : chunk.cubes)
+                meshes.push_back(mPools->cubes.get(cube));
+            for (Handle<ObjMesh> model : chunk.models)
+                meshes.push_back(mPools->models.get(model));
+            for (Mesh *mesh : meshes)
+            {
+                if (shader)
+                {
+                    mesh->generateVertexData(*shader, *mResources);
+                    if (mReleaseGeometry)
+                        mesh->releaseGeometry();
+                }
+                else
+                    mesh->computeBounds();
+            }
+
+            chunk.state = CHUNK_LOADED;
+            outAttached.push_back(&chunk);
+        }
+    }
+
+    // Frees a chunk returned in outEvicted by apply(), once the scene no longer references it
+    void evict(LevelChunk *chunk)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        release(*chunk, true);
+        chunk->state = CHUNK_UNLOADED;
+    }
+
+    // Bytes of geometry of the chunks that are loaded or on their way
+    size_t getResidentMemory()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        size_t memory = 0;
+        for (size_t i = 0; i < mChunks.size(); i++)
+        {
+            if (mChunks[i].state != CHUNK_UNLOADED && mChunks[i].state != CHUNK_FAILED)
+                memory += mFile->chunks[i].memory;
+        }
+        return memory;
+    }
+
+    // Number of chunks requested by a portal before the camera came within range of them
+    unsigned long getPrefetchHints()
+    {
+        return mHints;
+    }
+};
@@ -2,6 +2,7 @@
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/vec3.hpp>
+#include <cmath>
 #include <shader.hpp>
 #include <node.hpp>
 
@@ -31,13 +32,33 @@ class Light : public Node
         return mColor;
     }
 
+    int getID()
+    {
+        return mID;
+    }
+
+    // Moves the light to another slot of the uniform arrays, e.g. when lights are streamed in and out
+    void setID(int id)
+    {
+        mID = id;
+    }
+
+    // Distance where the attenuation in shader.frag, 1 / (0.01 + 0.05d + 0.01d^2), drops below 1/256.
+    // Light from further away does not change the 8 bit output, so the light is skipped for meshes outside it.
+    static float getRange()
+    {
+        const float a = 0.01f, b = 0.05f, c = 0.01f - 256.0f;
+        return (-b + sqrtf(b * b - 4 * a * c)) / (2 * a);
+    }
+
     // Send the color and position of the light to the fragment shader
     void updateUniform(Shader &shader)
     {
         int uPositionLoc = shader.getUniformLocation("u_light_positions") + mID;
-        glUniform3fv(uPositionLoc, 1, glm::value_ptr(getGlobalPosition()));
+        glUniform3fv(uPositionLoc, 1, glm::value_ptr(getRenderPosition()));
 
         int uColorLoc = shader.getUniformLocation("u_light_colors") + mID;
         glUniform3fv(uColorLoc, 1, glm::value_ptr(getColor()));
+        RENDER_STAT(STAT_UNIFORM_UPLOADS, 2);
     }
 };
\ No newline at end of file
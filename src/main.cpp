@@ -13,6 +13,11 @@
 #include <glm/gtx/string_cast.hpp>
 #include <iostream>
 
+// Defines the global operator new and delete of the allocation tracker, if it is compiled in.
+// Has to come before any other header including it.
+#define ALLOCATION_TRACKER_IMPLEMENTATION
+#include <allocations.hpp>
+
 #include <game.hpp>
 #include <shader.hpp>
 #include <window.hpp>
@@ -22,117 +27,788 @@
 #include <texture.hpp>
 #include <portal.hpp>
 #include <light.hpp>
+#include <material.hpp>
+#include <profiler.hpp>
+#include <benchmark.hpp>
+#include <scenegenerator.hpp>
+#include <assetgraph.hpp>
+#include <softwarerenderer.hpp>
+#include <renderstats.hpp>
+#include <memory.hpp>
+#include <glcapture.hpp>
+#include <rendergraph.hpp>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <algorithm>
+#include <climits>
+#include <map>
 
-void init(gamedata_st &gamedata);
+void init(gamedata_st &gamedata, const SceneSettings &scene);
+void buildDefaultScene(gamedata_st &gamedata, int wallMaterial, int turretMaterial);
+bool loadLevel(gamedata_st &gamedata, const SceneSettings &scene);
+bool saveLevel(gamedata_st &gamedata, std::string path);
+void streamLevel(gamedata_st &gamedata, bool blocking);
+void refreshScene(gamedata_st &gamedata);
 void update(gamedata_st &gamedata);
-void placePortals(gamedata_st &gamedata);
+void simulate(gamedata_st &gamedata, const InputState &input);
+void tick(gamedata_st &gamedata, const InputState &input, float dt);
+void publishSnapshot(gamedata_st &gamedata);
+void startSimulationThread(gamedata_st &gamedata);
+void placePortals(gamedata_st &gamedata, int portalIndex);
 void render(gamedata_st &gamedata);
-void renderWorld(gamedata_st &gamedata, glm::mat4 view, glm::mat4 proj);
-void renderRecursivePortals(gamedata_st &gamedata, glm::mat4 view, glm::mat4 proj, int maxDepth);
+void renderWorld(gamedata_st &gamedata, const RenderView &view);
+void renderViews(gamedata_st &gamedata);
+void planViews(gamedata_st &gamedata, const glm::mat4 &view, const glm::mat4 &proj);
+void compileViews(gamedata_st &gamedata);
+void binLights(gamedata_st &gamedata);
 void destroy(gamedata_st &gamedata);
+void writeGraphDump(gamedata_st &gamedata, const std::string &path);
+int runBenchmark(gamedata_st &gamedata, int argc, char **argv);
 
-int main()
+#ifdef PORTAL_HEADLESS
+int main(int argc, char **argv)
+{
+    gamedata_st gamedata;
+    return runBenchmark(gamedata, argc, argv);
+}
+#else
+// Usage: PortalProject [--record file] [--replay file] [--threaded 0|1] [--gpu-budget MB] [--shadows 0|1] [--stats-csv file]
+//                      [--release-geometry 0|1] [--capture file] [--capture-frames n]
+//                      [--depth-scale falloff] [--min-scale scale] [--target-ms ms]
+//                      [--seed s] [--rooms n] [--boxes n] [--turrets n] [--lights n] [--portals n]
+//                      [--level file] [--save-level file] [--stream-radius units] [--stream-budget MB]
+int main(int argc, char **argv)
 {
+    AllocationTracker::trackThread();
     gamedata_st gamedata;
+    InputRecorder recorder;
+    InputReplayer replayer;
+    bool threaded = true;
+    bool shadows = true;
+    bool releaseGeometry = false;
+    std::string capturePath;
+    unsigned int captureFrames = 100;
+    unsigned int gpuBudget = 256;
+    SceneSettings scene = defaultSceneSettings();
+    ResolutionSettings resolution = defaultResolutionSettings();
 
-    init(gamedata);
+    gamedata.window = new Window(900, 900, "Portal Demo");
+
+    // Record the input of the session, or replay a recorded session frame by frame
+    for (int i = 1; i < argc; i += 2)
+    {
+        std::string arg = argv[i];
+        if (i + 1 == argc)
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            break;
+        }
+        if (arg == "--record")
+        {
+            if (recorder.open(argv[i + 1]))
+                gamedata.window->getInput().record(&recorder);
+        }
+        else if (arg == "--replay")
+        {
+            if (replayer.open(argv[i + 1]))
+                gamedata.window->getInput().replay(&replayer);
+        }
+        else if (arg == "--threaded")
+            threaded = atoi(argv[i + 1]) != 0;
+        else if (arg == "--gpu-budget")
+            gpuBudget = atoi(argv[i + 1]);
+        else if (arg == "--shadows")
+            shadows = atoi(argv[i + 1]) != 0;
+        else if (arg == "--stats-csv")
+            RenderStats::get().openCsv(argv[i + 1]);
+        else if (arg == "--release-geometry")
+            releaseGeometry = atoi(argv[i + 1]) != 0;
+        else if (arg == "--capture")
+            capturePath = argv[i + 1];
+        else if (arg == "--capture-frames")
+            captureFrames = atoi(argv[i + 1]);
+        else if (!parseResolutionArgument(arg, argv[i + 1], resolution) && !parseSceneArgument(arg, argv[i + 1], scene))
+            std::cerr << "Unknown argument " << arg << std::endl;
+    }
+
+    gamedata.resources = new ResourceCache((size_t) gpuBudget << 20);
+    gamedata.jobThreads = 0;
+    gamedata.software = nullptr;
+    gamedata.resolution = DynamicResolution::isEnabled(resolution) ? new DynamicResolution(resolution) : nullptr;
+    gamedata.shadows = shadows ? new ShadowMaps() : nullptr;
+    gamedata.releaseGeometry = releaseGeometry;
+
+    // The capture starts before the assets are loaded, so it creates everything the frames use
+    if (!capturePath.empty())
+        GLCapture::get().start(capturePath, captureFrames, gamedata.window->getWidth(), gamedata.window->getHeight(), gamedata.window->getFramebuffer());
+    init(gamedata, scene);
+    if (threaded)
+        startSimulationThread(gamedata);
 
     double prevTime = 0, time;
     int frames = 0;
     while (!gamedata.window->shouldClose())
     {
         // Print the fps and average frametime every 10 seconds
-        time = gamedata.window->getTime();
+        time = gamedata.window->getRealTime();
         if(time - prevTime >= 10.0)
         {
             printf("FPS: %f, (ms per frame: %f)\n", frames / (time - prevTime), (time - prevTime) / frames);
+            Profiler::get().report();
+            RenderStats::get().report();
+            MemoryTracker::get().report();
+            AllocationTracker::get().report();
             frames = 0;
             prevTime = time;
         }
 
         // Run render and update loop
-        update(gamedata);
-        render(gamedata);
+        Profiler::get().beginFrame();
+        {
+            PROFILE_ZONE("frame");
+            update(gamedata);
+            render(gamedata);
+        }
+        Profiler::get().endFrame();
+        RenderStats::get().endFrame();
+        GLCapture::get().endFrame();
+        AllocationTracker::get().endFrame();
         frames++;
     }
 
+    recorder.close();
     destroy(gamedata);
 }
+#endif
 
-void init(gamedata_st &gamedata)
+// Renders a scripted camera path, or a recorded input session, offscreen at a fixed resolution and writes the frame times.
+// PortalSoftware renders on the CPU, and can write every frame as prefixNNNNN.ppm.
+// Usage: PortalHeadless [--script file | --replay file] [--csv file] [--summary file] [--width w] [--height h]
+//                       [--baseline summary] [--tolerance fraction] [--threaded 0|1] [--gpu-budget MB] [--shadows 0|1]
+//                       [--stats-csv file] [--release-geometry 0|1] [--memory-report file] [--max-cpu-mb MB] [--max-gpu-mb MB]
+//                       [--capture file] [--capture-frames n] [--assert-no-alloc warmup] [--graph-dump file] [--threads n]
+//                       [--depth-scale falloff] [--min-scale scale] [--target-ms ms]
+//                       [--seed s] [--rooms n] [--boxes n] [--turrets n] [--lights n] [--portals n]
+//                       [--level file] [--save-level file] [--stream-radius units] [--stream-budget MB]
+//        PortalSoftware [the arguments above] [--frames prefix]
+int runBenchmark(gamedata_st &gamedata, int argc, char **argv)
 {
-    // Create the window
-    gamedata.window = new Window(900, 900, "Portal Demo");
+    std::string scriptPath = "../res/benchmarks/flythrough.txt";
+    std::string csvPath = "benchmark.csv";
+    std::string summaryPath = "benchmark_summary.txt";
+    std::string baselinePath;
+    std::string replayPath;
+    std::string framesPrefix;
+    double tolerance = 0.1;
+    int width = 1280, height = 720;
+    std::string memoryPath;
+    std::string capturePath;
+    std::string graphPath;
+    unsigned int captureFrames = 100;
+    double maxCPUMemory = 0, maxGPUMemory = 0;
+    long allocationWarmup = -1;
+    bool threaded = true;
+    bool shadows = true;
+    bool releaseGeometry = false;
+    unsigned int gpuBudget = 256;
+    unsigned int jobThreads = 0;
+    SceneSettings scene = defaultSceneSettings();
+    ResolutionSettings resolution = defaultResolutionSettings();
 
-    // Load the shader
-    gamedata.shader = new Shader();
-    gamedata.shader->attach("../shaders/shader.vert");
-    gamedata.shader->attach("../shaders/shader.frag");
-    gamedata.shader->link();
-    gamedata.shader->activate();
+    for (int i = 1; i < argc; i += 2)
+    {
+        std::string arg = argv[i];
+        if (i + 1 == argc)
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            break;
+        }
+        if (arg == "--script") scriptPath = argv[i + 1];
+        else if (arg == "--csv") csvPath = argv[i + 1];
+        else if (arg == "--summary") summaryPath = argv[i + 1];
+        else if (arg == "--width") width = atoi(argv[i + 1]);
+        else if (arg == "--height") height = atoi(argv[i + 1]);
+        else if (arg == "--baseline") baselinePath = argv[i + 1];
+        else if (arg == "--replay") replayPath = argv[i + 1];
+        else if (arg == "--tolerance") tolerance = atof(argv[i + 1]);
+        else if (arg == "--threaded") threaded = atoi(argv[i + 1]) != 0;
+        else if (arg == "--gpu-budget") gpuBudget = atoi(argv[i + 1]);
+        else if (arg == "--shadows") shadows = atoi(argv[i + 1]) != 0;
+        else if (arg == "--stats-csv") RenderStats::get().openCsv(argv[i + 1]);
+        else if (arg == "--release-geometry") releaseGeometry = atoi(argv[i + 1]) != 0;
+        else if (arg == "--memory-report") memoryPath = argv[i + 1];
+        else if (arg == "--max-cpu-mb") maxCPUMemory = atof(argv[i + 1]);
+        else if (arg == "--max-gpu-mb") maxGPUMemory = atof(argv[i + 1]);
+        else if (arg == "--capture") capturePath = argv[i + 1];
+        else if (arg == "--capture-frames") captureFrames = atoi(argv[i + 1]);
+        else if (arg == "--assert-no-alloc") allocationWarmup = atol(argv[i + 1]);
+        else if (arg == "--graph-dump") graphPath = argv[i + 1];
+        else if (arg == "--frames") framesPrefix = argv[i + 1];
+        else if (arg == "--threads") jobThreads = atoi(argv[i + 1]);
+        else if (parseSceneArgument(arg, argv[i + 1], scene)) continue;
+        else if (parseResolutionArgument(arg, argv[i + 1], resolution)) continue;
+        else std::cerr << "Unknown argument " << arg << std::endl;
+    }
+
+    // Frames after the warmup must not allocate on the threads of the frame loop. The warmup counts from the first
+    // frame, which includes the startup.
+    AllocationTracker::trackThread();
+    bool allocationsPassed = true;
+    if (allocationWarmup >= 0)
+    {
+#ifdef PORTAL_ALLOCATION_TRACKER
+        AllocationTracker::get().setAssert(allocationWarmup);
+#else
+        std::cerr << "Error: --assert-no-alloc needs a build with the allocation tracker (-DENABLE_ALLOCATION_TRACKER=ON)" << std::endl;
+        allocationsPassed = false;
+#endif
+    }
+
+#ifdef PORTAL_SOFTWARE
+    if (!capturePath.empty())
+    {
+        std::cerr << "Error: The software renderer makes no GL calls to capture" << std::endl;
+        return 1;
+    }
+#endif
+
+    // A replayed session drives the game through its recorded input instead of the script
+    BenchmarkScript script;
+    InputReplayer replayer;
+    bool replay = !replayPath.empty();
+    if (replay ? !replayer.open(replayPath) : !script.load(scriptPath))
+        return 1;
+
+    gamedata.window = new Window(width, height, "Portal Benchmark");
+    if (replay)
+        gamedata.window->getInput().replay(&replayer);
+    gamedata.resources = new ResourceCache((size_t) gpuBudget << 20);
+    gamedata.jobThreads = jobThreads;
+#ifdef PORTAL_SOFTWARE
+    // The rasterizer renders every depth at full resolution, without shadows, and reads the vertices of the meshes
+    gamedata.software = new SoftwareRenderer(width, height);
+    gamedata.resolution = nullptr;
+    gamedata.shadows = nullptr;
+    gamedata.releaseGeometry = false;
+    (void) shadows;
+    (void) releaseGeometry;
+    (void) captureFrames;
+#else
+    gamedata.software = nullptr;
+    gamedata.resolution = DynamicResolution::isEnabled(resolution) ? new DynamicResolution(resolution) : nullptr;
+    gamedata.shadows = shadows ? new ShadowMaps() : nullptr;
+    gamedata.releaseGeometry = releaseGeometry;
+    if (!capturePath.empty())
+        GLCapture::get().start(capturePath, captureFrames, width, height, gamedata.window->getFramebuffer());
+#endif
+    init(gamedata, scene);
+
+    // The script is applied by the simulation, at the start of each simulated frame
+    if (!replay)
+        gamedata.script = &script;
+    if (threaded)
+        startSimulationThread(gamedata);
+
+    BenchmarkStats stats;
+    if (!replay)
+        stats.reserve(script.getFrames());
+    int frames = 0;
+    for (int frame = 0; replay ? !gamedata.window->shouldClose() : frame < script.getWarmup() + script.getFrames(); frame++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Profiler::get().beginFrame();
+
+        update(gamedata);
+        auto updated = std::chrono::steady_clock::now();
+        render(gamedata);
+        auto end = std::chrono::steady_clock::now();
+
+        Profiler::get().endFrame();
+        RenderStats::get().endFrame();
+        GLCapture::get().endFrame();
+        allocationsPassed &= AllocationTracker::get().endFrame();
+
+        if (gamedata.software && !framesPrefix.empty())
+        {
+            char number[16];
+            snprintf(number, sizeof(number), "%05d", frame);
+            gamedata.software->writeImage(framesPrefix + number + ".ppm");
+        }
+
+        if (frame >= script.getWarmup())
+        {
+            frames++;
+            stats.record(
+                std::chrono::duration<double, std::milli>(end - start).count(),
+                std::chrono::duration<double, std::milli>(updated - start).count(),
+                std::chrono::duration<double, std::milli>(end - updated).count());
+        }
+    }
+
+    printf("Rendered %d frames at %dx%d with %s on %u job threads, simulation on %s\n", frames, width, height,
+           gamedata.software ? "the software renderer" : "OpenGL", gamedata.jobs->getThreads(),
+           threaded ? "its own thread" : "the main thread");
+    if (gamedata.resolution)
+        printf("Dynamic resolution: falloff %.2f per portal depth at the end\n", gamedata.resolution->getFalloff());
+    stats.printSummary();
+    Profiler::get().report();
+    RenderStats::get().report();
+    MemoryTracker::get().report();
+    AllocationTracker::get().report();
+    stats.writeCsv(csvPath);
+    stats.writeSummary(summaryPath);
+    if (!memoryPath.empty())
+        MemoryTracker::get().writeReport(memoryPath);
+    if (!graphPath.empty())
+        writeGraphDump(gamedata, graphPath);
+
+    bool passed = baselinePath.empty() || stats.compareBaseline(baselinePath, tolerance);
+    passed &= MemoryTracker::get().checkLimits(maxCPUMemory, maxGPUMemory);
+    passed &= allocationsPassed;
+
+    destroy(gamedata);
+    return passed ? 0 : 1;
+}
+
+// Sets up the scene, either the default room, a generated level or a streamed level file. The window has to be created before, as it owns the OpenGL context
+void init(gamedata_st &gamedata, const SceneSettings &scene)
+{
+    // Worker threads for the parallel parts of the frame, and for loading the assets
+    gamedata.jobs = gamedata.jobThreads ? new JobSystem(gamedata.jobThreads) : new JobSystem();
+    printf("Job system: %d threads\n", gamedata.jobs->getThreads());
+    gamedata.program = nullptr;
+    gamedata.shader = nullptr;
+    gamedata.noiseTexture = nullptr;
+    gamedata.noiseResource = nullptr;
+    gamedata.graph = new RenderGraph(*gamedata.resources);
+    gamedata.dumpGraph = false;
 
     // Create cameras
     gamedata.camera = new Camera(*gamedata.window, glm::vec3(0), M_PI / 2, 0.01f, 200.0f);
 
-    // Create all meshes
-    gamedata.turret = new ObjMesh("../res/models/turret.obj", 0.1f);
-    gamedata.player = new Cube(glm::vec3(1.0f, 1.0f, 1.0f), false);
-    gamedata.portals[0] = new Portal(glm::vec2(5, 10), glm::vec3(0.36f, 0.58f, 1.0f));
-    gamedata.portals[1] = new Portal(glm::vec2(5, 10), glm::vec3(1.0f, 0.5f, 0.05f));
-    gamedata.cubes.push_back(new Cube(glm::vec3(120, 60, 60), true));   // The room
-    gamedata.cubes.push_back(new Cube(glm::vec3(20, 20, 60), false));   // The Long bar
-    gamedata.cubes.push_back(new Cube(glm::vec3(40, 20, 20), false));   // The center cube
-    gamedata.cubes.push_back(new Cube(glm::vec3(20, 60, 20), false));   // 45 degree corner
-    gamedata.cubes.push_back(new Cube(glm::vec3(20, 60, 20), false));   // 45 degree corner
-
-    // Generate vertexdata for all meshes
-    gamedata.turret->generateVertexData(*gamedata.shader);
-    gamedata.portals[0]->generateVertexData(*gamedata.shader);
-    gamedata.portals[1]->generateVertexData(*gamedata.shader);
-    gamedata.player->generateVertexData(*gamedata.shader);
+    // The player and the pair of portals it places are part of every scene
+    gamedata.player = gamedata.pools.cubes.emplace(glm::vec3(1.0f, 1.0f, 1.0f), false);
+    gamedata.portals.push_back(gamedata.pools.portals.emplace(glm::vec2(5, 10), glm::vec3(0.36f, 0.58f, 1.0f)));
+    gamedata.portals.push_back(gamedata.pools.portals.emplace(glm::vec2(5, 10), glm::vec3(1.0f, 0.5f, 0.05f)));
 
     // Create a root node and connect the scene elements as a tree
-    gamedata.root = new Node();
+    gamedata.root = gamedata.pools.nodes.emplace();
     gamedata.root->addChild(*gamedata.camera);
     gamedata.root->addChild(*gamedata.portals[0]);
     gamedata.root->addChild(*gamedata.portals[1]);
-    gamedata.root->addChild(*gamedata.turret);
     gamedata.camera->addChild(*gamedata.player);
-    
-    gamedata.root->addChild(*gamedata.cubes[0]);
-    for(size_t i = 1; i < gamedata.cubes.size(); i++)
-    {
-        gamedata.cubes[0]->addChild(*gamedata.cubes[i]);
-    }
 
-    // Create all lights
-    gamedata.lights[0] = new Light(glm::vec3(0, 0, 0.5), glm::vec3(0.36, 0.58, 1.0));
-    gamedata.lights[1] = new Light(glm::vec3(0, 0, 0.5), glm::vec3(1.0, 0.5, 0.05));
-    gamedata.lights[2] = new Light(glm::vec3(-30,5,0), glm::vec3(0.5, 0.5, 0.5));
-    gamedata.lights[3] = new Light(glm::vec3(0,5,0), glm::vec3(0.5, 0.5, 0.5));
-    gamedata.lights[4] = new Light(glm::vec3(30,5,0), glm::vec3(0.5, 0.5, 0.5));
-    
     // Add lights to the portals
+    gamedata.lights.push_back(gamedata.pools.lights.emplace(glm::vec3(0, 0, 0.5), glm::vec3(0.36, 0.58, 1.0)));
+    gamedata.lights.push_back(gamedata.pools.lights.emplace(glm::vec3(0, 0, 0.5), glm::vec3(1.0, 0.5, 0.05)));
     gamedata.portals[0]->addChild(*gamedata.lights[0]);
     gamedata.portals[1]->addChild(*gamedata.lights[1]);
 
-    // Load all textures and genereate a perlin noise texture
-    gamedata.wallTexture = new Texture("../res/textures/wall.png", LINEAR);
-    gamedata.rubixTexture = new Texture("../res/textures/rubix.png", NEAREST);
-    gamedata.turretTexture = new Texture("../res/textures/turret.bmp", LINEAR);
-    gamedata.noiseTexture = new Texture(255, 255, 4, 50, 34877u);
-    gamedata.noiseTexture->bind(NOISE_TEXTURE_BINDING);
+    // The level file decides which materials and models are needed
+    gamedata.materials = new MaterialLibrary();
+    gamedata.materialSources = {{"../res/textures/wall.png", LINEAR}, {"../res/textures/rubix.png", NEAREST}, {"../res/textures/turret.bmp", LINEAR}};
+    gamedata.level = nullptr;
+    gamedata.streamer = nullptr;
+    if (!scene.level.empty() && !loadLevel(gamedata, scene))
+        std::cerr << "Error: Could not load the level, using the default room" << std::endl;
+    int wallMaterial = 0, rubixMaterial = 1, turretMaterial = 2;
 
+    // Load the assets as a graph: files are read, parsed and decoded on the workers,
+    // and uploaded here in the order they finish
+    AssetGraph assets;
+
+    // The shader. Sample the material texture arrays through bindless handles when the driver supports it
+    std::string defines = MaterialLibrary::supportsBindless() ? "#define BINDLESS\n" : "";
+    std::string vertexCode, fragmentCode;
+    int vertexShader = assets.add("shader.vert", [&] { vertexCode = Shader::load("../shaders/shader.vert", defines); }, nullptr);
+    int fragmentShader = assets.add("shader.frag", [&] { fragmentCode = Shader::load("../shaders/shader.frag", defines); }, nullptr);
+    int program = assets.add("program", nullptr, [&] {
+        if (gamedata.software)
+            return;
+        gamedata.program = gamedata.resources->acquireProgram("../shaders/shader.vert", "../shaders/shader.frag", defines, vertexCode, fragmentCode);
+        gamedata.shader = gamedata.program->program;
+        if (gamedata.resolution)
+            gamedata.resolution->create(*gamedata.resources);
+        if (gamedata.shadows)
+            gamedata.shadows->create(*gamedata.resources);
+        gamedata.shader->activate();
+    }, {vertexShader, fragmentShader});
+
+    // Load all materials into texture arrays. The software renderer decodes them for itself.
+    std::vector<int> textures;
+    if (gamedata.software)
+        gamedata.software->setMaterialCount(gamedata.materialSources.size());
+    for(const LevelMaterial &source : gamedata.materialSources)
+    {
+        int material = gamedata.materials->add(source.path, source.filter);
+        textures.push_back(assets.add(source.path, [&gamedata, material, source] {
+            if (gamedata.software)
+                gamedata.software->loadMaterial(material, source.path, source.filter);
+            else
+                gamedata.materials->load(material);
+        }, nullptr));
+    }
+    assets.add("materials", nullptr, [&] {
+        if (!gamedata.software)
+            gamedata.materials->build(*gamedata.resources);
+    }, textures);
+
+    // Genereate a perlin noise texture
+    NoiseSettings noiseSettings = {255, 255, 1, 4, 50, 0.5f, 34877u, true};
+    std::vector<unsigned char> noise;
+    assets.add("noise", [&] { NoiseTexture::generate(noiseSettings, noise); }, [&] {
+        if (gamedata.software)
+        {
+            gamedata.software->setNoise(noiseSettings, noise);
+            return;
+        }
+        gamedata.noiseResource = gamedata.resources->createTexture("noise", NoiseTexture::getTarget(noiseSettings),
+                                                                   NoiseTexture::getBytes(noiseSettings), MEMORY_TEXTURES);
+        gamedata.noiseTexture = new NoiseTexture(noiseSettings, gamedata.noiseResource->name, noise);
+        gamedata.noiseTexture->bind(NOISE_TEXTURE_BINDING);
+    });
+
+    // Parse the models once, the meshes and the chunk loaders copy the parsed geometry
+    std::vector<LevelModel> modelSources = {{"../res/models/turret.obj", 0.1f}};
+    if (gamedata.level)
+        modelSources = gamedata.level->models;
+    std::vector<int> models;
+    for(const LevelModel &source : modelSources)
+    {
+        models.push_back(assets.add(source.path, [source] { ObjMesh::load(source.path, source.scale); }, nullptr));
+    }
+
+    // Build the rest of the level once the models are parsed, unless it is streamed in
+    int sceneTask = assets.add("scene", [&] {
+        if (!gamedata.streamer && scene.generate)
+            generateScene(gamedata, scene, wallMaterial, rubixMaterial, turretMaterial);
+        else if (!gamedata.streamer)
+            buildDefaultScene(gamedata, wallMaterial, turretMaterial);
+        gamedata.player->material = rubixMaterial;
+    }, nullptr, models);
+
+    // Generate vertexdata for all meshes. The software renderer reads the vertices of the meshes directly.
+    assets.add("meshes", nullptr, [&] {
+        std::vector<Mesh*> meshes(gamedata.turrets.begin(), gamedata.turrets.end());
+        meshes.insert(meshes.end(), gamedata.portals.begin(), gamedata.portals.end());
+        meshes.push_back(gamedata.player);
+        meshes.insert(meshes.end(), gamedata.cubes.begin(), gamedata.cubes.end());
+        for(Mesh *mesh : meshes)
+        {
+            if (gamedata.software)
+                mesh->computeBounds();
+            else
+                mesh->generateVertexData(*gamedata.shader, *gamedata.resources);
+            if (gamedata.releaseGeometry)
+                mesh->releaseGeometry();
+        }
+    }, {program, sceneTask});
+
+    assets.run(*gamedata.jobs);
+    assets.printTimeline();
+
+    if (!gamedata.software)
+    {
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glEnable(GL_BLEND);
+    }
+
+    gamedata.window->disableCursor();
+
+    // Start the simulation clock, and give every node a valid transform before the first tick
+    gamedata.simulationTime = 0;
+    gamedata.accumulator = 0;
+    gamedata.prevFrameTime = gamedata.window->getTime();
+    gamedata.frame = 0;
+    gamedata.simulation = nullptr;
+    gamedata.script = nullptr;
+    gamedata.snapshots = new TripleBuffer<RenderSnapshot>();
+    gamedata.views.resize(PORTAL_MAX_VIEWS);
+    gamedata.viewCount = 0;
+    refreshScene(gamedata);
+
+    // Load the chunks around the start before the first frame
+    if (gamedata.streamer)
+    {
+        for(Node *node : gamedata.nodes)
+        {
+            node->setRenderTransform(node->getTransformMatrix());
+        }
+        streamLevel(gamedata, true);
+    }
+
+    if (!scene.saveLevel.empty())
+        saveLevel(gamedata, scene.saveLevel);
+}
+
+// Rebuilds everything derived from the scene graph, after nodes were added or removed
+void refreshScene(gamedata_st &gamedata)
+{
+    PROFILE_ZONE("refreshScene");
+
+    // The meshes of the world, in draw order, with room for the draws of every view
+    gamedata.meshes.assign(gamedata.cubes.begin(), gamedata.cubes.end());
+    gamedata.meshes.push_back(gamedata.player);
+    gamedata.meshes.insert(gamedata.meshes.end(), gamedata.turrets.begin(), gamedata.turrets.end());
+    for(RenderView &view : gamedata.views)
+    {
+        view.draws.reserve(gamedata.meshes.size());
+    }
+
+    // Lights take the slots of the uniform arrays in order
+    for(size_t i = 0; i < gamedata.lights.size(); i++)
+    {
+        gamedata.lights[i]->setID(i);
+    }
+    if (gamedata.shadows)
+        gamedata.shadows->invalidate();
+
+    // Allocate the snapshots for every node in the scene, and publish the current state
+    gamedata.root->updateTransforms();
+    gamedata.nodes.clear();
+    gamedata.root->collect(gamedata.nodes);
+    gamedata.snapshots->reset({
+        std::vector<glm::mat4>(gamedata.nodes.size()),
+        std::vector<glm::mat4>(gamedata.nodes.size()),
+        glm::fquat(1, 0, 0, 0), 0, 0
+    });
+    publishSnapshot(gamedata);
+}
+
+// Opens a level file, places its portals and camera, and starts streaming its chunks.
+// The materials of the level are added to the built in ones.
+bool loadLevel(gamedata_st &gamedata, const SceneSettings &scene)
+{
+    LevelFile *level = new LevelFile();
+    if (!level->open(scene.level))
+    {
+        delete level;
+        return false;
+    }
+
+    // Level materials map to the library, sharing the built in textures
+    std::vector<int> materialMap;
+    for(const LevelMaterial &material : level->materials)
+    {
+        size_t index = 0;
+        while(index < gamedata.materialSources.size() && gamedata.materialSources[index].path != material.path)
+            index++;
+        if(index == gamedata.materialSources.size())
+            gamedata.materialSources.push_back(material);
+        materialMap.push_back(index);
+    }
+
+    // The first pair is the one of the player
+    for(size_t i = 0; i < level->portals.size(); i++)
+    {
+        const LevelPortal &record = level->portals[i];
+        if(i >= 2)
+        {
+            gamedata.portals.push_back(gamedata.pools.portals.emplace(glm::vec2(record.dimensions[0], record.dimensions[1]), glm::vec3(record.color[0], record.color[1], record.color[2])));
+            gamedata.root->addChild(*gamedata.portals[i]);
+        }
+        gamedata.portals[i]->setPosition(glm::vec3(record.position[0], record.position[1], record.position[2]));
+        gamedata.portals[i]->setOrientation(glm::fquat(record.orientation[0], record.orientation[1], record.orientation[2], record.orientation[3]));
+    }
+    gamedata.camera->setPosition(level->spawn);
+
+    gamedata.level = level;
+    gamedata.streamer = new LevelStreamer(level, &gamedata.pools, gamedata.resources, materialMap, scene.streamRadius, (size_t) scene.streamBudget << 20);
+    gamedata.streamer->setReleaseGeometry(gamedata.releaseGeometry);
+    return true;
+}
+
+// Loads and unloads chunks of the streamed level around the camera. Finished chunks are attached to the scene here,
+// with the simulation paused, as it owns the scene graph. With blocking set, the queued chunks are waited for.
+void streamLevel(gamedata_st &gamedata, bool blocking)
+{
+    PROFILE_ZONE("streamLevel");
+
+    // The render transforms belong to the main thread, so they are read instead of the simulated ones
+    std::vector<glm::vec3> &portals = gamedata.portalPositions;
+    portals.clear();
+    for(Portal *portal : gamedata.portals)
+    {
+        portals.push_back(portal->getRenderPosition());
+    }
+    gamedata.streamer->plan(gamedata.camera->getRenderPosition(), portals);
+    if (blocking)
+        gamedata.streamer->finish();
+    if (!gamedata.streamer->hasChanges())
+        return;
+
+    if (gamedata.simulation)
+        gamedata.simulation->wait();
+
+    std::vector<LevelChunk*> attached, evicted;
+    gamedata.streamer->apply(gamedata.shader, MAX_LIGHTS - gamedata.lights.size(), attached, evicted);
+    for(LevelChunk *chunk : attached)
+    {
+        for(Node *node : chunk->roots)
+            gamedata.root->addChild(*node);
+        for(Handle<Cube> cube : chunk->cubes)
+            gamedata.cubes.push_back(gamedata.pools.cubes.get(cube));
+        for(Handle<ObjMesh> model : chunk->models)
+            gamedata.turrets.push_back(gamedata.pools.models.get(model));
+        gamedata.turretPositions.insert(gamedata.turretPositions.end(), chunk->modelPositions.begin(), chunk->modelPositions.end());
+        for(Handle<Light> light : chunk->lights)
+            gamedata.lights.push_back(gamedata.pools.lights.get(light));
+    }
+    for(LevelChunk *chunk : evicted)
+    {
+        for(Node *node : chunk->roots)
+            gamedata.root->removeChild(*node);
+        for(Handle<Cube> cube : chunk->cubes)
+            gamedata.cubes.erase(std::find(gamedata.cubes.begin(), gamedata.cubes.end(), gamedata.pools.cubes.get(cube)));
+        for(Handle<ObjMesh> model : chunk->models)
+        {
+            size_t index = std::find(gamedata.turrets.begin(), gamedata.turrets.end(), gamedata.pools.models.get(model)) - gamedata.turrets.begin();
+            gamedata.turrets.erase(gamedata.turrets.begin() + index);
+            gamedata.turretPositions.erase(gamedata.turretPositions.begin() + index);
+        }
+        for(Handle<Light> light : chunk->lights)
+            gamedata.lights.erase(std::find(gamedata.lights.begin(), gamedata.lights.end(), gamedata.pools.lights.get(light)));
+    }
+
+    refreshScene(gamedata);
+    for(LevelChunk *chunk : evicted)
+    {
+        gamedata.streamer->evict(chunk);
+    }
+}
+
+// Writes the scene as a level file. Every top level node is saved with its subtree in the chunk it stands in.
+// The camera, player and portals are saved as the spawn and portal table.
+bool saveLevel(gamedata_st &gamedata, std::string path)
+{
+    LevelWriter writer;
+    writer.materials = gamedata.materialSources;
+    writer.spawn = gamedata.camera->getGlobalPosition();
+    for(Portal *portal : gamedata.portals)
+    {
+        glm::vec3 position = portal->getPosition();
+        glm::fquat orientation = portal->getOrientation();
+        glm::vec3 color = portal->getColor();
+        writer.portals.push_back({
+            {position.x, position.y, position.z},
+            {orientation.w, orientation.x, orientation.y, orientation.z},
+            {portal->getDimensions().x, portal->getDimensions().y},
+            {color.x, color.y, color.z}
+        });
+    }
+
+    std::map<Node*, Cube*> cubes;
+    std::map<Node*, size_t> turrets;
+    std::map<Node*, Light*> lights;
     for(Cube *cube : gamedata.cubes)
+        cubes[cube] = cube;
+    for(size_t i = 0; i < gamedata.turrets.size(); i++)
+        turrets[gamedata.turrets[i]] = i;
+    for(Light *light : gamedata.lights)
+        lights[light] = light;
+
+    // Saves a node and its subtree. Nodes of other types are skipped with their children.
+    std::function<void(Node*, int, int)> saveNode = [&](Node *node, int chunk, int parent) {
+        glm::vec3 position = node->getPosition();
+        glm::fquat orientation = node->getOrientation();
+        LevelNode record = {LEVEL_BOX, parent, -1, -1,
+            {position.x, position.y, position.z},
+            {orientation.w, orientation.x, orientation.y, orientation.z},
+            {0, 0, 0}};
+
+        Mesh *mesh = nullptr;
+        glm::vec3 size = glm::vec3(0);
+        if(cubes.count(node))
+        {
+            Cube *cube = cubes[node];
+            record.type = cube->isInside() ? LEVEL_ROOM : LEVEL_BOX;
+            size = cube->getDimensions();
+            mesh = cube;
+        }
+        else if(turrets.count(node))
+        {
+            ObjMesh *turret = gamedata.turrets[turrets[node]];
+            record.type = LEVEL_MODEL;
+            record.model = writer.addModel(turret->getPath(), turret->getScale());
+            position = gamedata.turretPositions[turrets[node]];
+            mesh = turret;
+        }
+        else if(lights.count(node))
+        {
+            record.type = LEVEL_LIGHT;
+            size = lights[node]->getColor();
+        }
+        else
+        {
+            return;
+        }
+
+        for(int i = 0; i < 3; i++)
+        {
+            record.position[i] = position[i];
+            record.size[i] = size[i];
+        }
+
+        glm::vec3 boundsMin = node->getGlobalPosition(), boundsMax = boundsMin;
+        uint32_t memory = 0;
+        if(mesh)
+        {
+            glm::vec3 center, extents;
+            transformBounds(mesh->boundsMin, mesh->boundsMax, mesh->getTransformMatrix(), center, extents);
+            boundsMin = center - extents;
+            boundsMax = center + extents;
+            record.material = mesh->material;
+            memory = mesh->getGeometryBytes();
+        }
+
+        int index = writer.addNode(chunk, record, boundsMin, boundsMax, memory);
+        for(Node *child : node->getChildren())
+        {
+            saveNode(child, chunk, index);
+        }
+    };
+
+    for(Node *node : gamedata.root->getChildren())
     {
-        cube->generateVertexData(*gamedata.shader);
-        cube->albedo = gamedata.wallTexture;
+        saveNode(node, writer.chunkAt(node->getGlobalPosition()), -1);
     }
+    return writer.write(path);
+}
+
+
+// The hand made room of the demo: a room with a few blocks, a turret and three lights
+void buildDefaultScene(gamedata_st &gamedata, int wallMaterial, int turretMaterial)
+{
+    ObjMesh *turret = gamedata.pools.models.emplace("../res/models/turret.obj", 0.1f);
+    turret->material = turretMaterial;
+    gamedata.turrets.push_back(turret);
+    gamedata.turretPositions.push_back(glm::vec3(0, -25, 0));
+    gamedata.root->addChild(*turret);
+
+    gamedata.cubes.push_back(gamedata.pools.cubes.emplace(glm::vec3(120, 60, 60), true));   // The room
+    gamedata.cubes.push_back(gamedata.pools.cubes.emplace(glm::vec3(20, 20, 60), false));   // The Long bar
+    gamedata.cubes.push_back(gamedata.pools.cubes.emplace(glm::vec3(40, 20, 20), false));   // The center cube
+    gamedata.cubes.push_back(gamedata.pools.cubes.emplace(glm::vec3(20, 60, 20), false));   // 45 degree corner
+    gamedata.cubes.push_back(gamedata.pools.cubes.emplace(glm::vec3(20, 60, 20), false));   // 45 degree corner
+
+    gamedata.root->addChild(*gamedata.cubes[0]);
+    for(size_t i = 1; i < gamedata.cubes.size(); i++)
+    {
+        gamedata.cubes[0]->addChild(*gamedata.cubes[i]);
+    }
+    for(Cube *cube : gamedata.cubes)
+    {
+        cube->material = wallMaterial;
+    }
+
+    gamedata.lights.push_back(gamedata.pools.lights.emplace(glm::vec3(-30,5,0), glm::vec3(0.5, 0.5, 0.5)));
+    gamedata.lights.push_back(gamedata.pools.lights.emplace(glm::vec3(0,5,0), glm::vec3(0.5, 0.5, 0.5)));
+    gamedata.lights.push_back(gamedata.pools.lights.emplace(glm::vec3(30,5,0), glm::vec3(0.5, 0.5, 0.5)));
 
-    // Assign all initial textures
-    gamedata.player->albedo = gamedata.rubixTexture;
-    gamedata.turret->albedo = gamedata.turretTexture;
-    
     // Initial position of the portals
     gamedata.portals[0]->setPosition(glm::vec3(-8, -24, -9.8f));
     gamedata.portals[1]->setPosition(glm::vec3(8, -24, -9.8f));
@@ -144,271 +820,884 @@ void init(gamedata_st &gamedata)
     gamedata.cubes[4]->setPosition(glm::vec3(-60, 0, -30));
     gamedata.cubes[3]->rotate(glm::vec3(0, 1, 0), M_PI / 4);
     gamedata.cubes[4]->rotate(glm::vec3(0, 1, 0), M_PI / 4);
+}
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-    glEnable(GL_BLEND);
-
-    gamedata.window->disableCursor();
+// Moves the simulation to its own thread. From here on, only the simulation thread may touch the simulation
+// state (node positions, camera direction, portals), and the main thread only reads the snapshots.
+void startSimulationThread(gamedata_st &gamedata)
+{
+    gamedata.simulation = new SimulationThread();
+    gamedata.simulation->start([&gamedata](const InputState &input) {
+        simulate(gamedata, input);
+    });
 }
 
+// Handles the input of this frame on the main thread, and passes it on to the simulation
 void update(gamedata_st &gamedata)
 {
-    // Update the global position of all the nodes in the scene
-    gamedata.root->updateTransforms();
-
-    // Rotate and bob the turret up and down
-    double time = gamedata.window->getTime();
-    gamedata.turret->rotate(glm::vec3(0, 1, 0), 0.01f);
-    gamedata.turret->setPosition(glm::vec3(0, -25 + sin(time), 0));
+    PROFILE_ZONE("update");
 
     // Update the inputs of the window. E.g check if buttons were pressed this frame
     gamedata.window->updateInput();
 
-    // Direct the camera using the mouse
+    // Regenerate the portal noise with a new seed by pressing N. It is generated in the background
+    if (gamedata.noiseTexture && gamedata.window->isKeyPressed(GLFW_KEY_N))
+        gamedata.noiseTexture->regenerate((uint32_t) (gamedata.window->getTime() * 1000));
+
+    // Write a trace of the next frames by pressing F12 (requires PORTAL_PROFILE=1)
+    if (gamedata.window->isKeyPressed(GLFW_KEY_F12))
+        Profiler::get().captureTrace();
+
+    // Print the render graph of the next frame by pressing F11
+    if (gamedata.window->isKeyPressed(GLFW_KEY_F11))
+        gamedata.dumpGraph = true;
+
+    // Bring the chunks of the level around the camera in and out
+    if (gamedata.streamer)
+        streamLevel(gamedata, false);
+
+    // Exit the game by pressing escape
+    if (gamedata.window->isKeyDown(GLFW_KEY_ESCAPE))
+        gamedata.window->close();
+
+    // The simulation thread gets a copy of the input, so it can run while the next frame polls events
+    if (gamedata.simulation)
+        gamedata.simulation->submit(gamedata.window->getInput().getState());
+    else
+        simulate(gamedata, gamedata.window->getInput().getState());
+}
+
+// Simulates one frame: applies the input, runs the fixed ticks that are due and publishes a snapshot for rendering
+void simulate(gamedata_st &gamedata, const InputState &input)
+{
+    PROFILE_ZONE("simulate");
+
+    // Move the camera along the benchmark path, and place portals where it is looking
+    if (gamedata.script)
+    {
+        float position[3], yaw, pitch;
+        gamedata.script->getCamera(gamedata.frame, position, yaw, pitch);
+        gamedata.camera->setPosition(glm::vec3(position[0], position[1], position[2]));
+        gamedata.camera->setDirection(yaw, pitch);
+        gamedata.camera->snap();
+        gamedata.root->updateTransforms();
+        gamedata.script->getPortalEvents(gamedata.frame, gamedata.portalEvents);
+        for (int portal : gamedata.portalEvents)
+            placePortals(gamedata, portal);
+    }
+
+    // Direct the camera using the mouse. This is done every frame instead of every tick to keep the view responsive
     gamedata.camera->direct(
-        -gamedata.window->getMouseDelta().x / 500,
-        -gamedata.window->getMouseDelta().y / 500
+        -input.mouseDelta.x / 500,
+        -input.mouseDelta.y / 500
     );
-    
+
+    // If the mouse buttons are pressed, attempt to place the corresponding portal
+    if(input.isMouseButtonPressed(GLFW_MOUSE_BUTTON_1))
+    {
+        placePortals(gamedata, 0);
+    }
+    else if(input.isMouseButtonPressed(GLFW_MOUSE_BUTTON_2))
+    {
+        placePortals(gamedata, 1);
+    }
+
+    // Run as many fixed ticks as the time since the last frame covers
+    gamedata.accumulator += std::min(input.time - gamedata.prevFrameTime, MAX_FRAME_TIME);
+    gamedata.prevFrameTime = input.time;
+    while (gamedata.accumulator >= TICK_DT)
+    {
+        tick(gamedata, input, (float) TICK_DT);
+        gamedata.accumulator -= TICK_DT;
+    }
+
+    publishSnapshot(gamedata);
+    gamedata.frame++;
+}
+
+// Advances the simulation by one fixed step of dt seconds
+void tick(gamedata_st &gamedata, const InputState &input, float dt)
+{
+    PROFILE_ZONE("tick");
+
+    // Keep the transforms of the last tick to interpolate from
+    gamedata.root->storePreviousTransforms();
+    gamedata.simulationTime += dt;
+
+    // Rotate and bob the turrets up and down, each a bit out of phase with the others
+    for(size_t i = 0; i < gamedata.turrets.size(); i++)
+    {
+        gamedata.turrets[i]->rotate(glm::vec3(0, 1, 0), TURRET_SPEED * dt);
+        gamedata.turrets[i]->setPosition(gamedata.turretPositions[i] + glm::vec3(0, sin(gamedata.simulationTime + i), 0));
+    }
+
     // Get the camera translation in world space based on keyboard input
     glm::vec3 camTranslation = gamedata.camera->getCameraTranslation(glm::vec3(
-        (gamedata.window->isKeyDown(GLFW_KEY_D) - gamedata.window->isKeyDown(GLFW_KEY_A)) / 5.0f,
-        (gamedata.window->isKeyDown(GLFW_KEY_SPACE) - gamedata.window->isKeyDown(GLFW_KEY_LEFT_SHIFT)) / 5.0f,
-        (gamedata.window->isKeyDown(GLFW_KEY_W) - gamedata.window->isKeyDown(GLFW_KEY_S)) / 5.0f    
-    ));
+        input.isKeyDown(GLFW_KEY_D) - input.isKeyDown(GLFW_KEY_A),
+        input.isKeyDown(GLFW_KEY_SPACE) - input.isKeyDown(GLFW_KEY_LEFT_SHIFT),
+        input.isKeyDown(GLFW_KEY_W) - input.isKeyDown(GLFW_KEY_S)
+    ) * MOVE_SPEED * dt);
 
     // Move the camera using the translation
     gamedata.camera->translate(camTranslation);
 
-    // Check if the camera would pass through the portal and move it if it does
-    // If the camera passes through the portal, it cannot pass through the other portal
-    if(!gamedata.portals[0]->passthrough(*gamedata.camera, camTranslation, *gamedata.portals[1]))
+    // Check if the camera would pass through a portal and move it if it does
+    // If the camera passes through a portal, it cannot pass through any other portal this tick
+    for(size_t i = 0; i + 1 < gamedata.portals.size(); i += 2)
     {
-        gamedata.portals[1]->passthrough(*gamedata.camera, camTranslation, *gamedata.portals[0]);
+        if(gamedata.portals[i]->passthrough(*gamedata.camera, camTranslation, *gamedata.portals[i + 1]) ||
+           gamedata.portals[i + 1]->passthrough(*gamedata.camera, camTranslation, *gamedata.portals[i]))
+        {
+            break;
+        }
     }
 
-    // If the mouse buttons are pressed, attempt to place a portal
-    if(
-        gamedata.window->isMouseButtonPressed(GLFW_MOUSE_BUTTON_1) || 
-        gamedata.window->isMouseButtonPressed(GLFW_MOUSE_BUTTON_2)
-    )
+    // Update the global position of all the nodes in the scene
     {
-        placePortals(gamedata);
+        PROFILE_ZONE("transforms");
+        gamedata.root->updateTransforms(*gamedata.jobs);
     }
+}
 
-    // Exit the game by pressing escape
-    if (gamedata.window->isKeyDown(GLFW_KEY_ESCAPE))
-        gamedata.window->close();
+// Copies the transforms of the last two ticks into the next snapshot and hands it to the renderer
+void publishSnapshot(gamedata_st &gamedata)
+{
+    PROFILE_ZONE("publishSnapshot");
+
+    RenderSnapshot &snapshot = gamedata.snapshots->write();
+    for (size_t i = 0; i < gamedata.nodes.size(); i++)
+    {
+        snapshot.previous[i] = gamedata.nodes[i]->getPreviousTransform();
+        snapshot.current[i] = gamedata.nodes[i]->getTransformMatrix();
+    }
+    snapshot.cameraOrientation = gamedata.camera->getOrientation();
+    snapshot.alpha = (float) (gamedata.accumulator / TICK_DT);
+    snapshot.frame = gamedata.frame;
+    gamedata.snapshots->publish();
 }
 
 // Attempt to place a portal by casting two rays intersecting with the cubes in the scene
-void placePortals(gamedata_st &gamedata)
+void placePortals(gamedata_st &gamedata, int portalIndex)
 {
+    PROFILE_ZONE("placePortals");
+
     #define MAX_DIST 1000.0f // Max distance for the rays
-    float dist = MAX_DIST;
-    glm::vec3 pos, normal, up;  // Positions, normal and up vector of the wall that is hit
-    for(Cube *cube : gamedata.cubes)
-    {
-        // Cast two rays, one from the camara and one from some distance upward in viewspace
-        // This is to find the upward vector along surfaces which have a non-zero z-value in the normalvector
-        glm::vec3 intersectNormal1, intersectNormal2;
-        glm::vec3 intersection1, intersection2;
-        if(
-            cube->isColliding(gamedata.camera->getGlobalPosition(), MAX_DIST * gamedata.camera->get3DLookingVector(), intersectNormal1, intersection1) && 
-            cube->isColliding(gamedata.camera->getGlobalPosition() + gamedata.camera->getUpVector(), MAX_DIST * gamedata.camera->get3DLookingVector(), intersectNormal2, intersection2) &&
-            intersectNormal1 == intersectNormal2 // Check if the normals are equal, to not place portals in corners
-        )
+
+    glm::vec3 origin = gamedata.camera->getGlobalPosition();
+    glm::vec3 ray = MAX_DIST * gamedata.camera->get3DLookingVector();
+    glm::vec3 upVector = gamedata.camera->getUpVector();
+
+    // Test the cubes in parallel, each job writes the hits of its own cubes
+    std::vector<RayHit> &hits = gamedata.hits;
+    hits.assign(gamedata.cubes.size(), {MAX_DIST, glm::vec3(0), glm::vec3(0), glm::vec3(0)});
+    gamedata.jobs->parallelFor("rayQueries", gamedata.cubes.size(), 8, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
         {
-            // Find the closest intersection point
-            float tmpDist = glm::distance(gamedata.camera->getGlobalPosition(), intersection1);
-            if(dist > tmpDist)
+            // Cast two rays, one from the camara and one from some distance upward in viewspace
+            // This is to find the upward vector along surfaces which have a non-zero z-value in the normalvector
+            glm::vec3 intersectNormal1, intersectNormal2;
+            glm::vec3 intersection1, intersection2;
+            if(
+                gamedata.cubes[i]->isColliding(origin, ray, intersectNormal1, intersection1) && 
+                gamedata.cubes[i]->isColliding(origin + upVector, ray, intersectNormal2, intersection2) &&
+                intersectNormal1 == intersectNormal2 // Check if the normals are equal, to not place portals in corners
+            )
             {
-                dist = tmpDist;
-                normal = intersectNormal1;
-                pos = intersection1;
-                up = intersection2 - intersection1;
+                hits[i] = {glm::distance(origin, intersection1), intersection1, intersectNormal1, intersection2 - intersection1};
             }
         }
+    });
+
+    // Find the closest intersection point. The first of equally close hits wins, as before.
+    RayHit closest = {MAX_DIST, glm::vec3(0), glm::vec3(0), glm::vec3(0)};
+    for(const RayHit &hit : hits)
+    {
+        if(closest.dist > hit.dist)
+        {
+            closest = hit;
+        }
     }
 
-    // Place the portal corresponding to the mouse button pressed
-    if(dist != MAX_DIST)
+    // Place the portal at the closest hit
+    if(closest.dist != MAX_DIST)
     {
-        Portal *portal = gamedata.window->isMouseButtonDown(GLFW_MOUSE_BUTTON_1) ? gamedata.portals[0] : gamedata.portals[1];
-        portal->place(pos + normal * 0.2f, normal, up);
+        gamedata.portals[portalIndex]->place(closest.pos + closest.normal * 0.2f, closest.normal, closest.up);
     }
 }
 
 void render(gamedata_st &gamedata)
 {
-    // Send the time to the fragmentshader
-    int uTimeLoc = gamedata.shader->getUniformLocation("u_time");
-    glUniform1f(uTimeLoc, (float) gamedata.window->getTime());
+    PROFILE_GPU_ZONE("render");
 
-    // Update all lights in the fragment shader
-    for(int i = 0; i < N_LIGHTS; i++)
+    // Take the latest simulated frame, and render the state between its last two ticks.
+    // If the simulation has not finished a new frame, the previous snapshot is rendered again.
+    if (gamedata.snapshots->update())
     {
-        gamedata.lights[i]->updateUniform(*gamedata.shader);
+        PROFILE_ZONE("interpolate");
+        const RenderSnapshot &snapshot = gamedata.snapshots->read();
+        for (size_t i = 0; i < gamedata.nodes.size(); i++)
+        {
+            gamedata.nodes[i]->setRenderTransform(Node::interpolate(snapshot.previous[i], snapshot.current[i], snapshot.alpha));
+        }
+        gamedata.camera->setRenderOrientation(snapshot.cameraOrientation);
     }
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    // Upload the regenerated noise texture, if it finished this frame
+    if (!gamedata.software)
+        gamedata.noiseTexture->update();
 
-    // Render the recursive portals
+    // Plan the views through the portals, then compile their draw lists and scissors and bin the lights in parallel,
+    // before anything is drawn
     glm::mat4 view = gamedata.camera->getViewMatrix();
     glm::mat4 proj = gamedata.camera->getPerspectiveMatrix();
-    renderRecursivePortals(gamedata, view, proj, 10);
+    planViews(gamedata, view, proj);
+    if (gamedata.resolution)
+    {
+        gamedata.resolution->update(gamedata.window->getRealTime());
+        gamedata.resolution->plan(gamedata.views, gamedata.viewCount);
+    }
+    compileViews(gamedata);
+    binLights(gamedata);
+
+    // Render the shadows and the views through the portals as the passes of a render graph
+    renderViews(gamedata);
+    if (gamedata.software)
+        gamedata.software->finish(*gamedata.jobs);
 
+    PROFILE_ZONE("swapBuffers");
     gamedata.window->swapBuffers();
+    gamedata.resources->endFrame();
 }
 
-void recursivePortalHelper(gamedata_st gamedata, glm::mat4 proj, glm::mat4 p1View, glm::mat4 p1Proj, glm::mat4 p2View, glm::mat4 p2Proj, int maxDepth, int depth);
-void renderRecursivePortals(gamedata_st &gamedata, glm::mat4 view, glm::mat4 proj, int maxDepth)
+// Adds the portals seen in the view to its frames, and the ones that can be looked through to the candidates
+void findPortals(gamedata_st &gamedata, int viewIndex, std::vector<ViewCandidate> &candidates)
 {
-    glEnable(GL_STENCIL_TEST);
-    glStencilMask(0xff);
+    RenderView &view = gamedata.views[viewIndex];
+    const glm::vec3 &eye = view.eye;
+
+    // The view looks out of the partner of the portal it looks through. Everything behind that portal is clipped.
+    int exit = view.portal < 0 ? -1 : view.portal ^ 1;
+    Portal *exitPortal = exit < 0 ? nullptr : gamedata.portals[exit];
+
+    for(int p = 0; p < (int) gamedata.portals.size(); p++)
+    {
+        Portal *portal = gamedata.portals[p];
+        glm::vec3 position = portal->getRenderPosition();
+        float radius = glm::max(portal->getDimensions().x, portal->getDimensions().y) / 2;
+
+        // Only the front of a portal can be seen
+        if(p == exit || glm::dot(portal->getRenderNormal(), eye - position) <= 0)
+            continue;
+        if(exitPortal && glm::dot(exitPortal->getRenderNormal(), position - exitPortal->getRenderPosition()) < -radius)
+            continue;
 
-    recursivePortalHelper(gamedata, proj, view, proj, view, proj, maxDepth, 0);
+        // A portal is only seen inside the screen rectangle of the portal the view looks through
+        glm::vec4 bounds;
+        if(!portal->getScreenBounds(view.viewProjection, bounds))
+            continue;
+        bounds = glm::vec4(glm::max(glm::vec2(bounds), glm::vec2(view.bounds)), glm::min(glm::vec2(bounds.z, bounds.w), glm::vec2(view.bounds.z, view.bounds.w)));
+        if(bounds.x >= bounds.z || bounds.y >= bounds.w)
+            continue;
 
-    glDisable(GL_STENCIL_TEST);
+        view.frames.push_back(p);
+        if(view.depth < PORTAL_MAX_DEPTH && (size_t) (p ^ 1) < gamedata.portals.size())
+        {
+            candidates.push_back({(bounds.z - bounds.x) * (bounds.w - bounds.y) / 4, viewIndex, p, bounds});
+            std::push_heap(candidates.begin(), candidates.end());
+        }
+    }
 }
 
-void recursivePortalHelper(gamedata_st gamedata, glm::mat4 proj, glm::mat4 p1View, glm::mat4 p1Proj, glm::mat4 p2View, glm::mat4 p2Proj, int maxDepth, int depth)
+// Plans the views through the portals as a traversal of the portal graph. The candidate covering the largest part of the
+// screen is looked through first, until PORTAL_MAX_VIEWS views, so the budget goes to the branches that are seen the most.
+// The matrices, eye and clip plane of every view are computed here, compileViews() does the rest.
+void planViews(gamedata_st &gamedata, const glm::mat4 &view, const glm::mat4 &proj)
 {
-    int uViewLoc = gamedata.shader->getUniformLocation("view");
-    int uProjLoc = gamedata.shader->getUniformLocation("proj");
-    Portal *p1 = gamedata.portals[0];
-    Portal *p2 = gamedata.portals[1];
+    PROFILE_ZONE("planViews");
+    static_assert(PORTAL_MAX_VIEWS <= 256, "Every view needs its own 8 bit stencil value");
 
-    // Render the world inside portal 1. 
-    // On depth 0, this is the world outside the portals
-    glStencilFunc(GL_EQUAL, depth, 0xff);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-    renderWorld(gamedata, p1View, p1Proj);
+    RenderView &camera = gamedata.views[0];
+    camera.view = view;
+    camera.proj = proj;
+    camera.viewProjection = proj * view;
+    camera.eye = viewEye(view);
+    camera.clipPlane = glm::vec4(0);
+    camera.parent = camera.portal = -1;
+    camera.depth = 0;
+    camera.stencil = 0;
+    camera.bounds = glm::vec4(-1, -1, 1, 1);
+    camera.children.clear();
+    camera.frames.clear();
+    gamedata.viewCount = 1;
+
+    std::vector<ViewCandidate> &candidates = gamedata.candidates;
+    candidates.clear();
+    findPortals(gamedata, 0, candidates);
+    while(!candidates.empty() && gamedata.viewCount < PORTAL_MAX_VIEWS)
+    {
+        std::pop_heap(candidates.begin(), candidates.end());
+        ViewCandidate candidate = candidates.back();
+        candidates.pop_back();
+
+        // Looking into the portal, and out of its partner
+        int index = gamedata.viewCount++;
+        RenderView &parent = gamedata.views[candidate.parent];
+        RenderView &next = gamedata.views[index];
+        Portal *portal = gamedata.portals[candidate.portal];
+        Portal *destination = gamedata.portals[candidate.portal ^ 1];
+        next.view = portal->getViewMatrix(parent.view, destination);
+        next.eye = viewEye(next.view);
+        // Create the oblique projections using the standard projection, assumes that the input has a standard view-frustum
+        next.clipPlane = destination->getClipPlane();
+        next.proj = Portal::getObliqueProjection(proj, next.view, next.clipPlane);
+        next.viewProjection = next.proj * next.view;
+        next.parent = candidate.parent;
+        next.portal = candidate.portal;
+        next.depth = parent.depth + 1;
+        next.stencil = index;
+        next.bounds = candidate.bounds;
+        next.children.clear();
+        next.frames.clear();
+
+        parent.children.push_back(index);
+        parent.frames.erase(std::find(parent.frames.begin(), parent.frames.end(), candidate.portal));
+        findPortals(gamedata, index, candidates);
+    }
 
-    if(depth > 0)
+    // Where portals overlap, the nearest one has to mark the stencil first
+    for(size_t i = 0; i < gamedata.viewCount; i++)
     {
-        // Render the world inside portal 2
-        glStencilFunc(GL_EQUAL, (uint8_t)-depth, 0xff);
-        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-        renderWorld(gamedata, p2View, p2Proj);
+        RenderView &parent = gamedata.views[i];
+        std::sort(parent.children.begin(), parent.children.end(), [&](int a, int b) {
+            return glm::distance(parent.eye, gamedata.portals[gamedata.views[a].portal]->getRenderPosition())
+                 < glm::distance(parent.eye, gamedata.portals[gamedata.views[b].portal]->getRenderPosition());
+        });
     }
+}
+
+// Compiles the planned views for submission as parallel jobs: the list of the meshes visible in each view, and its
+// scissor rectangles in the pixels of the targets it is drawn into. Needs the scales of dynamic resolution for the frame.
+// Then the scissor of each depth covers the scissors of its views, for the depth clears.
+void compileViews(gamedata_st &gamedata)
+{
+    PROFILE_ZONE("compileViews");
+
+    int width = gamedata.window->getWidth();
+    int height = gamedata.window->getHeight();
+    auto targetSize = [&](int depth) {
+        float scale = gamedata.resolution ? gamedata.resolution->getScale(depth) : 1.0f;
+        return glm::ivec2(DynamicResolution::scaled(width, scale), DynamicResolution::scaled(height, scale));
+    };
+
+    // One job per view
+    gamedata.jobs->parallelFor("compileView", gamedata.viewCount, 1, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            RenderView &view = gamedata.views[i];
+            Frustum frustum(view.viewProjection);
+            view.draws.clear();
+            for(size_t m = 0; m < gamedata.meshes.size(); m++)
+            {
+                Mesh *mesh = gamedata.meshes[m];
+                glm::vec3 center, extents;
+                transformBounds(mesh->boundsMin, mesh->boundsMax, mesh->getRenderTransform(), center, extents);
+                if(frustum.intersects(center, extents))
+                    view.draws.push_back(m);
+            }
 
-    if (depth < maxDepth)
+            glm::ivec2 size = targetSize(view.depth);
+            view.scissor = scissorRect(view.bounds, size.x, size.y);
+            if(view.parent >= 0)
+            {
+                glm::ivec2 parentSize = targetSize(view.depth - 1);
+                view.parentScissor = scissorRect(view.bounds, parentSize.x, parentSize.y);
+            }
+        }
+    });
+
+    // Merged as min x, min y, max x, max y, then turned into x, y, width, height
+    std::vector<glm::ivec4> &depthScissors = gamedata.depthScissors;
+    depthScissors.clear();
+    for(size_t i = 0; i < gamedata.viewCount; i++)
     {
-        // Create the stencil for portal 1 by incrementing the stencil buffer
-        glStencilFunc(GL_EQUAL, depth, 0xff);
-        glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+        const RenderView &view = gamedata.views[i];
+        glm::ivec2 min = glm::ivec2(view.scissor);
+        glm::ivec2 max = min + glm::ivec2(view.scissor.z, view.scissor.w);
+        if((size_t) view.depth >= depthScissors.size())
+            depthScissors.resize(view.depth + 1, glm::ivec4(INT_MAX, INT_MAX, 0, 0));
+        glm::ivec4 &merged = depthScissors[view.depth];
+        merged = glm::ivec4(glm::min(glm::ivec2(merged), min), glm::max(glm::ivec2(merged.z, merged.w), max));
+    }
+    for(glm::ivec4 &rect : depthScissors)
+        rect = glm::ivec4(rect.x, rect.y, rect.z - rect.x, rect.w - rect.y);
+}
 
-        glUniformMatrix4fv(uViewLoc, 1, GL_FALSE, glm::value_ptr(p1View));
-        glUniformMatrix4fv(uProjLoc, 1, GL_FALSE, glm::value_ptr(p1Proj));
+// Finds the lights that can reach each mesh, so the fragment shader skips the others
+void binLights(gamedata_st &gamedata)
+{
+    float range = Light::getRange();
+    gamedata.jobs->parallelFor("binLights", gamedata.meshes.size(), 16, [&](size_t begin, size_t end) {
+        for(size_t m = begin; m < end; m++)
+        {
+            Mesh *mesh = gamedata.meshes[m];
+            glm::vec3 center, extents;
+            transformBounds(mesh->boundsMin, mesh->boundsMax, mesh->getRenderTransform(), center, extents);
 
-        p1->render();
+            int mask = 0;
+            for(Light *light : gamedata.lights)
+            {
+                // Distance from the light to the closest point of the box
+                glm::vec3 delta = glm::max(glm::abs(light->getRenderPosition() - center) - extents, glm::vec3(0));
+                if(glm::dot(delta, delta) <= range * range)
+                    mask |= 1 << light->getID();
+            }
+            mesh->lightMask = mask;
+        }
+    });
+}
 
-        // Create the stencil for portal 2 by decrementing the stencil buffer
-        glStencilFunc(GL_EQUAL, (uint8_t)-depth, 0xff);
-        glStencilOp(GL_KEEP, GL_KEEP, GL_DECR_WRAP);
+void setStencil(gamedata_st &gamedata, uint8_t ref, uint8_t value);
+void setDepthFunc(gamedata_st &gamedata, GLenum func);
+void setScissor(gamedata_st &gamedata, const glm::ivec4 &rect);
+void drawPortal(gamedata_st &gamedata, Portal *portal, const glm::mat4 &view, const glm::mat4 &proj);
+void clearDepth(gamedata_st &gamedata, int depth);
+void bindTarget(gamedata_st &gamedata, int depth);
+void beginResolutionTarget(gamedata_st &gamedata, int depth);
+void compositeResolutionTarget(gamedata_st &gamedata, int depth);
+void renderShadows(gamedata_st &gamedata);
+void beginFrame(gamedata_st &gamedata);
+void renderDepth(gamedata_st &gamedata, int depth);
+void renderFrames(gamedata_st &gamedata, int depth);
+// Renders the views planned by planViews() and compiled by compileViews() as the passes of a render graph. Each view is
+// drawn where the stencil has its value, one depth at a time, and every draw is limited to the screen rectangle of its
+// view with the scissor test. The portals of a view mark the pixels of the views through them, and their frames are drawn
+// over those views on the way back out. With dynamic resolution, the depths with a lower scale are rendered into
+// transient targets of the graph, and upsampled on the way back out.
+void renderViews(gamedata_st &gamedata)
+{
+    int maxDepth = 0;
+    for(size_t i = 0; i < gamedata.viewCount; i++)
+        maxDepth = std::max(maxDepth, gamedata.views[i].depth);
+    RENDER_STAT(STAT_VIEWS, gamedata.viewCount);
+    RENDER_STAT(STAT_DEPTHS, maxDepth + 1);
 
-        glUniformMatrix4fv(uViewLoc, 1, GL_FALSE, glm::value_ptr(p2View));
-        glUniformMatrix4fv(uProjLoc, 1, GL_FALSE, glm::value_ptr(p2Proj));
+    RenderGraph &graph = *gamedata.graph;
+    graph.reset();
+    int window = graph.importTarget("window", gamedata.window->getFramebuffer());
+    graph.setOutput(window);
 
-        p2->render();
+    // The functions of the passes, alive until the graph is executed
+    auto shadowsPass = [&](int) { renderShadows(gamedata); };
+    auto clearPass = [&](int) { beginFrame(gamedata); };
+    auto viewsPass = [&](int depth) { renderDepth(gamedata, depth); };
+    auto framesPass = [&](int depth) { renderFrames(gamedata, depth); };
 
-        // Create the view from the destination portal given the view used then looking into it
-        glm::mat4 nextP1View = p1->getViewMatrix(p1View, p2);
-        glm::mat4 nextP2View = p2->getViewMatrix(p2View, p1);
-        // Create the oblique projections using the standard projection, assumes that the input has a standard view-frustum
-        glm::mat4 nextP1Proj = p2->getObliqueProjection(proj, nextP1View);
-        glm::mat4 nextP2Proj = p1->getObliqueProjection(proj, nextP2View);
+    // The shadow maps are kept by ShadowMaps between frames, and sampled by every view
+    int shadowMaps = -1;
+    if (gamedata.shadows)
+    {
+        shadowMaps = graph.importTarget("shadowMaps", 0);
+        graph.write(graph.addPass("shadows", -1, shadowsPass), shadowMaps);
+    }
+
+    int clear = graph.addPass("clear", -1, clearPass);
+    graph.write(clear, window);
+    if (shadowMaps >= 0)
+        graph.read(clear, shadowMaps);
+
+    // A depth with a lower scale gets a new target, the deeper views with the same scale are drawn into it too
+    int width = gamedata.window->getWidth();
+    int height = gamedata.window->getHeight();
+    gamedata.depthTargets.resize(maxDepth + 1);
+    for(int depth = 0; depth <= maxDepth; depth++)
+    {
+        int &target = gamedata.depthTargets[depth];
+        if(gamedata.resolution && gamedata.resolution->startsTarget(depth))
+            target = graph.createTarget("resolutionTarget", depth, DynamicResolution::getTargetDesc(width, height));
+        else
+            target = depth > 0 ? gamedata.depthTargets[depth - 1] : window;
 
-        // Clearing the depth buffer is necessary because the objects inside the portal can have
-        // both a lower and higher depth value, because the near plane is moved
-        // By clearing the depth buffer, it is ensured that everything inside the portals are rendered
-        // The stencil buffer ensures that the fragments outside of the portal are not overwritten.
-        glClear(GL_DEPTH_BUFFER_BIT);
-        recursivePortalHelper(gamedata, proj, nextP1View, nextP1Proj, nextP2View, nextP2Proj, maxDepth, depth + 1);
+        int pass = graph.addPass("views", depth, viewsPass);
+        graph.write(pass, target);
+        if (shadowMaps >= 0)
+            graph.read(pass, shadowMaps);
     }
 
-    // Draw the portals on the way back out
-    glUniformMatrix4fv(uViewLoc, 1, GL_FALSE, glm::value_ptr(p1View));
-    glUniformMatrix4fv(uProjLoc, 1, GL_FALSE, glm::value_ptr(proj));
-    glStencilOp(GL_KEEP, GL_KEEP, GL_DECR);
-    glStencilFunc(GL_EQUAL, depth + 1, 0xff);
-    p1->render();
+    // The frames are drawn into the target of the depth before, after the target of their depth is upsampled into it
+    for(int depth = maxDepth; depth > 0; depth--)
+    {
+        int pass = graph.addPass("frames", depth, framesPass);
+        if(gamedata.depthTargets[depth] != gamedata.depthTargets[depth - 1])
+            graph.read(pass, gamedata.depthTargets[depth]);
+        graph.write(pass, gamedata.depthTargets[depth - 1]);
+    }
+
+    graph.compile();
+    if (gamedata.dumpGraph)
+    {
+        graph.dump(std::cout);
+        gamedata.dumpGraph = false;
+    }
+    graph.execute();
+
+    if (!gamedata.software)
+    {
+        glStencilMask(0xff);
+        glDisable(GL_STENCIL_TEST);
+        glDisable(GL_SCISSOR_TEST);
+    }
+}
+
+// Writes the render graph of the last frame
+void writeGraphDump(gamedata_st &gamedata, const std::string &path)
+{
+    std::ofstream fileStream(path.c_str());
+    if (!fileStream)
+    {
+        std::cerr << "Error: Could not write " << path << std::endl;
+        return;
+    }
+    gamedata.graph->dump(fileStream);
+}
 
-    glUniformMatrix4fv(uViewLoc, 1, GL_FALSE, glm::value_ptr(p2View));
-    glUniformMatrix4fv(uProjLoc, 1, GL_FALSE, glm::value_ptr(proj));
-    glStencilOp(GL_KEEP, GL_KEEP, GL_INCR_WRAP);
-    glStencilFunc(GL_EQUAL, (uint8_t)(-depth - 1), 0xff);
-    p2->render();
+// The shadow maps are shared by all views. The cubes never move, the player and turrets do.
+void renderShadows(gamedata_st &gamedata)
+{
+    gamedata.shadows->update(gamedata.lights, gamedata.meshes, gamedata.cubes.size());
 }
 
-void renderWorld(gamedata_st &gamedata, glm::mat4 view, glm::mat4 proj)
+// Clears the window and sets the uniforms which are the same for every view
+void beginFrame(gamedata_st &gamedata)
 {
+    if (gamedata.software)
+    {
+        // Records the frame, which is rasterized once all draws are known
+        gamedata.software->begin((float) gamedata.window->getTime(), gamedata.lights);
+        return;
+    }
+
+    bindTarget(gamedata, 0);
+    gamedata.shader->activate();
+    if (gamedata.shadows)
+        gamedata.shadows->bind(*gamedata.shader);
+
+    // Send the time to the fragmentshader
+    int uTimeLoc = gamedata.shader->getUniformLocation("u_time");
+    glUniform1f(uTimeLoc, (float) gamedata.window->getTime());
+
+    // Update all lights in the fragment shader
+    glUniform1i(gamedata.shader->getUniformLocation("u_light_count"), (int) gamedata.lights.size());
+    RENDER_STAT(STAT_UNIFORM_UPLOADS, 2);
+    for(Light *light : gamedata.lights)
+    {
+        light->updateUniform(*gamedata.shader);
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    RENDER_STAT(STAT_DEPTH_CLEARS, 1);
+
+    // Until the end of renderViews()
+    glEnable(GL_STENCIL_TEST);
+    glEnable(GL_SCISSOR_TEST);
+}
+
+// Draws the views at depth, and marks the pixels of the views one portal deeper
+void renderDepth(gamedata_st &gamedata, int depth)
+{
+    PROFILE_GPU_ZONE(Profiler::depthName(depth));
+
+    // Clearing the depth buffer is necessary because the objects inside the portals can have
+    // both a lower and higher depth value, because the near plane is moved.
+    // The stencil buffer ensures that the fragments outside of the portals are not overwritten.
+    if(gamedata.resolution && gamedata.resolution->startsTarget(depth))
+    {
+        beginResolutionTarget(gamedata, depth);
+    }
+    else
+    {
+        bindTarget(gamedata, depth);
+        if(depth > 0)
+            clearDepth(gamedata, depth);
+    }
+
+    for(size_t i = 0; i < gamedata.viewCount; i++)
+    {
+        const RenderView &view = gamedata.views[i];
+        if(view.depth != depth)
+            continue;
+
+        setStencil(gamedata, view.stencil, view.stencil);
+        setScissor(gamedata, view.scissor);
+        renderWorld(gamedata, view);
+    }
+
+    for(size_t i = 0; i < gamedata.viewCount; i++)
+    {
+        const RenderView &view = gamedata.views[i];
+        if(view.depth != depth)
+            continue;
+
+        for(int child : view.children)
+        {
+            setStencil(gamedata, view.stencil, gamedata.views[child].stencil);
+            setScissor(gamedata, gamedata.views[child].parentScissor);
+            drawPortal(gamedata, gamedata.portals[gamedata.views[child].portal], view.view, view.proj);
+        }
+    }
+}
+
+// Draws the frames of the portals of the views at depth on the way back out, deepest first, and gives their pixels back
+// to the parent view, so the frame of the parent portal covers them too. The stencil already limits them to the pixels
+// of the portal.
+void renderFrames(gamedata_st &gamedata, int depth)
+{
+    setDepthFunc(gamedata, GL_ALWAYS);
+    if(gamedata.resolution && gamedata.resolution->startsTarget(depth))
+        compositeResolutionTarget(gamedata, depth);
+    else
+        bindTarget(gamedata, depth - 1);
+
+    for(size_t i = gamedata.viewCount - 1; i > 0; i--)
+    {
+        const RenderView &view = gamedata.views[i];
+        if(view.depth != depth)
+            continue;
+
+        const RenderView &parent = gamedata.views[view.parent];
+        setStencil(gamedata, view.stencil, parent.stencil);
+        setScissor(gamedata, view.parentScissor);
+        drawPortal(gamedata, gamedata.portals[view.portal], parent.view, parent.proj);
+    }
+    setDepthFunc(gamedata, GL_LESS);
+}
+
+// Following draws only pass where the stencil equals ref, and set it to value where they pass the depth test too.
+// GL_INVERT with the write mask ref ^ value turns ref into value, so any value can be written while testing for another.
+void setStencil(gamedata_st &gamedata, uint8_t ref, uint8_t value)
+{
+    GLenum op = ref == value ? GL_KEEP : GL_INVERT;
+    RENDER_STAT(STAT_STENCIL_CHANGES, 1);
+    if (gamedata.software)
+    {
+        gamedata.software->stencil(ref, op, ref ^ value);
+        return;
+    }
+
+    glStencilFunc(GL_EQUAL, ref, 0xff);
+    glStencilMask(ref ^ value);
+    glStencilOp(GL_KEEP, GL_KEEP, op);
+}
+
+// The software renderer has no scissor test, its tiles are binned by the bounds of the triangles
+void setScissor(gamedata_st &gamedata, const glm::ivec4 &rect)
+{
+    if (!gamedata.software)
+        glScissor(rect.x, rect.y, rect.z, rect.w);
+}
+
+void setDepthFunc(gamedata_st &gamedata, GLenum func)
+{
+    if (gamedata.software)
+        gamedata.software->depthFunc(func);
+    else
+        glDepthFunc(func);
+}
+
+void drawPortal(gamedata_st &gamedata, Portal *portal, const glm::mat4 &view, const glm::mat4 &proj)
+{
+    if (gamedata.software)
+    {
+        gamedata.software->drawPortal(*portal, view, proj);
+        return;
+    }
+
+    glUniformMatrix4fv(gamedata.shader->getUniformLocation("view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(gamedata.shader->getUniformLocation("proj"), 1, GL_FALSE, glm::value_ptr(proj));
+    RENDER_STAT(STAT_UNIFORM_UPLOADS, 2);
+    portal->render();
+}
+
+// Clears the depth of the views at depth, only inside their scissors
+void clearDepth(gamedata_st &gamedata, int depth)
+{
+    RENDER_STAT(STAT_DEPTH_CLEARS, 1);
+    if (gamedata.software)
+    {
+        gamedata.software->clearDepth();
+        return;
+    }
+
+    setScissor(gamedata, gamedata.depthScissors[depth]);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+// Binds the render graph target the views at depth are drawn into
+void bindTarget(gamedata_st &gamedata, int depth)
+{
+    if (gamedata.software)
+        return;
+
+    int width = gamedata.window->getWidth();
+    int height = gamedata.window->getHeight();
+    unsigned int framebuffer = gamedata.graph->getFramebuffer(gamedata.depthTargets[depth]);
+    if (gamedata.resolution)
+    {
+        gamedata.resolution->bindTarget(depth, framebuffer, width, height);
+    }
+    else
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+    }
+}
+
+// Starts rendering the views at depth, and the deeper views, into a lower resolution target. The views are marked by
+// drawing their portals as seen from their parents without a depth test. Where a portal is partly hidden in its parent
+// view this marks more pixels than the view has in the framebuffer, but only the pixels of the view are composited back.
+void beginResolutionTarget(gamedata_st &gamedata, int depth)
+{
+    PROFILE_GPU_ZONE("beginResolutionTarget");
+    // The whole target is cleared
+    glDisable(GL_SCISSOR_TEST);
+    unsigned int framebuffer = gamedata.graph->getFramebuffer(gamedata.depthTargets[depth]);
+    gamedata.resolution->beginTarget(depth, framebuffer, gamedata.window->getWidth(), gamedata.window->getHeight());
+    glEnable(GL_SCISSOR_TEST);
+
+    setDepthFunc(gamedata, GL_ALWAYS);
+    for(size_t i = 1; i < gamedata.viewCount; i++)
+    {
+        const RenderView &view = gamedata.views[i];
+        if(view.depth != depth)
+            continue;
+
+        const RenderView &parent = gamedata.views[view.parent];
+        setStencil(gamedata, 0, view.stencil);
+        setScissor(gamedata, view.scissor);
+        drawPortal(gamedata, gamedata.portals[view.portal], parent.view, parent.proj);
+    }
+    setDepthFunc(gamedata, GL_LESS);
+    clearDepth(gamedata, depth);
+}
+
+// Upsamples the target started at depth into the target of the parent depth, which stays bound for the frames of the
+// portals at depth
+void compositeResolutionTarget(gamedata_st &gamedata, int depth)
+{
+    PROFILE_GPU_ZONE("compositeResolutionTarget");
+    int width = gamedata.window->getWidth();
+    int height = gamedata.window->getHeight();
+    unsigned int texture = gamedata.graph->getTexture(gamedata.depthTargets[depth]);
+    bindTarget(gamedata, depth - 1);
+    glDisable(GL_SCISSOR_TEST);
+    gamedata.resolution->composite(depth, texture, gamedata.views, gamedata.viewCount, width, height);
+    glEnable(GL_SCISSOR_TEST);
+    gamedata.shader->activate();
+}
+
+// Renders the meshes of the world which are visible in the view, and the frames of the portals it does not look through
+void renderWorld(gamedata_st &gamedata, const RenderView &view)
+{
+    PROFILE_GPU_ZONE("renderWorld");
+
+    if (gamedata.software)
+    {
+        for(int mesh : view.draws)
+        {
+            gamedata.software->drawMesh(*gamedata.meshes[mesh], view.view, view.proj);
+        }
+        for(int portal : view.frames)
+        {
+            gamedata.software->drawPortal(*gamedata.portals[portal], view.view, view.proj);
+        }
+        return;
+    }
+
     // Send the camera position, view, and projection
     // This is required to do every render, because the camera position would be different
-    // depending on the state of the recursion.
+    // depending on the view.
     int uCameraLoc = gamedata.shader->getUniformLocation("u_camera_position");
     int uViewLoc = gamedata.shader->getUniformLocation("view");
     int uProjLoc = gamedata.shader->getUniformLocation("proj");
     
-    glm::vec3 camPosition = glm::vec3(glm::column(glm::inverse(view), 3));
-    glUniform3fv(uCameraLoc, 1, glm::value_ptr(camPosition));
-    glUniformMatrix4fv(uViewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(uProjLoc, 1, GL_FALSE, glm::value_ptr(proj));
+    glUniform3fv(uCameraLoc, 1, glm::value_ptr(view.eye));
+    glUniformMatrix4fv(uViewLoc, 1, GL_FALSE, glm::value_ptr(view.view));
+    glUniformMatrix4fv(uProjLoc, 1, GL_FALSE, glm::value_ptr(view.proj));
+    RENDER_STAT(STAT_UNIFORM_UPLOADS, 3);
 
-    // Render all scene elements
-    for(Cube *cube : gamedata.cubes)
+    // Render all scene elements that were not culled
+    for(int mesh : view.draws)
     {
-        cube->render();
+        gamedata.meshes[mesh]->render();
+    }
+
+    for(int portal : view.frames)
+    {
+        gamedata.portals[portal]->render();
     }
-    gamedata.player->render();
-    gamedata.turret->render();
 }
 
 void destroy(gamedata_st &gamedata)
 {
+    // Writes a capture that was cut short, without the teardown
+    GLCapture::get().stop();
+
+    // Let the simulation finish before anything is deleted
+    if (gamedata.simulation)
+    {
+        gamedata.simulation->stop();
+        delete gamedata.simulation;
+    }
+    delete gamedata.snapshots;
+    delete gamedata.jobs;
+
+    // Stops the loader threads. The loaded chunks are part of the scene, and are freed with it below.
+    delete gamedata.streamer;
+    delete gamedata.level;
+
     // Destroy all meshes
-    gamedata.portals[0]->destroy();
-    gamedata.portals[1]->destroy();
-    gamedata.player->destroy();
-    gamedata.turret->destroy();
+    for(Portal *portal : gamedata.portals)
+    {
+        portal->destroy(*gamedata.resources);
+    }
+    gamedata.player->destroy(*gamedata.resources);
+    for(ObjMesh *turret : gamedata.turrets)
+    {
+        turret->destroy(*gamedata.resources);
+    }
     for(Cube *cube : gamedata.cubes)
     {
-        cube->destroy();
+        cube->destroy(*gamedata.resources);
     }
+    if (gamedata.resolution)
+        gamedata.resolution->destroy(*gamedata.resources);
+    if (gamedata.shadows)
+        gamedata.shadows->destroy(*gamedata.resources);
 
-    // Destory all textures
-    gamedata.turretTexture->destroy();
-    gamedata.noiseTexture->destroy();
-    gamedata.rubixTexture->destroy();
-    gamedata.wallTexture->destroy();
+    // Destory all textures and render targets
+    if (!gamedata.software)
+    {
+        gamedata.graph->destroy();
+        gamedata.materials->destroy(*gamedata.resources);
+        gamedata.noiseTexture->destroy();
+        gamedata.resources->release(gamedata.noiseResource);
+    }
+    gamedata.resources->release(gamedata.program);
+    gamedata.resources->destroy();
 
+    Profiler::get().destroy();
     gamedata.window->destroy();
     glfwTerminate();
 
     delete gamedata.window;
-    delete gamedata.root;
-    delete gamedata.turret;
-    delete gamedata.player;
-    delete gamedata.portals[0];
-    delete gamedata.portals[1];
-    delete gamedata.wallTexture;
-    delete gamedata.rubixTexture;
-    delete gamedata.turretTexture;
+    delete gamedata.materials;
     delete gamedata.noiseTexture;
+    delete gamedata.software;
+    delete gamedata.resolution;
+    delete gamedata.shadows;
+    delete gamedata.graph;
     delete gamedata.camera;
-    delete gamedata.shader;
+    delete gamedata.resources;
 
-    for(int i = 0; i < N_LIGHTS; i++)
-    {
-        delete gamedata.lights[i];
-    }
-
-    for(Cube *cube : gamedata.cubes)
-    {
-        delete cube;
-    }
+    // Free the scene objects all at once
+    gamedata.pools.reset();
 }
\ No newline at end of file
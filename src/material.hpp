@@ -0,0 +1,286 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <texture.hpp>
+#include <resources.hpp>
+#include <cookedtexture.hpp>
+#include <memory.hpp>
+#include <glcapture.hpp>
+
+// These have to match the layout qualifiers in shader.frag
+#define MATERIAL_BUFFER_BINDING 0
+#define TEXTURE_ARRAY_BINDING 2
+#define MAX_TEXTURE_ARRAYS 4
+
+// GPU side material, std430 layout
+typedef struct GPUMaterial
+{
+    uint32_t array;     // Index of the texture array, used without bindless textures
+    uint32_t layer;     // Layer within the texture array
+    uint64_t handle;    // Bindless handle of the texture array, 0 without bindless textures
+} GPUMaterial;
+
+// Collects the albedo textures of all materials into GL_TEXTURE_2D_ARRAYs, one per
+// size/format/filter combination, and stores a table of (array, layer) in a shader storage buffer.
+// A draw then only selects its material with the u_material uniform and no textures are bound between draws.
+// If the driver supports ARB_bindless_texture, the table also holds the handle of each array.
+class MaterialLibrary
+{
+private:
+    // A texture waiting to be put in an array. Either a mapped cooked file or a decoded RGBA8 image.
+    typedef struct PendingTexture
+    {
+        std::string path;
+        filter_e filter;
+        unsigned int width;
+        unsigned int height;
+        unsigned int levels;
+        GLenum internalFormat;
+        CookedTexture *cooked;
+        unsigned char *pixels;
+        bool loaded;
+    } PendingTexture;
+
+    typedef struct TextureArray
+    {
+        Resource *texture;
+        unsigned int textureID;             // Of the resource
+        unsigned int width;
+        unsigned int height;
+        unsigned int levels;
+        GLenum internalFormat;
+        filter_e filter;
+        bool cooked;                        // The layers have all their mips, otherwise they are generated
+        std::vector<unsigned int> textures; // Indices into mPending
+    } TextureArray;
+
+    std::vector<PendingTexture> mPending;
+    std::vector<TextureArray> mArrays;
+    std::vector<GPUMaterial> mMaterials;
+    Resource *mBuffer = nullptr;
+    bool mBindless = false;
+
+    static GLenum cookedInternalFormat(uint32_t format)
+    {
+        switch (format)
+        {
+        case COOKED_BC1: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case COOKED_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        }
+        return GL_RGBA8;
+    }
+
+    void upload(TextureArray &array, unsigned int layer, PendingTexture &texture)
+    {
+        if (!texture.cooked)
+        {
+            glTextureSubImage3D(array.textureID, 0, 0, 0, layer, texture.width, texture.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, texture.pixels);
+            return;
+        }
+
+        for (unsigned int i = 0; i < texture.levels; i++)
+        {
+            const CookedTextureLevel &level = texture.cooked->level(i);
+            if (texture.internalFormat == GL_RGBA8)
+                glTextureSubImage3D(array.textureID, i, 0, 0, layer, level.width, level.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, texture.cooked->levelData(i));
+            else
+                glCompressedTextureSubImage3D(array.textureID, i, 0, 0, layer, level.width, level.height, 1, texture.internalFormat, level.size, texture.cooked->levelData(i));
+        }
+    }
+
+public:
+    // Whether the draws will use bindless handles. Decides which variant of the fragment shader to compile.
+    // A GL capture uses the texture arrays, as the handles in the material buffer are only valid in this process.
+    static bool supportsBindless()
+    {
+        return GLAD_GL_ARB_bindless_texture && !GLCapture::get().isRecording();
+    }
+
+    // Registers a material using the texture at path as albedo, and returns the material index.
+    // Nothing is loaded or uploaded before load() or build()
+    int add(std::string path, filter_e filter)
+    {
+        mPending.push_back({path, filter, 0, 0, 1, GL_RGBA8, nullptr, nullptr, false});
+        mMaterials.push_back({0, 0, 0});
+        return mMaterials.size() - 1;
+    }
+
+    // Maps the cooked texture or decodes the image of a material. Does not use GL, so the materials can be
+    // loaded in parallel on worker threads, as long as no material is added meanwhile. Returns false on failure.
+    bool load(int material)
+    {
+        PendingTexture &texture = mPending[material];
+        if (texture.loaded)
+            return texture.cooked || texture.pixels;
+        texture.loaded = true;
+        std::string path = texture.path;
+
+        // Prefer the cooked texture, unless the driver lacks its compressed format
+        CookedTexture *cooked = new CookedTexture();
+        if (cooked->open(cookedTexturePath(path)) && (cooked->header().format != COOKED_BC1 || GLAD_GL_EXT_texture_compression_s3tc))
+        {
+            texture.cooked = cooked;
+            texture.width = cooked->header().width;
+            texture.height = cooked->header().height;
+            texture.levels = cooked->header().levels;
+            texture.internalFormat = cookedInternalFormat(cooked->header().format);
+        }
+        else
+        {
+            cooked->close();
+            delete cooked;
+            int width, height, channels;
+            texture.pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+            if (!texture.pixels)
+            {
+                std::cerr << "Error: Could not load " << path << std::endl;
+                return false;
+            }
+            texture.width = width;
+            texture.height = height;
+            texture.levels = (unsigned int) floor(log2(std::max(width, height))) + 1;
+            MemoryTracker::get().cpu(MEMORY_TEXTURES, (int64_t) width * height * 4);
+        }
+        return true;
+    }
+
+    // Loads the textures that are not loaded yet, creates the texture arrays and the material buffer, and frees the CPU side images.
+    // Materials whose texture failed to load keep the first layer of the first array.
+    void build(ResourceCache &resources)
+    {
+        mBindless = supportsBindless();
+
+        // Group the textures with matching size, format and filtering into the same array. Cooked and decoded
+        // textures are kept apart, as only the decoded ones need their mips generated.
+        for (unsigned int i = 0; i < mPending.size(); i++)
+        {
+            PendingTexture &texture = mPending[i];
+            if (!load(i))
+                continue;
+            auto match = std::find_if(mArrays.begin(), mArrays.end(), [&](const TextureArray &array) {
+                return array.width == texture.width && array.height == texture.height &&
+                       array.internalFormat == texture.internalFormat && array.filter == texture.filter &&
+                       array.levels == texture.levels && array.cooked == (texture.cooked != nullptr);
+            });
+
+            if (match == mArrays.end())
+            {
+                mArrays.push_back({nullptr, 0, texture.width, texture.height, texture.levels, texture.internalFormat, texture.filter,
+                                   texture.cooked != nullptr, {}});
+                match = mArrays.end() - 1;
+            }
+
+            mMaterials[i].array = match - mArrays.begin();
+            mMaterials[i].layer = match->textures.size();
+            match->textures.push_back(i);
+        }
+
+        if (!mBindless && mArrays.size() > MAX_TEXTURE_ARRAYS)
+        {
+            std::cerr << "Error: " << mArrays.size() << " texture arrays are needed, but only " << MAX_TEXTURE_ARRAYS << " can be bound" << std::endl;
+        }
+
+        for (unsigned int a = 0; a < mArrays.size(); a++)
+        {
+            TextureArray &array = mArrays[a];
+
+            // The mip chain adds a third to the images that are not cooked
+            size_t bytes = 0;
+            for (unsigned int index : array.textures)
+            {
+                const PendingTexture &texture = mPending[index];
+                if (!array.cooked)
+                    bytes += (size_t) texture.width * texture.height * 4 * 4 / 3;
+                for (unsigned int i = 0; array.cooked && i < texture.levels; i++)
+                    bytes += texture.cooked->level(i).size;
+            }
+
+            array.texture = resources.createTexture("materials" + std::to_string(a), GL_TEXTURE_2D_ARRAY, bytes, MEMORY_TEXTURES);
+            array.textureID = array.texture->name;
+            glTextureStorage3D(array.textureID, array.levels, array.internalFormat, array.width, array.height, array.textures.size());
+            for (unsigned int layer = 0; layer < array.textures.size(); layer++)
+                upload(array, layer, mPending[array.textures[layer]]);
+
+            // The arrays are grouped on whether they are cooked, so either every layer has all its mips, or none has
+            if (!array.cooked)
+                glGenerateTextureMipmap(array.textureID);
+
+            switch (array.filter)
+            {
+            case LINEAR:
+                glTextureParameteri(array.textureID, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+                glTextureParameteri(array.textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                break;
+            case NEAREST:
+                glTextureParameteri(array.textureID, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+                glTextureParameteri(array.textureID, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                break;
+            }
+
+            if (mBindless)
+            {
+                // The texture becomes immutable once a handle is created, so this has to be done last
+                GLuint64 handle = glGetTextureHandleARB(array.textureID);
+                glMakeTextureHandleResidentARB(handle);
+                for (unsigned int index : array.textures)
+                    mMaterials[index].handle = handle;
+            }
+            else if (a < MAX_TEXTURE_ARRAYS)
+            {
+                glBindTextureUnit(TEXTURE_ARRAY_BINDING + a, array.textureID);
+            }
+
+            printf("Texture array %d: %dx%d, %d layers, %d levels\n", a, array.width, array.height, (int) array.textures.size(), array.levels);
+        }
+
+        // The images are now on the GPU
+        for (PendingTexture &texture : mPending)
+        {
+            if (texture.cooked)
+            {
+                texture.cooked->close();
+                delete texture.cooked;
+            }
+            if (texture.pixels)
+            {
+                stbi_image_free(texture.pixels);
+                MemoryTracker::get().cpu(MEMORY_TEXTURES, -(int64_t) texture.width * texture.height * 4);
+            }
+        }
+        mPending.clear();
+
+        size_t bufferBytes = mMaterials.size() * sizeof(GPUMaterial);
+        mBuffer = resources.createBuffer("materials", bufferBytes, MEMORY_TEXTURES);
+        glNamedBufferStorage(mBuffer->name, bufferBytes, mMaterials.data(), 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BUFFER_BINDING, mBuffer->name);
+    }
+
+    bool isBindless()
+    {
+        return mBindless;
+    }
+
+    unsigned int size()
+    {
+        return mMaterials.size();
+    }
+
+    void destroy(ResourceCache &resources)
+    {
+        for (TextureArray &array : mArrays)
+        {
+            if (mBindless)
+                glMakeTextureHandleNonResidentARB(glGetTextureHandleARB(array.textureID));
+            resources.release(array.texture);
+        }
+        mArrays.clear();
+        resources.release(mBuffer);
+        mBuffer = nullptr;
+    }
+};
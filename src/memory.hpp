@@ -0,0 +1,141 @@
+#pragma once
+
+// Tagged memory accounting. Every subsystem reports the CPU memory it allocates and the GPU memory of the buffers and
+// textures it creates, under the tag of the subsystem, as a positive size when allocated and a negative size when freed.
+// The current and peak usage of every tag can be printed, written as key = value, and checked against limits.
+// Reporting is lock free and can be done from any thread.
+//
+// Usage:
+//     MemoryTracker::get().cpu(MEMORY_MESHES, bytes);
+//     MemoryTracker::get().gpu(MEMORY_TEXTURES, -(int64_t) bytes);
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+typedef enum memory_tag_e
+{
+    MEMORY_MESHES,      // Vertex data, on the CPU until released and in GPU buffers
+    MEMORY_TEXTURES,    // Images and noise
+    MEMORY_SCENE,       // Scene objects
+    MEMORY_LIGHTING,    // Lights and shadow maps
+    MEMORY_TARGETS,     // Offscreen framebuffers
+    MEMORY_TAG_COUNT
+} memory_tag_e;
+
+class MemoryTracker
+{
+private:
+    typedef struct Counter
+    {
+        std::atomic<int64_t> current{0};
+        std::atomic<int64_t> peak{0};
+    } Counter;
+
+    Counter mCPU[MEMORY_TAG_COUNT];
+    Counter mGPU[MEMORY_TAG_COUNT];
+    Counter mCPUTotal;
+    Counter mGPUTotal;
+
+    static void add(Counter &counter, int64_t bytes)
+    {
+        int64_t current = counter.current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        int64_t peak = counter.peak.load(std::memory_order_relaxed);
+        while (current > peak && !counter.peak.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    static double megabytes(const Counter &counter, bool peak)
+    {
+        return (peak ? counter.peak : counter.current).load(std::memory_order_relaxed) / (1024.0 * 1024.0);
+    }
+
+public:
+    static MemoryTracker &get()
+    {
+        static MemoryTracker tracker;
+        return tracker;
+    }
+
+    static const char *getName(memory_tag_e tag)
+    {
+        static const char *names[MEMORY_TAG_COUNT] = {"meshes", "textures", "scene", "lighting", "targets"};
+        return names[tag];
+    }
+
+    void cpu(memory_tag_e tag, int64_t bytes)
+    {
+        add(mCPU[tag], bytes);
+        add(mCPUTotal, bytes);
+    }
+
+    void gpu(memory_tag_e tag, int64_t bytes)
+    {
+        add(mGPU[tag], bytes);
+        add(mGPUTotal, bytes);
+    }
+
+    int64_t getCPU(memory_tag_e tag)
+    {
+        return mCPU[tag].current.load(std::memory_order_relaxed);
+    }
+
+    int64_t getGPU(memory_tag_e tag)
+    {
+        return mGPU[tag].current.load(std::memory_order_relaxed);
+    }
+
+    void report()
+    {
+        printf("%-10s %12s %12s %12s %12s\n", "Memory", "CPU MB", "CPU peak", "GPU MB", "GPU peak");
+        for (int i = 0; i < MEMORY_TAG_COUNT; i++)
+            printf("%-10s %12.2f %12.2f %12.2f %12.2f\n", getName((memory_tag_e) i),
+                   megabytes(mCPU[i], false), megabytes(mCPU[i], true), megabytes(mGPU[i], false), megabytes(mGPU[i], true));
+        printf("%-10s %12.2f %12.2f %12.2f %12.2f\n", "total",
+               megabytes(mCPUTotal, false), megabytes(mCPUTotal, true), megabytes(mGPUTotal, false), megabytes(mGPUTotal, true));
+    }
+
+    // Writes the current and peak usage in MB as key = value, in the format of the benchmark summary
+    bool writeReport(std::string path)
+    {
+        std::ofstream fileStream(path.c_str());
+        if (!fileStream)
+        {
+            std::cerr << "Error: Could not write " << path << std::endl;
+            return false;
+        }
+
+        for (int i = 0; i < MEMORY_TAG_COUNT; i++)
+        {
+            std::string name = getName((memory_tag_e) i);
+            fileStream << "cpu_" << name << "_mb = " << megabytes(mCPU[i], false) << "\n";
+            fileStream << "cpu_" << name << "_peak_mb = " << megabytes(mCPU[i], true) << "\n";
+            fileStream << "gpu_" << name << "_mb = " << megabytes(mGPU[i], false) << "\n";
+            fileStream << "gpu_" << name << "_peak_mb = " << megabytes(mGPU[i], true) << "\n";
+        }
+        fileStream << "cpu_peak_mb = " << megabytes(mCPUTotal, true) << "\n";
+        fileStream << "gpu_peak_mb = " << megabytes(mGPUTotal, true) << "\n";
+        return true;
+    }
+
+    // Returns false if the peak CPU or GPU usage exceeded its limit in MB. A limit of 0 is not checked.
+    bool checkLimits(double cpuLimit, double gpuLimit)
+    {
+        bool passed = true;
+        if (cpuLimit > 0 && megabytes(mCPUTotal, true) > cpuLimit)
+        {
+            std::cerr << "Error: Peak CPU memory " << megabytes(mCPUTotal, true) << " MB exceeds the limit of " << cpuLimit << " MB" << std::endl;
+            passed = false;
+        }
+        if (gpuLimit > 0 && megabytes(mGPUTotal, true) > gpuLimit)
+        {
+            std::cerr << "Error: Peak GPU memory " << megabytes(mGPUTotal, true) << " MB exceeds the limit of " << gpuLimit << " MB" << std::endl;
+            passed = false;
+        }
+        return passed;
+    }
+};
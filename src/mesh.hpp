@@ -2,8 +2,11 @@
 
 #include <algorithm>
 #include <shader.hpp>
+#include <resources.hpp>
 #include <node.hpp>
 #include <texture.hpp>
+#include <renderstats.hpp>
+#include <memory.hpp>
 #include <glad/glad.h>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
@@ -11,80 +14,216 @@
 #include <vector>
 #include <iostream>
 #include <sstream>
+#include <map>
+#include <memory>
+#include <mutex>
 
 class Mesh : public Node
 {
 protected:
     Shader *mShader = nullptr;
+    Resource *mResource = nullptr;
+    std::string mResourceKey;   // Meshes with the same key share their GPU buffers. Set by the shapes, empty if unique.
+    size_t mIndexCount = 0;     // Of the uploaded indices, which are kept when the CPU geometry is released
+    size_t mGeometryBytes = 0;  // Size of the vertex data
+    size_t mTrackedBytes = 0;   // CPU memory of the vertex data reported to the MemoryTracker
+
+    // Reports the change of the memory held by the vertex data since the last call
+    void trackGeometry()
+    {
+        size_t bytes = vertices.capacity() * sizeof(glm::vec3) + normals.capacity() * sizeof(glm::vec3) +
+                       textureCoordinates.capacity() * sizeof(glm::vec2) + indices.capacity() * sizeof(unsigned int);
+        MemoryTracker::get().cpu(MEMORY_MESHES, (int64_t) bytes - (int64_t) mTrackedBytes);
+        mTrackedBytes = bytes;
+    }
+
+    // Selects the material of the draw. Meshes with a material only send an index, while meshes
+    // with a plain albedo texture bind it to unit 0.
+    void bindMaterial()
+    {
+        int uMaterialLoc = mShader->getUniformLocation("u_material");
+        glUniform1i(uMaterialLoc, material);
+
+        int uLightMaskLoc = mShader->getUniformLocation("u_light_mask");
+        glUniform1i(uLightMaskLoc, lightMask);
+        RENDER_STAT(STAT_UNIFORM_UPLOADS, 2);
+
+        if (material < 0 && albedo)
+        {
+            albedo->bind(0);
+        }
+    }
 
-    template <class T>
-    void generateAttribute(int location, int elementsPerEntry, std::vector<T> data, bool normalize)
+    // Reports a draw with the model matrix upload and vertex array bind before it
+    static void countDraw(uint64_t uniforms, uint64_t triangles)
     {
-        unsigned int vbo;
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(T), data.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(location, elementsPerEntry, GL_FLOAT, normalize ? GL_TRUE : GL_FALSE, sizeof(T), 0);
-        glEnableVertexAttribArray(location);
-        vbos.push_back(vbo);
+        RENDER_STAT(STAT_UNIFORM_UPLOADS, uniforms);
+        RENDER_STAT(STAT_VAO_BINDS, 1);
+        RENDER_STAT(STAT_DRAW_CALLS, 1);
+        RENDER_STAT(STAT_TRIANGLES, triangles);
     }
 
 public:
-    unsigned int vao, ebo;
-    std::vector<unsigned int> vbos;
+    unsigned int vao = 0;
     std::vector<unsigned int> indices;
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
     std::vector<glm::vec2> textureCoordinates;
     Texture *albedo = nullptr;
+    int material = -1; // Index in the MaterialLibrary, used instead of albedo when set
+    int lightMask = -1; // Bit i is set if light i can reach the mesh
 
-    void generateVertexData(Shader &shader)
-    {
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
-
-        if (vertices.size() > 0)
-            generateAttribute(shader.getAttributeLocation("position"), 3, vertices, false);
+    // Local space bounding box of the vertices
+    glm::vec3 boundsMin = glm::vec3(0);
+    glm::vec3 boundsMax = glm::vec3(0);
 
-        if (normals.size() > 0)
-            generateAttribute(shader.getAttributeLocation("normal"), 3, normals, false);
-
-        if (textureCoordinates.size() > 0)
-            generateAttribute(shader.getAttributeLocation("textureCoordinate"), 2, textureCoordinates, false);
+    ~Mesh()
+    {
+        MemoryTracker::get().cpu(MEMORY_MESHES, -(int64_t) mTrackedBytes);
+    }
 
-        glGenBuffers(1, &ebo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    // Uploads the vertex data, or shares the buffers of an identical mesh uploaded before
+    void generateVertexData(Shader &shader, ResourceCache &cache)
+    {
+        mResource = cache.acquireMesh(mResourceKey, shader, vertices, normals, textureCoordinates, indices);
+        vao = mResource->vao;
+        mIndexCount = indices.size();
 
         mShader = &shader;
+        computeBounds();
+    }
+
+    void computeBounds()
+    {
+        mGeometryBytes = vertices.size() * sizeof(glm::vec3) + normals.size() * sizeof(glm::vec3) +
+                         textureCoordinates.size() * sizeof(glm::vec2) + indices.size() * sizeof(unsigned int);
+        trackGeometry();
+        if (vertices.empty())
+            return;
+
+        boundsMin = boundsMax = vertices[0];
+        for (const glm::vec3 &vertex : vertices)
+        {
+            boundsMin = glm::min(boundsMin, vertex);
+            boundsMax = glm::max(boundsMax, vertex);
+        }
     }
 
     void render()
     {
         int uModlLoc = mShader->getUniformLocation("model");
-        glUniformMatrix4fv(uModlLoc, 1, GL_FALSE, glm::value_ptr(getTransformMatrix()));
+        glUniformMatrix4fv(uModlLoc, 1, GL_FALSE, glm::value_ptr(getRenderTransform()));
         glBindVertexArray(vao);
+        bindMaterial();
 
-        if (albedo)
-        {
-            albedo->bind(0);
-        }
+        glDrawElements(GL_TRIANGLES, mIndexCount, GL_UNSIGNED_INT, nullptr);
+        countDraw(1, mIndexCount / 3);
+    }
 
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
+    // Draws only the geometry with the active program, e.g. into the shadow maps
+    void renderGeometry(int modelLocation)
+    {
+        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(getRenderTransform()));
+        glBindVertexArray(vao);
+        glDrawElements(GL_TRIANGLES, mIndexCount, GL_UNSIGNED_INT, nullptr);
+        countDraw(1, mIndexCount / 3);
     }
 
-    void destroy()
+    // Frees the CPU copy of the vertex data once it is uploaded. Only the software renderer reads it after that.
+    void releaseGeometry()
     {
-        glDeleteBuffers(vbos.size(), vbos.data());
-        glDeleteBuffers(1, &ebo);
-        glDeleteBuffers(1, &vao);
+        std::vector<unsigned int>().swap(indices);
+        std::vector<glm::vec3>().swap(vertices);
+        std::vector<glm::vec3>().swap(normals);
+        std::vector<glm::vec2>().swap(textureCoordinates);
+        trackGeometry();
+    }
+
+    // Size of the vertex data, also after it was released
+    size_t getGeometryBytes()
+    {
+        return mGeometryBytes;
+    }
+
+    void destroy(ResourceCache &cache)
+    {
+        cache.release(mResource);
+        mResource = nullptr;
+        vao = 0;
     }
 };
 
+// Geometry of an OBJ file, as parsed on the CPU
+typedef struct ObjData
+{
+    std::vector<unsigned int> indices;
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> textureCoordinates;
+
+    size_t getBytes() const
+    {
+        return vertices.capacity() * sizeof(glm::vec3) + normals.capacity() * sizeof(glm::vec3) +
+               textureCoordinates.capacity() * sizeof(glm::vec2) + indices.capacity() * sizeof(unsigned int);
+    }
+} ObjData;
+
 class ObjMesh : public Mesh
 {
+private:
+    std::string mPath;
+    float mScale;
+
+    // Every file and scale is parsed once, and later meshes copy the geometry
+    inline static std::mutex sCacheMutex;
+    inline static std::map<std::string, std::shared_ptr<const ObjData>> sCache;
+
 public:
     ObjMesh(std::string path, float scale)
+    {
+        mPath = path;
+        mScale = scale;
+        mResourceKey = "obj:" + path + ":" + std::to_string(scale);
+
+        std::shared_ptr<const ObjData> data = load(path, scale);
+        indices = data->indices;
+        vertices = data->vertices;
+        normals = data->normals;
+        textureCoordinates = data->textureCoordinates;
+    }
+
+    // The parsed geometry of the file, which is only read the first time. Thread safe, so models can be
+    // loaded ahead on worker threads before the meshes are created.
+    static std::shared_ptr<const ObjData> load(std::string path, float scale)
+    {
+        std::string key = path + ":" + std::to_string(scale);
+        {
+            std::lock_guard<std::mutex> lock(sCacheMutex);
+            auto cached = sCache.find(key);
+            if (cached != sCache.end())
+                return cached->second;
+        }
+
+        // Parsed outside the lock, if two threads parse the same file the first result is kept
+        std::shared_ptr<ObjData> data = std::make_shared<ObjData>();
+        parse(path, scale, *data);
+        std::lock_guard<std::mutex> lock(sCacheMutex);
+        auto inserted = sCache.emplace(key, data);
+        if (inserted.second)
+            MemoryTracker::get().cpu(MEMORY_MESHES, data->getBytes());
+        return inserted.first->second;
+    }
+
+    // Frees the parsed geometry. Meshes keep their own copy.
+    static void clearCache()
+    {
+        std::lock_guard<std::mutex> lock(sCacheMutex);
+        for (auto &entry : sCache)
+            MemoryTracker::get().cpu(MEMORY_MESHES, -(int64_t) entry.second->getBytes());
+        sCache.clear();
+    }
+
+    static void parse(std::string path, float scale, ObjData &outData)
     {
         // Load mesh from file
         std::ifstream fileStream;
@@ -163,22 +302,32 @@ public:
         {
             int index = vertIdx[i];
             glm::vec3 vertex = tmpVerts[index - 1]; // .OBJ indexing starts at 1
-            vertices.push_back(vertex);
-            indices.push_back(i);
+            outData.vertices.push_back(vertex);
+            outData.indices.push_back(i);
         }
 
         for (int i : texIdx)
         {
             glm::vec2 uv = tmpTex[i - 1]; // .OBJ indexing starts at 1
-            textureCoordinates.push_back(uv);
+            outData.textureCoordinates.push_back(uv);
         }
 
         for (int i : normIdx)
         {
             glm::vec3 normal = tmpNorm[i - 1]; // .OBJ indexing starts at 1
-            normals.push_back(normal);
+            outData.normals.push_back(normal);
         }
     }
+
+    std::string getPath()
+    {
+        return mPath;
+    }
+
+    float getScale()
+    {
+        return mScale;
+    }
 };
 
 class Circle : public Mesh
@@ -190,6 +339,7 @@ public:
     Circle(glm::vec2 dimensions, int triangles)
     {
         mDimensions = dimensions;
+        mResourceKey = "circle:" + std::to_string(dimensions.x) + "x" + std::to_string(dimensions.y) + ":" + std::to_string(triangles);
 
         for (int i = 0; i <= triangles; i++)
         {
@@ -214,16 +364,13 @@ public:
     void render()
     {
         int uModlLoc = mShader->getUniformLocation("model");
-        glUniformMatrix4fv(uModlLoc, 1, GL_FALSE, glm::value_ptr(getTransformMatrix()));
+        glUniformMatrix4fv(uModlLoc, 1, GL_FALSE, glm::value_ptr(getRenderTransform()));
         glBindVertexArray(vao);
-
-        if (albedo)
-        {
-            albedo->bind(0);
-        }
+        bindMaterial();
 
         // The circle is drawn using trianglefan
-        glDrawElements(GL_TRIANGLE_FAN, indices.size(), GL_UNSIGNED_INT, nullptr);
+        glDrawElements(GL_TRIANGLE_FAN, mIndexCount, GL_UNSIGNED_INT, nullptr);
+        countDraw(1, mIndexCount - 2);
     }
 
     glm::vec2 getDimensions()
@@ -260,6 +407,7 @@ public:
     {
         mInside = inside;
         mDimension = dimensions;
+        mResourceKey = std::string(inside ? "room:" : "box:") + std::to_string(dimensions.x) + "x" + std::to_string(dimensions.y) + "x" + std::to_string(dimensions.z);
 
         glm::vec3 verts[8];
         int idx[36];
@@ -324,6 +472,16 @@ public:
         }
     }
 
+    glm::vec3 getDimensions()
+    {
+        return mDimension;
+    }
+
+    bool isInside()
+    {
+        return mInside;
+    }
+
     // Takes a position and a ray and checks if there is an intersection with the cube.
     // If there is an intersection, the outNormal is the normal of the surface of the cube
     // which is hit, the outIntersection is the position of the intersection. 
@@ -1,10 +1,16 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <algorithm>
 #include <vector>
 #include <glm/vec3.hpp>
 #include <glm/gtc/matrix_access.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <jobs.hpp>
+
+// Nodes with more children than this update their subtrees as parallel jobs
+#define NODE_JOB_GRAIN 16
 
 class Node
 {
@@ -14,6 +20,24 @@ class Node
         glm::fquat mOrientation;
         
         glm::mat4 mGlobalTransform;
+
+        // The simulation runs at a fixed tick rate. Rendering interpolates between the
+        // transform of the previous tick and the current one.
+        glm::mat4 mPrevGlobalTransform;
+        glm::mat4 mRenderTransform;
+        bool mSnap = true;
+        void updateGlobalTransform(const glm::mat4 &parentTransform, bool &snap)
+        {
+            mGlobalTransform = glm::translate(parentTransform, mPosition) * (glm::mat4) mOrientation;
+
+            // Nodes that were teleported should not be interpolated from their old transform
+            snap = snap || mSnap;
+            if(snap)
+            {
+                mPrevGlobalTransform = mGlobalTransform;
+                mSnap = false;
+            }
+        }
     public:
         Node()
         {
@@ -71,16 +95,105 @@ class Node
             children.push_back(&child);
         }
 
-        void updateTransforms(glm::mat4 transformMatrix = glm::identity<glm::mat4>())
+        void removeChild(Node &child)
         {
-            transformMatrix = glm::translate(transformMatrix, mPosition) * (glm::mat4) mOrientation;
+            children.erase(std::remove(children.begin(), children.end(), &child), children.end());
+        }
+
+        const std::vector<Node*> &getChildren()
+        {
+            return children;
+        }
 
-            mGlobalTransform = transformMatrix;
+        void updateTransforms(const glm::mat4 &transformMatrix = glm::identity<glm::mat4>(), bool snap = false)
+        {
+            updateGlobalTransform(transformMatrix, snap);
 
             for(Node *child : children)
             {
-                child->updateTransforms(transformMatrix);
+                child->updateTransforms(mGlobalTransform, snap);
+            }
+        }
+
+        // Same as above, but the children of nodes with many children are updated as parallel jobs
+        void updateTransforms(JobSystem &jobs, const glm::mat4 &transformMatrix = glm::identity<glm::mat4>(), bool snap = false)
+        {
+            updateGlobalTransform(transformMatrix, snap);
+
+            if(children.size() <= NODE_JOB_GRAIN)
+            {
+                for(Node *child : children)
+                {
+                    child->updateTransforms(jobs, mGlobalTransform, snap);
+                }
+                return;
             }
+
+            jobs.parallelFor("updateTransforms", children.size(), NODE_JOB_GRAIN, [&](size_t begin, size_t end) {
+                for(size_t i = begin; i < end; i++)
+                {
+                    children[i]->updateTransforms(jobs, mGlobalTransform, snap);
+                }
+            });
+        }
+
+        // Skip the interpolation of this node and its children at the next tick, e.g. after teleporting
+        void snap()
+        {
+            mSnap = true;
+        }
+
+        // Called at the start of every tick, before the simulation moves anything
+        void storePreviousTransforms()
+        {
+            mPrevGlobalTransform = mGlobalTransform;
+
+            for(Node *child : children)
+            {
+                child->storePreviousTransforms();
+            }
+        }
+
+        // Blends the transforms of two ticks. alpha is the fraction of a tick since the first one.
+        static glm::mat4 interpolate(const glm::mat4 &previous, const glm::mat4 &current, float alpha)
+        {
+            glm::vec3 position = glm::mix(glm::vec3(glm::column(previous, 3)), glm::vec3(glm::column(current, 3)), alpha);
+            glm::fquat orientation = glm::slerp(glm::quat_cast(glm::mat3(previous)), glm::quat_cast(glm::mat3(current)), alpha);
+
+            glm::mat4 transform = glm::mat4_cast(orientation);
+            return glm::column(transform, 3, glm::vec4(position, 1));
+        }
+
+        // Appends this node and all its descendants, parents before children
+        void collect(std::vector<Node*> &nodes)
+        {
+            nodes.push_back(this);
+            for(Node *child : children)
+            {
+                child->collect(nodes);
+            }
+        }
+
+        glm::mat4 getPreviousTransform()
+        {
+            return mPrevGlobalTransform;
+        }
+
+        // Set by the renderer from the latest simulation snapshot
+        void setRenderTransform(const glm::mat4 &transform)
+        {
+            mRenderTransform = transform;
+        }
+
+        // Transform used for rendering, interpolated between the last two ticks
+        glm::mat4 getRenderTransform()
+        {
+            return mRenderTransform;
+        }
+
+        glm::vec3 getRenderPosition()
+        {
+            return glm::column(mRenderTransform, 3);
         }
 
         glm::vec3 getGlobalPosition()
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Number of samples evaluated together. The inner loops are written over fixed size
+// arrays of this width, so the compiler can map them onto SIMD registers.
+#define NOISE_LANES 8
+
+typedef struct NoiseSettings
+{
+    unsigned int width;
+    unsigned int height;
+    unsigned int depth;         // 1 for 2D noise, > 1 for a 3D volume (e.g. animated noise)
+    unsigned int octaves;
+    float frequency;            // Size of the first octave in texels
+    float persistence;          // Amplitude multiplier between octaves
+    uint32_t seed;
+    bool tileable;              // Wrap the lattice so the output tiles in every dimension
+} NoiseSettings;
+
+// Gradient (Perlin) noise with a seeded permutation table.
+// Rows of the output are split across threads, and each row is evaluated NOISE_LANES samples at a time.
+class NoiseGenerator
+{
+private:
+    int mPerm[512];
+    uint32_t mSeed;
+    unsigned int mThreads;
+
+    static inline float fade(float t)
+    {
+        return t * t * t * (t * (t * 6 - 15) + 10);
+    }
+
+    static inline float lerp(float a, float b, float t)
+    {
+        return a + t * (b - a);
+    }
+
+    void seed(uint32_t seed)
+    {
+        std::iota(mPerm, mPerm + 256, 0);
+        std::shuffle(mPerm, mPerm + 256, std::mt19937(seed));
+        std::copy(mPerm, mPerm + 256, mPerm + 256);
+        mSeed = seed;
+    }
+
+    // Wraps a lattice coordinate into the tiling period. Period 0 means no tiling.
+    static inline int wrap(int i, int period)
+    {
+        if (period > 0)
+        {
+            i %= period;
+            if (i < 0) i += period;
+        }
+        return i & 255;
+    }
+
+    // Evaluates one octave of 2D noise for NOISE_LANES samples and adds it to out
+    void octave2D(const float *x, float y, int periodX, int periodY, float amplitude, float *out) const
+    {
+        int xi[NOISE_LANES], h00[NOISE_LANES], h10[NOISE_LANES], h01[NOISE_LANES], h11[NOISE_LANES];
+        float xf[NOISE_LANES];
+
+        int y0 = (int) floorf(y);
+        float yf = y - y0;
+        float v = fade(yf);
+        int ya = wrap(y0, periodY);
+        int yb = wrap(y0 + 1, periodY);
+
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            float fl = floorf(x[l]);
+            xi[l] = (int) fl;
+            xf[l] = x[l] - fl;
+        }
+
+        // Hashing is a table lookup per lane, the rest of the octave is pure lane arithmetic
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            int xa = wrap(xi[l], periodX);
+            int xb = wrap(xi[l] + 1, periodX);
+            h00[l] = mPerm[mPerm[xa] + ya];
+            h10[l] = mPerm[mPerm[xb] + ya];
+            h01[l] = mPerm[mPerm[xa] + yb];
+            h11[l] = mPerm[mPerm[xb] + yb];
+        }
+
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            float u = fade(xf[l]);
+            float n00 = grad2(h00[l], xf[l], yf);
+            float n10 = grad2(h10[l], xf[l] - 1, yf);
+            float n01 = grad2(h01[l], xf[l], yf - 1);
+            float n11 = grad2(h11[l], xf[l] - 1, yf - 1);
+            out[l] += amplitude * lerp(lerp(n00, n10, u), lerp(n01, n11, u), v);
+        }
+    }
+
+    // Evaluates one octave of 3D noise for NOISE_LANES samples and adds it to out
+    void octave3D(const float *x, float y, float z, int periodX, int periodY, int periodZ, float amplitude, float *out) const
+    {
+        int xi[NOISE_LANES], h[8][NOISE_LANES];
+        float xf[NOISE_LANES];
+
+        int y0 = (int) floorf(y), z0 = (int) floorf(z);
+        float yf = y - y0, zf = z - z0;
+        float v = fade(yf), w = fade(zf);
+        int ya = wrap(y0, periodY), yb = wrap(y0 + 1, periodY);
+        int za = wrap(z0, periodZ), zb = wrap(z0 + 1, periodZ);
+
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            float fl = floorf(x[l]);
+            xi[l] = (int) fl;
+            xf[l] = x[l] - fl;
+        }
+
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            int xa = wrap(xi[l], periodX);
+            int xb = wrap(xi[l] + 1, periodX);
+            int a = mPerm[xa], b = mPerm[xb];
+            int aa = mPerm[a + ya], ab = mPerm[a + yb], ba = mPerm[b + ya], bb = mPerm[b + yb];
+            h[0][l] = mPerm[aa + za]; h[1][l] = mPerm[ba + za];
+            h[2][l] = mPerm[ab + za]; h[3][l] = mPerm[bb + za];
+            h[4][l] = mPerm[aa + zb]; h[5][l] = mPerm[ba + zb];
+            h[6][l] = mPerm[ab + zb]; h[7][l] = mPerm[bb + zb];
+        }
+
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            float u = fade(xf[l]);
+            float x0 = lerp(grad3(h[0][l], xf[l], yf, zf), grad3(h[1][l], xf[l] - 1, yf, zf), u);
+            float x1 = lerp(grad3(h[2][l], xf[l], yf - 1, zf), grad3(h[3][l], xf[l] - 1, yf - 1, zf), u);
+            float x2 = lerp(grad3(h[4][l], xf[l], yf, zf - 1), grad3(h[5][l], xf[l] - 1, yf, zf - 1), u);
+            float x3 = lerp(grad3(h[6][l], xf[l], yf - 1, zf - 1), grad3(h[7][l], xf[l] - 1, yf - 1, zf - 1), u);
+            out[l] += amplitude * lerp(lerp(x0, x1, v), lerp(x2, x3, v), w);
+        }
+    }
+
+    // Branchless gradient selection, so the lane loops stay vectorizable
+    static inline float grad2(int hash, float x, float y)
+    {
+        float u = (hash & 4) ? y : x;
+        float v = (hash & 4) ? x : y;
+        return ((hash & 1) ? -u : u) + ((hash & 2) ? -2.0f * v : 2.0f * v);
+    }
+
+    static inline float grad3(int hash, float x, float y, float z)
+    {
+        int h = hash & 15;
+        float u = h < 8 ? x : y;
+        float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+        return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+    }
+
+    // Generates the rows [rowBegin, rowEnd) of the output. A row is one line of one z-slice.
+    void generateRows(const NoiseSettings &settings, unsigned int rowBegin, unsigned int rowEnd, unsigned char *out) const
+    {
+        const float invFreq = 1.0f / settings.frequency;
+        const bool is3D = settings.depth > 1;
+
+        // The base period in lattice cells. Tileable noise rounds it so the image holds a whole number of cells.
+        int periodX = settings.tileable ? std::max(1, (int) roundf(settings.width * invFreq)) : 0;
+        int periodY = settings.tileable ? std::max(1, (int) roundf(settings.height * invFreq)) : 0;
+        int periodZ = settings.tileable ? std::max(1, (int) roundf(settings.depth * invFreq)) : 0;
+        float scaleX = settings.tileable ? (float) periodX / settings.width : invFreq;
+        float scaleY = settings.tileable ? (float) periodY / settings.height : invFreq;
+        float scaleZ = settings.tileable ? (float) periodZ / settings.depth : invFreq;
+
+        float amplitudeSum = 0;
+        for (unsigned int o = 0; o < settings.octaves; o++)
+            amplitudeSum += powf(settings.persistence, (float) o);
+
+        float xs[NOISE_LANES], sum[NOISE_LANES];
+        for (unsigned int row = rowBegin; row < rowEnd; row++)
+        {
+            unsigned int y = row % settings.height;
+            unsigned int z = row / settings.height;
+            unsigned char *dst = out + (size_t) row * settings.width;
+
+            for (unsigned int x = 0; x < settings.width; x += NOISE_LANES)
+            {
+                std::fill(sum, sum + NOISE_LANES, 0.0f);
+
+                float frequency = 1, amplitude = 1;
+                for (unsigned int o = 0; o < settings.octaves; o++)
+                {
+                    for (int l = 0; l < NOISE_LANES; l++)
+                        xs[l] = (x + l) * scaleX * frequency;
+
+                    int octavePeriodX = periodX * (int) frequency;
+                    int octavePeriodY = periodY * (int) frequency;
+                    if (is3D)
+                        octave3D(xs, y * scaleY * frequency, z * scaleZ * frequency, octavePeriodX, octavePeriodY, periodZ * (int) frequency, amplitude, sum);
+                    else
+                        octave2D(xs, y * scaleY * frequency, octavePeriodX, octavePeriodY, amplitude, sum);
+
+                    frequency *= 2;
+                    amplitude *= settings.persistence;
+                }
+
+                unsigned int lanes = std::min((unsigned int) NOISE_LANES, settings.width - x);
+                for (unsigned int l = 0; l < lanes; l++)
+                {
+                    float value = sum[l] / amplitudeSum * 0.5f + 0.5f;
+                    dst[x + l] = (unsigned char) (255 * std::min(1.0f, std::max(0.0f, value)));
+                }
+            }
+        }
+    }
+
+public:
+    NoiseGenerator(unsigned int threads = std::thread::hardware_concurrency())
+    {
+        mThreads = std::max(1u, threads);
+        seed(0);
+    }
+
+    void setThreads(unsigned int threads)
+    {
+        mThreads = std::max(1u, threads);
+    }
+
+    // Fills out with width * height * depth bytes of noise in [0, 255]
+    void generate(const NoiseSettings &settings, unsigned char *out)
+    {
+        if (settings.seed != mSeed)
+            seed(settings.seed);
+
+        unsigned int rows = settings.height * std::max(1u, settings.depth);
+        unsigned int threads = std::min(mThreads, rows);
+        if (threads <= 1)
+        {
+            generateRows(settings, 0, rows, out);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        unsigned int rowsPerThread = (rows + threads - 1) / threads;
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            unsigned int begin = t * rowsPerThread;
+            unsigned int end = std::min(rows, begin + rowsPerThread);
+            if (begin >= end)
+                break;
+            workers.emplace_back(&NoiseGenerator::generateRows, this, std::cref(settings), begin, end, out);
+        }
+
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+};
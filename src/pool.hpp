@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <memory.hpp>
+
+#define POOL_PAGE_SIZE 256      // Objects per page
+#define POOL_MAX_PAGES 1024     // Pages per pool, so at most 262144 objects of a type
+
+// Refers to an object in a Pool. The generation tells a live object apart from a destroyed one that reused its slot.
+template <typename T>
+struct Handle
+{
+    uint32_t index = 0;
+    uint32_t generation = 0;   // 0 is never used by a live object
+
+    bool isNull() const
+    {
+        return generation == 0;
+    }
+
+    bool operator==(const Handle &other) const
+    {
+        return index == other.index && generation == other.generation;
+    }
+};
+
+// Stores objects of one type in fixed pages, which are allocated once and never moved, so pointers to the
+// objects stay valid for their whole life. Destroyed slots go on a free list and are reused by the next create(),
+// so spawning and despawning does not allocate once the pool has grown. create() and destroy() can be called
+// from several threads. get() is lock free, the handle has to be passed to the thread in a synchronized way.
+// The pages are accounted as CPU memory under the tag of the pool.
+template <typename T>
+class Pool
+{
+private:
+    typedef struct Slot
+    {
+        alignas(T) unsigned char storage[sizeof(T)];
+        uint32_t generation = 0;
+        uint32_t nextFree = 0;
+        bool alive = false;
+    } Slot;
+
+    std::unique_ptr<Slot[]> mPages[POOL_MAX_PAGES];
+    uint32_t mSlots = 0;            // Slots handed out so far, live or free
+    uint32_t mFree = UINT32_MAX;    // Head of the free list
+    uint32_t mLive = 0;
+    memory_tag_e mTag;
+    std::mutex mMutex;
+
+    Slot *slot(uint32_t index)
+    {
+        return &mPages[index / POOL_PAGE_SIZE][index % POOL_PAGE_SIZE];
+    }
+
+    T *object(Slot *slot)
+    {
+        return std::launder(reinterpret_cast<T *>(slot->storage));
+    }
+
+public:
+    Pool(memory_tag_e tag = MEMORY_SCENE) : mTag(tag) {}
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+
+    ~Pool()
+    {
+        reset();
+        uint32_t pages = (mSlots + POOL_PAGE_SIZE - 1) / POOL_PAGE_SIZE;
+        MemoryTracker::get().cpu(mTag, -(int64_t) pages * POOL_PAGE_SIZE * sizeof(Slot));
+    }
+
+    // Constructs an object in a free slot. Returns a null handle if the pool is full. The slot is reserved under the
+    // lock and the object constructed outside it, so threads creating expensive objects (the meshes of the level
+    // loaders) do not wait for each other's constructors.
+    template <typename... Args>
+    Handle<T> create(Args &&...args)
+    {
+        Slot *target;
+        uint32_t index;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mFree != UINT32_MAX)
+            {
+                index = mFree;
+                mFree = slot(index)->nextFree;
+            }
+            else
+            {
+                if (mSlots == POOL_PAGE_SIZE * POOL_MAX_PAGES)
+                    return Handle<T>();
+                if (mSlots % POOL_PAGE_SIZE == 0)
+                {
+                    mPages[mSlots / POOL_PAGE_SIZE].reset(new Slot[POOL_PAGE_SIZE]);
+                    MemoryTracker::get().cpu(mTag, POOL_PAGE_SIZE * sizeof(Slot));
+                }
+                index = mSlots++;
+            }
+            target = slot(index);
+        }
+
+        // The reserved slot is neither free nor alive, so no other call touches it until it is published
+        new (target->storage) T(std::forward<Args>(args)...);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        target->generation++;
+        if (target->generation == 0)
+            target->generation = 1;
+        target->alive = true;
+        mLive++;
+        return Handle<T>{index, target->generation};
+    }
+
+    // Constructs an object that lives until the pool is reset, for objects nothing refers to by handle
+    template <typename... Args>
+    T *emplace(Args &&...args)
+    {
+        return get(create(std::forward<Args>(args)...));
+    }
+
+    // The object of the handle, or nullptr if it has been destroyed
+    T *get(Handle<T> handle)
+    {
+        if (handle.isNull() || handle.index >= POOL_PAGE_SIZE * POOL_MAX_PAGES || !mPages[handle.index / POOL_PAGE_SIZE])
+            return nullptr;
+        Slot *target = slot(handle.index);
+        return target->alive && target->generation == handle.generation ? object(target) : nullptr;
+    }
+
+    // Destroys the object, and invalidates every handle to it. Stale handles are ignored.
+    void destroy(Handle<T> handle)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        T *target = get(handle);
+        if (!target)
+            return;
+
+        target->~T();
+        Slot *freed = slot(handle.index);
+        freed->alive = false;
+        freed->nextFree = mFree;
+        mFree = handle.index;
+        mLive--;
+    }
+
+    // Calls function(T&) for every live object, in slot order
+    template <typename F>
+    void forEach(F function)
+    {
+        for (uint32_t i = 0; i < mSlots; i++)
+        {
+            Slot *target = slot(i);
+            if (target->alive)
+                function(*object(target));
+        }
+    }
+
+    // Destroys every object at once. The pages are kept for the next level, and old handles stay invalid.
+    // Must not run while another thread is in create().
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFree = UINT32_MAX;
+        for (uint32_t i = mSlots; i-- > 0;)
+        {
+            Slot *target = slot(i);
+            if (target->alive)
+            {
+                object(target)->~T();
+                target->alive = false;
+            }
+            target->nextFree = mFree;
+            mFree = i;
+        }
+        mLive = 0;
+    }
+
+    uint32_t size()
+    {
+        return mLive;
+    }
+};
@@ -20,6 +20,11 @@ public:
         mColor = color;
     }
 
+    glm::vec3 getColor()
+    {
+        return mColor;
+    }
+
     void render()
     {
         int uIsPortalLoc = mShader->getUniformLocation("u_is_portal");
@@ -77,6 +82,9 @@ public:
 
                     node.setPosition(destination.getPosition() + destDeltaPos);
                     node.direct(deltaYaw, 0);
+
+                    // Do not interpolate the camera across the teleport
+                    node.snap();
                     return true;
                 }
             }
@@ -131,16 +139,19 @@ public:
             axis = targetNormal;
         }
         rotate(axis, angle);
+
+        // Jump to the new place instead of sliding there
+        snap();
     }
 
     // Return the view matrix which is looking  out of the destination portal, 
     // with the same view as into this portal
-    glm::mat4 getViewMatrix(glm::mat4 viewMatrix, Portal *destPortal)
+    glm::mat4 getViewMatrix(const glm::mat4 &viewMatrix, Portal *destPortal)
     {
         return viewMatrix 
-            * getTransformMatrix()                                                              
+            * getRenderTransform()                                                              
             * glm::rotate(glm::identity<glm::mat4>(), (float) M_PI, glm::vec3(0.0, 1.0, 0.0)) // Rotate the camara to look out by rotting 
-            * glm::inverse(destPortal->getTransformMatrix());                                 // Move to the destination portal
+            * glm::inverse(destPortal->getRenderTransform());                                 // Move to the destination portal
     }
 
     glm::vec3 getNormal()
@@ -148,26 +159,69 @@ public:
         return glm::vec3(0, 0, 1) * glm::mat3_cast(glm::conjugate(getOrientation()));
     }
 
+    // The normal of the interpolated transform that is rendered
+    glm::vec3 getRenderNormal()
+    {
+        return glm::mat3(getRenderTransform()) * glm::vec3(0, 0, 1);
+    }
+
+    // Screen rectangle of the rendered portal in normalized device coordinates: min x, min y, max x, max y.
+    // Returns false if the portal is entirely behind the eye. If only a part is, the rectangle is the whole screen.
+    bool getScreenBounds(const glm::mat4 &viewProjection, glm::vec4 &outBounds)
+    {
+        glm::mat4 transform = viewProjection * getRenderTransform();
+        glm::vec2 min = glm::vec2(1), max = glm::vec2(-1);
+        int behind = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            glm::vec4 corner = transform * glm::vec4((i & 1 ? 0.5f : -0.5f) * mDimensions.x, (i & 2 ? 0.5f : -0.5f) * mDimensions.y, 0, 1);
+            if (corner.w <= 0.0001f)
+            {
+                behind++;
+                continue;
+            }
+            min = glm::min(min, glm::vec2(corner) / corner.w);
+            max = glm::max(max, glm::vec2(corner) / corner.w);
+        }
+
+        if (behind == 4)
+            return false;
+        outBounds = behind > 0 ? glm::vec4(-1, -1, 1, 1) : glm::vec4(min, max);
+        return true;
+    }
+
     glm::vec3 getUp()
     {
         return glm::vec3(0, 1, 0) * glm::mat3_cast(glm::conjugate(getOrientation()));
     }
 
+    // The plane of the portal in world space, using the interpolated transform that is rendered. The normal points out of the front.
+    glm::vec4 getClipPlane()
+    {
+        glm::vec3 normal = getRenderNormal();
+        return glm::vec4(normal, -glm::dot(normal, getRenderPosition()));
+    }
+
     // Create an oblique projection matrix, given a standard view-frustum and the view matrix
+    glm::mat4 getObliqueProjection(const glm::mat4 &proj, const glm::mat4 &view)
+    {
+        return getObliqueProjection(proj, view, getClipPlane());
+    }
+
+    // Same as above, with the clip plane from getClipPlane(). The view matrix has to be rigid, which every view matrix is.
     /* Source: http://www.terathon.com/lengyel/Lengyel-Oblique.pdf */
-    glm::mat4 getObliqueProjection(glm::mat4 proj, glm::mat4 view)
+    static glm::mat4 getObliqueProjection(const glm::mat4 &proj, const glm::mat4 &view, const glm::vec4 &worldPlane)
     {
-        // Define the clip plane
-        glm::vec3 normal = getNormal();
-        float d = -glm::dot(normal, mPosition);
-        glm::vec4 clipPlane = glm::inverse(glm::transpose(view)) * glm::vec4(normal, d);
+        // Move the plane into view space. For a rigid matrix this is the rotation of the normal, without an inverse.
+        glm::vec3 normal = glm::mat3(view) * glm::vec3(worldPlane);
+        glm::vec4 clipPlane = glm::vec4(normal, worldPlane.w - glm::dot(normal, glm::vec3(view[3])));
             
         if (clipPlane.w > 0.0f)
         {
             return proj;
         }
 
-        float *ptr = glm::value_ptr(proj);
+        const float *ptr = glm::value_ptr(proj);
         glm::vec4 q = glm::vec4(
             (glm::sign(clipPlane.x) + ptr[8]) / ptr[0],
             (glm::sign(clipPlane.y) + ptr[9]) / ptr[5],
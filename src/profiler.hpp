@@ -0,0 +1,479 @@
+#pragma once
+
+// Frame profiler with scoped CPU zones and GPU timestamp zones.
+//
+// Compile time: the profiler is only compiled in when PORTAL_PROFILER is defined (CMake option ENABLE_PROFILER).
+//               Otherwise all the PROFILE_* macros expand to nothing.
+// Runtime:      it records nothing unless the environment variable PORTAL_PROFILE is set to 1.
+//               PORTAL_TRACE sets the file the Chrome trace is written to (default trace.json).
+//
+// Usage:
+//     PROFILE_ZONE("update");            // CPU zone until the end of the scope
+//     PROFILE_GPU_ZONE("renderWorld");   // CPU zone + GPU timestamps around the scope
+//
+// Per zone min/avg/p95/p99 are kept over the last PROFILER_WINDOW frames. captureTrace() records the next
+// PROFILER_CAPTURE_FRAMES frames and writes them as Chrome trace-event JSON (open in chrome://tracing or Perfetto).
+
+#define PROFILER_WINDOW 300
+#define PROFILER_GPU_FRAMES 4
+#define PROFILER_CAPTURE_FRAMES 120
+#define PROFILER_MAX_DEPTH 64
+
+#ifdef PORTAL_PROFILER
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef struct ProfileEvent
+{
+    const char *name;
+    int64_t start;  // Nanoseconds on the CPU timeline
+    int64_t end;
+    int depth;
+    int thread;     // Index of the recording thread, PROFILER_GPU_THREAD for GPU zones
+} ProfileEvent;
+
+#define PROFILER_GPU_THREAD 1000
+
+class Profiler
+{
+private:
+    // Events are recorded into a buffer per thread, so zones in worker threads do not contend
+    typedef struct ThreadBuffer
+    {
+        std::mutex mutex;
+        std::vector<ProfileEvent> events;
+        int index;
+        int depth = 0;
+    } ThreadBuffer;
+
+    typedef struct GPUZone
+    {
+        const char *name;
+        unsigned int beginQuery;
+        unsigned int endQuery;
+        int depth;
+    } GPUZone;
+
+    // Queries of one frame in flight
+    typedef struct GPUFrame
+    {
+        std::vector<unsigned int> queries;
+        std::vector<GPUZone> zones;
+        unsigned int used = 0;
+    } GPUFrame;
+
+    // Zones are keyed by their name, which is not always the same pointer for the same name
+    typedef struct NameLess
+    {
+        bool operator()(const char *a, const char *b) const
+        {
+            return strcmp(a, b) < 0;
+        }
+    } NameLess;
+
+    typedef struct ZoneStats
+    {
+        double samples[PROFILER_WINDOW];
+        unsigned int count = 0;
+        unsigned int next = 0;
+        bool touched = false;
+        double frameTotal = 0;
+    } ZoneStats;
+
+    typedef std::map<const char *, ZoneStats, NameLess> StatsMap;
+
+    bool mEnabled = false;
+    std::string mTracePath = "trace.json";
+    std::chrono::steady_clock::time_point mEpoch = std::chrono::steady_clock::now();
+
+    std::mutex mThreadsMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> mThreads;
+
+    GPUFrame mGPUFrames[PROFILER_GPU_FRAMES];
+    unsigned int mGPUFrame = 0;
+    int64_t mGPUOffset = 0; // CPU time - GPU time
+    bool mGPUCalibrated = false;
+    unsigned int mGPUDropped = 0;
+    std::vector<ProfileEvent> mGPUEvents;
+
+    StatsMap mCPUStats;
+    StatsMap mGPUStats;
+    std::vector<ProfileEvent> mEvents;  // Of the current frame, reused every frame
+
+    std::vector<ProfileEvent> mTrace;
+    int mCaptureFrames = 0;
+
+    Profiler()
+    {
+        const char *profile = getenv("PORTAL_PROFILE");
+        mEnabled = profile && std::string(profile) == "1";
+
+        const char *trace = getenv("PORTAL_TRACE");
+        if (trace)
+            mTracePath = trace;
+    }
+
+    ThreadBuffer &threadBuffer()
+    {
+        thread_local ThreadBuffer *buffer = nullptr;
+        if (!buffer)
+        {
+            std::lock_guard<std::mutex> lock(mThreadsMutex);
+            mThreads.emplace_back(new ThreadBuffer());
+            buffer = mThreads.back().get();
+            buffer->index = mThreads.size() - 1;
+        }
+        return *buffer;
+    }
+
+    unsigned int nextQuery(GPUFrame &frame)
+    {
+        if (frame.used == frame.queries.size())
+        {
+            unsigned int query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+        }
+        return frame.queries[frame.used++];
+    }
+
+    // Reads back the queries of the oldest frame in flight, if the GPU is done with them.
+    // Never waits. If they are not ready when the slot is reused, the frame is dropped.
+    void resolveGPUFrame(GPUFrame &frame)
+    {
+        if (frame.zones.empty())
+            return;
+
+        int available = 0;
+        glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            for (GPUZone &zone : frame.zones)
+            {
+                GLuint64 begin, end;
+                glGetQueryObjectui64v(zone.beginQuery, GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(zone.endQuery, GL_QUERY_RESULT, &end);
+                mGPUEvents.push_back({zone.name, (int64_t) begin + mGPUOffset, (int64_t) end + mGPUOffset, zone.depth, PROFILER_GPU_THREAD});
+            }
+        }
+        else
+        {
+            mGPUDropped++;
+        }
+
+        frame.zones.clear();
+        frame.used = 0;
+    }
+
+    static void addSample(StatsMap &stats, const ProfileEvent &event)
+    {
+        ZoneStats &zone = stats[event.name];
+        zone.frameTotal += (event.end - event.start) / 1e6;
+        zone.touched = true;
+    }
+
+    // Zones that are entered several times a frame (e.g. renderWorld) are summed into one sample per frame
+    static void commitFrame(StatsMap &stats)
+    {
+        for (auto &entry : stats)
+        {
+            ZoneStats &zone = entry.second;
+            if (!zone.touched)
+                continue;
+            zone.samples[zone.next] = zone.frameTotal;
+            zone.next = (zone.next + 1) % PROFILER_WINDOW;
+            zone.count = std::min(zone.count + 1, (unsigned int) PROFILER_WINDOW);
+            zone.frameTotal = 0;
+            zone.touched = false;
+        }
+    }
+
+    static void printStats(const char *title, StatsMap &stats)
+    {
+        printf("%-28s %9s %9s %9s %9s\n", title, "min", "avg", "p95", "p99");
+        for (auto &entry : stats)
+        {
+            ZoneStats &zone = entry.second;
+            if (zone.count == 0)
+                continue;
+
+            std::vector<double> sorted(zone.samples, zone.samples + zone.count);
+            std::sort(sorted.begin(), sorted.end());
+            double sum = 0;
+            for (double sample : sorted)
+                sum += sample;
+
+            printf(
+                "%-28s %9.3f %9.3f %9.3f %9.3f\n",
+                entry.first,
+                sorted.front(),
+                sum / sorted.size(),
+                sorted[(size_t) (0.95 * (sorted.size() - 1))],
+                sorted[(size_t) (0.99 * (sorted.size() - 1))]);
+        }
+    }
+
+    void writeTrace()
+    {
+        std::ofstream fileStream(mTracePath.c_str());
+        if (!fileStream)
+        {
+            fprintf(stderr, "Error: Could not write %s\n", mTracePath.c_str());
+            return;
+        }
+
+        fileStream << "{\"traceEvents\":[\n";
+        fileStream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << PROFILER_GPU_THREAD << ",\"args\":{\"name\":\"GPU\"}}";
+        for (const ProfileEvent &event : mTrace)
+        {
+            fileStream << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread
+                       << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+        }
+        fileStream << "\n]}\n";
+
+        printf("Profiler: wrote %d events to %s\n", (int) mTrace.size(), mTracePath.c_str());
+        mTrace.clear();
+    }
+
+public:
+    static Profiler &get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    bool isEnabled()
+    {
+        return mEnabled;
+    }
+
+    int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mEpoch).count();
+    }
+
+    // Name of the zone for a recursion depth. The returned pointer stays valid.
+    static const char *depthName(int depth)
+    {
+        static std::string names[PROFILER_MAX_DEPTH];
+        static std::once_flag once;
+        std::call_once(once, []() {
+            for (int i = 0; i < PROFILER_MAX_DEPTH; i++)
+                names[i] = "portal depth " + std::to_string(i);
+        });
+        return names[std::min(std::max(depth, 0), PROFILER_MAX_DEPTH - 1)].c_str();
+    }
+
+    int beginZone()
+    {
+        return threadBuffer().depth++;
+    }
+
+    void endZone(const char *name, int64_t start, int depth)
+    {
+        ThreadBuffer &buffer = threadBuffer();
+        buffer.depth--;
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.events.push_back({name, start, now(), depth, buffer.index});
+    }
+
+    void beginGPUZone(const char *name, int depth)
+    {
+        GPUFrame &frame = mGPUFrames[mGPUFrame];
+        unsigned int query = nextQuery(frame);
+        glQueryCounter(query, GL_TIMESTAMP);
+        frame.zones.push_back({name, query, 0, depth});
+    }
+
+    void endGPUZone(const char *name)
+    {
+        GPUFrame &frame = mGPUFrames[mGPUFrame];
+        // Find the innermost open zone with this name
+        for (auto zone = frame.zones.rbegin(); zone != frame.zones.rend(); zone++)
+        {
+            if (zone->name == name && zone->endQuery == 0)
+            {
+                zone->endQuery = nextQuery(frame);
+                glQueryCounter(zone->endQuery, GL_TIMESTAMP);
+                return;
+            }
+        }
+    }
+
+    // Records the next PROFILER_CAPTURE_FRAMES frames, and writes them to the trace file
+    void captureTrace()
+    {
+        if (!mEnabled || mCaptureFrames > 0)
+            return;
+        mTrace.clear();
+        mCaptureFrames = PROFILER_CAPTURE_FRAMES;
+        printf("Profiler: capturing %d frames\n", PROFILER_CAPTURE_FRAMES);
+    }
+
+    // Must be called at the start of every frame on the thread owning the GL context
+    void beginFrame()
+    {
+        if (!mEnabled)
+            return;
+
+#ifndef PORTAL_SOFTWARE
+        if (!mGPUCalibrated)
+        {
+            GLint64 gpuTime;
+            glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+            mGPUOffset = now() - gpuTime;
+            mGPUCalibrated = true;
+        }
+#endif
+
+        // The slot about to be reused is the oldest frame in flight
+        mGPUFrame = (mGPUFrame + 1) % PROFILER_GPU_FRAMES;
+        resolveGPUFrame(mGPUFrames[mGPUFrame]);
+    }
+
+    // Must be called at the end of every frame. Collects the events of all threads into the statistics.
+    void endFrame()
+    {
+        if (!mEnabled)
+            return;
+
+        mEvents.clear();
+        {
+            std::lock_guard<std::mutex> lock(mThreadsMutex);
+            for (std::unique_ptr<ThreadBuffer> &buffer : mThreads)
+            {
+                std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+                mEvents.insert(mEvents.end(), buffer->events.begin(), buffer->events.end());
+                buffer->events.clear();
+            }
+        }
+
+        for (const ProfileEvent &event : mEvents)
+            addSample(mCPUStats, event);
+        commitFrame(mCPUStats);
+
+        for (const ProfileEvent &event : mGPUEvents)
+            addSample(mGPUStats, event);
+        commitFrame(mGPUStats);
+
+        if (mCaptureFrames > 0)
+        {
+            mTrace.insert(mTrace.end(), mEvents.begin(), mEvents.end());
+            mTrace.insert(mTrace.end(), mGPUEvents.begin(), mGPUEvents.end());
+            if (--mCaptureFrames == 0)
+                writeTrace();
+        }
+
+        mGPUEvents.clear();
+    }
+
+    void report()
+    {
+        if (!mEnabled)
+            return;
+
+        printStats("CPU zone (ms)", mCPUStats);
+        printStats("GPU zone (ms)", mGPUStats);
+        if (mGPUDropped)
+            printf("GPU frames dropped (queries not ready): %d\n", mGPUDropped);
+    }
+
+    void destroy()
+    {
+        for (GPUFrame &frame : mGPUFrames)
+        {
+            if (frame.queries.empty())
+                continue;
+            glDeleteQueries(frame.queries.size(), frame.queries.data());
+            frame.queries.clear();
+            frame.zones.clear();
+        }
+    }
+};
+
+class ProfileZone
+{
+private:
+    const char *mName;
+    int64_t mStart;
+    int mDepth;
+    bool mActive;
+    bool mGPU;
+
+public:
+    ProfileZone(const char *name, bool gpu = false)
+    {
+        Profiler &profiler = Profiler::get();
+        mActive = profiler.isEnabled();
+        if (!mActive)
+            return;
+
+        mName = name;
+        mGPU = gpu;
+        mDepth = profiler.beginZone();
+        if (mGPU)
+            profiler.beginGPUZone(name, mDepth);
+        mStart = profiler.now();
+    }
+
+    ~ProfileZone()
+    {
+        if (!mActive)
+            return;
+
+        Profiler &profiler = Profiler::get();
+        if (mGPU)
+            profiler.endGPUZone(mName);
+        profiler.endZone(mName, mStart, mDepth);
+    }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#ifdef PORTAL_SOFTWARE
+// There is no GPU to time, the zones are timed on the CPU
+#define PROFILE_GPU_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_GPU_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name, true)
+#endif
+
+#else
+
+// The profiler is compiled out, everything is a no-op
+class Profiler
+{
+public:
+    static Profiler &get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    bool isEnabled() { return false; }
+    static const char *depthName(int) { return ""; }
+    void captureTrace() {}
+    void beginFrame() {}
+    void endFrame() {}
+    void report() {}
+    void destroy() {}
+};
+
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+
+#endif
@@ -0,0 +1,690 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <jobs.hpp>
+
+#define RASTER_TILE_SIZE 64     // Pixels per side of a tile. Each tile is rasterized by one thread at a time.
+#define RASTER_LANES 8          // Pixels of a row tested together. The loops over the lanes are written so the compiler can map them onto SIMD registers.
+#define RASTER_ATTRIBUTES 8     // World position, normal and texture coordinate
+#define RASTER_MAX_LIGHTS 32
+#define RASTER_MIN_W 1e-5f      // Vertices closer to the eye plane are clipped
+
+typedef enum raster_stencil_e
+{
+    RASTER_KEEP,
+    RASTER_INCR,        // Clamped to 255
+    RASTER_DECR,        // Clamped to 0
+    RASTER_INCR_WRAP,
+    RASTER_DECR_WRAP,
+    RASTER_INVERT
+} raster_stencil_e;
+
+typedef enum raster_shading_e
+{
+    RASTER_PHONG,       // The lighting of shader.frag
+    RASTER_PORTAL       // The noisy portal border of shader.frag
+} raster_shading_e;
+
+// Geometry of a draw. The arrays are read during finish(), so they have to stay alive until then.
+typedef struct RasterMesh
+{
+    const float *positions;         // 3 floats per vertex
+    const float *normals;           // 3 floats per vertex, or nullptr
+    const float *textureCoordinates;// 2 floats per vertex, or nullptr
+    const unsigned int *indices;
+    size_t count;                   // Number of indices
+    bool fan;                       // Triangle fan instead of a triangle list
+} RasterMesh;
+
+typedef struct RasterDraw
+{
+    RasterMesh mesh;
+    float model[16];                // Column major, as glm
+    float viewProjection[16];
+    float camera[3];                // World position of the eye, for the specular light
+    raster_shading_e shading;
+    int material;                   // Index of the texture, -1 is white
+    uint32_t lightMask;             // Bit i is set if light i can reach the mesh
+    float portalColor[3];
+    int stencilRef;                 // Fragments pass where the stencil equals this, -1 disables the test
+    raster_stencil_e stencilPass;   // Applied when the stencil and depth tests pass
+    uint8_t stencilWriteMask;       // Bits of the stencil the operation may change
+    bool depthTest;                 // GL_LESS, otherwise GL_ALWAYS. The depth is written either way.
+} RasterDraw;
+
+// Renders triangles on the CPU with a depth buffer and an 8 bit stencil buffer, like the OpenGL pipeline of the renderer:
+// clipping against the near and far planes, back face culling, depth test, GL_EQUAL stencil test and blending.
+// Draws are recorded, and finish() transforms and bins the triangles of every draw into screen tiles as parallel jobs,
+// then rasterizes the tiles as parallel jobs. Each tile runs through all draws in order, so the stencil and depth
+// operations between draws behave as on the GPU. Window coordinates have y up as in OpenGL.
+class Rasterizer
+{
+private:
+    typedef enum command_e
+    {
+        COMMAND_CLEAR,          // Color, depth and stencil
+        COMMAND_CLEAR_DEPTH,
+        COMMAND_DRAW
+    } command_e;
+
+    typedef struct Vertex
+    {
+        float clip[4];
+        float attributes[RASTER_ATTRIBUTES];
+    } Vertex;
+
+    // A triangle after clipping, ready to be rasterized
+    typedef struct Triangle
+    {
+        float edges[3][3];          // Barycentric coordinate of each vertex as A x + B y + C in window coordinates
+        bool topLeft[3];            // Pixel centers exactly on a top or left edge belong to the triangle
+        float depth[3];             // Window depth of the vertices
+        float invW[3];
+        float attributes[3][RASTER_ATTRIBUTES]; // Divided by w, for perspective correct interpolation
+        int bounds[4];              // Pixels covered by the bounding box: min x, min y, max x, max y
+    } Triangle;
+
+    typedef struct Command
+    {
+        command_e type;
+        RasterDraw draw;
+        std::vector<Triangle> triangles;
+        std::vector<uint32_t> tileStart;        // The triangles of tile t are tileTriangles[tileStart[t]] to tileTriangles[tileStart[t + 1] - 1]
+        std::vector<uint32_t> tileTriangles;
+    } Command;
+
+    typedef struct Texture
+    {
+        int width = 0;
+        int height = 0;
+        int channels = 4;
+        bool nearest = false;
+        bool repeat = true;         // GL_REPEAT, otherwise GL_CLAMP_TO_EDGE
+        std::vector<uint8_t> texels;
+    } Texture;
+
+    int mWidth;
+    int mHeight;
+    int mTilesX;
+    int mTilesY;
+    std::vector<uint32_t> mColor;   // RGBA8, the red channel in the lowest byte
+    std::vector<float> mDepth;
+    std::vector<uint8_t> mStencil;
+
+    // The commands are kept between frames, so their arrays are only allocated while the scene grows
+    std::vector<Command> mCommands;
+    size_t mCommandCount = 0;
+
+    std::vector<Texture> mMaterials;
+    Texture mNoise;
+    int mLightCount = 0;
+    float mLightPositions[RASTER_MAX_LIGHTS][3];
+    float mLightColors[RASTER_MAX_LIGHTS][3];
+    float mTime = 0;
+    float mClearColor[4] = {0, 0, 0, 1};
+
+    Command &push(command_e type)
+    {
+        if (mCommandCount == mCommands.size())
+            mCommands.emplace_back();
+        Command &command = mCommands[mCommandCount++];
+        command.type = type;
+        return command;
+    }
+
+    static void transform(const float *m, const float *v, float w, float *out)
+    {
+        for (int i = 0; i < 4; i++)
+            out[i] = m[i] * v[0] + m[4 + i] * v[1] + m[8 + i] * v[2] + m[12 + i] * w;
+    }
+
+    Vertex fetch(const RasterDraw &draw, unsigned int index)
+    {
+        const RasterMesh &mesh = draw.mesh;
+        Vertex vertex;
+        float world[4], normal[4];
+        transform(draw.model, mesh.positions + 3 * index, 1, world);
+        transform(draw.viewProjection, world, 1, vertex.clip);
+
+        // The normal is transformed by the upper 3x3 of the model matrix, as in shader.vert
+        static const float zero[3] = {0, 0, 0};
+        transform(draw.model, mesh.normals ? mesh.normals + 3 * index : zero, 0, normal);
+        const float *uv = mesh.textureCoordinates ? mesh.textureCoordinates + 2 * index : zero;
+
+        float *attributes = vertex.attributes;
+        attributes[0] = world[0], attributes[1] = world[1], attributes[2] = world[2];
+        attributes[3] = normal[0], attributes[4] = normal[1], attributes[5] = normal[2];
+        attributes[6] = uv[0], attributes[7] = uv[1];
+        return vertex;
+    }
+
+    static Vertex lerp(const Vertex &a, const Vertex &b, float t)
+    {
+        Vertex out;
+        for (int i = 0; i < 4; i++)
+            out.clip[i] = a.clip[i] + t * (b.clip[i] - a.clip[i]);
+        for (int i = 0; i < RASTER_ATTRIBUTES; i++)
+            out.attributes[i] = a.attributes[i] + t * (b.attributes[i] - a.attributes[i]);
+        return out;
+    }
+
+    // Signed distance to the clip planes: near (z > -w), far (z < w), and in front of the eye
+    static float planeDistance(const Vertex &vertex, int plane)
+    {
+        switch (plane)
+        {
+        case 0: return vertex.clip[2] + vertex.clip[3];
+        case 1: return vertex.clip[3] - vertex.clip[2];
+        default: return vertex.clip[3] - RASTER_MIN_W;
+        }
+    }
+
+    // Clips the triangle, and adds the remaining polygon as a fan of triangles
+    void clipAndSetup(Command &command, const Vertex triangle[3])
+    {
+        // Most triangles are entirely inside
+        bool inside = true;
+        for (int plane = 0; plane < 3 && inside; plane++)
+            for (int i = 0; i < 3; i++)
+                inside = inside && planeDistance(triangle[i], plane) >= 0;
+        if (inside)
+        {
+            setup(command, triangle[0], triangle[1], triangle[2]);
+            return;
+        }
+
+        // Sutherland-Hodgman, every plane can add one vertex
+        Vertex buffers[2][6];
+        int count = 3;
+        std::copy(triangle, triangle + 3, buffers[0]);
+        for (int plane = 0; plane < 3; plane++)
+        {
+            const Vertex *in = buffers[plane % 2];
+            Vertex *out = buffers[(plane + 1) % 2];
+            int outCount = 0;
+            for (int i = 0; i < count; i++)
+            {
+                const Vertex &a = in[i];
+                const Vertex &b = in[(i + 1) % count];
+                float da = planeDistance(a, plane);
+                float db = planeDistance(b, plane);
+                if (da >= 0)
+                    out[outCount++] = a;
+                if ((da >= 0) != (db >= 0))
+                    out[outCount++] = lerp(a, b, da / (da - db));
+            }
+            count = outCount;
+            if (count < 3)
+                return;
+        }
+
+        const Vertex *polygon = buffers[1];
+        for (int i = 1; i + 1 < count; i++)
+            setup(command, polygon[0], polygon[i], polygon[i + 1]);
+    }
+
+    void setup(Command &command, const Vertex &v0, const Vertex &v1, const Vertex &v2)
+    {
+        const Vertex *vertices[3] = {&v0, &v1, &v2};
+        float x[3], y[3];
+        Triangle triangle;
+        for (int i = 0; i < 3; i++)
+        {
+            const float *clip = vertices[i]->clip;
+            float invW = 1.0f / clip[3];
+            x[i] = (clip[0] * invW * 0.5f + 0.5f) * mWidth;
+            y[i] = (clip[1] * invW * 0.5f + 0.5f) * mHeight;
+            triangle.depth[i] = clip[2] * invW * 0.5f + 0.5f;
+            triangle.invW[i] = invW;
+            for (int a = 0; a < RASTER_ATTRIBUTES; a++)
+                triangle.attributes[i][a] = vertices[i]->attributes[a] * invW;
+        }
+
+        // Counter clockwise triangles are front facing, the others are culled as with GL_CULL_FACE
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (!(area > 0))
+            return;
+
+        for (int i = 0; i < 3; i++)
+        {
+            int a = (i + 1) % 3, b = (i + 2) % 3;
+            float dx = x[b] - x[a], dy = y[b] - y[a];
+            triangle.edges[i][0] = -dy / area;
+            triangle.edges[i][1] = dx / area;
+            triangle.edges[i][2] = (dy * x[a] - dx * y[a]) / area;
+            triangle.topLeft[i] = dy < 0 || (dy == 0 && dx < 0);
+        }
+
+        // The pixels whose centers can be inside, clamped to the screen before converting to int
+        float minX = std::min({x[0], x[1], x[2]}), maxX = std::max({x[0], x[1], x[2]});
+        float minY = std::min({y[0], y[1], y[2]}), maxY = std::max({y[0], y[1], y[2]});
+        triangle.bounds[0] = (int) std::max(0.0f, ceilf(minX - 0.5f));
+        triangle.bounds[1] = (int) std::max(0.0f, ceilf(minY - 0.5f));
+        triangle.bounds[2] = (int) std::min(mWidth - 1.0f, floorf(maxX - 0.5f));
+        triangle.bounds[3] = (int) std::min(mHeight - 1.0f, floorf(maxY - 0.5f));
+        if (triangle.bounds[0] > triangle.bounds[2] || triangle.bounds[1] > triangle.bounds[3])
+            return;
+
+        command.triangles.push_back(triangle);
+    }
+
+    // Transforms, clips and bins the triangles of a draw
+    void processDraw(Command &command)
+    {
+        const RasterDraw &draw = command.draw;
+        const RasterMesh &mesh = draw.mesh;
+        command.triangles.clear();
+
+        size_t triangles = mesh.fan ? (mesh.count >= 3 ? mesh.count - 2 : 0) : mesh.count / 3;
+        for (size_t t = 0; t < triangles; t++)
+        {
+            size_t first = mesh.fan ? 0 : 3 * t;
+            size_t second = mesh.fan ? t + 1 : 3 * t + 1;
+            Vertex vertices[3] = {fetch(draw, mesh.indices[first]), fetch(draw, mesh.indices[second]), fetch(draw, mesh.indices[second + 1])};
+            clipAndSetup(command, vertices);
+        }
+
+        // Counting sort of the triangles into the tiles they overlap
+        size_t tiles = mTilesX * mTilesY;
+        command.tileStart.assign(tiles + 1, 0);
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (uint32_t t = 0; t < command.triangles.size(); t++)
+            {
+                const int *bounds = command.triangles[t].bounds;
+                for (int ty = bounds[1] / RASTER_TILE_SIZE; ty <= bounds[3] / RASTER_TILE_SIZE; ty++)
+                {
+                    for (int tx = bounds[0] / RASTER_TILE_SIZE; tx <= bounds[2] / RASTER_TILE_SIZE; tx++)
+                    {
+                        uint32_t tile = ty * mTilesX + tx;
+                        if (pass == 0)
+                            command.tileStart[tile + 1]++;
+                        else
+                            command.tileTriangles[command.tileStart[tile]++] = t;
+                    }
+                }
+            }
+
+            if (pass == 0)
+            {
+                for (size_t tile = 0; tile < tiles; tile++)
+                    command.tileStart[tile + 1] += command.tileStart[tile];
+                command.tileTriangles.resize(command.tileStart[tiles]);
+            }
+        }
+
+        // The fill pass moved every start to the start of the next tile
+        for (size_t tile = tiles; tile > 0; tile--)
+            command.tileStart[tile] = command.tileStart[tile - 1];
+        command.tileStart[0] = 0;
+    }
+
+    static float texel(const Texture &texture, int x, int y, int channel)
+    {
+        if (texture.repeat)
+        {
+            x %= texture.width;
+            y %= texture.height;
+            if (x < 0) x += texture.width;
+            if (y < 0) y += texture.height;
+        }
+        else
+        {
+            x = std::min(std::max(x, 0), texture.width - 1);
+            y = std::min(std::max(y, 0), texture.height - 1);
+        }
+        return texture.texels[((size_t) y * texture.width + x) * texture.channels + channel] * (1.0f / 255.0f);
+    }
+
+    // Samples the texture at (u, v), the first row of the texels is v = 0 as in OpenGL
+    static void sample(const Texture &texture, float u, float v, float *out)
+    {
+        if (texture.nearest)
+        {
+            int x = (int) floorf(u * texture.width), y = (int) floorf(v * texture.height);
+            for (int c = 0; c < texture.channels; c++)
+                out[c] = texel(texture, x, y, c);
+            return;
+        }
+
+        float fx = u * texture.width - 0.5f, fy = v * texture.height - 0.5f;
+        float x0 = floorf(fx), y0 = floorf(fy);
+        float tx = fx - x0, ty = fy - y0;
+        int x = (int) x0, y = (int) y0;
+        for (int c = 0; c < texture.channels; c++)
+        {
+            float top = texel(texture, x, y, c) * (1 - tx) + texel(texture, x + 1, y, c) * tx;
+            float bottom = texel(texture, x, y + 1, c) * (1 - tx) + texel(texture, x + 1, y + 1, c) * tx;
+            out[c] = top * (1 - ty) + bottom * ty;
+        }
+    }
+
+    // The phong branch of shader.frag. Returns the alpha.
+    float shadePhong(const RasterDraw &draw, const float *attributes, float *outColor)
+    {
+        const float *position = attributes;
+        const float *normal = attributes + 3;
+        float albedo[4] = {1, 1, 1, 1};
+        if (draw.material >= 0 && draw.material < (int) mMaterials.size() && !mMaterials[draw.material].texels.empty())
+            sample(mMaterials[draw.material], attributes[6], attributes[7], albedo);
+
+        float view[3] = {draw.camera[0] - position[0], draw.camera[1] - position[1], draw.camera[2] - position[2]};
+        float viewLength = sqrtf(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+        for (int i = 0; i < 3; i++)
+            view[i] /= viewLength;
+
+        float diffuse[3] = {0, 0, 0};
+        float specular[3] = {0, 0, 0};
+        for (int l = 0; l < mLightCount; l++)
+        {
+            if (!(draw.lightMask & (1u << l)))
+                continue;
+
+            float light[3] = {mLightPositions[l][0] - position[0], mLightPositions[l][1] - position[1], mLightPositions[l][2] - position[2]};
+            float dist = sqrtf(light[0] * light[0] + light[1] * light[1] + light[2] * light[2]);
+            for (int i = 0; i < 3; i++)
+                light[i] /= dist;
+
+            // reflect(-L, N), the normal is not normalized in the shader either
+            float nDotL = normal[0] * light[0] + normal[1] * light[1] + normal[2] * light[2];
+            float reflected[3];
+            for (int i = 0; i < 3; i++)
+                reflected[i] = 2 * nDotL * normal[i] - light[i];
+            float reflectedLength = sqrtf(reflected[0] * reflected[0] + reflected[1] * reflected[1] + reflected[2] * reflected[2]);
+            float rDotV = reflectedLength > 0 ? (reflected[0] * view[0] + reflected[1] * view[1] + reflected[2] * view[2]) / reflectedLength : 0;
+
+            // pow(x, 32) by squaring
+            float s = std::min(std::max(rDotV, 0.0f), 1.0f);
+            s *= s, s *= s, s *= s, s *= s, s *= s;
+
+            float attenuation = 1 / (0.01f + 0.05f * dist + 0.01f * dist * dist);
+            float lambert = std::min(std::max(nDotL, 0.0f), 1.0f);
+            for (int i = 0; i < 3; i++)
+            {
+                diffuse[i] += attenuation * mLightColors[l][i] * lambert;
+                specular[i] += attenuation * mLightColors[l][i] * s;
+            }
+        }
+
+        const float ambient = 0.3f, specularFactor = 0.5f;
+        for (int i = 0; i < 3; i++)
+            outColor[i] = (ambient + diffuse[i]) * albedo[i] + specular[i] * specularFactor;
+        return 2 * albedo[3];
+    }
+
+    // The portal branch of shader.frag: a noisy elliptic border, transparent inside. Returns the alpha.
+    float shadePortal(const RasterDraw &draw, const float *attributes, float *outColor)
+    {
+        float u = attributes[6] - 0.5f, v = attributes[7] - 0.5f;
+        float c = cosf(mTime), s = sinf(mTime);
+        float noise;
+
+        // rotation * (uv - 0.5) * 2, with the columns of the GLSL mat2 (cos, -sin) and (sin, cos)
+        sample(mNoise, (c * u + s * v) * 2, (-s * u + c * v) * 2, &noise);
+        float border = 1 - noise;
+        const float width = 5, height = 10;
+
+        float x = u * 2, y = v * 2;
+        float radius = sqrtf(x * x + y * y);
+        float rH = 1 - border / width;
+        float rV = 1 - border / height;
+        float radiusAvg = (rH + rV) / 2;
+        x = fabsf(x), y = fabsf(y);
+        float minRadius = x > y ? rH + (radiusAvg - rH) * (y / x) : rV + (radiusAvg - rV) * (y > 0 ? x / y : 0);
+        if (!(radius > minRadius))
+            return 0;
+
+        // -rotation * (uv - 0.5) + 0.5
+        sample(mNoise, -(c * u + s * v) + 0.5f, -(-s * u + c * v) + 0.5f, &noise);
+        for (int i = 0; i < 3; i++)
+            outColor[i] = draw.portalColor[i] - noise * 0.5f;
+        return 1;
+    }
+
+    static uint32_t pack(const float *color)
+    {
+        uint32_t packed = 0;
+        for (int i = 0; i < 4; i++)
+            packed |= (uint32_t) lrintf(std::min(std::max(color[i], 0.0f), 1.0f) * 255) << (8 * i);
+        return packed;
+    }
+
+    void rasterizeTriangle(const RasterDraw &draw, const Triangle &triangle, const int tile[4])
+    {
+        int minX = std::max(triangle.bounds[0], tile[0]), maxX = std::min(triangle.bounds[2], tile[2]);
+        int minY = std::max(triangle.bounds[1], tile[1]), maxY = std::min(triangle.bounds[3], tile[3]);
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = y + 0.5f;
+            size_t row = (size_t) y * mWidth;
+            for (int x = minX; x <= maxX; x += RASTER_LANES)
+            {
+                // Edge functions and depth of RASTER_LANES pixels at once
+                float b[3][RASTER_LANES];
+                float depth[RASTER_LANES];
+                bool covered[RASTER_LANES];
+                for (int l = 0; l < RASTER_LANES; l++)
+                {
+                    float px = x + l + 0.5f;
+                    covered[l] = x + l <= maxX;
+                    for (int e = 0; e < 3; e++)
+                    {
+                        b[e][l] = triangle.edges[e][0] * px + triangle.edges[e][1] * py + triangle.edges[e][2];
+                        covered[l] = covered[l] && (b[e][l] > 0 || (b[e][l] == 0 && triangle.topLeft[e]));
+                    }
+                    depth[l] = b[0][l] * triangle.depth[0] + b[1][l] * triangle.depth[1] + b[2][l] * triangle.depth[2];
+                }
+
+                bool any = false;
+                for (int l = 0; l < RASTER_LANES; l++)
+                    any = any || covered[l];
+                if (!any)
+                    continue;
+
+                for (int l = 0; l < RASTER_LANES; l++)
+                {
+                    size_t index = row + x + l;
+                    if (!covered[l] || (draw.stencilRef >= 0 && mStencil[index] != draw.stencilRef) || (draw.depthTest && !(depth[l] < mDepth[index])))
+                        continue;
+
+                    mDepth[index] = depth[l];
+                    uint8_t stencil = mStencil[index];
+                    switch (draw.stencilPass)
+                    {
+                    case RASTER_KEEP: break;
+                    case RASTER_INCR: stencil = stencil == 255 ? 255 : stencil + 1; break;
+                    case RASTER_DECR: stencil = stencil == 0 ? 0 : stencil - 1; break;
+                    case RASTER_INCR_WRAP: stencil++; break;
+                    case RASTER_DECR_WRAP: stencil--; break;
+                    case RASTER_INVERT: stencil = ~stencil; break;
+                    }
+                    mStencil[index] = (stencil & draw.stencilWriteMask) | (mStencil[index] & ~draw.stencilWriteMask);
+
+                    // Perspective correct attributes
+                    float invW = b[0][l] * triangle.invW[0] + b[1][l] * triangle.invW[1] + b[2][l] * triangle.invW[2];
+                    float attributes[RASTER_ATTRIBUTES];
+                    for (int a = 0; a < RASTER_ATTRIBUTES; a++)
+                        attributes[a] = (b[0][l] * triangle.attributes[0][a] + b[1][l] * triangle.attributes[1][a] + b[2][l] * triangle.attributes[2][a]) / invW;
+
+                    float color[4];
+                    float alpha = draw.shading == RASTER_PORTAL ? shadePortal(draw, attributes, color) : shadePhong(draw, attributes, color);
+                    alpha = std::min(std::max(alpha, 0.0f), 1.0f);
+                    if (alpha == 0)
+                        continue;
+
+                    // glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+                    uint32_t previous = mColor[index];
+                    for (int i = 0; i < 3; i++)
+                        color[i] = color[i] * alpha + ((previous >> (8 * i)) & 0xff) / 255.0f * (1 - alpha);
+                    color[3] = alpha * alpha + ((previous >> 24) & 0xff) / 255.0f * (1 - alpha);
+                    mColor[index] = pack(color);
+                }
+            }
+        }
+    }
+
+    void rasterizeTile(int tileIndex)
+    {
+        int tx = tileIndex % mTilesX, ty = tileIndex / mTilesX;
+        int tile[4] = {tx * RASTER_TILE_SIZE, ty * RASTER_TILE_SIZE,
+                       std::min(mWidth, (tx + 1) * RASTER_TILE_SIZE) - 1, std::min(mHeight, (ty + 1) * RASTER_TILE_SIZE) - 1};
+
+        for (size_t c = 0; c < mCommandCount; c++)
+        {
+            const Command &command = mCommands[c];
+            if (command.type == COMMAND_DRAW)
+            {
+                for (uint32_t t = command.tileStart[tileIndex]; t < command.tileStart[tileIndex + 1]; t++)
+                    rasterizeTriangle(command.draw, command.triangles[command.tileTriangles[t]], tile);
+                continue;
+            }
+
+            uint32_t clearColor = pack(mClearColor);
+            for (int y = tile[1]; y <= tile[3]; y++)
+            {
+                size_t row = (size_t) y * mWidth;
+                std::fill(mDepth.begin() + row + tile[0], mDepth.begin() + row + tile[2] + 1, 1.0f);
+                if (command.type == COMMAND_CLEAR)
+                {
+                    std::fill(mColor.begin() + row + tile[0], mColor.begin() + row + tile[2] + 1, clearColor);
+                    std::fill(mStencil.begin() + row + tile[0], mStencil.begin() + row + tile[2] + 1, 0);
+                }
+            }
+        }
+    }
+
+public:
+    Rasterizer(int width, int height)
+    {
+        mWidth = std::max(1, width);
+        mHeight = std::max(1, height);
+        mTilesX = (mWidth + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        mTilesY = (mHeight + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        mColor.resize((size_t) mWidth * mHeight);
+        mDepth.resize((size_t) mWidth * mHeight, 1.0f);
+        mStencil.resize((size_t) mWidth * mHeight);
+    }
+
+    int getWidth()
+    {
+        return mWidth;
+    }
+
+    int getHeight()
+    {
+        return mHeight;
+    }
+
+    // Has to be called before the materials are set, which can then be set from several threads at once
+    void setMaterialCount(size_t count)
+    {
+        mMaterials.resize(count);
+    }
+
+    // Copies an RGBA8 texture, the first row is v = 0
+    void setMaterial(int material, int width, int height, const uint8_t *rgba, bool nearest)
+    {
+        Texture &texture = mMaterials[material];
+        texture.width = width;
+        texture.height = height;
+        texture.nearest = nearest;
+        texture.texels.assign(rgba, rgba + (size_t) width * height * 4);
+    }
+
+    // Copies the single channel noise sampled by the portals
+    void setNoise(int width, int height, const uint8_t *noise, bool repeat)
+    {
+        mNoise.width = width;
+        mNoise.height = height;
+        mNoise.channels = 1;
+        mNoise.repeat = repeat;
+        mNoise.texels.assign(noise, noise + (size_t) width * height);
+    }
+
+    // Lights in the order of their bits in the light masks. positions and colors hold 3 floats per light.
+    void setLights(int count, const float *positions, const float *colors)
+    {
+        mLightCount = std::min(count, RASTER_MAX_LIGHTS);
+        memcpy(mLightPositions, positions, mLightCount * sizeof(mLightPositions[0]));
+        memcpy(mLightColors, colors, mLightCount * sizeof(mLightColors[0]));
+    }
+
+    // Starts recording a frame, which is cleared to the color
+    void begin(float time, const float clearColor[3])
+    {
+        mTime = time;
+        std::copy(clearColor, clearColor + 3, mClearColor);
+        mCommandCount = 0;
+        push(COMMAND_CLEAR);
+    }
+
+    void clearDepth()
+    {
+        push(COMMAND_CLEAR_DEPTH);
+    }
+
+    void draw(const RasterDraw &draw)
+    {
+        if (draw.mesh.count == 0)
+            return;
+        push(COMMAND_DRAW).draw = draw;
+    }
+
+    // Renders the recorded frame
+    void finish(JobSystem &jobs)
+    {
+        jobs.parallelFor("rasterGeometry", mCommandCount, 1, [this](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++)
+            {
+                if (mCommands[c].type == COMMAND_DRAW)
+                    processDraw(mCommands[c]);
+            }
+        });
+
+        jobs.parallelFor("rasterTiles", mTilesX * mTilesY, 1, [this](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; tile++)
+                rasterizeTile(tile);
+        });
+    }
+
+    // The finished frame, bottom row first
+    const uint32_t *getPixels()
+    {
+        return mColor.data();
+    }
+
+    // Writes the frame as a binary PPM image
+    bool writeImage(std::string path)
+    {
+        FILE *file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cerr << "Error: Could not write " << path << std::endl;
+            return false;
+        }
+
+        fprintf(file, "P6\n%d %d\n255\n", mWidth, mHeight);
+        std::vector<uint8_t> row(mWidth * 3);
+        for (int y = mHeight - 1; y >= 0; y--)
+        {
+            for (int x = 0; x < mWidth; x++)
+            {
+                uint32_t pixel = mColor[(size_t) y * mWidth + x];
+                row[3 * x + 0] = pixel & 0xff;
+                row[3 * x + 1] = (pixel >> 8) & 0xff;
+                row[3 * x + 2] = (pixel >> 16) & 0xff;
+            }
+            fwrite(row.data(), 1, row.size(), file);
+        }
+        fclose(file);
+        return true;
+    }
+};
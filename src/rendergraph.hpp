@@ -0,0 +1,495 @@
+#pragma once
+
+// Render graph of a frame. The passes of the frame are added with the targets they read and write, then compile()
+// culls the passes whose results are never used, orders the others so every target is written before it is read, and
+// gives the transient targets their framebuffers. Transient targets only live from their first to their last pass, and
+// targets with the same size and formats whose lifetimes do not overlap share one framebuffer. The framebuffers are kept
+// in a pool across frames, and freed when they were not used for RENDER_GRAPH_IDLE_FRAMES frames. Their textures,
+// renderbuffers and framebuffers are created through the resource cache, so they count against its budget.
+//
+// Imported targets live outside the graph (e.g. the window or the shadow maps). The passes writing an output target,
+// and the passes they depend on, are never culled. A pass reading a target runs after the passes added before it which
+// write the target, or after all of them if none was added before it, so a producer can be added after its consumer.
+// Passes writing the same target, or writing a target read by an earlier pass, run in the order they were added.
+// The graph is built again every frame, its lists keep their capacity so building it does not allocate.
+//
+// Usage:
+//     graph.reset();
+//     int window = graph.importTarget("window", framebuffer);
+//     graph.setOutput(window);
+//     int pass = graph.addPass("composite", depth, compositeFunction);   // Called as compositeFunction(depth)
+//     graph.read(pass, target);
+//     graph.write(pass, window);
+//     graph.compile();
+//     graph.execute();     // The functions have to be alive until here
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <profiler.hpp>
+#include <memory.hpp>
+#include <resources.hpp>
+
+#define RENDER_GRAPH_IDLE_FRAMES 120
+
+// Size and formats of a transient target. GL_NONE leaves out the attachment.
+typedef struct TargetDesc
+{
+    int width;
+    int height;
+    GLenum colorFormat;
+    GLenum depthFormat;     // Attached as depth and stencil when the format has stencil
+} TargetDesc;
+
+class RenderGraph
+{
+private:
+    typedef struct Pass
+    {
+        const char *name;
+        int argument;
+        void (*execute)(const void *, int);     // Called as execute(function, argument)
+        const void *function;
+        std::vector<int> reads;
+        std::vector<int> writes;
+        bool culled;
+        bool scheduled;
+    } Pass;
+
+    typedef struct Target
+    {
+        const char *name;
+        int argument;
+        bool imported;
+        bool output;
+        TargetDesc desc;
+        unsigned int framebuffer;   // Of the physical target after compile(), for the transient targets
+        unsigned int texture;       // Color attachment
+        int physical;               // -1 for imported targets
+        int first;                  // Positions in the order of the first and last pass using it, -1 when unused
+        int last;
+    } Target;
+
+    typedef struct PhysicalTarget
+    {
+        TargetDesc desc;
+        Resource *framebuffer;
+        Resource *color;
+        Resource *depth;
+        int busyUntil;              // Position of the last pass using it this frame, -1 when free
+        unsigned long lastFrame;
+    } PhysicalTarget;
+
+    std::vector<Pass> mPasses;      // Only the first mPassCount are part of this frame, the others keep their lists
+    size_t mPassCount = 0;
+    std::vector<Target> mTargets;
+    std::vector<int> mOrder;        // Passes which are not culled, in the order they are executed
+    std::vector<PhysicalTarget> mPhysical;
+    unsigned long mFrame = 0;
+    ResourceCache &mResources;
+
+    template <typename Function>
+    static void invokePass(const void *function, int argument)
+    {
+        (*(const Function *) function)(argument);
+    }
+
+    static bool contains(const std::vector<int> &list, int value)
+    {
+        return std::find(list.begin(), list.end(), value) != list.end();
+    }
+
+    static bool sameDesc(const TargetDesc &a, const TargetDesc &b)
+    {
+        return a.width == b.width && a.height == b.height && a.colorFormat == b.colorFormat && a.depthFormat == b.depthFormat;
+    }
+
+    // Of one attachment of the format
+    static size_t getBytes(const TargetDesc &desc, GLenum format)
+    {
+        int bytesPerPixel = format == GL_RGBA16F ? 8 : format != GL_NONE ? 4 : 0;
+        return (size_t) desc.width * desc.height * bytesPerPixel;
+    }
+
+    static size_t getBytes(const TargetDesc &desc)
+    {
+        return getBytes(desc, desc.colorFormat) + getBytes(desc, desc.depthFormat);
+    }
+
+    static bool hasStencil(GLenum format)
+    {
+        return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+    }
+
+    void allocate(PhysicalTarget &target)
+    {
+        const TargetDesc &desc = target.desc;
+        target.framebuffer = mResources.createFramebuffer("render graph");
+        unsigned int framebuffer = target.framebuffer->name;
+        if (desc.colorFormat != GL_NONE)
+        {
+            target.color = mResources.createTexture("render graph", GL_TEXTURE_2D, getBytes(desc, desc.colorFormat), MEMORY_TARGETS);
+            unsigned int color = target.color->name;
+            glTextureStorage2D(color, 1, desc.colorFormat, desc.width, desc.height);
+            glTextureParameteri(color, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTextureParameteri(color, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTextureParameteri(color, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTextureParameteri(color, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0, color, 0);
+        }
+        else
+        {
+            glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+            glNamedFramebufferReadBuffer(framebuffer, GL_NONE);
+        }
+        if (desc.depthFormat != GL_NONE)
+        {
+            target.depth = mResources.createRenderbuffer("render graph", getBytes(desc, desc.depthFormat), MEMORY_TARGETS);
+            glNamedRenderbufferStorage(target.depth->name, desc.depthFormat, desc.width, desc.height);
+            GLenum attachment = hasStencil(desc.depthFormat) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+            glNamedFramebufferRenderbuffer(framebuffer, attachment, GL_RENDERBUFFER, target.depth->name);
+        }
+        if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Error: A " << desc.width << "x" << desc.height << " render graph target is incomplete" << std::endl;
+    }
+
+    void release(PhysicalTarget &target)
+    {
+        mResources.release(target.framebuffer);
+        mResources.release(target.color);
+        mResources.release(target.depth);
+        target.framebuffer = target.color = target.depth = nullptr;
+    }
+
+    // Keeps the passes writing the outputs, and every pass writing a target which a kept pass reads
+    void cull()
+    {
+        for (size_t i = 0; i < mPassCount; i++)
+        {
+            Pass &pass = mPasses[i];
+            pass.culled = true;
+            for (int target : pass.writes)
+                pass.culled = pass.culled && !mTargets[target].output;
+        }
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (size_t i = 0; i < mPassCount; i++)
+            {
+                Pass &pass = mPasses[i];
+                if (!pass.culled)
+                    continue;
+                for (size_t j = 0; j < mPassCount && pass.culled; j++)
+                {
+                    if (mPasses[j].culled)
+                        continue;
+                    for (int target : pass.writes)
+                        pass.culled = pass.culled && !contains(mPasses[j].reads, target);
+                }
+                changed = changed || !pass.culled;
+            }
+        }
+    }
+
+    bool writtenBefore(int target, size_t index)
+    {
+        for (size_t i = 0; i < index; i++)
+        {
+            if (!mPasses[i].culled && contains(mPasses[i].writes, target))
+                return true;
+        }
+        return false;
+    }
+
+    // A pass is ready when the writers of the targets it reads have run, and the writers and readers added before it
+    // of the targets it writes
+    bool isReady(size_t index)
+    {
+        const Pass &pass = mPasses[index];
+        for (size_t i = 0; i < mPassCount; i++)
+        {
+            const Pass &other = mPasses[i];
+            if (i == index || other.culled || other.scheduled)
+                continue;
+            for (int target : other.writes)
+            {
+                if (i < index && contains(pass.writes, target))
+                    return false;
+                if (contains(pass.reads, target) && (i < index || !writtenBefore(target, index)))
+                    return false;
+            }
+            // A reader which does not wait for this pass has to see the target before this pass writes it
+            for (int target : other.reads)
+            {
+                if (i < index && contains(pass.writes, target) && writtenBefore(target, i))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Topological order of the passes, taking the first ready pass in the order they were added
+    void schedule()
+    {
+        mOrder.clear();
+        for (size_t i = 0; i < mPassCount; i++)
+            mPasses[i].scheduled = false;
+
+        size_t count = 0;
+        for (size_t i = 0; i < mPassCount; i++)
+            count += !mPasses[i].culled;
+
+        while (mOrder.size() < count)
+        {
+            size_t next = mPassCount;
+            for (size_t i = 0; i < mPassCount && next == mPassCount; i++)
+            {
+                if (!mPasses[i].culled && !mPasses[i].scheduled && isReady(i))
+                    next = i;
+            }
+
+            // A cycle, the passes in it run in the order they were added
+            if (next == mPassCount)
+            {
+                for (size_t i = 0; i < mPassCount && next == mPassCount; i++)
+                {
+                    if (!mPasses[i].culled && !mPasses[i].scheduled)
+                        next = i;
+                }
+                std::cerr << "Error: The render graph has a cycle at pass " << mPasses[next].name << std::endl;
+            }
+            mPasses[next].scheduled = true;
+            mOrder.push_back(next);
+        }
+    }
+
+    // Every transient target takes a free physical target with its description when its first pass runs, which stays
+    // busy until its last pass has run
+    void assignTargets()
+    {
+        for (Target &target : mTargets)
+            target.first = target.last = -1;
+        for (size_t position = 0; position < mOrder.size(); position++)
+        {
+            const Pass &pass = mPasses[mOrder[position]];
+            for (const std::vector<int> *list : {&pass.reads, &pass.writes})
+            {
+                for (int index : *list)
+                {
+                    Target &target = mTargets[index];
+                    if (target.first < 0)
+                        target.first = position;
+                    target.last = position;
+                }
+            }
+        }
+
+        // Targets which were not used for a while are freed, before any is taken this frame
+        for (size_t i = mPhysical.size(); i-- > 0;)
+        {
+            if (mPhysical[i].lastFrame + RENDER_GRAPH_IDLE_FRAMES < mFrame)
+            {
+                release(mPhysical[i]);
+                mPhysical.erase(mPhysical.begin() + i);
+            }
+        }
+        for (PhysicalTarget &physical : mPhysical)
+            physical.busyUntil = -1;
+
+        for (size_t position = 0; position < mOrder.size(); position++)
+        {
+            for (Target &target : mTargets)
+            {
+                if (target.imported || target.first != (int) position)
+                    continue;
+
+                int free = -1;
+                for (size_t i = 0; i < mPhysical.size() && free < 0; i++)
+                {
+                    if (mPhysical[i].busyUntil < (int) position && sameDesc(mPhysical[i].desc, target.desc))
+                        free = i;
+                }
+                if (free < 0)
+                {
+                    mPhysical.push_back({target.desc, nullptr, nullptr, nullptr, -1, mFrame});
+                    allocate(mPhysical.back());
+                    free = mPhysical.size() - 1;
+                }
+
+                PhysicalTarget &physical = mPhysical[free];
+                physical.busyUntil = target.last;
+                physical.lastFrame = mFrame;
+                target.physical = free;
+                target.framebuffer = physical.framebuffer->name;
+                target.texture = physical.color ? physical.color->name : 0;
+            }
+        }
+    }
+
+public:
+    RenderGraph(ResourceCache &resources) : mResources(resources) {}
+
+    // Starts the graph of a new frame
+    void reset()
+    {
+        mPassCount = 0;
+        mTargets.clear();
+        mOrder.clear();
+        mFrame++;
+    }
+
+    // A target which lives outside of the graph, e.g. the window with framebuffer 0
+    int importTarget(const char *name, unsigned int framebuffer, unsigned int texture = 0)
+    {
+        mTargets.push_back({name, -1, true, false, {0, 0, GL_NONE, GL_NONE}, framebuffer, texture, -1, -1, -1});
+        return mTargets.size() - 1;
+    }
+
+    // A target which only lives for the passes using it this frame. The argument tells targets of the same name apart.
+    int createTarget(const char *name, int argument, TargetDesc desc)
+    {
+        mTargets.push_back({name, argument, false, false, desc, 0, 0, -1, -1, -1});
+        return mTargets.size() - 1;
+    }
+
+    // The passes writing the target are never culled
+    void setOutput(int target)
+    {
+        mTargets[target].output = true;
+    }
+
+    // Adds a pass, which is executed as function(argument). The function is not copied.
+    template <typename Function>
+    int addPass(const char *name, int argument, const Function &function)
+    {
+        if (mPassCount == mPasses.size())
+            mPasses.push_back({});
+        Pass &pass = mPasses[mPassCount];
+        pass.name = name;
+        pass.argument = argument;
+        pass.execute = &invokePass<Function>;
+        pass.function = &function;
+        pass.reads.clear();
+        pass.writes.clear();
+        pass.culled = false;
+        pass.scheduled = false;
+        return mPassCount++;
+    }
+
+    void read(int pass, int target)
+    {
+        if (!contains(mPasses[pass].reads, target))
+            mPasses[pass].reads.push_back(target);
+    }
+
+    void write(int pass, int target)
+    {
+        if (!contains(mPasses[pass].writes, target))
+            mPasses[pass].writes.push_back(target);
+    }
+
+    void compile()
+    {
+        PROFILE_ZONE("compileGraph");
+        cull();
+        schedule();
+        assignTargets();
+    }
+
+    void execute()
+    {
+        for (int index : mOrder)
+        {
+            const Pass &pass = mPasses[index];
+            PROFILE_GPU_ZONE(pass.name);
+            pass.execute(pass.function, pass.argument);
+        }
+    }
+
+    // Valid after compile()
+    unsigned int getFramebuffer(int target)
+    {
+        return mTargets[target].framebuffer;
+    }
+
+    unsigned int getTexture(int target)
+    {
+        return mTargets[target].texture;
+    }
+
+    void destroy()
+    {
+        for (PhysicalTarget &physical : mPhysical)
+            release(physical);
+        mPhysical.clear();
+    }
+
+    // The passes in the order they run, the culled passes, and the targets with their lifetimes and framebuffers
+    void dump(std::ostream &out)
+    {
+        auto targetName = [&](int index) {
+            const Target &target = mTargets[index];
+            out << " " << target.name;
+            if (target.argument >= 0)
+                out << "[" << target.argument << "]";
+        };
+        auto passLine = [&](const Pass &pass) {
+            out << pass.name;
+            if (pass.argument >= 0)
+                out << " " << pass.argument;
+            out << "\n    reads:";
+            for (int target : pass.reads)
+                targetName(target);
+            out << "\n    writes:";
+            for (int target : pass.writes)
+                targetName(target);
+            out << "\n";
+        };
+
+        out << "Render graph of frame " << mFrame << ": " << mOrder.size() << " of " << mPassCount << " passes\n";
+        for (size_t position = 0; position < mOrder.size(); position++)
+        {
+            out << "  " << position << ": ";
+            passLine(mPasses[mOrder[position]]);
+        }
+        for (size_t i = 0; i < mPassCount; i++)
+        {
+            if (!mPasses[i].culled)
+                continue;
+            out << "  culled: ";
+            passLine(mPasses[i]);
+        }
+
+        size_t transientBytes = 0;
+        out << "Targets:\n";
+        for (size_t i = 0; i < mTargets.size(); i++)
+        {
+            const Target &target = mTargets[i];
+            out << " ";
+            targetName(i);
+            if (target.imported)
+                out << " imported";
+            else
+                out << " " << target.desc.width << "x" << target.desc.height << " physical " << target.physical;
+            if (target.output)
+                out << " output";
+            if (target.first >= 0)
+                out << " passes " << target.first << "-" << target.last;
+            else
+                out << " unused";
+            out << " framebuffer " << target.framebuffer << "\n";
+            if (!target.imported && target.first >= 0)
+                transientBytes += getBytes(target.desc);
+        }
+
+        size_t physicalBytes = 0;
+        for (const PhysicalTarget &physical : mPhysical)
+            physicalBytes += getBytes(physical.desc);
+        out << "Transient targets: " << transientBytes / (1024.0 * 1024.0) << " MB, in " << mPhysical.size()
+            << " physical targets of " << physicalBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+// Counters of the work each frame submits: draw calls, triangles, state changes and the portal views rendered.
+// The render path reports into them as it issues the GL calls (or the software renderer draws), endFrame() takes
+// a snapshot of the frame and resets them. Averages are kept over the last RENDER_STATS_WINDOW frames, and every
+// snapshot can be written as a row of a CSV file.
+//
+// Usage:
+//     RENDER_STAT(STAT_DRAW_CALLS, 1);
+//     RenderStats::get().endFrame();
+//
+// Only the thread rendering the frames may report.
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define RENDER_STATS_WINDOW 300
+
+typedef enum render_stat_e
+{
+    STAT_DRAW_CALLS,
+    STAT_TRIANGLES,
+    STAT_UNIFORM_UPLOADS,
+    STAT_UNIFORM_LOOKUPS,   // glGetUniformLocation() calls, the names looked up before are cached by the shader
+    STAT_TEXTURE_BINDS,
+    STAT_VAO_BINDS,
+    STAT_STENCIL_CHANGES,
+    STAT_DEPTH_CLEARS,
+    STAT_VIEWS,             // Portal views rendered, including the camera
+    STAT_DEPTHS,            // Portal depths rendered, including the camera
+    STAT_COUNT
+} render_stat_e;
+
+typedef struct RenderCounters
+{
+    uint64_t values[STAT_COUNT];
+} RenderCounters;
+
+class RenderStats
+{
+private:
+    RenderCounters mCurrent = {};
+    RenderCounters mLast = {};
+    std::vector<RenderCounters> mWindow;    // Ring buffer of the last frames
+    uint64_t mSums[STAT_COUNT] = {};        // Of the frames in the window
+    unsigned long mFrame = 0;
+    std::ofstream mCsv;
+
+public:
+    RenderStats()
+    {
+        mWindow.reserve(RENDER_STATS_WINDOW);
+    }
+
+    static RenderStats &get()
+    {
+        static RenderStats stats;
+        return stats;
+    }
+
+    static const char *getName(render_stat_e stat)
+    {
+        static const char *names[STAT_COUNT] = {
+            "draw_calls", "triangles", "uniform_uploads", "uniform_lookups", "texture_binds",
+            "vao_binds", "stencil_changes", "depth_clears", "views", "depths"};
+        return names[stat];
+    }
+
+    void add(render_stat_e stat, uint64_t count)
+    {
+        mCurrent.values[stat] += count;
+    }
+
+    // Writes one row per frame from now on, with a column per counter
+    bool openCsv(std::string path)
+    {
+        mCsv.open(path.c_str());
+        if (!mCsv)
+        {
+            std::cerr << "Error: Could not write " << path << std::endl;
+            return false;
+        }
+
+        mCsv << "frame";
+        for (int i = 0; i < STAT_COUNT; i++)
+            mCsv << "," << getName((render_stat_e) i);
+        mCsv << "\n";
+        return true;
+    }
+
+    void endFrame()
+    {
+        if (mWindow.size() < RENDER_STATS_WINDOW)
+            mWindow.push_back(mCurrent);
+        else
+        {
+            RenderCounters &oldest = mWindow[mFrame % RENDER_STATS_WINDOW];
+            for (int i = 0; i < STAT_COUNT; i++)
+                mSums[i] -= oldest.values[i];
+            oldest = mCurrent;
+        }
+        for (int i = 0; i < STAT_COUNT; i++)
+            mSums[i] += mCurrent.values[i];
+
+        if (mCsv.is_open())
+        {
+            mCsv << mFrame;
+            for (int i = 0; i < STAT_COUNT; i++)
+                mCsv << "," << mCurrent.values[i];
+            mCsv << "\n";
+        }
+
+        mLast = mCurrent;
+        mCurrent = {};
+        mFrame++;
+    }
+
+    // The counters of the last finished frame
+    const RenderCounters &getLast()
+    {
+        return mLast;
+    }
+
+    // Average per frame over the last RENDER_STATS_WINDOW frames
+    double getAverage(render_stat_e stat)
+    {
+        return mWindow.empty() ? 0.0 : (double) mSums[stat] / mWindow.size();
+    }
+
+    void report()
+    {
+        if (mWindow.empty())
+            return;
+
+        printf("%-20s %12s %12s\n", "Render stat", "last", "avg");
+        for (int i = 0; i < STAT_COUNT; i++)
+            printf("%-20s %12llu %12.1f\n", getName((render_stat_e) i), (unsigned long long) mLast.values[i], getAverage((render_stat_e) i));
+    }
+};
+
+#define RENDER_STAT(stat, count) RenderStats::get().add(stat, count)
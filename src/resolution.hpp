@@ -0,0 +1,216 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <glm/common.hpp>
+#include <resources.hpp>
+#include <culling.hpp>
+#include <renderstats.hpp>
+#include <rendergraph.hpp>
+
+// Has to match the layout qualifier in composite.frag. Follows the texture arrays of material.hpp, which stay bound.
+#define COMPOSITE_TEXTURE_BINDING 6
+#define RESOLUTION_STEPS 16         // Scales are multiples of 1/16, so small changes do not move every pixel
+#define RESOLUTION_SMOOTHING 0.1    // Weight of the latest frame in the smoothed frame time
+#define RESOLUTION_GAIN 0.05f       // Change of the falloff per frame for a frame time off by 100%
+
+typedef struct ResolutionSettings
+{
+    float falloff;          // Resolution scale of each portal depth relative to the one before it, 1 disables the scaling
+    float minScale;         // No depth is rendered at a lower scale
+    double targetFrameMs;   // When set, the falloff is adjusted every frame to reach this frame time
+} ResolutionSettings;
+
+inline ResolutionSettings defaultResolutionSettings()
+{
+    return {1.0f, 0.25f, 0.0};
+}
+
+// Returns false if the argument is not a resolution option.
+// --depth-scale falloff --min-scale scale --target-ms ms
+inline bool parseResolutionArgument(std::string arg, const char *value, ResolutionSettings &settings)
+{
+    if (arg == "--depth-scale") settings.falloff = glm::clamp((float) atof(value), 0.0f, 1.0f);
+    else if (arg == "--min-scale") settings.minScale = glm::clamp((float) atof(value), 1.0f / RESOLUTION_STEPS, 1.0f);
+    else if (arg == "--target-ms") settings.targetFrameMs = atof(value);
+    else return false;
+    return true;
+}
+
+// Renders the deeper portal views at a lower resolution. Every portal depth gets a scale, which shrinks with the depth
+// and with the part of the screen the views at that depth can cover. A depth with a lower scale than the one before it
+// is rendered into its own offscreen target, together with the deeper views, and upsampled into the target of its
+// parent depth through the stencil of its views. Deeper views with the same scale share the target.
+// The targets are transient targets of the render graph, see getTargetDesc().
+// With a target frame time, the falloff per depth is adjusted every frame to reach it.
+class DynamicResolution
+{
+private:
+    ResolutionSettings mSettings;
+    float mFalloff;
+    double mFrameMs = 0;        // Smoothed
+    double mPrevTime = -1;
+    std::vector<float> mScales;         // Per depth, the camera has scale 1
+    std::vector<float> mCoverage;       // Per depth, reused every frame
+    Resource *mProgram = nullptr;
+    unsigned int mVertexArray = 0;
+
+public:
+    // Pixels of a viewport of size at scale
+    static int scaled(int size, float scale)
+    {
+        return std::max(1, (int) std::ceil(size * scale));
+    }
+
+    DynamicResolution(ResolutionSettings settings) : mSettings(settings), mFalloff(settings.falloff)
+    {
+        // The controller starts from full resolution
+        if (mSettings.targetFrameMs > 0)
+            mFalloff = 1.0f;
+    }
+
+    static bool isEnabled(const ResolutionSettings &settings)
+    {
+        return settings.falloff < 1.0f || settings.targetFrameMs > 0;
+    }
+
+    void create(ResourceCache &resources)
+    {
+        mProgram = resources.acquireProgram("../shaders/composite.vert", "../shaders/composite.frag");
+        glCreateVertexArrays(1, &mVertexArray);
+    }
+
+    void destroy(ResourceCache &resources)
+    {
+        glDeleteVertexArrays(1, &mVertexArray);
+        resources.release(mProgram);
+        mProgram = nullptr;
+    }
+
+    // Called once per frame with the wall clock time, adjusts the falloff towards the target frame time
+    void update(double time)
+    {
+        if (mPrevTime >= 0)
+        {
+            double frameMs = (time - mPrevTime) * 1000.0;
+            mFrameMs = mFrameMs > 0 ? mFrameMs + (frameMs - mFrameMs) * RESOLUTION_SMOOTHING : frameMs;
+        }
+        mPrevTime = time;
+
+        if (mSettings.targetFrameMs > 0 && mFrameMs > 0)
+        {
+            float error = (float) ((mSettings.targetFrameMs - mFrameMs) / mSettings.targetFrameMs);
+            mFalloff = glm::clamp(mFalloff + RESOLUTION_GAIN * glm::clamp(error, -1.0f, 1.0f), mSettings.minScale, 1.0f);
+        }
+    }
+
+    // Picks the scale of every depth from the planned views. A depth is scaled by falloff^depth, and further down when
+    // its views cover less than a quarter of the screen, with the linear size of the area they cover.
+    void plan(const std::vector<RenderView> &views, size_t count)
+    {
+        std::vector<float> &coverage = mCoverage;
+        coverage.assign(1, 0.0f);
+        for (size_t i = 0; i < count; i++)
+        {
+            const RenderView &view = views[i];
+            if ((size_t) view.depth >= coverage.size())
+                coverage.resize(view.depth + 1, 0.0f);
+            coverage[view.depth] += (view.bounds.z - view.bounds.x) * (view.bounds.w - view.bounds.y) / 4;
+        }
+
+        mScales.assign(coverage.size(), 1.0f);
+        for (size_t depth = 1; depth < coverage.size(); depth++)
+        {
+            float area = std::min(1.0f, 2.0f * std::sqrt(std::min(coverage[depth], 1.0f)));
+            float scale = std::pow(mFalloff, (float) depth) * area;
+            scale = std::ceil(scale * RESOLUTION_STEPS) / RESOLUTION_STEPS;
+            mScales[depth] = glm::clamp(scale, std::min(mSettings.minScale, mScales[depth - 1]), mScales[depth - 1]);
+        }
+    }
+
+    float getScale(int depth)
+    {
+        return mScales[depth];
+    }
+
+    float getFalloff()
+    {
+        return mFalloff;
+    }
+
+    // Whether the views at depth are rendered into a new target, which has to be prepared with beginTarget()
+    bool startsTarget(int depth)
+    {
+        return depth > 0 && mScales[depth] < mScales[depth - 1];
+    }
+
+    // The depth whose target the views at depth are rendered into, 0 for the main framebuffer
+    int targetDepth(int depth)
+    {
+        while (depth > 0 && mScales[depth] >= mScales[depth - 1])
+            depth--;
+        return depth;
+    }
+
+    // The targets are full size, the scale only changes the viewport. So every target has the same description and
+    // any of them can take the framebuffer of another.
+    static TargetDesc getTargetDesc(int width, int height)
+    {
+        return {width, height, GL_RGBA8, GL_DEPTH24_STENCIL8};
+    }
+
+    // Binds and clears the framebuffer of the target of depth, rendering at its scale. The stencil still has to be
+    // marked for its views.
+    void beginTarget(int depth, unsigned int framebuffer, int width, int height)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, scaled(width, mScales[depth]), scaled(height, mScales[depth]));
+        glStencilMask(0xff);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        RENDER_STAT(STAT_DEPTH_CLEARS, 1);
+    }
+
+    // Binds the framebuffer of the target the views at depth are rendered into, at its scale
+    void bindTarget(int depth, unsigned int framebuffer, int width, int height)
+    {
+        depth = targetDepth(depth);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, scaled(width, mScales[depth]), scaled(height, mScales[depth]));
+    }
+
+    // Upsamples the color texture of the target of depth into the target of the depth before it, on the pixels of the
+    // views at depth. The target of the depth before has to be bound. Leaves the composite program active, and the depth
+    // test unchanged.
+    void composite(int depth, unsigned int texture, const std::vector<RenderView> &views, size_t count, int width, int height)
+    {
+        int parentDepth = targetDepth(depth - 1);
+        float uvScaleX = mScales[depth] / (width * mScales[parentDepth]);
+        float uvScaleY = mScales[depth] / (height * mScales[parentDepth]);
+
+        Shader *program = mProgram->program;
+        program->activate();
+        glUniform2f(program->getUniformLocation("u_uv_scale"), uvScaleX, uvScaleY);
+        glBindTextureUnit(COMPOSITE_TEXTURE_BINDING, texture);
+        glBindVertexArray(mVertexArray);
+        glStencilMask(0);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        RENDER_STAT(STAT_UNIFORM_UPLOADS, 1);
+        RENDER_STAT(STAT_TEXTURE_BINDS, 1);
+        RENDER_STAT(STAT_VAO_BINDS, 1);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (views[i].depth != depth)
+                continue;
+            glStencilFunc(GL_EQUAL, views[i].stencil, 0xff);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            RENDER_STAT(STAT_STENCIL_CHANGES, 1);
+            RENDER_STAT(STAT_DRAW_CALLS, 1);
+            RENDER_STAT(STAT_TRIANGLES, 1);
+        }
+        glBindVertexArray(0);
+    }
+};
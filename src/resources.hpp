@@ -0,0 +1,318 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <shader.hpp>
+#include <memory.hpp>
+
+typedef enum resource_type_e
+{
+    RESOURCE_MESH,
+    RESOURCE_PROGRAM,
+    RESOURCE_TEXTURE,
+    RESOURCE_RENDERBUFFER,
+    RESOURCE_FRAMEBUFFER,
+    RESOURCE_BUFFER
+} resource_type_e;
+
+// GL objects of one asset, shared by everything that uses it
+typedef struct Resource
+{
+    resource_type_e type;
+    std::string key;
+    int refs;
+    size_t bytes;               // Estimated GPU memory
+    unsigned long lastUsed;     // Frame of the last release, the least recently used unreferenced resources are evicted first
+    bool shared;                // Kept cached after the last release. The others have one owner, and are freed then.
+    memory_tag_e tag;           // The bytes are accounted under it in the MemoryTracker
+
+    // RESOURCE_MESH
+    unsigned int vao;
+    unsigned int ebo;
+    std::vector<unsigned int> vbos;
+
+    // RESOURCE_PROGRAM
+    Shader *program;
+
+    // RESOURCE_TEXTURE, RESOURCE_RENDERBUFFER, RESOURCE_FRAMEBUFFER, RESOURCE_BUFFER
+    unsigned int name;
+} Resource;
+
+// Creates and frees every GL mesh and program, keyed by asset path and parameters, so an asset used many times is
+// only uploaded once. Resources are reference counted. Unreferenced resources stay cached for reuse, e.g. when a
+// level chunk is loaded again, until the cached memory exceeds the budget.
+// The textures, renderbuffers, framebuffers and buffers of the engine (material arrays, noise, shadow maps, render
+// targets) are created here as well, so their memory counts against the budget and leaks are reported. They have a
+// single owner and are freed by its release().
+// Only used from the thread owning the GL context.
+class ResourceCache
+{
+private:
+    std::map<std::string, std::unique_ptr<Resource>> mResources;
+    size_t mBudget;
+    size_t mBytes = 0;
+    unsigned long mFrame = 0;
+    unsigned long mHits = 0;
+    unsigned long mMisses = 0;
+    unsigned long mEvictions = 0;
+    unsigned long mOwned = 0;       // Resources with one owner created so far, numbers their keys
+
+    Resource *insert(resource_type_e type, std::string key, bool shared = true)
+    {
+        Resource *resource = new Resource{type, key, 1, 0, 0, shared, MEMORY_MESHES, 0, 0, {}, nullptr, 0};
+        mResources[key].reset(resource);
+        if (shared)
+            mMisses++;
+        return resource;
+    }
+
+    Resource *insertOwned(resource_type_e type, std::string key, size_t bytes, memory_tag_e tag)
+    {
+        Resource *resource = insert(type, key + "#" + std::to_string(mOwned++), false);
+        resource->bytes = bytes;
+        resource->tag = tag;
+        MemoryTracker::get().gpu(tag, bytes);
+        mBytes += bytes;
+        evict();
+        return resource;
+    }
+
+    // Returns the cached resource with a new reference, or nullptr
+    Resource *find(std::string key)
+    {
+        auto entry = mResources.find(key);
+        if (entry == mResources.end())
+            return nullptr;
+
+        mHits++;
+        entry->second->refs++;
+        return entry->second.get();
+    }
+
+    template <class T>
+    void uploadAttribute(Resource *resource, int location, int elementsPerEntry, const std::vector<T> &data)
+    {
+        if (data.empty() || location < 0)
+            return;
+
+        unsigned int vbo;
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(T), data.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(location, elementsPerEntry, GL_FLOAT, GL_FALSE, sizeof(T), 0);
+        glEnableVertexAttribArray(location);
+        resource->vbos.push_back(vbo);
+        resource->bytes += data.size() * sizeof(T);
+    }
+
+    void free(Resource *resource)
+    {
+        switch (resource->type)
+        {
+        case RESOURCE_MESH:
+            glDeleteBuffers(resource->vbos.size(), resource->vbos.data());
+            glDeleteBuffers(1, &resource->ebo);
+            glDeleteVertexArrays(1, &resource->vao);
+            MemoryTracker::get().gpu(MEMORY_MESHES, -(int64_t) resource->bytes);
+            break;
+        case RESOURCE_PROGRAM:
+            resource->program->destroy();
+            delete resource->program;
+            break;
+        case RESOURCE_TEXTURE:
+            glDeleteTextures(1, &resource->name);
+            break;
+        case RESOURCE_RENDERBUFFER:
+            glDeleteRenderbuffers(1, &resource->name);
+            break;
+        case RESOURCE_FRAMEBUFFER:
+            glDeleteFramebuffers(1, &resource->name);
+            break;
+        case RESOURCE_BUFFER:
+            glDeleteBuffers(1, &resource->name);
+            break;
+        }
+        if (!resource->shared)
+            MemoryTracker::get().gpu(resource->tag, -(int64_t) resource->bytes);
+        mBytes -= resource->bytes;
+    }
+
+    // Frees unreferenced resources, least recently used first, until the cache fits in the budget
+    void evict()
+    {
+        while (mBytes > mBudget)
+        {
+            auto oldest = mResources.end();
+            for (auto entry = mResources.begin(); entry != mResources.end(); entry++)
+            {
+                if (entry->second->refs == 0 && (oldest == mResources.end() || entry->second->lastUsed < oldest->second->lastUsed))
+                    oldest = entry;
+            }
+            if (oldest == mResources.end())
+                return;
+
+            free(oldest->second.get());
+            mResources.erase(oldest);
+            mEvictions++;
+        }
+    }
+
+    Resource *insertProgram(std::string key, std::string vertexPath, const std::string &vertexCode, std::string fragmentPath, const std::string &fragmentCode)
+    {
+        Resource *resource = insert(RESOURCE_PROGRAM, key);
+        resource->program = new Shader();
+        resource->program->attachSource(vertexPath, vertexCode);
+        resource->program->attachSource(fragmentPath, fragmentCode);
+        resource->program->link();
+        return resource;
+    }
+
+public:
+    // budget in bytes of GPU memory
+    ResourceCache(size_t budget)
+    {
+        mBudget = budget;
+    }
+
+    // Vertex array of the mesh with the key, uploaded from the given data the first time it is acquired.
+    // An empty key makes a mesh that is not shared.
+    Resource *acquireMesh(std::string key, Shader &shader, const std::vector<glm::vec3> &vertices, const std::vector<glm::vec3> &normals,
+                          const std::vector<glm::vec2> &textureCoordinates, const std::vector<unsigned int> &indices)
+    {
+        if (key.empty())
+            key = "mesh#" + std::to_string(mMisses);
+        else if (Resource *cached = find("mesh:" + key))
+            return cached;
+        else
+            key = "mesh:" + key;
+
+        Resource *resource = insert(RESOURCE_MESH, key);
+        glGenVertexArrays(1, &resource->vao);
+        glBindVertexArray(resource->vao);
+        uploadAttribute(resource, shader.getAttributeLocation("position"), 3, vertices);
+        uploadAttribute(resource, shader.getAttributeLocation("normal"), 3, normals);
+        uploadAttribute(resource, shader.getAttributeLocation("textureCoordinate"), 2, textureCoordinates);
+
+        glGenBuffers(1, &resource->ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, resource->ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        resource->bytes += indices.size() * sizeof(unsigned int);
+        MemoryTracker::get().gpu(MEMORY_MESHES, resource->bytes);
+
+        mBytes += resource->bytes;
+        evict();
+        return resource;
+    }
+
+    // Linked program of a vertex and fragment shader. The defines are inserted in both.
+    Resource *acquireProgram(std::string vertexPath, std::string fragmentPath, std::string defines = "")
+    {
+        std::string key = "program:" + vertexPath + ":" + fragmentPath + ":" + defines;
+        if (Resource *cached = find(key))
+            return cached;
+
+        return insertProgram(key, vertexPath, Shader::load(vertexPath, defines), fragmentPath, Shader::load(fragmentPath, defines));
+    }
+
+    // Same as above, with the sources already read by Shader::load(), e.g. on a loader thread
+    Resource *acquireProgram(std::string vertexPath, std::string fragmentPath, std::string defines,
+                             const std::string &vertexCode, const std::string &fragmentCode)
+    {
+        std::string key = "program:" + vertexPath + ":" + fragmentPath + ":" + defines;
+        if (Resource *cached = find(key))
+            return cached;
+
+        return insertProgram(key, vertexPath, vertexCode, fragmentPath, fragmentCode);
+    }
+
+    // A texture of the target without storage, which the owner allocates. bytes is the GPU memory of that storage.
+    Resource *createTexture(std::string name, GLenum target, size_t bytes, memory_tag_e tag)
+    {
+        Resource *resource = insertOwned(RESOURCE_TEXTURE, "texture:" + name, bytes, tag);
+        glCreateTextures(target, 1, &resource->name);
+        return resource;
+    }
+
+    Resource *createRenderbuffer(std::string name, size_t bytes, memory_tag_e tag)
+    {
+        Resource *resource = insertOwned(RESOURCE_RENDERBUFFER, "renderbuffer:" + name, bytes, tag);
+        glCreateRenderbuffers(1, &resource->name);
+        return resource;
+    }
+
+    Resource *createFramebuffer(std::string name)
+    {
+        Resource *resource = insertOwned(RESOURCE_FRAMEBUFFER, "framebuffer:" + name, 0, MEMORY_TARGETS);
+        glCreateFramebuffers(1, &resource->name);
+        return resource;
+    }
+
+    Resource *createBuffer(std::string name, size_t bytes, memory_tag_e tag)
+    {
+        Resource *resource = insertOwned(RESOURCE_BUFFER, "buffer:" + name, bytes, tag);
+        glCreateBuffers(1, &resource->name);
+        return resource;
+    }
+
+    // Drops a reference. Shared resources stay cached until they are evicted, the others are freed.
+    void release(Resource *resource)
+    {
+        if (!resource)
+            return;
+        if (resource->refs <= 0)
+        {
+            std::cerr << "Error: " << resource->key << " released more often than acquired" << std::endl;
+            return;
+        }
+
+        resource->refs--;
+        resource->lastUsed = mFrame;
+        if (!resource->shared && resource->refs == 0)
+        {
+            std::string key = resource->key;
+            free(resource);
+            mResources.erase(key);
+            return;
+        }
+        evict();
+    }
+
+    void endFrame()
+    {
+        mFrame++;
+    }
+
+    size_t getBytes()
+    {
+        return mBytes;
+    }
+
+    void report()
+    {
+        int referenced = 0;
+        for (auto &entry : mResources)
+            referenced += entry.second->refs > 0;
+        printf("Resources: %d (%d referenced), %.2f MB, %lu hits, %lu misses, %lu evicted\n",
+               (int) mResources.size(), referenced, mBytes / (1024.0 * 1024.0), mHits, mMisses, mEvictions);
+    }
+
+    // Frees everything. Resources that are still referenced were never released, and are reported as leaks.
+    void destroy()
+    {
+        report();
+        for (auto &entry : mResources)
+        {
+            if (entry.second->refs > 0)
+                std::cerr << "Error: " << entry.first << " leaked " << entry.second->refs << " references" << std::endl;
+            free(entry.second.get());
+        }
+        mResources.clear();
+    }
+};
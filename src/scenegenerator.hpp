@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <game.hpp>
+
+// Parameters of a generated level. The same seed and counts always produce the same level.
+typedef struct SceneSettings
+{
+    bool generate;              // false builds the default hand made room
+    uint32_t seed;
+    unsigned int rooms;
+    unsigned int boxes;
+    unsigned int turrets;
+    unsigned int lights;
+    unsigned int portalPairs;   // Including the pair placed by the player
+
+    std::string level;          // Streams this level file instead of building a scene
+    std::string saveLevel;      // Writes the built scene to this level file
+    float streamRadius;         // Chunks closer than this are loaded
+    unsigned int streamBudget;  // MB of chunk geometry kept loaded
+} SceneSettings;
+
+inline SceneSettings defaultSceneSettings()
+{
+    return {false, 1, 4, 32, 4, 8, 3, "", "", 300, 64};
+}
+
+// Handles the scene options of the command line. Any of the generator options selects the generated scene.
+// Returns false if the argument is not a scene option.
+// --seed s --rooms n --boxes n --turrets n --lights n --portals n
+// --level file --save-level file --stream-radius units --stream-budget MB
+inline bool parseSceneArgument(std::string arg, const char *value, SceneSettings &settings)
+{
+    if (arg == "--level") settings.level = value;
+    else if (arg == "--save-level") settings.saveLevel = value;
+    else if (arg == "--stream-radius") settings.streamRadius = atof(value);
+    else if (arg == "--stream-budget") settings.streamBudget = (unsigned int) strtoul(value, nullptr, 10);
+    else if (arg == "--seed") settings.seed = (uint32_t) strtoul(value, nullptr, 10);
+    else if (arg == "--rooms") settings.rooms = (unsigned int) strtoul(value, nullptr, 10);
+    else if (arg == "--boxes") settings.boxes = (unsigned int) strtoul(value, nullptr, 10);
+    else if (arg == "--turrets") settings.turrets = (unsigned int) strtoul(value, nullptr, 10);
+    else if (arg == "--lights") settings.lights = (unsigned int) strtoul(value, nullptr, 10);
+    else if (arg == "--portals") settings.portalPairs = (unsigned int) strtoul(value, nullptr, 10);
+    else return false;
+
+    settings.generate = settings.generate || (arg != "--level" && arg != "--save-level" && arg.compare(0, 8, "--stream") != 0);
+    return true;
+}
+
+// Random numbers that are identical on every platform. The mt19937 sequence is defined by the standard,
+// but the std distributions are not, so they are not used.
+class SceneRandom
+{
+private:
+    std::mt19937 mEngine;
+
+public:
+    SceneRandom(uint32_t seed) : mEngine(seed) {}
+
+    // Uniform in [min, max)
+    float range(float min, float max)
+    {
+        return min + (max - min) * (float) (mEngine() / 4294967296.0);
+    }
+
+    // Uniform in [0, count)
+    unsigned int index(unsigned int count)
+    {
+        return (unsigned int) (mEngine() % count);
+    }
+};
+
+// Builds a level of rooms on a grid, each an inside cube like the default room. Boxes, turrets and lights are
+// spread over the rooms, and every portal pair after the first links the walls of two rooms. The first pair starts
+// on the walls of the first room, where the camera starts. Materials are assigned by index, so the material
+// library can be built afterwards.
+inline void generateScene(gamedata_st &gamedata, const SceneSettings &settings, int wallMaterial, int boxMaterial, int turretMaterial)
+{
+    SceneRandom random(settings.seed);
+    unsigned int rooms = std::max(1u, settings.rooms);
+    unsigned int columns = (unsigned int) ceil(sqrt((double) rooms));
+    const float spacing = 200; // Larger than any room, so rooms never overlap
+
+    printf("Generating scene %u: %u rooms, %u boxes, %u turrets, %u lights, %u portal pairs\n",
+           settings.seed, rooms, settings.boxes, settings.turrets, settings.lights, settings.portalPairs);
+
+    // Rooms
+    std::vector<Cube *> roomCubes;
+    std::vector<glm::vec3> roomSizes;
+    for (unsigned int i = 0; i < rooms; i++)
+    {
+        glm::vec3 size = glm::vec3(random.range(60, 140), random.range(40, 60), random.range(60, 140));
+        Cube *room = gamedata.pools.cubes.emplace(size, true);
+        room->setPosition(glm::vec3((i % columns) * spacing, 0, (i / columns) * spacing));
+        room->material = wallMaterial;
+        gamedata.root->addChild(*room);
+        gamedata.cubes.push_back(room);
+        roomCubes.push_back(room);
+        roomSizes.push_back(size);
+    }
+
+    // Boxes standing on the floor of a random room, with a random yaw
+    for (unsigned int i = 0; i < settings.boxes; i++)
+    {
+        unsigned int r = random.index(rooms);
+        glm::vec3 size = glm::vec3(random.range(4, 20), random.range(4, 20), random.range(4, 20));
+        glm::vec3 half = roomSizes[r] * 0.5f - glm::vec3(10);
+        Cube *box = gamedata.pools.cubes.emplace(size, false);
+        box->setPosition(glm::vec3(random.range(-half.x, half.x), -roomSizes[r].y * 0.5f + size.y * 0.5f, random.range(-half.z, half.z)));
+        box->rotate(glm::vec3(0, 1, 0), random.range(0, 2 * M_PI));
+        box->material = i % 2 ? boxMaterial : wallMaterial;
+        roomCubes[r]->addChild(*box);
+        gamedata.cubes.push_back(box);
+    }
+
+    // Turrets hover above the floor, bobbing as in the default room
+    for (unsigned int i = 0; i < settings.turrets; i++)
+    {
+        unsigned int r = random.index(rooms);
+        glm::vec3 half = roomSizes[r] * 0.5f - glm::vec3(10);
+        glm::vec3 position = roomCubes[r]->getPosition() + glm::vec3(random.range(-half.x, half.x), -roomSizes[r].y * 0.5f + 5, random.range(-half.z, half.z));
+        ObjMesh *turret = gamedata.pools.models.emplace("../res/models/turret.obj", 0.1f);
+        turret->setPosition(position);
+        turret->material = turretMaterial;
+        gamedata.root->addChild(*turret);
+        gamedata.turrets.push_back(turret);
+        gamedata.turretPositions.push_back(position);
+    }
+
+    // Lights in the upper half of the rooms. The shader has a fixed number of light slots.
+    unsigned int lights = settings.lights;
+    if (gamedata.lights.size() + lights > MAX_LIGHTS)
+    {
+        std::cerr << "Error: Only " << MAX_LIGHTS << " lights are supported, " << MAX_LIGHTS - gamedata.lights.size() << " are generated" << std::endl;
+        lights = MAX_LIGHTS - gamedata.lights.size();
+    }
+    for (unsigned int i = 0; i < lights; i++)
+    {
+        unsigned int r = random.index(rooms);
+        glm::vec3 half = roomSizes[r] * 0.5f - glm::vec3(5);
+        glm::vec3 color = glm::vec3(random.range(0.3f, 0.7f), random.range(0.3f, 0.7f), random.range(0.3f, 0.7f));
+        Light *light = gamedata.pools.lights.emplace(glm::vec3(random.range(-half.x, half.x), random.range(0, half.y), random.range(-half.z, half.z)), color);
+        roomCubes[r]->addChild(*light);
+        gamedata.lights.push_back(light);
+    }
+
+    // Places a portal on a random wall of a room, facing into the room
+    auto placeOnWall = [&](Portal *portal, unsigned int r) {
+        static const glm::vec3 normals[4] = {glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)};
+        glm::vec3 normal = normals[random.index(4)];
+        glm::vec3 half = roomSizes[r] * 0.5f;
+        glm::vec3 tangent = glm::vec3(normal.z, 0, -normal.x);
+        float along = glm::dot(glm::abs(tangent), half) - 8;
+        glm::vec3 position = roomCubes[r]->getPosition()
+            - normal * glm::dot(glm::abs(normal), half)     // On the wall
+            + tangent * random.range(-along, along)         // Somewhere along it
+            + glm::vec3(0, -half.y + 6, 0);                 // Standing on the floor
+        portal->place(position + normal * 0.2f, normal, glm::vec3(0, 1, 0));
+    };
+
+    // The pair of the player starts in the first room
+    placeOnWall(gamedata.portals[0], 0);
+    placeOnWall(gamedata.portals[1], 0);
+
+    // The other pairs link random rooms
+    for (unsigned int i = 1; i < settings.portalPairs; i++)
+    {
+        glm::vec3 color = glm::vec3(random.range(0.2f, 1), random.range(0.2f, 1), random.range(0.2f, 1));
+        for (int side = 0; side < 2; side++)
+        {
+            Portal *portal = gamedata.pools.portals.emplace(glm::vec2(5, 10), side ? glm::vec3(1) - color : color);
+            gamedata.root->addChild(*portal);
+            gamedata.portals.push_back(portal);
+            placeOnWall(portal, random.index(rooms));
+        }
+    }
+
+    // Start in the middle of the first room
+    gamedata.camera->setPosition(roomCubes[0]->getPosition());
+}
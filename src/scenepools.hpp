@@ -0,0 +1,29 @@
+#pragma once
+
+#include <pool.hpp>
+#include <node.hpp>
+#include <mesh.hpp>
+#include <light.hpp>
+#include <portal.hpp>
+
+// Storage of the objects of a level. The scene graph links them by pointer, which stays valid as pool pages
+// never move, while anything that can outlive an object (e.g. a streamed chunk) refers to it by handle.
+class ScenePools
+{
+public:
+    Pool<Node> nodes;
+    Pool<Cube> cubes;
+    Pool<ObjMesh> models;
+    Pool<Light> lights{MEMORY_LIGHTING};
+    Pool<Portal> portals;
+
+    // Tears the whole level down at once. The GPU data of the meshes has to be destroyed before.
+    void reset()
+    {
+        portals.reset();
+        lights.reset();
+        models.reset();
+        cubes.reset();
+        nodes.reset();
+    }
+};
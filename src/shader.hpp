@@ -2,13 +2,19 @@
 
 #include <glad/glad.h>
 
+#include <cstring>
 #include <fstream>
 #include <memory>
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <renderstats.hpp>
 
 class Shader {
     private:
         unsigned int mProgramID;
+        std::vector<std::pair<std::string, int>> mUniforms;    // Locations looked up since the program was linked
         
         int shaderTypeFromPath(std::string path)
         {
@@ -42,7 +48,9 @@ class Shader {
             glDeleteProgram(mProgramID);
         }
 
-        void attach(std::string path)
+        // Reads the source of a shader. Defines are inserted right after the #version line, to compile variants of the same shader.
+        // Does not use GL, so it can run on any thread.
+        static std::string load(std::string path, std::string defines = "")
         {
             // Load shader from file
             std::ifstream fileStream;
@@ -57,6 +65,22 @@ class Shader {
                 std::istreambuf_iterator<char>()
             );
 
+            if (!defines.empty())
+            {
+                size_t versionEnd = shaderCode.find('\n') + 1;
+                shaderCode.insert(versionEnd, defines);
+            }
+            return shaderCode;
+        }
+
+        void attach(std::string path, std::string defines = "")
+        {
+            attachSource(path, load(path, defines));
+        }
+
+        // Compiles and attaches source read by load(). The path selects the shader type.
+        void attachSource(std::string path, const std::string &shaderCode)
+        {
             const char *shaderCodePtr = shaderCode.c_str();
 
             // Find the shader type from the file extention
@@ -95,6 +119,7 @@ class Shader {
         void link()
         {
             glLinkProgram(mProgramID);
+            mUniforms.clear();
 
             // Display errors
             int linkStatus;
@@ -109,9 +134,19 @@ class Shader {
             }
         }
 
-            int getUniformLocation(const char* name)
+        // Only asks GL the first time a name is looked up
+        int getUniformLocation(const char* name)
         {
-            return glGetUniformLocation(mProgramID, name);
+            for (const std::pair<std::string, int> &uniform : mUniforms)
+            {
+                if (strcmp(uniform.first.c_str(), name) == 0)
+                    return uniform.second;
+            }
+
+            RENDER_STAT(STAT_UNIFORM_LOOKUPS, 1);
+            int location = glGetUniformLocation(mProgramID, name);
+            mUniforms.emplace_back(name, location);
+            return location;
         }
 
         int getAttributeLocation(const char* name)
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <iostream>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/common.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <resources.hpp>
+#include <culling.hpp>
+#include <mesh.hpp>
+#include <light.hpp>
+#include <profiler.hpp>
+#include <renderstats.hpp>
+#include <memory.hpp>
+
+// Has to match the layout qualifier in shader.frag. Unit 6 is used by the resolution composite.
+#define SHADOW_TEXTURE_BINDING 7
+#define SHADOW_MAP_SIZE 512
+#define SHADOW_NEAR 0.1f
+
+// Cube shadow maps of the point lights, in two cube map arrays with one cube per light slot. The static layer holds the
+// casters which never move, and is only rendered again when a light moves or the scene changes. The composited layer
+// is a copy of the static layer with the moving casters drawn over it, and is what shader.frag samples. It is only
+// updated for the lights which a moving caster could reach before or after it moved, the others are left as they are.
+// The maps are in world space, so every view through the portals samples the same maps.
+class ShadowMaps
+{
+private:
+    typedef struct LightState
+    {
+        bool cached;            // The static layer is up to date
+        glm::vec3 position;     // Where the static layer was rendered from
+    } LightState;
+
+    typedef struct CasterState
+    {
+        glm::mat4 transform;    // At the last update
+        glm::vec3 center;
+        glm::vec3 extents;
+    } CasterState;
+
+    Resource *mStatic = nullptr;
+    Resource *mComposite = nullptr;
+    Resource *mFramebuffer = nullptr;
+    int mSlots = 0;
+    Resource *mProgram = nullptr;
+    ResourceCache *mResources = nullptr;    // Of create(), the maps are created again when lights are added
+    std::vector<LightState> mLights;
+    std::vector<CasterState> mCasters;
+    std::vector<CasterState> mMoved;        // The casters of this update, reused every frame like the lists below
+    std::vector<bool> mHasMoved;
+    std::vector<Mesh*> mInRange;
+    unsigned long mStaticUpdates = 0;
+    unsigned long mDynamicUpdates = 0;
+
+    static bool inRange(glm::vec3 position, glm::vec3 center, glm::vec3 extents, float range)
+    {
+        glm::vec3 delta = glm::max(glm::abs(position - center) - extents, glm::vec3(0));
+        return glm::dot(delta, delta) <= range * range;
+    }
+
+    // The cube map faces in the order of the layers, +X, -X, +Y, -Y, +Z, -Z, with the orientation cube maps are sampled in
+    static glm::mat4 faceViewProjection(glm::vec3 position, int face, float range)
+    {
+        static const glm::vec3 directions[6] = {
+            glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)};
+        static const glm::vec3 ups[6] = {
+            glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0)};
+
+        glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, SHADOW_NEAR, range);
+        return proj * glm::lookAt(position, position + directions[face], ups[face]);
+    }
+
+    // Of one layer
+    static size_t getBytes(int slots)
+    {
+        return (size_t) SHADOW_MAP_SIZE * SHADOW_MAP_SIZE * 4 * 6 * slots;
+    }
+
+    void allocate(int slots)
+    {
+        mResources->release(mStatic);
+        mResources->release(mComposite);
+        mStatic = mResources->createTexture("shadows static", GL_TEXTURE_CUBE_MAP_ARRAY, getBytes(slots), MEMORY_LIGHTING);
+        mComposite = mResources->createTexture("shadows composite", GL_TEXTURE_CUBE_MAP_ARRAY, getBytes(slots), MEMORY_LIGHTING);
+        for (Resource *texture : {mStatic, mComposite})
+        {
+            glTextureStorage3D(texture->name, 1, GL_DEPTH_COMPONENT32F, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, slots * 6);
+            glTextureParameteri(texture->name, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTextureParameteri(texture->name, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTextureParameteri(texture->name, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTextureParameteri(texture->name, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        mSlots = slots;
+        invalidate();
+    }
+
+    // Renders the casters into the 6 faces of the cube of the light
+    void renderCube(Resource *texture, int slot, glm::vec3 position, const std::vector<Mesh*> &casters, bool clear)
+    {
+        Shader *program = mProgram->program;
+        float range = Light::getRange();
+        int uModelLoc = program->getUniformLocation("model");
+        glUniform3fv(program->getUniformLocation("u_light_position"), 1, glm::value_ptr(position));
+        RENDER_STAT(STAT_UNIFORM_UPLOADS, 1);
+
+        for (int face = 0; face < 6; face++)
+        {
+            glm::mat4 viewProjection = faceViewProjection(position, face, range);
+            glNamedFramebufferTextureLayer(mFramebuffer->name, GL_DEPTH_ATTACHMENT, texture->name, 0, slot * 6 + face);
+            if (clear)
+            {
+                glClear(GL_DEPTH_BUFFER_BIT);
+                RENDER_STAT(STAT_DEPTH_CLEARS, 1);
+            }
+
+            glUniformMatrix4fv(program->getUniformLocation("viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+            RENDER_STAT(STAT_UNIFORM_UPLOADS, 1);
+            Frustum frustum(viewProjection);
+            for (Mesh *mesh : casters)
+            {
+                glm::vec3 center, extents;
+                transformBounds(mesh->boundsMin, mesh->boundsMax, mesh->getRenderTransform(), center, extents);
+                if (frustum.intersects(center, extents))
+                    mesh->renderGeometry(uModelLoc);
+            }
+        }
+    }
+
+public:
+    void create(ResourceCache &resources)
+    {
+        mResources = &resources;
+        mProgram = resources.acquireProgram("../shaders/shadow.vert", "../shaders/shadow.frag");
+        mFramebuffer = resources.createFramebuffer("shadows");
+        glNamedFramebufferDrawBuffer(mFramebuffer->name, GL_NONE);
+        glNamedFramebufferReadBuffer(mFramebuffer->name, GL_NONE);
+    }
+
+    void destroy(ResourceCache &resources)
+    {
+        printf("Shadow maps: %lu static and %lu dynamic light updates\n", mStaticUpdates, mDynamicUpdates);
+        for (Resource **resource : {&mFramebuffer, &mStatic, &mComposite, &mProgram})
+        {
+            resources.release(*resource);
+            *resource = nullptr;
+        }
+        mSlots = 0;
+        mResources = nullptr;
+    }
+
+    // The static casters or the lights changed, e.g. a level chunk was streamed in
+    void invalidate()
+    {
+        for (LightState &light : mLights)
+            light.cached = false;
+        mCasters.clear();
+    }
+
+    // Updates the maps of the lights. The first staticCount meshes never move, the others are redrawn when they do.
+    // Leaves the shadow program active and the shadow framebuffer bound, the caller restores its own.
+    void update(const std::vector<Light*> &lights, const std::vector<Mesh*> &meshes, size_t staticCount)
+    {
+        if (lights.empty())
+            return;
+        if ((int) lights.size() > mSlots)
+            allocate(lights.size());
+        mLights.resize(mSlots, {false, glm::vec3(0)});
+
+        // The moving casters, and their bounds before and after they moved
+        float range = Light::getRange();
+        size_t dynamicCount = meshes.size() - staticCount;
+        std::vector<CasterState> &casters = mMoved;
+        casters.resize(dynamicCount);
+        mHasMoved.resize(dynamicCount);
+        for (size_t i = 0; i < dynamicCount; i++)
+        {
+            Mesh *mesh = meshes[staticCount + i];
+            casters[i].transform = mesh->getRenderTransform();
+            transformBounds(mesh->boundsMin, mesh->boundsMax, casters[i].transform, casters[i].center, casters[i].extents);
+            mHasMoved[i] = i >= mCasters.size() || mCasters[i].transform != casters[i].transform;
+        }
+
+        mProgram->program->activate();
+        glUniform1f(mProgram->program->getUniformLocation("u_shadow_range"), range);
+        RENDER_STAT(STAT_UNIFORM_UPLOADS, 1);
+        glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer->name);
+        glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+        for (Light *light : lights)
+        {
+            int slot = light->getID();
+            if (slot < 0 || slot >= mSlots)
+                continue;
+
+            LightState &state = mLights[slot];
+            glm::vec3 position = light->getRenderPosition();
+            bool dirty = !state.cached || state.position != position;
+            if (dirty)
+            {
+                PROFILE_GPU_ZONE("staticShadows");
+                mInRange.clear();
+                for (size_t i = 0; i < staticCount; i++)
+                {
+                    glm::vec3 center, extents;
+                    transformBounds(meshes[i]->boundsMin, meshes[i]->boundsMax, meshes[i]->getRenderTransform(), center, extents);
+                    if (inRange(position, center, extents, range))
+                        mInRange.push_back(meshes[i]);
+                }
+                renderCube(mStatic, slot, position, mInRange, true);
+                state.cached = true;
+                state.position = position;
+                mStaticUpdates++;
+            }
+
+            // Moving casters which are in range now, or were before, change the composited layer
+            mInRange.clear();
+            for (size_t i = 0; i < dynamicCount; i++)
+            {
+                bool reaches = inRange(position, casters[i].center, casters[i].extents, range);
+                bool reached = i < mCasters.size() && inRange(position, mCasters[i].center, mCasters[i].extents, range);
+                dirty = dirty || (mHasMoved[i] && (reaches || reached));
+                if (reaches)
+                    mInRange.push_back(meshes[staticCount + i]);
+            }
+            if (!dirty)
+                continue;
+
+            PROFILE_GPU_ZONE("dynamicShadows");
+            glCopyImageSubData(mStatic->name, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, slot * 6,
+                               mComposite->name, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, slot * 6,
+                               SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 6);
+            renderCube(mComposite, slot, position, mInRange, false);
+            mDynamicUpdates++;
+        }
+        mCasters.swap(mMoved);
+    }
+
+    // Binds the composited maps for shader.frag, whose program has to be active
+    void bind(Shader &shader)
+    {
+        glBindTextureUnit(SHADOW_TEXTURE_BINDING, mComposite ? mComposite->name : 0);
+        glUniform1i(shader.getUniformLocation("u_shadows"), mSlots > 0);
+        glUniform1f(shader.getUniformLocation("u_shadow_range"), Light::getRange());
+        RENDER_STAT(STAT_TEXTURE_BINDS, 1);
+        RENDER_STAT(STAT_UNIFORM_UPLOADS, 2);
+    }
+};
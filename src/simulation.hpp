@@ -0,0 +1,100 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <input.hpp>
+#include <allocations.hpp>
+
+// Runs the simulation of each frame on its own thread, so it overlaps with the rendering of the previous frame.
+// The main thread submits the input of every frame, and the simulation thread processes the frames in order,
+// which keeps the simulation identical to a single threaded run of the same input.
+class SimulationThread
+{
+private:
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::function<void(const InputState &)> mSimulate;
+
+    InputState mInput;
+    bool mPending = false;  // mInput holds a frame that has not been started
+    bool mBusy = false;     // A frame is being simulated
+    bool mStop = false;
+
+    void run()
+    {
+        AllocationTracker::trackThread();
+        InputState input;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mCondition.wait(lock, [this] { return mPending || mStop; });
+                if (!mPending)
+                    return;
+                input = mInput;
+                mPending = false;
+                mBusy = true;
+            }
+            mCondition.notify_all();
+
+            mSimulate(input);
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mBusy = false;
+            }
+            mCondition.notify_all();
+        }
+    }
+
+public:
+    void start(std::function<void(const InputState &)> simulate)
+    {
+        mSimulate = simulate;
+        mStop = false;
+        mThread = std::thread(&SimulationThread::run, this);
+    }
+
+    bool isRunning()
+    {
+        return mThread.joinable();
+    }
+
+    // Queues the input of the next frame. Blocks while the previous submitted frame has not been started,
+    // so the simulation is at most one frame ahead of the renderer.
+    void submit(const InputState &input)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [this] { return !mPending; });
+            mInput = input;
+            mPending = true;
+        }
+        mCondition.notify_all();
+    }
+
+    // Blocks until every submitted frame is simulated
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this] { return !mPending && !mBusy; });
+    }
+
+    // Finishes the submitted frames and joins the thread
+    void stop()
+    {
+        if (!mThread.joinable())
+            return;
+
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mCondition.notify_all();
+        mThread.join();
+    }
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Lock free triple buffer for one producer and one consumer thread.
+// The producer fills write() and publishes it, the consumer calls update() and reads read().
+// Neither side ever waits, and the consumer always gets the most recently published buffer.
+template <typename T>
+class TripleBuffer
+{
+private:
+    static const int NEW_BIT = 4;    // Set in mMiddle when it holds a buffer the consumer has not seen
+
+    T mBuffers[3];
+    std::atomic<int> mMiddle{1};
+    int mWrite = 0;
+    int mRead = 2;
+
+public:
+    // Initializes all three buffers, e.g. to allocate their storage up front
+    void reset(const T &value)
+    {
+        for (T &buffer : mBuffers)
+            buffer = value;
+        mMiddle = 1;
+        mWrite = 0;
+        mRead = 2;
+    }
+
+    T &write()
+    {
+        return mBuffers[mWrite];
+    }
+
+    // Hands the write buffer over to the consumer, and continues with the buffer it no longer needs
+    void publish()
+    {
+        mWrite = mMiddle.exchange(mWrite | NEW_BIT) & 3;
+    }
+
+    // Switches to the latest published buffer. Returns false if nothing new was published.
+    bool update()
+    {
+        if (!(mMiddle.load() & NEW_BIT))
+            return false;
+        mRead = mMiddle.exchange(mRead) & 3;
+        return true;
+    }
+
+    const T &read()
+    {
+        return mBuffers[mRead];
+    }
+};
+
+// Everything the renderer reads from the simulation, captured at the end of a simulated frame
+typedef struct RenderSnapshot
+{
+    std::vector<glm::mat4> previous;    // Global transform of every node at the previous tick
+    std::vector<glm::mat4> current;     // and at the latest tick, in the order of gamedata.nodes
+    glm::fquat cameraOrientation;       // Latest camera orientation, not interpolated to keep mouse look responsive
+    float alpha;                        // Fraction of a tick between current and the frame time
+    unsigned long frame;
+} RenderSnapshot;
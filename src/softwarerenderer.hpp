@@ -0,0 +1,177 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_access.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <jobs.hpp>
+#include <profiler.hpp>
+#include <mesh.hpp>
+#include <portal.hpp>
+#include <light.hpp>
+#include <texture.hpp>
+#include <rasterizer.hpp>
+#include <renderstats.hpp>
+
+// Renders the scene on the CPU with the Rasterizer, for machines without an OpenGL 4.5 driver.
+// Takes the same meshes, views and stencil operations as the OpenGL renderer, with the stencil operations given as
+// the GL enums, so the portal recursion drives both the same way. Draws are recorded until finish().
+class SoftwareRenderer
+{
+private:
+    Rasterizer mRasterizer;
+    int mStencilRef = -1;
+    raster_stencil_e mStencilPass = RASTER_KEEP;
+    uint8_t mStencilWriteMask = 0xff;
+    bool mDepthTest = true;
+
+    static raster_stencil_e stencilOp(GLenum op)
+    {
+        switch (op)
+        {
+        case GL_INCR: return RASTER_INCR;
+        case GL_DECR: return RASTER_DECR;
+        case GL_INCR_WRAP: return RASTER_INCR_WRAP;
+        case GL_DECR_WRAP: return RASTER_DECR_WRAP;
+        case GL_INVERT: return RASTER_INVERT;
+        default: return RASTER_KEEP;
+        }
+    }
+
+    void draw(Mesh &mesh, const glm::mat4 &view, const glm::mat4 &proj, raster_shading_e shading, glm::vec3 portalColor, bool fan)
+    {
+        if (mesh.vertices.empty())
+            return;
+
+        RasterDraw draw;
+        bool attributes = mesh.normals.size() >= mesh.vertices.size() && mesh.textureCoordinates.size() >= mesh.vertices.size();
+        draw.mesh = {
+            glm::value_ptr(mesh.vertices[0]),
+            attributes ? glm::value_ptr(mesh.normals[0]) : nullptr,
+            attributes ? glm::value_ptr(mesh.textureCoordinates[0]) : nullptr,
+            mesh.indices.data(),
+            mesh.indices.size(),
+            fan};
+
+        glm::mat4 model = mesh.getRenderTransform();
+        glm::mat4 viewProjection = proj * view;
+        glm::vec3 camera = glm::vec3(glm::column(glm::inverse(view), 3));
+        memcpy(draw.model, glm::value_ptr(model), sizeof(draw.model));
+        memcpy(draw.viewProjection, glm::value_ptr(viewProjection), sizeof(draw.viewProjection));
+        memcpy(draw.camera, glm::value_ptr(camera), sizeof(draw.camera));
+        memcpy(draw.portalColor, glm::value_ptr(portalColor), sizeof(draw.portalColor));
+
+        // Meshes with a plain albedo texture instead of a material are drawn white
+        draw.shading = shading;
+        draw.material = mesh.material;
+        draw.lightMask = (uint32_t) mesh.lightMask;
+        draw.stencilRef = mStencilRef;
+        draw.stencilPass = mStencilPass;
+        draw.stencilWriteMask = mStencilWriteMask;
+        draw.depthTest = mDepthTest;
+        mRasterizer.draw(draw);
+        RENDER_STAT(STAT_DRAW_CALLS, 1);
+        RENDER_STAT(STAT_TRIANGLES, fan ? mesh.indices.size() - 2 : mesh.indices.size() / 3);
+    }
+
+public:
+    SoftwareRenderer(int width, int height) : mRasterizer(width, height) {}
+
+    // Has to be called before the materials are loaded, which can then be loaded on several threads at once
+    void setMaterialCount(size_t count)
+    {
+        mRasterizer.setMaterialCount(count);
+    }
+
+    // Decodes the image of a material. Returns false on failure, the material is then drawn white.
+    bool loadMaterial(int material, std::string path, filter_e filter)
+    {
+        int width, height, channels;
+        unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+        if (!pixels)
+        {
+            std::cerr << "Error: Could not load " << path << std::endl;
+            return false;
+        }
+
+        mRasterizer.setMaterial(material, width, height, pixels, filter == NEAREST);
+        stbi_image_free(pixels);
+        return true;
+    }
+
+    // The portals sample the first slice of 3D noise, repeated if it is tileable as with the OpenGL texture
+    void setNoise(NoiseSettings settings, const std::vector<unsigned char> &noise)
+    {
+        mRasterizer.setNoise(settings.width, settings.height, noise.data(), settings.tileable);
+    }
+
+    // Starts a frame, cleared to the clear color of the OpenGL renderer
+    void begin(float time, const std::vector<Light*> &lights)
+    {
+        float positions[RASTER_MAX_LIGHTS][3] = {};
+        float colors[RASTER_MAX_LIGHTS][3] = {};
+        int count = 0;
+        for (Light *light : lights)
+        {
+            int id = light->getID();
+            if (id < 0 || id >= RASTER_MAX_LIGHTS)
+                continue;
+            memcpy(positions[id], glm::value_ptr(light->getRenderPosition()), sizeof(positions[id]));
+            memcpy(colors[id], glm::value_ptr(light->getColor()), sizeof(colors[id]));
+            count = std::max(count, id + 1);
+        }
+        mRasterizer.setLights(count, positions[0], colors[0]);
+
+        const float clearColor[3] = {0.2f, 0.3f, 0.3f};
+        mRasterizer.begin(time, clearColor);
+        stencil(-1, GL_KEEP);
+        depthFunc(GL_LESS);
+    }
+
+    // Later draws only pass where the stencil equals ref (or everywhere for -1), and apply op to the bits of writeMask
+    // where they pass the depth test
+    void stencil(int ref, GLenum op, uint8_t writeMask = 0xff)
+    {
+        mStencilRef = ref;
+        mStencilPass = stencilOp(op);
+        mStencilWriteMask = writeMask;
+    }
+
+    // GL_LESS or GL_ALWAYS
+    void depthFunc(GLenum func)
+    {
+        mDepthTest = func != GL_ALWAYS;
+    }
+
+    void clearDepth()
+    {
+        mRasterizer.clearDepth();
+    }
+
+    void drawMesh(Mesh &mesh, const glm::mat4 &view, const glm::mat4 &proj)
+    {
+        draw(mesh, view, proj, RASTER_PHONG, glm::vec3(0), false);
+    }
+
+    // Portals are circles, drawn as a triangle fan
+    void drawPortal(Portal &portal, const glm::mat4 &view, const glm::mat4 &proj)
+    {
+        draw(portal, view, proj, RASTER_PORTAL, portal.getColor(), true);
+    }
+
+    // Renders the recorded frame on the job system
+    void finish(JobSystem &jobs)
+    {
+        PROFILE_ZONE("SoftwareRenderer::finish");
+        mRasterizer.finish(jobs);
+    }
+
+    bool writeImage(std::string path)
+    {
+        return mRasterizer.writeImage(path);
+    }
+};
@@ -3,7 +3,13 @@
 #include <glad/glad.h>
 #include <string>
 #include <iostream>
-#include <PerlinNoise.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <noise.hpp>
+#include <cookedtexture.hpp>
+#include <renderstats.hpp>
+#include <memory.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -16,32 +22,15 @@ typedef enum filter_e
 
 class Texture
 {
-private:
+protected:
     unsigned int textureID;
+    size_t mBytes = 0;  // GPU memory of all levels
 
-public:
-    Texture(std::string path, filter_e filter)
-    {
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        int width, height, channels;
-        unsigned char *imageData = stbi_load(path.c_str(), &width, &height, &channels, 4);
-
-        printf("Loaded: %s using %d channels\n", path.c_str(), channels);
-
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RGBA,
-            width,
-            height,
-            0,
-            GL_RGBA,
-            GL_UNSIGNED_BYTE,
-            imageData);
-
-        stbi_image_free(imageData);
+    Texture() {}
 
+private:
+    void setFilter(filter_e filter)
+    {
         switch (filter)
         {
         case LINEAR:
@@ -53,53 +42,242 @@ public:
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             break;
         }
-
-        glGenerateMipmap(GL_TEXTURE_2D);
     }
 
-    Texture(unsigned int width, unsigned int height, unsigned int octaves, float frequency, unsigned long seed)
+    // Uploads every level of a cooked texture straight from the memory mapped file.
+    // Returns false if there is no cooked texture, or the driver lacks the compressed format.
+    bool loadCooked(std::string path)
     {
-        const siv::PerlinNoise perlin{seed};
-        unsigned char *imageData = (unsigned char *)malloc(sizeof(char) * width * height);
+        CookedTexture cooked;
+        if (!cooked.open(path))
+            return false;
 
-        const double invFreq = 1.0f / frequency;
+        const CookedTextureHeader &header = cooked.header();
+        GLenum internalFormat = GL_RGBA8;
+        if (header.format == COOKED_BC1)
+        {
+            if (!GLAD_GL_EXT_texture_compression_s3tc)
+            {
+                cooked.close();
+                return false;
+            }
+            internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        }
+        else if (header.format == COOKED_BC7)
+        {
+            internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM; // Core since OpenGL 4.2
+        }
 
-        for (unsigned int i = 0; i < height; i++)
+        for (unsigned int i = 0; i < header.levels; i++)
         {
-            for (unsigned int j = 0; j < width; j++)
+            const CookedTextureLevel &level = cooked.level(i);
+            if (header.format == COOKED_RGBA8)
+            {
+                glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, cooked.levelData(i));
+            }
+            else
             {
-                imageData[i * width + j] = (unsigned char) (255 * perlin.octave2D_01(i * invFreq, j * invFreq, octaves));
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, level.width, level.height, 0, level.size, cooked.levelData(i));
             }
+            mBytes += level.size;
         }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levels - 1);
+
+        printf("Loaded: %s (%s, %d levels)\n", path.c_str(), cookedFormatName(header.format), header.levels);
+
+        cooked.close();
+        return true;
+    }
 
+public:
+    Texture(std::string path, filter_e filter)
+    {
         glGenTextures(1, &textureID);
         glBindTexture(GL_TEXTURE_2D, textureID);
 
+        // Prefer the cooked version of the texture, which already contains all mip levels
+        if (loadCooked(cookedTexturePath(path)))
+        {
+            setFilter(filter);
+            MemoryTracker::get().gpu(MEMORY_TEXTURES, mBytes);
+            return;
+        }
+
+        int width, height, channels;
+        unsigned char *imageData = stbi_load(path.c_str(), &width, &height, &channels, 4);
+
+        printf("Loaded: %s using %d channels\n", path.c_str(), channels);
+
         glTexImage2D(
             GL_TEXTURE_2D,
             0,
-            GL_R8,
+            GL_RGBA,
             width,
             height,
             0,
-            GL_RED,
+            GL_RGBA,
             GL_UNSIGNED_BYTE,
             imageData);
 
-        free(imageData);
+        stbi_image_free(imageData);
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        setFilter(filter);
         glGenerateMipmap(GL_TEXTURE_2D);
+        mBytes = (size_t) width * height * 4 * 4 / 3; // The mip chain adds a third
+        MemoryTracker::get().gpu(MEMORY_TEXTURES, mBytes);
     }
 
     void bind(unsigned int textureUnitIndex)
     {
         glBindTextureUnit(textureUnitIndex, textureID);
+        RENDER_STAT(STAT_TEXTURE_BINDS, 1);
+    }
+
+    size_t getBytes()
+    {
+        return mBytes;
     }
 
     void destroy()
     {
         glDeleteTextures(1, &textureID);
+        MemoryTracker::get().gpu(MEMORY_TEXTURES, -(int64_t) mBytes);
+        mBytes = 0;
+    }
+};
+
+// A single channel noise texture. 2D noise is stored as GL_TEXTURE_2D, 3D noise (depth > 1) as GL_TEXTURE_3D.
+// The noise can be regenerated with a new seed on a background thread, and is uploaded once it is ready,
+// so regenerating does not stall the frame. The texture is created by the owner through the resource cache, with the
+// target and bytes of getTarget() and getBytes(), and freed by releasing it after destroy().
+class NoiseTexture : public Texture
+{
+private:
+    GLenum mTarget;
+    NoiseSettings mSettings;
+    NoiseGenerator mGenerator;
+    std::vector<unsigned char> mPending;
+    std::thread mWorker;
+    std::atomic<bool> mReady{false};
+
+    void upload(const unsigned char *data)
+    {
+        // Rows are unaligned single bytes. The previous alignment is restored for the other uploads.
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        glBindTexture(mTarget, textureID);
+        if (mTarget == GL_TEXTURE_3D)
+            glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, mSettings.width, mSettings.height, mSettings.depth, GL_RED, GL_UNSIGNED_BYTE, data);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mSettings.width, mSettings.height, GL_RED, GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(mTarget);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    }
+
+    static NoiseSettings normalized(NoiseSettings settings)
+    {
+        settings.depth = std::max(1u, settings.depth);
+        return settings;
+    }
+
+    void create(NoiseSettings settings, unsigned int texture)
+    {
+        mSettings = normalized(settings);
+        mTarget = getTarget(mSettings);
+        mPending.resize((size_t) mSettings.width * mSettings.height * mSettings.depth);
+        mBytes = getBytes(mSettings);
+        MemoryTracker::get().cpu(MEMORY_TEXTURES, mPending.size());
+
+        textureID = texture;
+        glBindTexture(mTarget, textureID);
+        if (mTarget == GL_TEXTURE_3D)
+            glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, mSettings.width, mSettings.height, mSettings.depth, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, mSettings.width, mSettings.height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+
+        GLenum wrap = mSettings.tileable ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+        glTexParameteri(mTarget, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(mTarget, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(mTarget, GL_TEXTURE_WRAP_R, wrap);
+        glTexParameteri(mTarget, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+        glTexParameteri(mTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+public:
+    // texture is an unused texture of getTarget(settings)
+    NoiseTexture(NoiseSettings settings, unsigned int texture)
+    {
+        create(settings, texture);
+
+        // The first generation is blocking, since there is nothing to show before it
+        mGenerator.generate(mSettings, mPending.data());
+        upload(mPending.data());
+    }
+
+    // Uploads noise generated ahead by generate() with the same settings
+    NoiseTexture(NoiseSettings settings, unsigned int texture, const std::vector<unsigned char> &noise)
+    {
+        create(settings, texture);
+        upload(noise.data());
+    }
+
+    static GLenum getTarget(NoiseSettings settings)
+    {
+        return normalized(settings).depth > 1 ? GL_TEXTURE_3D : GL_TEXTURE_2D;
+    }
+
+    // Of the texture with its mip chain
+    static size_t getBytes(NoiseSettings settings)
+    {
+        settings = normalized(settings);
+        return (size_t) settings.width * settings.height * settings.depth * 4 / 3;
+    }
+
+    // Generates the noise of the settings without a texture, so it can run on another thread than the GL context
+    static void generate(NoiseSettings settings, std::vector<unsigned char> &outNoise)
+    {
+        settings = normalized(settings);
+        outNoise.resize((size_t) settings.width * settings.height * settings.depth);
+        NoiseGenerator().generate(settings, outNoise.data());
+    }
+
+    // Starts generating the noise with a new seed in the background.
+    // Returns false if a previous regeneration is still running.
+    bool regenerate(uint32_t seed)
+    {
+        if (mWorker.joinable())
+            return false;
+
+        mSettings.seed = seed;
+        // Leave a core for the render thread
+        mGenerator.setThreads(std::max(2u, std::thread::hardware_concurrency()) - 1);
+        mWorker = std::thread([this]() {
+            mGenerator.generate(mSettings, mPending.data());
+            mReady = true;
+        });
+        return true;
+    }
+
+    // Uploads the regenerated noise if it is ready. Call once per frame from the thread owning the GL context.
+    bool update()
+    {
+        if (!mReady)
+            return false;
+
+        mWorker.join();
+        mReady = false;
+        upload(mPending.data());
+        return true;
+    }
+
+    void destroy()
+    {
+        if (mWorker.joinable())
+            mWorker.join();
+        MemoryTracker::get().cpu(MEMORY_TEXTURES, -(int64_t) mPending.size());
+        mBytes = 0;
     }
-};
\ No newline at end of file
+};
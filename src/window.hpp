@@ -10,6 +10,189 @@
 #endif
 #include <string>
 #include <iostream>
+#include <input.hpp>
+#include <memory.hpp>
+
+#ifdef PORTAL_HEADLESS
+
+#ifndef PORTAL_SOFTWARE
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#include <chrono>
+
+// Offscreen window used by the headless benchmark. Creates an OpenGL 4.5 core context on a surfaceless
+// EGL display (works with Mesa llvmpipe without a GPU or display server) and renders into a fixed size
+// framebuffer object. Time advances a fixed 1/60 s per frame so runs are deterministic. The only input is
+// a replayed recording, which also replaces the clock with the recorded frame times.
+// With PORTAL_SOFTWARE there is no OpenGL at all, the frames are rendered by the SoftwareRenderer.
+class Window
+{
+private:
+#ifndef PORTAL_SOFTWARE
+	EGLDisplay mDisplay = EGL_NO_DISPLAY;
+	EGLContext mContext = EGL_NO_CONTEXT;
+	unsigned int mFramebuffer = 0;
+	unsigned int mRenderbuffers[2] = {0, 0};
+#endif
+	int mWidth;
+	int mHeight;
+	unsigned long mFrame = 0;
+	bool mShouldClose = false;
+	Input mInput;
+
+public:
+	Window(int width, int height, std::string title)
+	{
+		mWidth = width;
+		mHeight = height;
+
+#ifndef PORTAL_SOFTWARE
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay)
+			mDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (mDisplay == EGL_NO_DISPLAY)
+			mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint major, minor;
+		if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, &major, &minor))
+		{
+			std::cout << "Failed to init EGL" << std::endl;
+			return;
+		}
+
+		eglBindAPI(EGL_OPENGL_API);
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 4,
+			EGL_CONTEXT_MINOR_VERSION, 5,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE};
+		mContext = eglCreateContext(mDisplay, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+		if (mContext == EGL_NO_CONTEXT || !eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, mContext))
+		{
+			std::cout << "Failed to create a surfaceless OpenGL 4.5 context (" << title << ")" << std::endl;
+			return;
+		}
+
+		gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
+
+		// There is no default framebuffer, so render into a framebuffer object with a stencil buffer
+		glGenRenderbuffers(2, mRenderbuffers);
+		glBindRenderbuffer(GL_RENDERBUFFER, mRenderbuffers[0]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, mRenderbuffers[1]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+		glGenFramebuffers(1, &mFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mRenderbuffers[0]);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mRenderbuffers[1]);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "Failed to create the offscreen framebuffer" << std::endl;
+		}
+		glViewport(0, 0, width, height);
+		MemoryTracker::get().gpu(MEMORY_TARGETS, (int64_t) width * height * 8);
+
+		// Print various OpenGL information
+		printf("%s: %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER));
+		printf("EGL\t %d.%d (surfaceless)\n", major, minor);
+		printf("OpenGL\t %s\n", glGetString(GL_VERSION));
+		printf("GLSL\t %s\n\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+#else
+		printf("%s: software renderer, no OpenGL context\n\n", title.c_str());
+#endif
+	}
+
+	int getWidth()
+	{
+		return mWidth;
+	}
+
+	int getHeight()
+	{
+		return mHeight;
+	}
+
+	// The framebuffer object the frames are rendered into
+	unsigned int getFramebuffer()
+	{
+#ifndef PORTAL_SOFTWARE
+		return mFramebuffer;
+#else
+		return 0;
+#endif
+	}
+
+	bool shouldClose()
+	{
+		return mShouldClose;
+	}
+
+	void close()
+	{
+		mShouldClose = true;
+	}
+
+	// There is nothing to present. Wait for the GPU so the frame time includes the rendering.
+	void swapBuffers()
+	{
+#ifndef PORTAL_SOFTWARE
+		glFinish();
+#endif
+		mFrame++;
+	}
+
+	void destroy()
+	{
+#ifndef PORTAL_SOFTWARE
+		glDeleteFramebuffers(1, &mFramebuffer);
+		glDeleteRenderbuffers(2, mRenderbuffers);
+		MemoryTracker::get().gpu(MEMORY_TARGETS, -(int64_t) mWidth * mHeight * 8);
+		eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(mDisplay, mContext);
+		eglTerminate(mDisplay);
+#endif
+	}
+
+	void disableCursor() {}
+	void enableCursor() {}
+
+	double getTime()
+	{
+		return mInput.isReplaying() ? mInput.getTime() : mFrame / 60.0;
+	}
+
+	// Wall clock time, for measuring performance
+	double getRealTime()
+	{
+		static const auto start = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Input handling
+
+	Input &getInput()
+	{
+		return mInput;
+	}
+
+	bool isKeyDown(int key) { return mInput.isKeyDown(key); }
+	bool isKeyPressed(int key) { return mInput.isKeyPressed(key); }
+	bool isMouseButtonDown(int button) { return mInput.isMouseButtonDown(button); }
+	bool isMouseButtonPressed(int button) { return mInput.isMouseButtonPressed(button); }
+	MousePosition getMousePosition() { return mInput.getMousePosition(); }
+	MousePosition getMouseDelta() { return mInput.getMouseDelta(); }
+
+	void updateInput()
+	{
+		// The window closes when the replay runs out of frames
+		if (!mInput.beginFrame(mFrame / 60.0) && mInput.isReplaying())
+			mShouldClose = true;
+	}
+};
+
+#else
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -28,12 +211,6 @@ static void errorCallback(int error, const char *description)
     fprintf(stderr, "GLFW returned an error:\n\t%s (%i)\n", description, error);
 }
 
-typedef struct MousePosition
-{
-	double x;
-	double y;
-} MousePosition;
-
 class Window
 {
 private:
@@ -41,12 +218,29 @@ private:
 	int mWidth;
 	int mHeight;
 
-	bool mPrevIsKeyDown[GLFW_KEY_LAST] = {false};
-	bool mPrevIsMouseDown[GLFW_KEY_LAST] = {false};
-	bool mIsKeyPressed[GLFW_KEY_LAST] = {false};
-	bool mIsMousePressed[GLFW_MOUSE_BUTTON_LAST] = {false};
-	MousePosition mMousePosition = {0, 0};
-	MousePosition mMouseDelta = {0, 0};
+	Input mInput;
+
+	// The input callbacks only queue the events, they are applied once per frame by updateInput()
+	static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
+	{
+		(void) scancode;
+		(void) mods;
+		Window *self = (Window *) glfwGetWindowUserPointer(window);
+		self->mInput.push({INPUT_KEY, key, action, 0, 0});
+	}
+
+	static void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
+	{
+		(void) mods;
+		Window *self = (Window *) glfwGetWindowUserPointer(window);
+		self->mInput.push({INPUT_MOUSE_BUTTON, button, action, 0, 0});
+	}
+
+	static void cursorPositionCallback(GLFWwindow *window, double x, double y)
+	{
+		Window *self = (Window *) glfwGetWindowUserPointer(window);
+		self->mInput.push({INPUT_CURSOR, 0, 0, x, y});
+	}
 
 public:
 	Window(int width, int height, std::string title)
@@ -78,7 +272,11 @@ public:
 		glfwSwapInterval(1);
 		
 		// Add window callbacks
+		glfwSetWindowUserPointer(mWindow, this);
 		glfwSetFramebufferSizeCallback(mWindow, framebufferSizeCallback);
+		glfwSetKeyCallback(mWindow, keyCallback);
+		glfwSetMouseButtonCallback(mWindow, mouseButtonCallback);
+		glfwSetCursorPosCallback(mWindow, cursorPositionCallback);
 
 		// Print various OpenGL information
 		printf("%s: %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER));
@@ -99,6 +297,12 @@ public:
 		return mHeight;
 	}
 
+	// The default framebuffer
+	unsigned int getFramebuffer()
+	{
+		return 0;
+	}
+
 	bool shouldClose()
 	{
 		return glfwWindowShouldClose(mWindow);
@@ -129,65 +333,63 @@ public:
 		glfwSetInputMode(mWindow, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 	}
 
+	// Time of the current frame. During a replay this is the recorded time.
 	double getTime()
+	{
+		return mInput.getTime();
+	}
+
+	// Wall clock time, for measuring performance
+	double getRealTime()
 	{
 		return glfwGetTime();
 	}
 
 	// Input handling
 
+	Input &getInput()
+	{
+		return mInput;
+	}
+
 	bool isKeyDown(int key)
 	{
-		return glfwGetKey(mWindow, key) == GLFW_PRESS;
+		return mInput.isKeyDown(key);
 	}
 
 	bool isKeyPressed(int key)
 	{
-		if(key < 0 || key > GLFW_KEY_LAST) return false;
-		return mIsKeyPressed[key];
+		return mInput.isKeyPressed(key);
 	}
 
 	bool isMouseButtonDown(int button)
 	{
-		return glfwGetMouseButton(mWindow, button) == GLFW_PRESS;
+		return mInput.isMouseButtonDown(button);
 	}
 
 	bool isMouseButtonPressed(int button)
 	{
-		if(button < 0 || button > GLFW_MOUSE_BUTTON_LAST) return false;
-		return mIsMousePressed[button];
+		return mInput.isMouseButtonPressed(button);
 	}
 
 	MousePosition getMousePosition()
 	{
-		return mMousePosition;
+		return mInput.getMousePosition();
 	}
 
 	MousePosition getMouseDelta()
 	{
-		return mMouseDelta;
+		return mInput.getMouseDelta();
 	}
 
 	void updateInput()
 	{
 		glfwPollEvents();
 
-		for(int i = 0; i < GLFW_KEY_LAST; i++)
-		{
-			mIsKeyPressed[i] = isKeyDown(i) && !mPrevIsKeyDown[i];
-			mPrevIsKeyDown[i] = isKeyDown(i);
-		}
-
-		for(int i = 0; i < GLFW_MOUSE_BUTTON_LAST; i++)
-		{
-			mIsMousePressed[i] = isMouseButtonDown(i) && !mPrevIsMouseDown[i];
-			mPrevIsMouseDown[i] = isMouseButtonDown(i);
-		}
-
-		double xpos, ypos;
-		glfwGetCursorPos(mWindow, &xpos, &ypos);
-
-		mMouseDelta = {xpos - mMousePosition.x, ypos - mMousePosition.y};
-		mMousePosition = {xpos, ypos};
+		// The window closes when the replay runs out of frames
+		if (!mInput.beginFrame(glfwGetTime()) && mInput.isReplaying())
+			close();
 	}
 };
+
+#endif
@@ -0,0 +1,361 @@
+// Stress tests of the code shared between threads. They check their results, but are mainly meant to run under
+// ThreadSanitizer: the StressTests target is built with -fsanitize=thread unless ENABLE_THREAD_SANITIZER is off,
+// and every test is registered with CTest.
+//
+// Usage: StressTests [--iterations n] [test...]   Runs every test when none is given
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <snapshot.hpp>
+#include <simulation.hpp>
+#include <jobs.hpp>
+#include <pool.hpp>
+
+#define STRESS_DEFAULT_ITERATIONS 200000
+// Workers of the job system test, independent of the machine so the queues are always contended
+#define STRESS_JOB_THREADS 4
+// Threads creating and destroying objects in the pool test
+#define STRESS_POOL_THREADS 4
+
+typedef struct StressTest
+{
+    const char *name;
+    bool (*run)(unsigned long iterations);
+} StressTest;
+
+// Fails the test it is called in
+#define STRESS_CHECK(condition, ...)             \
+    if (!(condition))                            \
+    {                                            \
+        fprintf(stderr, "Error: " __VA_ARGS__); \
+        fprintf(stderr, "\n");                   \
+        return false;                            \
+    }
+
+// A buffer whose values all have to come from the same publish
+typedef struct StressFrame
+{
+    unsigned long frame;
+    unsigned long values[16];
+} StressFrame;
+
+// One thread publishes frames as fast as it can, the other reads them. Every frame read has to be complete, and the
+// frames have to be seen in order, ending with the last one.
+bool testTripleBuffer(unsigned long iterations)
+{
+    TripleBuffer<StressFrame> buffer;
+    buffer.reset(StressFrame{});
+
+    std::thread producer([&] {
+        for (unsigned long frame = 1; frame <= iterations; frame++)
+        {
+            StressFrame &write = buffer.write();
+            write.frame = frame;
+            for (unsigned long &value : write.values)
+                value = frame;
+            buffer.publish();
+        }
+    });
+
+    unsigned long last = 0, updates = 0;
+    bool passed = true;
+    while (last < iterations && passed)
+    {
+        if (!buffer.update())
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        const StressFrame &read = buffer.read();
+        passed = read.frame > last;
+        for (unsigned long value : read.values)
+            passed = passed && value == read.frame;
+        last = read.frame;
+        updates++;
+    }
+    producer.join();
+
+    STRESS_CHECK(passed, "The triple buffer returned a torn or old frame after frame %lu", last);
+    printf("tripleBuffer: %lu frames published, %lu read\n", iterations, updates);
+    return true;
+}
+
+// Submits frames to a SimulationThread, which simulates them in order and publishes a snapshot of each into a triple
+// buffer, like the game. The main thread waits now and then, as at a window resize or shutdown.
+bool testSimulationThread(unsigned long iterations)
+{
+    TripleBuffer<StressFrame> snapshots;
+    snapshots.reset(StressFrame{});
+    unsigned long simulated = 0;    // Only touched by the simulation thread, and read after wait()
+    bool inOrder = true;
+
+    SimulationThread simulation;
+    simulation.start([&](const InputState &input) {
+        unsigned long frame = (unsigned long) input.time;
+        inOrder = inOrder && frame == simulated + 1;
+        simulated = frame;
+
+        StressFrame &write = snapshots.write();
+        write.frame = frame;
+        for (unsigned long &value : write.values)
+            value = frame;
+        snapshots.publish();
+    });
+
+    InputState input;
+    memset(&input, 0, sizeof(input));
+    unsigned long last = 0;
+    bool complete = true;
+    for (unsigned long frame = 1; frame <= iterations; frame++)
+    {
+        input.time = (double) frame;
+        simulation.submit(input);
+        if (frame % 1000 == 0)
+        {
+            simulation.wait();
+            STRESS_CHECK(simulated == frame, "Frame %lu was not simulated after wait(), the last was %lu", frame, simulated);
+        }
+
+        if (snapshots.update())
+        {
+            const StressFrame &read = snapshots.read();
+            complete = complete && read.frame >= last;
+            for (unsigned long value : read.values)
+                complete = complete && value == read.frame;
+            last = read.frame;
+        }
+    }
+    simulation.stop();
+
+    STRESS_CHECK(inOrder, "The simulation thread skipped or reordered frames");
+    STRESS_CHECK(simulated == iterations, "%lu of %lu frames were simulated", simulated, iterations);
+    STRESS_CHECK(complete, "The renderer read a torn or old snapshot");
+    printf("simulationThread: %lu frames simulated in order\n", simulated);
+    return true;
+}
+
+// One round of the job system test: a parallelFor whose batches run nested parallelFor calls, and jobs queued with
+// run() whose jobs queue more jobs. Every element and job has to run exactly once.
+bool runJobRound(JobSystem &jobs, std::vector<int> &values, const int outer, const int inner)
+{
+    std::fill(values.begin(), values.end(), 0);
+    jobs.parallelFor("outer", outer, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            jobs.parallelFor("inner", inner, 8, [&, i](size_t innerBegin, size_t innerEnd) {
+                for (size_t j = innerBegin; j < innerEnd; j++)
+                    values[i * inner + j]++;
+            });
+        }
+    });
+
+    std::atomic<int> ran{0};
+    JobCounter counter;
+    for (int i = 0; i < outer; i++)
+    {
+        jobs.run("job", [&] {
+            JobCounter nested;
+            jobs.run("nested", [&] { ran++; }, nested);
+            jobs.wait(nested);
+            ran++;
+        }, counter);
+    }
+    jobs.wait(counter);
+
+    for (int value : values)
+    {
+        if (value != 1)
+            return false;
+    }
+    return ran == outer * 2;
+}
+
+// The main thread and two external threads (like the main and simulation threads of the game) submit work to the
+// same job system at once, each waiting only for its own work
+bool testJobSystem(unsigned long iterations)
+{
+    const int outer = 32, inner = 256;
+    const unsigned long rounds = std::max(1ul, iterations / 1000);
+    JobSystem jobs(STRESS_JOB_THREADS);
+
+    std::atomic<int> failures{0};
+    auto submitter = [&] {
+        std::vector<int> values(outer * inner);
+        for (unsigned long round = 0; round < rounds; round++)
+        {
+            if (!runJobRound(jobs, values, outer, inner))
+                failures++;
+        }
+    };
+
+    std::thread external[2] = {std::thread(submitter), std::thread(submitter)};
+    submitter();
+    for (std::thread &thread : external)
+        thread.join();
+
+    STRESS_CHECK(failures == 0, "%d of %lu job rounds ran an element or job more or less than once", failures.load(), rounds * 3);
+    printf("jobSystem: %lu rounds on 3 submitting threads, %u job threads\n", rounds, jobs.getThreads());
+    return true;
+}
+
+// Job systems of different sizes created one after another in the same place, as when the game restarts. The main
+// thread has to get a queue of the new job system, not the one it had in the previous system at the same address.
+bool testJobSystemRestart(unsigned long iterations)
+{
+    const int count = 256;
+    const unsigned long rounds = std::max(1ul, iterations / 10000);
+    std::vector<int> values(count);
+    alignas(JobSystem) unsigned char storage[sizeof(JobSystem)];
+    for (unsigned long round = 0; round < rounds; round++)
+    {
+        JobSystem *jobs = new (storage) JobSystem(round % 2 ? 1 : STRESS_JOB_THREADS * 2);
+        bool passed = runJobRound(*jobs, values, 4, count / 4);
+        jobs->~JobSystem();
+        STRESS_CHECK(passed, "Round %lu ran an element or job more or less than once", round);
+    }
+    printf("jobSystemRestart: %lu job systems\n", rounds);
+    return true;
+}
+
+// An object whose contents show whether it was constructed and destroyed exactly once
+typedef struct PoolObject
+{
+    unsigned long owner;
+    unsigned long values[8];
+    inline static std::atomic<long> sLive{0};
+
+    PoolObject(unsigned long owner) : owner(owner)
+    {
+        for (unsigned long &value : values)
+            value = owner;
+        sLive++;
+    }
+
+    ~PoolObject()
+    {
+        owner = 0;
+        sLive--;
+    }
+
+    bool isValid(unsigned long expected) const
+    {
+        bool valid = owner == expected;
+        for (unsigned long value : values)
+            valid = valid && value == expected;
+        return valid;
+    }
+} PoolObject;
+
+// Slot reuse, stale handles and reset on one thread, then several threads creating and destroying objects at once.
+// Every thread checks that its objects keep their contents while other threads reuse the slots around them.
+bool testPool(unsigned long iterations)
+{
+    Pool<PoolObject> pool;
+
+    Handle<PoolObject> first = pool.create(1ul);
+    pool.destroy(first);
+    Handle<PoolObject> reused = pool.create(2ul);
+    STRESS_CHECK(reused.index == first.index && !(reused == first), "A destroyed slot was not reused with a new generation");
+    STRESS_CHECK(!pool.get(first), "A stale handle returned the object that reused its slot");
+    pool.destroy(first);
+    STRESS_CHECK(pool.size() == 1 && pool.get(reused)->isValid(2), "Destroying a stale handle destroyed the new object");
+
+    std::vector<Handle<PoolObject>> handles;
+    for (unsigned long i = 0; i < 1000; i++)
+        handles.push_back(pool.create(i + 1));
+    pool.reset();
+    STRESS_CHECK(pool.size() == 0 && PoolObject::sLive == 0, "reset() left %ld objects alive", PoolObject::sLive.load());
+    STRESS_CHECK(!pool.get(reused), "A handle stayed valid after reset()");
+    for (Handle<PoolObject> handle : handles)
+        STRESS_CHECK(!pool.get(handle), "A handle stayed valid after reset()");
+    handles.clear();
+
+    const unsigned long rounds = std::max(1ul, iterations / 200);
+    std::atomic<int> failures{0};
+    auto worker = [&](unsigned long thread) {
+        std::vector<Handle<PoolObject>> owned;
+        std::vector<Handle<PoolObject>> stale;
+        for (unsigned long round = 0; round < rounds; round++)
+        {
+            // Creates a batch of a varying size, so the free list is mixed between the threads
+            unsigned long owner = thread * rounds + round + 1;
+            for (unsigned long i = 0; i < 16 + round % 32; i++)
+                owned.push_back(pool.create(owner));
+            for (Handle<PoolObject> handle : owned)
+            {
+                PoolObject *object = pool.get(handle);
+                if (handle.isNull() || !object || !object->isValid(owner))
+                    failures++;
+            }
+            for (Handle<PoolObject> handle : stale)
+                pool.destroy(handle);
+            stale.clear();
+            for (Handle<PoolObject> handle : owned)
+                pool.destroy(handle);
+            stale.swap(owned);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned long i = 0; i < STRESS_POOL_THREADS; i++)
+        threads.emplace_back(worker, i);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    STRESS_CHECK(failures == 0, "%d objects were lost or overwritten while other threads used the pool", failures.load());
+    STRESS_CHECK(pool.size() == 0 && PoolObject::sLive == 0, "%u objects are alive after destroying all", pool.size());
+    printf("pool: %lu rounds of create and destroy on %d threads\n", rounds, STRESS_POOL_THREADS);
+    return true;
+}
+
+static const StressTest tests[] = {
+    {"tripleBuffer", testTripleBuffer},
+    {"simulationThread", testSimulationThread},
+    {"jobSystem", testJobSystem},
+    {"jobSystemRestart", testJobSystemRestart},
+    {"pool", testPool},
+};
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = STRESS_DEFAULT_ITERATIONS;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc)
+            iterations = std::stoul(argv[++i]);
+        else
+            names.push_back(arg);
+    }
+
+    int failed = 0, run = 0;
+    for (const StressTest &test : tests)
+    {
+        bool selected = names.empty();
+        for (const std::string &name : names)
+            selected = selected || name == test.name;
+        if (!selected)
+            continue;
+
+        run++;
+        if (!test.run(iterations))
+        {
+            fprintf(stderr, "Error: %s failed\n", test.name);
+            failed++;
+        }
+    }
+
+    if (run == 0)
+    {
+        fprintf(stderr, "Error: No test matches the arguments\n");
+        return 1;
+    }
+    printf("%d of %d stress tests passed\n", run - failed, run);
+    return failed ? 1 : 0;
+}
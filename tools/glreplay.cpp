@@ -0,0 +1,91 @@
+// Replays a GL capture written with --capture in an offscreen EGL context, without any game logic, so the cost of
+// submitting the frames to the driver can be measured apart from the simulation. Every frame of the capture is
+// replayed once, then the frames from --loop-start on are replayed --loops times and timed.
+//
+// Usage: GLReplay [--loops n] [--loop-start frame] [--csv file] [--summary file] [--baseline summary] [--tolerance fraction] <capture>
+
+#include <chrono>
+#include <string>
+#include <iostream>
+#include <window.hpp>
+#include <glcapture.hpp>
+#include <benchmark.hpp>
+
+int main(int argc, char **argv)
+{
+    std::string capturePath;
+    std::string csvPath = "replay.csv";
+    std::string summaryPath = "replay_summary.txt";
+    std::string baselinePath;
+    double tolerance = 0.1;
+    int loops = 10;
+    unsigned int loopStart = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 < argc && arg == "--loops") loops = atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--loop-start") loopStart = atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--csv") csvPath = argv[++i];
+        else if (i + 1 < argc && arg == "--summary") summaryPath = argv[++i];
+        else if (i + 1 < argc && arg == "--baseline") baselinePath = argv[++i];
+        else if (i + 1 < argc && arg == "--tolerance") tolerance = atof(argv[++i]);
+        else capturePath = arg;
+    }
+
+    if (capturePath.empty())
+    {
+        std::cerr << "Usage: " << argv[0] << " [--loops n] [--loop-start frame] [--csv file] [--summary file] "
+                  << "[--baseline summary] [--tolerance fraction] <capture>" << std::endl;
+        return 1;
+    }
+
+    GLReplay replay;
+    if (!replay.open(capturePath))
+        return 1;
+
+    Window window(replay.getWidth(), replay.getHeight(), "GL Replay");
+    replay.setFramebuffer(window.getFramebuffer());
+
+    // The first pass creates the resources, the frames before loopStart are not timed
+    auto start = std::chrono::steady_clock::now();
+    while (replay.replayFrame())
+        window.swapBuffers();
+    double setupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("Replayed %u frames from %s (%.2f MB of GL calls) in %.1f ms\n",
+           replay.getFrames(), capturePath.c_str(), replay.getBytes() / (1024.0 * 1024.0), setupMs);
+
+    if (loopStart >= replay.getFrames())
+    {
+        std::cerr << "Error: The capture has no frames after frame " << loopStart << " to loop" << std::endl;
+        replay.destroy();
+        window.destroy();
+        return 1;
+    }
+
+    BenchmarkStats stats;
+    for (int loop = 0; loop < loops; loop++)
+    {
+        replay.seek(loopStart);
+        while (true)
+        {
+            auto frameStart = std::chrono::steady_clock::now();
+            if (!replay.replayFrame())
+                break;
+            window.swapBuffers();
+            double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+            stats.record(frameMs, 0.0, frameMs);
+        }
+    }
+
+    printf("Replayed frames %u to %u %d times at %dx%d\n", loopStart, replay.getFrames() - 1, loops, replay.getWidth(), replay.getHeight());
+    stats.printSummary();
+    stats.writeCsv(csvPath);
+    stats.writeSummary(summaryPath);
+
+    bool passed = baselinePath.empty() || stats.compareBaseline(baselinePath, tolerance);
+
+    replay.destroy();
+    window.destroy();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+// Offline texture cooker. Decodes an image, builds every mip level on the CPU and
+// writes them to a .ctex file, optionally compressed to BC1 or BC7.
+//
+// Usage: TextureCooker [--format rgba8|bc1|bc7] <input> <output>
+
+#include <string>
+#include <iostream>
+#include <cookedtexture.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+int main(int argc, char **argv)
+{
+    cooked_format_e format = COOKED_BC7;
+    std::string input, output;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (name == "rgba8") format = COOKED_RGBA8;
+            else if (name == "bc1") format = COOKED_BC1;
+            else if (name == "bc7") format = COOKED_BC7;
+            else
+            {
+                std::cerr << "Error: Unknown format " << name << std::endl;
+                return 1;
+            }
+        }
+        else if (input.empty())
+        {
+            input = arg;
+        }
+        else
+        {
+            output = arg;
+        }
+    }
+
+    if (input.empty() || output.empty())
+    {
+        std::cerr << "Usage: " << argv[0] << " [--format rgba8|bc1|bc7] <input> <output>" << std::endl;
+        return 1;
+    }
+
+    int width, height, channels;
+    unsigned char *imageData = stbi_load(input.c_str(), &width, &height, &channels, 4);
+    if (!imageData)
+    {
+        std::cerr << "Error: Could not load " << input << ": " << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+
+    bool success = writeCookedTexture(output, imageData, width, height, format);
+    stbi_image_free(imageData);
+
+    if (success)
+    {
+        printf("Cooked: %s -> %s (%dx%d, %s)\n", input.c_str(), output.c_str(), width, height, cookedFormatName(format));
+    }
+
+    return success ? 0 : 1;
+}